@@ -8,6 +8,27 @@ gcc -c src/UselessConfigC/parser.c -Iinclude -Isrc/UselessConfigC -o build/parse
 gcc -c src/UselessConfigC/tokenizer.c -Iinclude -Isrc/UselessConfigC -o build/tokenizer.o
 gcc -c src/UselessConfigC/hashtable.c -Iinclude -Isrc/UselessConfigC -o build/hashtable.o
 gcc -c src/UselessConfigC/utils.c -Iinclude -Isrc/UselessConfigC -o build/utils.o
+gcc -c src/UselessConfigC/mapping.c -Iinclude -Isrc/UselessConfigC -o build/mapping.o
+gcc -c src/UselessConfigC/arena.c -Iinclude -Isrc/UselessConfigC -o build/arena.o
+gcc -c src/UselessConfigC/hash.c -Iinclude -Isrc/UselessConfigC -o build/hash.o
+gcc -c src/UselessConfigC/thread.c -Iinclude -Isrc/UselessConfigC -o build/thread.o
+gcc -c src/UselessConfigC/scan.c -Iinclude -Isrc/UselessConfigC -o build/scan.o
+gcc -c src/UselessConfigC/errors.c -Iinclude -Isrc/UselessConfigC -o build/errors.o
+gcc -c src/UselessConfigC/context.c -Iinclude -Isrc/UselessConfigC -o build/context.o
+gcc -c src/UselessConfigC/batch.c -Iinclude -Isrc/UselessConfigC -o build/batch.o
+gcc -c src/UselessConfigC/segment.c -Iinclude -Isrc/UselessConfigC -o build/segment.o
+gcc -c src/UselessConfigC/pool.c -Iinclude -Isrc/UselessConfigC -o build/pool.o
+gcc -c src/UselessConfigC/parallel.c -Iinclude -Isrc/UselessConfigC -o build/parallel.o
+gcc -c src/UselessConfigC/document.c -Iinclude -Isrc/UselessConfigC -o build/document.o
+gcc -c src/UselessConfigC/push.c -Iinclude -Isrc/UselessConfigC -o build/push.o
+gcc -c src/UselessConfigC/binary.c -Iinclude -Isrc/UselessConfigC -o build/binary.o
+gcc -c src/UselessConfigC/cache.c -Iinclude -Isrc/UselessConfigC -o build/cache.o
+gcc -c src/UselessConfigC/number.c -Iinclude -Isrc/UselessConfigC -o build/number.o
+gcc -c src/UselessConfigC/format.c -Iinclude -Isrc/UselessConfigC -o build/format.o
+gcc -c src/UselessConfigC/packed.c -Iinclude -Isrc/UselessConfigC -o build/packed.o
+gcc -c src/UselessConfigC/value.c -Iinclude -Isrc/UselessConfigC -o build/value.o
+gcc -c src/UselessConfigC/path.c -Iinclude -Isrc/UselessConfigC -o build/path.o
+gcc -c src/UselessConfigC/atom.c -Iinclude -Isrc/UselessConfigC -o build/atom.o
 
 echo [BUILD] Archiving libusec.a...
 ar rcs build/libusec.a build/*.o
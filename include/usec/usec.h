@@ -8,6 +8,7 @@ extern "C" {
 	typedef struct USEC_Value USEC_Value;
 	typedef struct Usec_Hashtable Usec_Hashtable;
 	typedef struct Usec_HashNode Usec_HashNode;
+	typedef struct USEC_Arena USEC_Arena;
 
 #include <stdbool.h>
 #include <stddef.h>
@@ -29,6 +30,7 @@ extern "C" {
 		VALUE_CHAR,
 		VALUE_ARRAY,
 		VALUE_OBJECT,
+		VALUE_PACKED_ARRAY, // Array of ints, uints, doubles or bools stored contiguously, see usec_packed_ints
 
 		// Formatting support types:
 		VALUE_FORMAT,
@@ -42,6 +44,11 @@ extern "C" {
 	// Parsed value node
 	struct USEC_Value {
 		USEC_ValueType type;
+		uint32_t flags; // Ownership flags, managed by the library. Zero for values allocated on their own.
+		// A value owns its string, items and table, usec_free releases them with it. The text of a parsed
+		// string and the items block of a parsed array may share an allocation with their value, so they
+		// must not be freed or reallocated on their own. They can be replaced: usec_free also frees a
+		// malloc'd string assigned to stringValue, and a value stored in place of an item freed with usec_free.
 		union {
 			bool boolValue;
 			double doubleValue;
@@ -53,6 +60,11 @@ extern "C" {
 				USEC_Value** items;
 				size_t count;
 			} arrayValue;
+			struct {
+				void* data; // count int64_t, uint64_t, double or bool elements
+				uint32_t count;
+				USEC_ValueType elementType; // VALUE_INT, VALUE_UINT, VALUE_DOUBLE or VALUE_BOOL
+			} packedValue;
 			Usec_Hashtable* objectValue;
 
 			// Formatting
@@ -84,7 +96,12 @@ extern "C" {
 		bool keepVariables;
 		bool debugTokens;
 		bool debugParser;
-		Usec_Hashtable* variables; // Note: The contents will be modified by the parser. To avoid, use usec_ht_from.
+		bool useArena; // Allocate the whole tree in a few large blocks. usec_free on the root releases them at once, subtrees can't be freed individually.
+		bool packArrays; // Store non-empty arrays whose items are all ints, all uints, all doubles or all bools as VALUE_PACKED_ARRAY, without a USEC_Value per item.
+		bool streaming; // Tokenize as the parser goes, keeping a few tokens instead of all of them. Parser errors are reported once the whole input is tokenized.
+		size_t maxErrors; // Errors collected by usec_parse_result before it gives up, 0 for no limit
+		Usec_Hashtable* variables; // Stays owned by the caller. Note: The contents will be modified by the parser. To avoid, use usec_ht_from.
+		const char* cacheDir; // Existing directory where usec_parse_file keeps the trees of files parsed without errors, keyed by a hash of the content, pedantic, keepVariables and variables. NULL to always parse.
 	} USEC_ParseOptions;
 
 	typedef struct {
@@ -92,6 +109,37 @@ extern "C" {
 		bool enable_variables;
 	} USEC_ToStringOptions;
 
+	// ==============================
+	//         Error Reporting
+	// ==============================
+
+	typedef enum {
+		USEC_ERROR_SYNTAX, // Input the tokenizer can't read, like an unexpected character
+		USEC_ERROR_UNBALANCED, // Unclosed string, interpolation or bracket, or a closer without opener
+		USEC_ERROR_FORMAT, // Whitespace, comma and comment rules, stricter in compact mode
+		USEC_ERROR_UNEXPECTED_TOKEN,
+		USEC_ERROR_INVALID_NUMBER,
+		USEC_ERROR_UNDEFINED_VARIABLE,
+		USEC_ERROR_INTERPOLATION, // Value that can't be interpolated into a string
+		USEC_ERROR_SCOPE_DEPTH, // Deprecated: never reported, scopes nest without a limit. Kept so the codes after it keep their values.
+		USEC_ERROR_IO // File that can't be read
+	} USEC_ErrorCode;
+
+	typedef struct {
+		USEC_ErrorCode code;
+		int line; // 1-based, 0 if the error has no position
+		int col;
+		char message[128];
+	} USEC_Error;
+
+	// Outcome of usec_parse_result. Release with usec_free_result.
+	typedef struct {
+		USEC_Value* value; // NULL if parsing failed
+		USEC_Error* errors; // In the order they were found
+		size_t error_count;
+		bool truncated; // More errors were found than maxErrors allowed
+	} USEC_ParseResult;
+
 	/**
 	 * Returns properly initialized default parse options.
 	 *
@@ -124,8 +172,496 @@ extern "C" {
 	 */
 	USEC_Value* usec_parse(const char* input, const USEC_ParseOptions* options);
 
+	/**
+	 * Parse a USEC string of known length.
+	 *
+	 * @param input USEC text, doesn't need to be null-terminated
+	 * @param length Length of the input in bytes
+	 * @param options Optional; pass NULL for defaults
+	 * @return Pointer to parsed USEC_Value tree, or NULL on error
+	 */
+	USEC_Value* usec_parse_n(const char* input, size_t length, const USEC_ParseOptions* options);
+
+	/**
+	 * Parse a USEC file. The file is memory-mapped read-only and tokenized in place.
+	 * With options->cacheDir, an unchanged file is read from the cache instead. Cached trees are never arena allocated.
+	 *
+	 * @param path Path of the file
+	 * @param options Optional; pass NULL for defaults
+	 * @return Pointer to parsed USEC_Value tree, or NULL if the file can't be read or on error
+	 */
+	USEC_Value* usec_parse_file(const char* path, const USEC_ParseOptions* options);
+
+	/**
+	 * Parse a USEC string, collecting errors instead of printing them.
+	 * Never writes to stderr or exits, regardless of options->pedantic.
+	 *
+	 * Pedantic parses fail on any error, otherwise the value is returned along with the errors
+	 * that were recovered from. Parsing stops once more than options->maxErrors errors are found.
+	 *
+	 * @param input USEC text, doesn't need to be null-terminated
+	 * @param length Length of the input in bytes
+	 * @param options Optional; pass NULL for defaults
+	 * @return The value and errors, release with usec_free_result
+	 */
+	USEC_ParseResult usec_parse_result(const char* input, size_t length, const USEC_ParseOptions* options);
+
+	/**
+	 * Parse a USEC file like usec_parse_result. A file that can't be read is reported as USEC_ERROR_IO.
+	 *
+	 * @param path Path of the file
+	 * @param options Optional; pass NULL for defaults
+	 * @return The value and errors, release with usec_free_result
+	 */
+	USEC_ParseResult usec_parse_file_result(const char* path, const USEC_ParseOptions* options);
+
+	/**
+	 * Free the value and errors of a result. To keep the value, take it and set result->value to NULL first.
+	 */
+	void usec_free_result(USEC_ParseResult* result);
+
+	/**
+	 * Parse independent files on a pool of worker threads, each with its own context.
+	 * Errors are collected like usec_parse_file_result, nothing is printed.
+	 *
+	 * options->variables is shared by all files as a read-only table. Variables declared
+	 * in a file stay local to it and the table is never modified.
+	 *
+	 * @param paths Paths of the files
+	 * @param count Number of files
+	 * @param options Optional; pass NULL for defaults
+	 * @param threads Number of threads including the calling one, 0 for one per processor
+	 * @return count results in the order of paths, release with usec_free_results
+	 */
+	USEC_ParseResult* usec_parse_many(const char* const* paths, size_t count, const USEC_ParseOptions* options, size_t threads);
+
+	/**
+	 * Free the results of usec_parse_many.
+	 */
+	void usec_free_results(USEC_ParseResult* results, size_t count);
+
+	/**
+	 * Parse one large document on several threads. A quick pre-pass cuts it into runs of
+	 * top-level statements, the top-level declarations are resolved in order, then the runs
+	 * are parsed in parallel and merged into the root object in source order.
+	 * Small documents and documents with a root value are parsed on the calling thread.
+	 *
+	 * A document with errors is parsed again in one piece, so the value and errors are the
+	 * same as from usec_parse_result. options->variables is only read, declarations aren't added to it.
+	 *
+	 * @param input USEC text, doesn't need to be null-terminated
+	 * @param length Length of the input in bytes
+	 * @param options Optional; pass NULL for defaults
+	 * @param threads Number of threads including the calling one, 0 for one per processor
+	 * @return The value and errors, release with usec_free_result
+	 */
+	USEC_ParseResult usec_parse_parallel(const char* input, size_t length, const USEC_ParseOptions* options, size_t threads);
+
+	/**
+	 * Parse a memory-mapped file like usec_parse_parallel.
+	 */
+	USEC_ParseResult usec_parse_file_parallel(const char* path, const USEC_ParseOptions* options, size_t threads);
+
+	// ==============================
+	//         Parse Contexts
+	// ==============================
+
+	// Tokenizer and parser state kept between parses. Not thread-safe, use one context per thread.
+	typedef struct USEC_Context USEC_Context;
+
+	/**
+	 * Create a parse context. Its token buffer, string buffers, scope tables and a spare arena
+	 * are reused by every parse, so a steady stream of similar documents needs few allocations.
+	 * The buffers keep the size of the largest document parsed.
+	 */
+	USEC_Context* usec_context_create(void);
+
+	/**
+	 * Free a context. Documents parsed with it stay valid.
+	 */
+	void usec_context_destroy(USEC_Context* ctx);
+
+	/**
+	 * Parse like usec_parse_n, reusing the buffers of the context.
+	 */
+	USEC_Value* usec_context_parse(USEC_Context* ctx, const char* input, size_t length, const USEC_ParseOptions* options);
+
+	/**
+	 * Parse like usec_parse_result, reusing the buffers of the context.
+	 */
+	USEC_ParseResult usec_context_parse_result(USEC_Context* ctx, const char* input, size_t length, const USEC_ParseOptions* options);
+
+	/**
+	 * Free a document like usec_free. The arena of an arena document is kept by the context for its next arena parse.
+	 *
+	 * @param root A document root returned by any parse function
+	 */
+	void usec_context_free(USEC_Context* ctx, USEC_Value* root);
+
+	/**
+	 * Start a push parse on the context, for input that arrives in pieces, like from a pipe or a decompressor.
+	 * Calling it is optional, the first usec_feed starts one with default options. A push parse in progress
+	 * is discarded. Other parses with the context may not be mixed into a push parse.
+	 */
+	void usec_feed_begin(USEC_Context* ctx, const USEC_ParseOptions* options);
+
+	/**
+	 * Parse the next piece of the input. The piece can be freed or reused afterwards. Complete top-level
+	 * statements are parsed right away, only the unfinished ones at the end are copied until the rest of them
+	 * arrives. A document with a root value, or with everything in one top-level object, is kept until usec_finish.
+	 *
+	 * @return false once the error limit is reached, later input is ignored then
+	 */
+	bool usec_feed(USEC_Context* ctx, const char* data, size_t length);
+
+	/**
+	 * End the push parse and parse the rest of the input.
+	 *
+	 * @return The same as usec_parse_result for the whole input. A non-pedantic parse can differ in the
+	 *         errors after the first one, as recovery from an error stops where the input was cut.
+	 */
+	USEC_ParseResult usec_finish(USEC_Context* ctx);
+
+	// ==============================
+	//       On-demand Documents
+	// ==============================
+
+	// Document that is only tokenized up front. Objects and arrays are indexed when first visited
+	// and values are parsed when read, so parts that are never read cost little more than a scan.
+	// Not thread-safe.
+	typedef struct USEC_Document USEC_Document;
+
+	// Position of a value in a document, valid as long as the document. Fields are internal.
+	typedef struct {
+		USEC_Document* doc;
+		size_t node;
+		size_t member;
+	} USEC_Cursor;
+
+	/**
+	 * Tokenize a USEC string for on-demand reading. Errors are collected like usec_parse_result,
+	 * those inside a value are only found once it's read.
+	 *
+	 * options->variables is only read, declarations aren't added to it.
+	 *
+	 * @param input USEC text, doesn't need to be null-terminated. Has to stay valid while the document is used.
+	 * @param length Length of the input in bytes
+	 * @param options Optional; pass NULL for defaults. useArena and streaming are ignored, values always live in the document.
+	 * @return The document, release with usec_document_free
+	 */
+	USEC_Document* usec_document_parse(const char* input, size_t length, const USEC_ParseOptions* options);
+
+	/**
+	 * Memory-map a file and tokenize it like usec_document_parse. The mapping is kept until the document is freed.
+	 */
+	USEC_Document* usec_document_open(const char* path, const USEC_ParseOptions* options);
+
+	/**
+	 * Free a document along with every value read from it.
+	 */
+	void usec_document_free(USEC_Document* doc);
+
+	/**
+	 * Errors found so far, in the order they were found.
+	 */
+	const USEC_Error* usec_document_errors(const USEC_Document* doc, size_t* count);
+
+	/**
+	 * Cursor to the root value: the top-level object, or the value after '!'.
+	 *
+	 * @return false if the document couldn't be read or tokenized
+	 */
+	bool usec_document_root(USEC_Document* doc, USEC_Cursor* out);
+
+	/**
+	 * Type of the value at the cursor, telling it from its first token where possible.
+	 * Variable references are strings.
+	 */
+	USEC_ValueType usec_cursor_type(const USEC_Cursor* cursor);
+
+	/**
+	 * Number of members of an object or items of an array, 0 for other values.
+	 */
+	size_t usec_cursor_count(const USEC_Cursor* cursor);
+
+	/**
+	 * Cursor to the member of an object with the given key.
+	 *
+	 * @return false if the value isn't an object or has no such member
+	 */
+	bool usec_cursor_get(const USEC_Cursor* cursor, const char* key, USEC_Cursor* out);
+
+	/**
+	 * Cursor to the index-th item of an array, or member of an object in the order of usec_ht_foreach.
+	 */
+	bool usec_cursor_at(const USEC_Cursor* cursor, size_t index, USEC_Cursor* out);
+
+	/**
+	 * Key of an object member, NULL for array items and the root.
+	 */
+	const char* usec_cursor_key(const USEC_Cursor* cursor);
+
+	/**
+	 * Parse the value at the cursor, with everything below it. The value is owned by the document
+	 * and returned again by later calls.
+	 *
+	 * @return The value, or NULL if it has errors (see usec_document_errors)
+	 */
+	USEC_Value* usec_cursor_value(const USEC_Cursor* cursor);
+
+	// ==============================
+	//          Event Parsing
+	// ==============================
+
+	typedef enum {
+		USEC_EVENT_OBJECT_BEGIN, // also around the top level of a document without a root value
+		USEC_EVENT_OBJECT_END,
+		USEC_EVENT_ARRAY_BEGIN,
+		USEC_EVENT_ARRAY_END,
+		USEC_EVENT_KEY, // key of an object member, its value follows
+		USEC_EVENT_DECLARATION, // name of a declared variable, its value follows
+		USEC_EVENT_SCALAR
+	} USEC_EventType;
+
+	// Event of an event parse. What it points to is only valid during the callback.
+	typedef struct {
+		USEC_EventType type;
+		int line; // position of the token that starts the event
+		int col;
+		const char* text; // null-terminated key or variable name, or the text of a string scalar
+		size_t length;
+		USEC_Value value; // scalars only. A string points at text, nothing is allocated.
+	} USEC_Event;
+
+	// Receives the events of a document in order. Returning false stops the parse.
+	typedef bool (*USEC_EventFn)(void* user, const USEC_Event* event);
+
+	/**
+	 * Parse a document into events instead of a tree. No values or tables are built for the document,
+	 * only declared variables are kept for interpolation, in a scratch arena reused by the next parse.
+	 * Declared objects and arrays can't be interpolated, so they're only kept as placeholders.
+	 * options->variables is only read. With keepVariables, variable references are kept as text like usec_parse does.
+	 * Values that fail to parse are dropped with their key, as usec_parse_result drops them, and no
+	 * more events are sent once an error aborts the parse.
+	 * The input is tokenized as it's parsed, so events can precede a syntax error later in the input.
+	 * Only a result without errors means the events describe a valid document.
+	 *
+	 * @return Errors of the parse. The value is always NULL.
+	 */
+	USEC_ParseResult usec_parse_events(const char* input, size_t length, const USEC_ParseOptions* options, USEC_EventFn fn, void* user);
+
+	/**
+	 * Parse a memory-mapped file into events like usec_parse_events.
+	 */
+	USEC_ParseResult usec_parse_file_events(const char* path, const USEC_ParseOptions* options, USEC_EventFn fn, void* user);
+
+	/**
+	 * Parse into events like usec_parse_events, reusing the buffers of the context.
+	 */
+	USEC_ParseResult usec_context_parse_events(USEC_Context* ctx, const char* input, size_t length, const USEC_ParseOptions* options, USEC_EventFn fn, void* user);
+
+	// ==============================
+	//        Value Accessors
+	// ==============================
+
+	// Read parsed trees without touching the union. Formatting wrappers are looked through, packed arrays
+	// read like arrays. NULL values read as null.
+
+	// Type of the value, VALUE_ARRAY for packed arrays
+	USEC_ValueType usec_value_type(const USEC_Value* value);
+
+	// Scalars. They return 0 for values of other types, numbers convert between each other.
+	bool usec_value_bool(const USEC_Value* value);
+	char usec_value_char(const USEC_Value* value);
+	int64_t usec_value_int(const USEC_Value* value);
+	uint64_t usec_value_uint(const USEC_Value* value);
+	double usec_value_double(const USEC_Value* value);
+	// Null-terminated string, NULL for other types. length may be NULL.
+	const char* usec_value_string(const USEC_Value* value, size_t* length);
+
+	/**
+	 * Number of items of an array or members of an object, 0 for other values.
+	 */
+	size_t usec_value_count(const USEC_Value* value);
+
+	/**
+	 * Item of an array. Elements of packed arrays are copied into scratch, which is returned.
+	 *
+	 * @return NULL if the value isn't an array or the index is out of range
+	 */
+	const USEC_Value* usec_value_at(const USEC_Value* array, size_t index, USEC_Value* scratch);
+
+	/**
+	 * Member of an object, NULL if the value isn't an object or has no such member.
+	 */
+	const USEC_Value* usec_value_get(const USEC_Value* object, const char* key);
+
+	/**
+	 * Key of the index-th member of an object in insertion order, with its value in value (may be NULL).
+	 *
+	 * @return NULL if the value isn't an object or the index is out of range
+	 */
+	const char* usec_value_entry(const USEC_Value* object, size_t index, const USEC_Value** value);
+
+	// ==============================
+	//            Paths
+	// ==============================
+
+	// Paths name a value below a root: keys separated by '.', and [n] for the n-th item of an array,
+	// like "servers[3].http.port". Keys with '.', '[' or '"' in them are written quoted, as ["a.b"],
+	// escaping '"' and backslashes with a backslash. The empty path names the root.
+	// Compiled paths hash their keys once, looking them up needs no hashing or parsing.
+
+	typedef struct USEC_Path USEC_Path;
+	typedef struct USEC_PathSet USEC_PathSet;
+
+	/**
+	 * Compile a path for usec_path_get.
+	 *
+	 * @return NULL if the path is malformed. Release with usec_path_free.
+	 */
+	USEC_Path* usec_path_compile(const char* path);
+	void usec_path_free(USEC_Path* path);
+
+	/**
+	 * Value at the path below root. Elements of packed arrays are copied into scratch, which is returned.
+	 *
+	 * @return NULL if there is no such value
+	 */
+	const USEC_Value* usec_path_get(const USEC_Value* root, const USEC_Path* path, USEC_Value* scratch);
+
+	/**
+	 * Compile paths that are looked up together. Their common prefixes are resolved once per lookup.
+	 *
+	 * @return NULL if a path is malformed. Release with usec_path_set_free.
+	 */
+	USEC_PathSet* usec_path_set_compile(const char* const* paths, size_t count);
+	void usec_path_set_free(USEC_PathSet* set);
+
+	/**
+	 * Look up all paths of the set in one walk over root. out[i] gets the value of the i-th path, NULL if
+	 * there is none. Elements of packed arrays are copied into scratch[i]. Both hold one entry per path.
+	 * A set can be used by several threads at once.
+	 */
+	void usec_path_set_get(const USEC_Value* root, const USEC_PathSet* set, const USEC_Value** out, USEC_Value* scratch);
+
+	// ==============================
+	//         Packed Arrays
+	// ==============================
+
+	// Elements of a packed array as a C array, NULL if the value isn't a packed array of that element type.
+	// count may be NULL.
+	const int64_t* usec_packed_ints(const USEC_Value* value, size_t* count);
+	const uint64_t* usec_packed_uints(const USEC_Value* value, size_t* count);
+	const double* usec_packed_doubles(const USEC_Value* value, size_t* count);
+	const bool* usec_packed_bools(const USEC_Value* value, size_t* count);
+
+	// Element of a packed array as a scalar value. Out of range indices give a null value.
+	USEC_Value usec_packed_get(const USEC_Value* value, size_t index);
+
+	/**
+	 * Pack the arrays of a heap tree like the packArrays parse option does. Arena trees are left as they are.
+	 *
+	 * @param root Tree to convert in place
+	 */
+	void usec_pack(USEC_Value* root);
+
+	// ==============================
+	//        Binary Documents
+	// ==============================
+
+	// Compiled form of a parsed tree that is read in place. Objects carry a key index, strings are
+	// length-prefixed and stored once, small numbers are packed into their slot. Files are memory-mapped,
+	// so opening one costs nothing up front and processes reading the same file share its pages.
+	// The format is only read on machines with the byte order it was written on. Thread-safe for reading.
+	typedef struct USEC_Binary USEC_Binary;
+
+	// Position of a value in a binary document, valid as long as the document. Fields are internal.
+	typedef struct {
+		const USEC_Binary* bin;
+		size_t slot;
+		uint32_t key;
+	} USEC_BinaryRef;
+
+	/**
+	 * Serialize a tree to the binary format. Formatting nodes are unwrapped, comments can't be serialized.
+	 *
+	 * @param root A tree returned by a parse function
+	 * @param length Set to the size of the data
+	 * @return Dynamically allocated data (caller must free), or NULL if the tree can't be serialized or exceeds 4 GiB
+	 */
+	char* usec_to_binary(const USEC_Value* root, size_t* length);
+
+	/**
+	 * Serialize a tree like usec_to_binary and write it to a file.
+	 *
+	 * @return false if the tree can't be serialized or the file can't be written
+	 */
+	bool usec_save_binary(const USEC_Value* root, const char* path);
+
+	/**
+	 * Memory-map a binary file. Only the header is checked, damaged data is read as missing or empty values.
+	 *
+	 * @return The document, or NULL if the file can't be read or isn't in the binary format. Release with usec_binary_close.
+	 */
+	USEC_Binary* usec_binary_open(const char* path);
+
+	/**
+	 * Read binary data in memory like usec_binary_open. The data has to stay valid while the document is used.
+	 */
+	USEC_Binary* usec_binary_from(const void* data, size_t length);
+
+	void usec_binary_close(USEC_Binary* bin);
+
+	/**
+	 * Reference to the root value.
+	 */
+	bool usec_binary_root(const USEC_Binary* bin, USEC_BinaryRef* out);
+
+	USEC_ValueType usec_binary_type(const USEC_BinaryRef* ref);
+
+	/**
+	 * Number of members of an object or items of an array, 0 for other values.
+	 */
+	size_t usec_binary_count(const USEC_BinaryRef* ref);
+
+	/**
+	 * Reference to the member of an object with the given key.
+	 *
+	 * @return false if the value isn't an object or has no such member
+	 */
+	bool usec_binary_get(const USEC_BinaryRef* ref, const char* key, USEC_BinaryRef* out);
+
+	/**
+	 * Reference to the index-th item of an array, or member of an object in insertion order.
+	 */
+	bool usec_binary_at(const USEC_BinaryRef* ref, size_t index, USEC_BinaryRef* out);
+
+	/**
+	 * Key of an object member, NULL for array items and the root.
+	 */
+	const char* usec_binary_key(const USEC_BinaryRef* ref);
+
+	// Scalars, read without copying. They return 0 for values of other types, numbers convert between each other.
+	bool usec_binary_bool(const USEC_BinaryRef* ref);
+	char usec_binary_char(const USEC_BinaryRef* ref);
+	int64_t usec_binary_int(const USEC_BinaryRef* ref);
+	uint64_t usec_binary_uint(const USEC_BinaryRef* ref);
+	double usec_binary_double(const USEC_BinaryRef* ref);
+	// Null-terminated string in the document, NULL for other types. length may be NULL.
+	const char* usec_binary_string(const USEC_BinaryRef* ref, size_t* length);
+
+	/**
+	 * Deserialize the value with everything below it.
+	 *
+	 * @return A heap tree, release with usec_free
+	 */
+	USEC_Value* usec_binary_value(const USEC_BinaryRef* ref);
+
 	/**
 	 * Convert a USEC_Value tree back to a full file string.
+	 * Doubles are written as the shortest decimal that parses back to the same double, always with a '.'
+	 * or an exponent so they stay doubles.
 	 *
 	 * @param root The data structure to convert
 	 * @param readable Whether to format with readable indentation
@@ -160,31 +696,54 @@ extern "C" {
 	 */
 	bool usec_equals(const USEC_Value* a, const USEC_Value* b);
 
-	// Represents a key-value pair node used internally by the Usec_Hashtable. Linked as a chain to handle hash collisions.
+	/**
+	 * Prepare a tree that won't change anymore for reading. Every object gets exactly sized entries, and
+	 * objects too large for a linear scan get an index where each key has a slot of its own, found without
+	 * probing. Adding a key to a frozen object later still works, its table goes back to a regular index.
+	 *
+	 * @param root Tree to convert in place, heap or arena
+	 */
+	void usec_freeze(USEC_Value* root);
+
+	// Key-value entry of a Usec_Hashtable. Entries are stored densely in insertion order.
 	struct Usec_HashNode {
-		char* key;
+		char* key; // Owned by the table and possibly shared with other tables of the document, don't modify it
 		USEC_Value* value;
-		struct Usec_HashNode* next;
-		struct Usec_HashNode* order_prev;
-		struct Usec_HashNode* order_next;
+		uint64_t hash; // full hash of the key
 	};
 
 
-    // A simple hash table for storing key-value pairs representing USEC object members. Preserves order.
+	// Ordered hash table for storing key-value pairs representing USEC object members.
+	// Entries live in a dense array in insertion order, a separate open addressing index maps hashes to them.
+	// The index grows with the load factor and is only built once the table outgrows a linear scan.
+	// Frozen tables (usec_ht_freeze) use a displacement per bucket of keys instead of probing.
 	struct Usec_Hashtable {
-		size_t capacity;
+		size_t capacity; // slots in the index, zero while small tables are scanned linearly
 		size_t size;
-		Usec_HashNode** buckets;
-		Usec_HashNode* order_head;
-		Usec_HashNode* order_tail;
+		Usec_HashNode* entries;
+		size_t entries_capacity;
+		uint32_t* index; // entry position + 1 per slot, 0 for empty slots
+		uint32_t* displace; // Set for frozen tables, see usec_freeze: slot offset per bucket of keys, stored after the index
+		size_t buckets;
+		USEC_Arena* arena; // Set for objects of arena documents, their entries and keys live in the arena
 	};
 
-	Usec_Hashtable* usec_ht_create(size_t capacity);
+	Usec_Hashtable* usec_ht_create(size_t capacity); // capacity is a hint for the expected number of entries
 	void usec_ht_set(Usec_Hashtable* ht, const char* key, USEC_Value* value);
 	USEC_Value* usec_ht_get(Usec_Hashtable* ht, const char* key);
 	void usec_ht_free(Usec_Hashtable* ht);
+	void usec_ht_clear(Usec_Hashtable* ht); // Removes and frees all entries, keeps the entry storage
 	void usec_ht_foreach(Usec_Hashtable* ht, void (*fn)(const char* key, USEC_Value* value));
 	Usec_Hashtable* usec_ht_from(const Usec_Hashtable* source);
+	void usec_ht_freeze(Usec_Hashtable* ht); // Like usec_freeze for one table, its values are left as they are
+
+	// Hash of a key as stored in Usec_HashNode.hash. Randomly seeded per process, don't persist it.
+	uint64_t usec_ht_hash(const char* key, size_t length);
+	// Variants taking a key of known length (not necessarily null-terminated) and its precomputed usec_ht_hash
+	void usec_ht_set_hashed(Usec_Hashtable* ht, const char* key, size_t length, uint64_t hash, USEC_Value* value);
+	USEC_Value* usec_ht_get_hashed(Usec_Hashtable* ht, const char* key, size_t length, uint64_t hash);
+	// Like usec_ht_set_hashed, but returns the replaced value (NULL if the key is new) instead of freeing it
+	USEC_Value* usec_ht_swap_hashed(Usec_Hashtable* ht, const char* key, size_t length, uint64_t hash, USEC_Value* value);
 
 
 #ifdef __cplusplus
@@ -0,0 +1,162 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define ARENA_ALIGN (sizeof(void*) > 8 ? sizeof(void*) : 8)
+
+struct USEC_ArenaBlock {
+	USEC_ArenaBlock* next;
+	size_t size;
+	size_t used;
+	// data follows
+};
+
+#define BLOCK_HEADER ((sizeof(USEC_ArenaBlock) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+// Root value prefixed with its owning arena
+typedef struct {
+	USEC_Arena* arena;
+	USEC_Value value;
+} ArenaRoot;
+
+static char* block_data(USEC_ArenaBlock* block) {
+	return (char*)block + BLOCK_HEADER;
+}
+
+static USEC_ArenaBlock* new_block(USEC_Arena* arena, size_t min_size) {
+	size_t size = arena->next_block_size;
+	while (size < min_size) size *= 2;
+
+	USEC_ArenaBlock* block = malloc(BLOCK_HEADER + size);
+	if (!block) return NULL;
+	block->size = size;
+	block->used = 0;
+	block->next = arena->head;
+	arena->head = block;
+
+	if (arena->next_block_size < USEC_ARENA_MAX_BLOCK) arena->next_block_size *= 2;
+	return block;
+}
+
+static void* arena_alloc_aligned(USEC_Arena* arena, size_t size, size_t align) {
+	USEC_ArenaBlock* block = arena->head;
+	if (block) {
+		size_t offset = (block->used + align - 1) & ~(align - 1);
+		if (offset + size <= block->size) {
+			block->used = offset + size;
+			return block_data(block) + offset;
+		}
+	}
+
+	block = new_block(arena, size);
+	if (!block) return NULL;
+	block->used = size;
+	return block_data(block);
+}
+
+USEC_Arena* usec_arena_create(void) {
+	USEC_Arena* arena = malloc(sizeof(USEC_Arena));
+	if (!arena) return NULL;
+	arena->head = NULL;
+	arena->next_block_size = USEC_ARENA_MIN_BLOCK;
+	arena->adopted = NULL;
+	arena->adopted_count = 0;
+	arena->adopted_capacity = 0;
+	return arena;
+}
+
+static void free_adopted(USEC_Arena* arena) {
+	for (size_t i = 0; i < arena->adopted_count; ++i) {
+		usec_free(arena->adopted[i]);
+	}
+	arena->adopted_count = 0;
+}
+
+static void free_blocks(USEC_ArenaBlock* block) {
+	while (block) {
+		USEC_ArenaBlock* next = block->next;
+		free(block);
+		block = next;
+	}
+}
+
+void usec_arena_destroy(USEC_Arena* arena) {
+	if (!arena) return;
+
+	free_adopted(arena);
+	free(arena->adopted);
+	free_blocks(arena->head);
+	free(arena);
+}
+
+void usec_arena_reset(USEC_Arena* arena) {
+	free_adopted(arena);
+
+	USEC_ArenaBlock* head = arena->head;
+	if (head) {
+		free_blocks(head->next);
+		head->next = NULL;
+		head->used = 0;
+	}
+}
+
+void usec_arena_merge(USEC_Arena* dst, USEC_Arena* src) {
+	// The blocks go behind the head, which stays the one allocated from
+	if (src->head) {
+		USEC_ArenaBlock* tail = src->head;
+		while (tail->next) tail = tail->next;
+		if (dst->head) {
+			tail->next = dst->head->next;
+			dst->head->next = src->head;
+		} else {
+			dst->head = src->head;
+		}
+	}
+
+	for (size_t i = 0; i < src->adopted_count; ++i) {
+		usec_arena_adopt(dst, src->adopted[i]);
+	}
+	free(src->adopted);
+	free(src);
+}
+
+void* usec_arena_alloc(USEC_Arena* arena, size_t size) {
+	return arena_alloc_aligned(arena, size, ARENA_ALIGN);
+}
+
+void* usec_arena_calloc(USEC_Arena* arena, size_t size) {
+	void* ptr = arena_alloc_aligned(arena, size, ARENA_ALIGN);
+	if (ptr) memset(ptr, 0, size);
+	return ptr;
+}
+
+char* usec_arena_strndup(USEC_Arena* arena, const char* str, size_t len) {
+	char* copy = arena_alloc_aligned(arena, len + 1, 1);
+	if (!copy) return NULL;
+	memcpy(copy, str, len);
+	copy[len] = '\0';
+	return copy;
+}
+
+void usec_arena_adopt(USEC_Arena* arena, USEC_Value* value) {
+	if (!value || (value->flags & USEC_VALUE_ARENA)) return;
+	if (arena->adopted_count >= arena->adopted_capacity) {
+		arena->adopted_capacity = arena->adopted_capacity ? arena->adopted_capacity * 2 : 8;
+		arena->adopted = realloc(arena->adopted, sizeof(USEC_Value*) * arena->adopted_capacity);
+	}
+	arena->adopted[arena->adopted_count++] = value;
+}
+
+USEC_Value* usec_arena_make_root(USEC_Arena* arena, const USEC_Value* root) {
+	ArenaRoot* wrapper = usec_arena_alloc(arena, sizeof(ArenaRoot));
+	wrapper->arena = arena;
+	wrapper->value = *root;
+	wrapper->value.flags = USEC_VALUE_ARENA | USEC_VALUE_ARENA_ROOT;
+	return &wrapper->value;
+}
+
+USEC_Arena* usec_arena_of_root(const USEC_Value* root) {
+	const ArenaRoot* wrapper = (const ArenaRoot*)((const char*)root - offsetof(ArenaRoot, value));
+	return wrapper->arena;
+}
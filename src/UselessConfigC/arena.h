@@ -0,0 +1,54 @@
+#ifndef USEC_ARENA_H
+#define USEC_ARENA_H
+
+#include <usec/usec.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Ownership flags of USEC_Value.flags
+#define USEC_VALUE_ARENA      0x1u // allocated in an arena, freed with the whole document
+#define USEC_VALUE_ARENA_ROOT 0x2u // root of an arena document, freeing it releases the arena
+#define USEC_VALUE_EMBEDDED   0x4u // lives in the item block of its array, freeing it only frees its contents
+#define USEC_VALUE_INLINE     0x8u // the text of the string was allocated right behind the value, stringValue may have been replaced since
+
+#define USEC_ARENA_MIN_BLOCK (64 * 1024)
+#define USEC_ARENA_MAX_BLOCK (16 * 1024 * 1024)
+
+typedef struct USEC_ArenaBlock USEC_ArenaBlock;
+
+// Bump allocator owning a chain of large blocks. Everything is released at once.
+struct USEC_Arena {
+	USEC_ArenaBlock* head;   // block currently allocated from
+	size_t next_block_size;
+
+	// Heap values inserted into arena objects after parsing, freed with the arena
+	USEC_Value** adopted;
+	size_t adopted_count;
+	size_t adopted_capacity;
+};
+
+USEC_Arena* usec_arena_create(void);
+void usec_arena_destroy(USEC_Arena* arena);
+// Releases everything allocated so far, keeping the newest (largest) block for reuse
+void usec_arena_reset(USEC_Arena* arena);
+// Moves the blocks and adopted values of src into dst and frees src
+void usec_arena_merge(USEC_Arena* dst, USEC_Arena* src);
+
+// Pointer aligned memory
+void* usec_arena_alloc(USEC_Arena* arena, size_t size);
+void* usec_arena_calloc(USEC_Arena* arena, size_t size);
+char* usec_arena_strndup(USEC_Arena* arena, const char* str, size_t len);
+
+// Hands a heap value to the arena, it's freed when the arena is destroyed
+void usec_arena_adopt(USEC_Arena* arena, USEC_Value* value);
+
+// Hashtable whose nodes, keys and buckets are allocated from the arena
+Usec_Hashtable* usec_ht_create_in(USEC_Arena* arena, size_t capacity);
+
+// Wraps the parsed root so that usec_free on it releases the arena
+USEC_Value* usec_arena_make_root(USEC_Arena* arena, const USEC_Value* root);
+
+// Arena owning the given root value (flagged USEC_VALUE_ARENA_ROOT)
+USEC_Arena* usec_arena_of_root(const USEC_Value* root);
+
+#endif
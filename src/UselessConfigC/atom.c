@@ -0,0 +1,93 @@
+#include "atom.h"
+#include "thread.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ATOMS_MIN_CAPACITY 64
+
+typedef struct {
+	volatile long refs;
+} AtomHeader;
+
+static AtomHeader* header_of(const char* atom) {
+	return (AtomHeader*)atom - 1;
+}
+
+char* usec_atom_new(const char* text, size_t length) {
+	AtomHeader* header = malloc(sizeof(AtomHeader) + length + 1);
+	header->refs = 1;
+	char* atom = (char*)(header + 1);
+	memcpy(atom, text, length);
+	atom[length] = '\0';
+	return atom;
+}
+
+void usec_atom_retain(const char* atom) {
+	usec_atomic_increment(&header_of(atom)->refs);
+}
+
+void usec_atom_release(char* atom) {
+	if (atom && usec_atomic_decrement(&header_of(atom)->refs) == 0) free(header_of(atom));
+}
+
+void usec_atoms_init(USEC_AtomTable* atoms) {
+	atoms->slots = NULL;
+	atoms->capacity = 0;
+	atoms->count = 0;
+	atoms->arena = NULL;
+}
+
+void usec_atoms_clear(USEC_AtomTable* atoms) {
+	if (atoms->count == 0) return;
+	for (size_t i = 0; i < atoms->capacity; ++i) {
+		if (atoms->slots[i].atom && !atoms->arena) usec_atom_release(atoms->slots[i].atom);
+		atoms->slots[i].atom = NULL;
+	}
+	atoms->count = 0;
+}
+
+void usec_atoms_free(USEC_AtomTable* atoms) {
+	usec_atoms_clear(atoms);
+	free(atoms->slots);
+	usec_atoms_init(atoms);
+}
+
+static void grow(USEC_AtomTable* atoms) {
+	size_t capacity = atoms->capacity ? atoms->capacity * 2 : ATOMS_MIN_CAPACITY;
+	USEC_AtomSlot* slots = calloc(capacity, sizeof(USEC_AtomSlot));
+	size_t mask = capacity - 1;
+	for (size_t i = 0; i < atoms->capacity; ++i) {
+		USEC_AtomSlot* slot = &atoms->slots[i];
+		if (!slot->atom) continue;
+		size_t at = (size_t)slot->hash & mask;
+		while (slots[at].atom) at = (at + 1) & mask;
+		slots[at] = *slot;
+	}
+	free(atoms->slots);
+	atoms->slots = slots;
+	atoms->capacity = capacity;
+}
+
+const char* usec_atoms_intern(USEC_AtomTable* atoms, USEC_Arena* arena, const char* key, size_t length, uint64_t hash) {
+	if (arena != atoms->arena) {
+		usec_atoms_clear(atoms);
+		atoms->arena = arena;
+	}
+	// At most half full
+	if ((atoms->count + 1) * 2 > atoms->capacity) grow(atoms);
+
+	size_t mask = atoms->capacity - 1;
+	size_t at = (size_t)hash & mask;
+	while (atoms->slots[at].atom) {
+		USEC_AtomSlot* slot = &atoms->slots[at];
+		if (slot->hash == hash && slot->length == length && memcmp(slot->atom, key, length) == 0) return slot->atom;
+		at = (at + 1) & mask;
+	}
+
+	USEC_AtomSlot* slot = &atoms->slots[at];
+	slot->atom = arena ? usec_arena_strndup(arena, key, length) : usec_atom_new(key, length);
+	slot->length = length;
+	slot->hash = hash;
+	++atoms->count;
+	return slot->atom;
+}
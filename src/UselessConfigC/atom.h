@@ -0,0 +1,48 @@
+#ifndef USEC_ATOM_H
+#define USEC_ATOM_H
+
+#include "arena.h"
+#include <usec/usec.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Keys of heap tables are atoms: strings with a reference count in front of the text. Tables can share
+// a key this way while every key still reads as a plain C string.
+char* usec_atom_new(const char* text, size_t length);
+void usec_atom_retain(const char* atom);
+void usec_atom_release(char* atom);
+
+typedef struct {
+	char* atom;
+	size_t length;
+	uint64_t hash;
+} USEC_AtomSlot;
+
+// Keys interned during a parse, so members with the same key share one atom and compare by pointer.
+// Arena parses intern into the arena, the table then holds arena strings.
+typedef struct {
+	USEC_AtomSlot* slots;
+	size_t capacity; // a power of two, 0 before the first key
+	size_t count;
+	USEC_Arena* arena;
+} USEC_AtomTable;
+
+void usec_atoms_init(USEC_AtomTable* atoms);
+// Drops the interned keys, the tables using them keep them alive
+void usec_atoms_clear(USEC_AtomTable* atoms);
+void usec_atoms_free(USEC_AtomTable* atoms);
+// Interned copy of the key: an atom owned by the table, or a string in arena when it's set
+const char* usec_atoms_intern(USEC_AtomTable* atoms, USEC_Arena* arena, const char* key, size_t length, uint64_t hash);
+
+// Like usec_ht_swap_hashed, but a new entry keeps key instead of a copy of it. key has to be an atom
+// for heap tables and has to live as long as the arena for arena tables.
+USEC_Value* usec_ht_swap_shared(Usec_Hashtable* ht, const char* key, size_t length, uint64_t hash, USEC_Value* value);
+
+// Lets ht use the index of like if both have the same keys in the same order, which records of
+// an array usually do. False if they differ or like has no index to share. Tables small enough for a
+// linear scan have nothing else to share: their entries hold the values, next to keys that are
+// already interned atoms, and Usec_HashNode is iterated by callers so its layout stays.
+bool usec_ht_share_shape(Usec_Hashtable* ht, const Usec_Hashtable* like);
+
+#endif
@@ -0,0 +1,39 @@
+#include "context.h"
+#include "pool.h"
+#include <stdlib.h>
+
+typedef struct {
+	const char* const* paths;
+	USEC_ParseOptions options; // without variables, those are read through each context's shared_variables
+	Usec_Hashtable* shared_variables;
+	USEC_ParseResult* results;
+} Batch;
+
+static void parse_one(void* arg, USEC_Context* ctx, size_t index) {
+	Batch* batch = arg;
+	ctx->shared_variables = batch->shared_variables;
+	batch->results[index] = usec_context_run_file(ctx, batch->paths[index], &batch->options);
+}
+
+USEC_ParseResult* usec_parse_many(const char* const* paths, size_t count, const USEC_ParseOptions* options, size_t threads) {
+	USEC_ParseResult* results = calloc(count ? count : 1, sizeof(USEC_ParseResult));
+	if (!results) return NULL;
+
+	Batch batch;
+	batch.paths = paths;
+	batch.options = options ? *options : usec_get_default_parse_options();
+	batch.shared_variables = batch.options.variables;
+	batch.options.variables = NULL;
+	batch.results = results;
+
+	usec_pool_run(count, threads, parse_one, &batch);
+	return results;
+}
+
+void usec_free_results(USEC_ParseResult* results, size_t count) {
+	if (!results) return;
+	for (size_t i = 0; i < count; ++i) {
+		usec_free_result(&results[i]);
+	}
+	free(results);
+}
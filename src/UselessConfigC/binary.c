@@ -0,0 +1,598 @@
+#include "mapping.h"
+#include "hash.h"
+#include "bits.h"
+#include "utils.h"
+#include <usec/usec.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Layout, all integers in native byte order (the version field tells a foreign file apart):
+//   header: "USEB", u32 version, u32 file size, u32 reserved, root slot
+//   slot: u8 type, u8 flags, u16 reserved, u32 payload. The payload is the value itself for
+//         bools, chars and numbers that fit, otherwise the offset of its data.
+//   number: 8 bytes
+//   string: u32 length, bytes, NUL. Equal strings and keys are stored once.
+//   array: u32 count, count slots
+//   object: u32 count, u32 index size, count entries { u32 key offset, u32 key hash, slot } in insertion
+//           order, then the index: entry + 1 per slot, open addressing. Small objects have no index.
+#define BINARY_VERSION 1
+#define HEADER_SIZE 24
+#define SLOT_SIZE 8
+#define ENTRY_SIZE 16
+#define ROOT_SLOT 16
+
+// Objects up to this size are searched by scanning their entries, like in documents
+#define BINARY_LINEAR_MAX 8
+
+#define SLOT_INLINE 1 // payload holds the value, for numbers
+#define SLOT_FLOAT 2 // inline double stored as a float
+
+// Key hashes are persisted, so they can't use the per-process seed
+#define BINARY_HASH_SEED 0x5553454342494e31ull
+
+static const char magic[4] = { 'U', 'S', 'E', 'B' };
+
+static uint32_t key_hash(const char* key, size_t length) {
+	return (uint32_t)usec_hash_with_seed(key, length, BINARY_HASH_SEED);
+}
+
+// ==============================
+//            Writing
+// ==============================
+
+typedef struct {
+	uint8_t type;
+	uint8_t flags;
+	uint32_t payload;
+} Slot;
+
+typedef struct {
+	SB out;
+	bool failed; // formatting nodes or more than 4 GiB of output
+
+	// Offsets of the strings written so far, open addressing on the key hash
+	uint32_t* strings;
+	size_t strings_capacity;
+	size_t strings_count;
+} Writer;
+
+static void put32(Writer* w, uint32_t v) {
+	sb_append_data(&w->out, (const char*)&v, sizeof(v));
+}
+
+static void put_slot(Writer* w, Slot slot) {
+	unsigned char bytes[SLOT_SIZE] = { slot.type, slot.flags, 0, 0 };
+	memcpy(bytes + 4, &slot.payload, 4);
+	sb_append_data(&w->out, (const char*)bytes, SLOT_SIZE);
+}
+
+static uint32_t offset(Writer* w) {
+	if (w->out.length > UINT32_MAX) w->failed = true;
+	return (uint32_t)w->out.length;
+}
+
+static uint32_t put64(Writer* w, const void* v) {
+	uint32_t at = offset(w);
+	sb_append_data(&w->out, (const char*)v, 8);
+	return at;
+}
+
+static bool same_string(Writer* w, uint32_t at, const char* str, size_t length) {
+	return usec_read32(w->out.buffer + at) == length && memcmp(w->out.buffer + at + 4, str, length) == 0;
+}
+
+static void strings_grow(Writer* w) {
+	size_t capacity = w->strings_capacity ? w->strings_capacity * 2 : 256;
+	uint32_t* strings = calloc(capacity, sizeof(uint32_t));
+	for (size_t i = 0; i < w->strings_capacity; ++i) {
+		uint32_t at = w->strings[i];
+		if (!at) continue;
+		size_t slot = key_hash(w->out.buffer + at + 4, usec_read32(w->out.buffer + at)) & (capacity - 1);
+		while (strings[slot]) slot = (slot + 1) & (capacity - 1);
+		strings[slot] = at;
+	}
+	free(w->strings);
+	w->strings = strings;
+	w->strings_capacity = capacity;
+}
+
+// Writes the string unless it was written before. Returns its offset and hash.
+static uint32_t put_string(Writer* w, const char* str, uint32_t* hash_out) {
+	size_t length = strlen(str);
+	uint32_t hash = key_hash(str, length);
+	if (hash_out) *hash_out = hash;
+	if (length > UINT32_MAX) {
+		w->failed = true;
+		return 0;
+	}
+
+	if ((w->strings_count + 1) * 2 > w->strings_capacity) strings_grow(w);
+	size_t mask = w->strings_capacity - 1;
+	size_t slot = hash & mask;
+	while (w->strings[slot]) {
+		if (same_string(w, w->strings[slot], str, length)) return w->strings[slot];
+		slot = (slot + 1) & mask;
+	}
+
+	uint32_t at = offset(w);
+	put32(w, (uint32_t)length);
+	sb_append_data(&w->out, str, length + 1);
+	w->strings[slot] = at;
+	w->strings_count++;
+	return at;
+}
+
+static Slot put_value(Writer* w, const USEC_Value* value);
+
+// Packed arrays are written like the others
+static Slot put_array(Writer* w, const USEC_Value* value) {
+	bool packed = value->type == VALUE_PACKED_ARRAY;
+	size_t count = packed ? value->packedValue.count : value->arrayValue.count;
+	Slot* items = malloc(sizeof(Slot) * (count ? count : 1));
+	for (size_t i = 0; i < count; ++i) {
+		if (packed) {
+			USEC_Value item = usec_packed_get(value, i);
+			items[i] = put_value(w, &item);
+		} else {
+			items[i] = put_value(w, value->arrayValue.items[i]);
+		}
+	}
+
+	Slot slot = { VALUE_ARRAY, 0, offset(w) };
+	put32(w, (uint32_t)count);
+	for (size_t i = 0; i < count; ++i) put_slot(w, items[i]);
+	free(items);
+	return slot;
+}
+
+static Slot put_object(Writer* w, const USEC_Value* value) {
+	Usec_Hashtable* ht = value->objectValue;
+	size_t count = ht->size;
+	Slot* values = malloc(sizeof(Slot) * (count ? count : 1));
+	uint32_t* keys = malloc(sizeof(uint32_t) * 2 * (count ? count : 1));
+	for (size_t i = 0; i < count; ++i) {
+		keys[i * 2] = put_string(w, ht->entries[i].key, &keys[i * 2 + 1]);
+		values[i] = put_value(w, ht->entries[i].value);
+	}
+
+	size_t index_size = 0;
+	if (count > BINARY_LINEAR_MAX) {
+		index_size = 16;
+		while (index_size < count * 2) index_size *= 2;
+	}
+
+	Slot slot = { VALUE_OBJECT, 0, offset(w) };
+	put32(w, (uint32_t)count);
+	put32(w, (uint32_t)index_size);
+	for (size_t i = 0; i < count; ++i) {
+		put32(w, keys[i * 2]);
+		put32(w, keys[i * 2 + 1]);
+		put_slot(w, values[i]);
+	}
+
+	if (index_size) {
+		uint32_t* index = calloc(index_size, sizeof(uint32_t));
+		for (size_t i = 0; i < count; ++i) {
+			size_t at = keys[i * 2 + 1] & (index_size - 1);
+			while (index[at]) at = (at + 1) & (index_size - 1);
+			index[at] = (uint32_t)i + 1;
+		}
+		sb_append_data(&w->out, (const char*)index, index_size * sizeof(uint32_t));
+		free(index);
+	}
+
+	free(values);
+	free(keys);
+	return slot;
+}
+
+static Slot put_value(Writer* w, const USEC_Value* value) {
+	Slot slot = { VALUE_NULL, 0, 0 };
+	if (!value) return slot;
+	slot.type = (uint8_t)value->type;
+
+	switch (value->type) {
+	case VALUE_NULL:
+		break;
+	case VALUE_BOOL:
+		slot.payload = value->boolValue;
+		break;
+	case VALUE_CHAR:
+		slot.payload = (unsigned char)value->charValue;
+		break;
+	case VALUE_UINT:
+		if (value->uint64Value <= UINT32_MAX) {
+			slot.flags = SLOT_INLINE;
+			slot.payload = (uint32_t)value->uint64Value;
+		} else {
+			slot.payload = put64(w, &value->uint64Value);
+		}
+		break;
+	case VALUE_INT:
+		if (value->int64Value >= INT32_MIN && value->int64Value <= INT32_MAX) {
+			slot.flags = SLOT_INLINE;
+			slot.payload = (uint32_t)(int32_t)value->int64Value;
+		} else {
+			slot.payload = put64(w, &value->int64Value);
+		}
+		break;
+	case VALUE_DOUBLE: {
+		float f = (float)value->doubleValue;
+		if ((double)f == value->doubleValue || value->doubleValue != value->doubleValue) {
+			slot.flags = SLOT_INLINE | SLOT_FLOAT;
+			memcpy(&slot.payload, &f, 4);
+		} else {
+			slot.payload = put64(w, &value->doubleValue);
+		}
+		break;
+	}
+	case VALUE_STRING:
+		slot.payload = put_string(w, value->stringValue, NULL);
+		break;
+	case VALUE_ARRAY:
+	case VALUE_PACKED_ARRAY:
+		return put_array(w, value);
+	case VALUE_OBJECT:
+		return put_object(w, value);
+	case VALUE_FORMAT:
+		return put_value(w, value->formatNode->node);
+	default:
+		w->failed = true;
+		break;
+	}
+	return slot;
+}
+
+char* usec_to_binary(const USEC_Value* root, size_t* length) {
+	if (length) *length = 0;
+	if (!root) return NULL;
+
+	Writer w;
+	memset(&w, 0, sizeof(w));
+	sb_init(&w.out);
+	sb_append_data(&w.out, magic, sizeof(magic));
+	put32(&w, BINARY_VERSION);
+	put32(&w, 0); // size, patched below
+	put32(&w, 0);
+	put_slot(&w, (Slot){ 0 });
+
+	Slot slot = put_value(&w, root);
+	if (w.out.length > UINT32_MAX) w.failed = true;
+	free(w.strings);
+	if (w.failed) {
+		sb_free(&w.out);
+		return NULL;
+	}
+
+	uint32_t size = (uint32_t)w.out.length;
+	memcpy(w.out.buffer + 8, &size, 4);
+	w.out.buffer[16] = (char)slot.type;
+	w.out.buffer[17] = (char)slot.flags;
+	memcpy(w.out.buffer + 20, &slot.payload, 4);
+
+	if (length) *length = w.out.length;
+	return sb_build(&w.out);
+}
+
+bool usec_save_binary(const USEC_Value* root, const char* path) {
+	if (!path) return false;
+	size_t length;
+	char* data = usec_to_binary(root, &length);
+	if (!data) return false;
+
+	FILE* file = fopen(path, "wb");
+	bool ok = file && fwrite(data, 1, length, file) == length;
+	if (file && fclose(file) != 0) ok = false;
+	free(data);
+	return ok;
+}
+
+// ==============================
+//            Reading
+// ==============================
+
+struct USEC_Binary {
+	const unsigned char* data;
+	size_t length;
+	USEC_FileMapping mapping;
+	bool mapped;
+};
+
+// Pointer to size bytes at the offset, NULL if they are past the end of the data.
+// Every offset read from the data is checked, so a damaged file can't be read out of bounds.
+static const unsigned char* at(const USEC_Binary* bin, uint64_t offset, uint64_t size) {
+	if (offset > bin->length || size > bin->length - offset) return NULL;
+	return bin->data + offset;
+}
+
+static bool check_header(const unsigned char* data, size_t length) {
+	return length >= HEADER_SIZE && memcmp(data, magic, sizeof(magic)) == 0 &&
+		usec_read32(data + 4) == BINARY_VERSION && usec_read32(data + 8) == length;
+}
+
+USEC_Binary* usec_binary_from(const void* data, size_t length) {
+	if (!data || !check_header(data, length)) return NULL;
+	USEC_Binary* bin = calloc(1, sizeof(USEC_Binary));
+	bin->data = data;
+	bin->length = length;
+	return bin;
+}
+
+USEC_Binary* usec_binary_open(const char* path) {
+	USEC_FileMapping mapping;
+	if (!path || !usec_map_file(path, &mapping)) return NULL;
+
+	USEC_Binary* bin = usec_binary_from(mapping.data, mapping.length);
+	if (!bin) {
+		usec_unmap_file(&mapping);
+		return NULL;
+	}
+	bin->mapping = mapping;
+	bin->mapped = true;
+	return bin;
+}
+
+void usec_binary_close(USEC_Binary* bin) {
+	if (!bin) return;
+	if (bin->mapped) usec_unmap_file(&bin->mapping);
+	free(bin);
+}
+
+static void make_ref(const USEC_Binary* bin, const unsigned char* slot, uint32_t key, USEC_BinaryRef* out) {
+	out->bin = bin;
+	out->slot = (size_t)(slot - bin->data);
+	out->key = key;
+}
+
+bool usec_binary_root(const USEC_Binary* bin, USEC_BinaryRef* out) {
+	if (!bin) return false;
+	make_ref(bin, bin->data + ROOT_SLOT, 0, out);
+	return true;
+}
+
+static uint32_t payload(const USEC_BinaryRef* ref) {
+	return usec_read32(ref->bin->data + ref->slot + 4);
+}
+
+static uint8_t flags(const USEC_BinaryRef* ref) {
+	return ref->bin->data[ref->slot + 1];
+}
+
+USEC_ValueType usec_binary_type(const USEC_BinaryRef* ref) {
+	return (USEC_ValueType)ref->bin->data[ref->slot];
+}
+
+// Start of the container block, NULL if it's not a container of the type or doesn't fit in the data.
+// Containers are written before the slots referring to them, anything else would make damaged data loop.
+static const unsigned char* container(const USEC_BinaryRef* ref, USEC_ValueType type, uint32_t* count) {
+	if (usec_binary_type(ref) != type) return NULL;
+	uint32_t offset = payload(ref);
+	if (ref->slot != ROOT_SLOT && offset >= ref->slot) return NULL;
+	const unsigned char* block = at(ref->bin, offset, 4);
+	if (!block) return NULL;
+
+	*count = usec_read32(block);
+	if (type == VALUE_ARRAY) return at(ref->bin, offset, 4 + (uint64_t)*count * SLOT_SIZE);
+	block = at(ref->bin, offset, 8);
+	if (!block) return NULL;
+	return at(ref->bin, offset, 8 + (uint64_t)*count * ENTRY_SIZE + (uint64_t)usec_read32(block + 4) * 4);
+}
+
+size_t usec_binary_count(const USEC_BinaryRef* ref) {
+	uint32_t count;
+	USEC_ValueType type = usec_binary_type(ref);
+	if (type != VALUE_ARRAY && type != VALUE_OBJECT) return 0;
+	return container(ref, type, &count) ? count : 0;
+}
+
+// Null-terminated string at the offset and its length, NULL if it doesn't fit in the data
+static const char* string_at(const USEC_Binary* bin, uint32_t offset, size_t* length) {
+	const unsigned char* str = at(bin, offset, 4);
+	if (!str) return NULL;
+	uint32_t len = usec_read32(str);
+	str = at(bin, (uint64_t)offset + 4, (uint64_t)len + 1);
+	if (!str || str[len] != '\0') return NULL;
+	if (length) *length = len;
+	return (const char*)str;
+}
+
+bool usec_binary_get(const USEC_BinaryRef* ref, const char* key, USEC_BinaryRef* out) {
+	uint32_t count;
+	const unsigned char* block = container(ref, VALUE_OBJECT, &count);
+	if (!block || !key) return false;
+
+	size_t length = strlen(key);
+	uint32_t hash = key_hash(key, length);
+	uint32_t index_size = usec_read32(block + 4);
+	const unsigned char* entries = block + 8;
+
+	if (index_size == 0 || (index_size & (index_size - 1)) != 0) {
+		for (uint32_t i = 0; i < count; ++i) {
+			const unsigned char* entry = entries + (size_t)i * ENTRY_SIZE;
+			if (usec_read32(entry + 4) != hash) continue;
+			size_t key_length;
+			const char* name = string_at(ref->bin, usec_read32(entry), &key_length);
+			if (name && key_length == length && memcmp(name, key, length) == 0) {
+				make_ref(ref->bin, entry + 8, usec_read32(entry), out);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	const unsigned char* index = entries + (size_t)count * ENTRY_SIZE;
+	uint32_t mask = index_size - 1;
+	for (uint32_t probe = 0, slot = hash & mask; probe < index_size; ++probe, slot = (slot + 1) & mask) {
+		uint32_t pos = usec_read32(index + (size_t)slot * 4);
+		if (pos == 0 || pos > count) return false;
+		const unsigned char* entry = entries + (size_t)(pos - 1) * ENTRY_SIZE;
+		if (usec_read32(entry + 4) != hash) continue;
+		size_t key_length;
+		const char* name = string_at(ref->bin, usec_read32(entry), &key_length);
+		if (name && key_length == length && memcmp(name, key, length) == 0) {
+			make_ref(ref->bin, entry + 8, usec_read32(entry), out);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool usec_binary_at(const USEC_BinaryRef* ref, size_t index, USEC_BinaryRef* out) {
+	uint32_t count;
+	const unsigned char* block;
+	if ((block = container(ref, VALUE_ARRAY, &count)) != NULL) {
+		if (index >= count) return false;
+		make_ref(ref->bin, block + 4 + index * SLOT_SIZE, 0, out);
+		return true;
+	}
+	if ((block = container(ref, VALUE_OBJECT, &count)) != NULL) {
+		if (index >= count) return false;
+		const unsigned char* entry = block + 8 + index * ENTRY_SIZE;
+		make_ref(ref->bin, entry + 8, usec_read32(entry), out);
+		return true;
+	}
+	return false;
+}
+
+const char* usec_binary_key(const USEC_BinaryRef* ref) {
+	if (!ref->key) return NULL;
+	return string_at(ref->bin, ref->key, NULL);
+}
+
+bool usec_binary_bool(const USEC_BinaryRef* ref) {
+	return usec_binary_type(ref) == VALUE_BOOL && payload(ref) != 0;
+}
+
+char usec_binary_char(const USEC_BinaryRef* ref) {
+	return usec_binary_type(ref) == VALUE_CHAR ? (char)payload(ref) : '\0';
+}
+
+// The 8 bytes of an out of line number, zero if they don't fit in the data
+static uint64_t number_bits(const USEC_BinaryRef* ref) {
+	const unsigned char* p = at(ref->bin, payload(ref), 8);
+	return p ? usec_read64(p) : 0;
+}
+
+int64_t usec_binary_int(const USEC_BinaryRef* ref) {
+	switch (usec_binary_type(ref)) {
+	case VALUE_INT:
+		if (flags(ref) & SLOT_INLINE) return (int32_t)payload(ref);
+		return (int64_t)number_bits(ref);
+	case VALUE_UINT:
+		if (flags(ref) & SLOT_INLINE) return payload(ref);
+		return (int64_t)number_bits(ref);
+	default:
+		return 0;
+	}
+}
+
+uint64_t usec_binary_uint(const USEC_BinaryRef* ref) {
+	switch (usec_binary_type(ref)) {
+	case VALUE_UINT:
+		if (flags(ref) & SLOT_INLINE) return payload(ref);
+		return number_bits(ref);
+	case VALUE_INT:
+		return (uint64_t)usec_binary_int(ref);
+	default:
+		return 0;
+	}
+}
+
+double usec_binary_double(const USEC_BinaryRef* ref) {
+	switch (usec_binary_type(ref)) {
+	case VALUE_DOUBLE:
+		if (flags(ref) & SLOT_FLOAT) {
+			float f;
+			uint32_t bits = payload(ref);
+			memcpy(&f, &bits, 4);
+			return f;
+		} else {
+			double d;
+			uint64_t bits = number_bits(ref);
+			memcpy(&d, &bits, 8);
+			return d;
+		}
+	case VALUE_INT:
+		return (double)usec_binary_int(ref);
+	case VALUE_UINT:
+		return (double)usec_binary_uint(ref);
+	default:
+		return 0;
+	}
+}
+
+const char* usec_binary_string(const USEC_BinaryRef* ref, size_t* length) {
+	if (length) *length = 0;
+	if (usec_binary_type(ref) != VALUE_STRING) return NULL;
+	return string_at(ref->bin, payload(ref), length);
+}
+
+// budget is the number of slots left to read. Valid data has no more slots than fit in it,
+// damaged data can refer to a container from several slots and would otherwise grow exponentially.
+static USEC_Value* read_value(const USEC_BinaryRef* ref, size_t* budget) {
+	USEC_ValueType type = usec_binary_type(ref);
+	USEC_Value* value = malloc(sizeof(USEC_Value));
+	value->type = type;
+	value->flags = 0;
+	if (*budget == 0) type = value->type = VALUE_NULL;
+	else --*budget;
+
+	switch (type) {
+	case VALUE_NULL:
+		break;
+	case VALUE_BOOL:
+		value->boolValue = usec_binary_bool(ref);
+		break;
+	case VALUE_CHAR:
+		value->charValue = usec_binary_char(ref);
+		break;
+	case VALUE_INT:
+		value->int64Value = usec_binary_int(ref);
+		break;
+	case VALUE_UINT:
+		value->uint64Value = usec_binary_uint(ref);
+		break;
+	case VALUE_DOUBLE:
+		value->doubleValue = usec_binary_double(ref);
+		break;
+	case VALUE_STRING: {
+		size_t length;
+		const char* str = usec_binary_string(ref, &length);
+		value->stringValue = str ? usec_strndup(str, length) : strdup("");
+		break;
+	}
+	case VALUE_ARRAY: {
+		size_t count = usec_binary_count(ref);
+		value->arrayValue.count = count;
+		value->arrayValue.items = count ? malloc(sizeof(USEC_Value*) * count) : NULL;
+		for (size_t i = 0; i < count; ++i) {
+			USEC_BinaryRef item;
+			usec_binary_at(ref, i, &item);
+			value->arrayValue.items[i] = read_value(&item, budget);
+		}
+		break;
+	}
+	case VALUE_OBJECT: {
+		size_t count = usec_binary_count(ref);
+		value->objectValue = usec_ht_create(count);
+		for (size_t i = 0; i < count; ++i) {
+			USEC_BinaryRef member;
+			usec_binary_at(ref, i, &member);
+			const char* key = usec_binary_key(&member);
+			usec_ht_set(value->objectValue, key ? key : "", read_value(&member, budget));
+		}
+		break;
+	}
+	default:
+		// Not written by usec_to_binary, the data is damaged
+		value->type = VALUE_NULL;
+		break;
+	}
+	return value;
+}
+
+USEC_Value* usec_binary_value(const USEC_BinaryRef* ref) {
+	size_t budget = ref->bin->length / SLOT_SIZE;
+	return read_value(ref, &budget);
+}
@@ -0,0 +1,65 @@
+#ifndef USEC_BITS_H
+#define USEC_BITS_H
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#pragma intrinsic(_umul128)
+#pragma intrinsic(_BitScanReverse64)
+#endif
+
+// Full 64x64 -> 128 bit product, returns the low half and stores the high half in hi
+static inline uint64_t usec_mul128(uint64_t a, uint64_t b, uint64_t* hi) {
+#if defined(__SIZEOF_INT128__)
+	__uint128_t r = (__uint128_t)a * b;
+	*hi = (uint64_t)(r >> 64);
+	return (uint64_t)r;
+#elif defined(_MSC_VER) && defined(_M_X64)
+	return _umul128(a, b, hi);
+#else
+	uint64_t a_lo = (uint32_t)a, a_hi = a >> 32;
+	uint64_t b_lo = (uint32_t)b, b_hi = b >> 32;
+	uint64_t lo_lo = a_lo * b_lo;
+	uint64_t hi_lo = a_hi * b_lo;
+	uint64_t lo_hi = a_lo * b_hi;
+	uint64_t hi_hi = a_hi * b_hi;
+	uint64_t cross = (lo_lo >> 32) + (uint32_t)hi_lo + lo_hi;
+	*hi = hi_hi + (hi_lo >> 32) + (cross >> 32);
+	return (cross << 32) | (uint32_t)lo_lo;
+#endif
+}
+
+// Leading zero bits of a nonzero value
+static inline int usec_clz64(uint64_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_clzll(v);
+#elif defined(_MSC_VER) && defined(_M_X64)
+	unsigned long index;
+	_BitScanReverse64(&index, v);
+	return 63 - (int)index;
+#else
+	int n = 0;
+	while (!(v & 0x8000000000000000ull)) {
+		v <<= 1;
+		n++;
+	}
+	return n;
+#endif
+}
+
+// Unaligned native endian loads
+static inline uint64_t usec_read64(const void* p) {
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint32_t usec_read32(const void* p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+#endif
@@ -0,0 +1,196 @@
+#include "cache.h"
+#include "context.h"
+#include "hash.h"
+#include "mapping.h"
+#include "thread.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+// Cache files are binary documents holding [root, variables], after a 128-bit hash of the document so
+// damaged files are misses. The variables are the caller's table after the parse, so a hit can declare
+// the same variables into it. Only parses without errors are cached, a parse with errors runs again
+// every time so they're printed as usual.
+
+#define CACHE_SEED_LO 0x9e3779b97f4a7c15ull
+#define CACHE_SEED_HI 0xc2b2ae3d27d4eb4full
+
+// Bumped whenever the file layout changes or a parse of the same input could give a different tree
+#define CACHE_FORMAT 2
+
+// Bytes of the hash before the binary document
+#define CACHE_CHECK_SIZE 16
+
+static USEC_Once temp_once = USEC_ONCE_INIT;
+static USEC_Mutex temp_mutex;
+static unsigned long temp_counter;
+
+static void temp_init(void) {
+	usec_mutex_init(&temp_mutex);
+}
+
+// Both halves of a 128-bit hash of the bytes
+static void hash128(const void* data, size_t length, uint64_t out[2]) {
+	out[0] = usec_hash_with_seed(data, length, CACHE_SEED_LO);
+	out[1] = usec_hash_with_seed(data, length, CACHE_SEED_HI);
+}
+
+// Appends the cache file path of the input to sb. False if the variables can't be hashed.
+static bool cache_path(SB* sb, const char* input, size_t length, const USEC_ParseOptions* options) {
+	// The key covers the input, the options that change the tree and the injected variables
+	uint64_t key[7] = { CACHE_FORMAT, options->pedantic, options->keepVariables, 0, 0, 0, 0 };
+	hash128(input, length, key + 3);
+	if (options->variables) {
+		USEC_Value vars = { .type = VALUE_OBJECT, .objectValue = options->variables };
+		size_t size;
+		char* data = usec_to_binary(&vars, &size);
+		if (!data) return false;
+		hash128(data, size, key + 5);
+		free(data);
+	}
+
+	uint64_t name[2];
+	hash128(key, sizeof(key), name);
+
+	sb_append_str(sb, options->cacheDir);
+	if (sb->length > 0 && sb->buffer[sb->length - 1] != '/' && sb->buffer[sb->length - 1] != '\\') sb_append_char(sb, '/');
+	char file[40];
+	snprintf(file, sizeof(file), "%016llx%016llx.useb", (unsigned long long)name[0], (unsigned long long)name[1]);
+	sb_append_str(sb, file);
+	return true;
+}
+
+// Reads a cached tree, declaring the cached variables into options->variables. NULL on a miss.
+static USEC_Value* load(const char* path, const USEC_ParseOptions* options) {
+	USEC_FileMapping mapping;
+	if (!usec_map_file(path, &mapping)) return NULL;
+	uint64_t check[2];
+	USEC_Binary* bin = NULL;
+	if (mapping.length > CACHE_CHECK_SIZE) {
+		hash128(mapping.data + CACHE_CHECK_SIZE, mapping.length - CACHE_CHECK_SIZE, check);
+		if (memcmp(mapping.data, check, CACHE_CHECK_SIZE) == 0) {
+			bin = usec_binary_from(mapping.data + CACHE_CHECK_SIZE, mapping.length - CACHE_CHECK_SIZE);
+		}
+	}
+	if (!bin) {
+		usec_unmap_file(&mapping);
+		return NULL;
+	}
+
+	USEC_BinaryRef root, value, vars;
+	USEC_Value* result = NULL;
+	usec_binary_root(bin, &root);
+	if (usec_binary_count(&root) == 2 && usec_binary_at(&root, 0, &value) && usec_binary_at(&root, 1, &vars) &&
+		usec_binary_type(&value) != VALUE_NULL && usec_binary_type(&vars) == (options->variables ? VALUE_OBJECT : VALUE_NULL)) {
+		result = usec_binary_value(&value);
+		if (options->packArrays) usec_pack(result); // stored unpacked
+		size_t count = usec_binary_count(&vars);
+		for (size_t i = 0; i < count; ++i) {
+			USEC_BinaryRef var;
+			usec_binary_at(&vars, i, &var);
+			const char* key = usec_binary_key(&var);
+			if (key) usec_ht_set(options->variables, key, usec_binary_value(&var));
+		}
+	}
+	usec_binary_close(bin);
+	usec_unmap_file(&mapping);
+	return result;
+}
+
+// Writes to a temporary file next to the cache file and renames it, so readers never see a partial file.
+// Failures only mean the next parse misses too.
+static void store(const char* path, const USEC_Value* value, const USEC_ParseOptions* options) {
+	USEC_Value vars = { .type = VALUE_OBJECT, .objectValue = options->variables };
+	USEC_Value null_value = { .type = VALUE_NULL };
+	USEC_Value* items[2] = { (USEC_Value*)value, options->variables ? &vars : &null_value };
+	USEC_Value entry = { .type = VALUE_ARRAY, .arrayValue = { items, 2 } };
+
+	size_t size;
+	char* data = usec_to_binary(&entry, &size);
+	if (!data) return;
+
+	usec_once(&temp_once, temp_init);
+	usec_mutex_lock(&temp_mutex);
+	unsigned long counter = temp_counter++;
+	usec_mutex_unlock(&temp_mutex);
+
+	SB temp;
+	sb_init(&temp);
+	sb_append_str(&temp, path);
+	char suffix[64];
+#ifdef _WIN32
+	snprintf(suffix, sizeof(suffix), ".%lu.%lu.tmp", (unsigned long)GetCurrentProcessId(), counter);
+#else
+	snprintf(suffix, sizeof(suffix), ".%ld.%lu.tmp", (long)getpid(), counter);
+#endif
+	sb_append_str(&temp, suffix);
+
+	uint64_t check[2];
+	hash128(data, size, check);
+
+	FILE* file = fopen(temp.buffer, "wb");
+	bool ok = file && fwrite(check, 1, CACHE_CHECK_SIZE, file) == CACHE_CHECK_SIZE && fwrite(data, 1, size, file) == size;
+	if (file && fclose(file) != 0) ok = false;
+	if (ok) {
+#ifdef _WIN32
+		ok = MoveFileExA(temp.buffer, path, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+		ok = rename(temp.buffer, path) == 0;
+#endif
+	}
+	if (file && !ok) remove(temp.buffer);
+
+	sb_free(&temp);
+	free(data);
+}
+
+USEC_Value* usec_cache_parse(const char* input, size_t length, const USEC_ParseOptions* options) {
+	SB path;
+	sb_init(&path);
+	if (!cache_path(&path, input, length, options)) {
+		sb_free(&path);
+		return usec_parse_n(input, length, options);
+	}
+
+	USEC_Value* value = load(path.buffer, options);
+	if (value) {
+		sb_free(&path);
+		return value;
+	}
+
+	// Miss: parse collecting errors, so a parse with errors can run again to print them.
+	// Declarations go into a copy of the variables until the parse is known to be clean.
+	USEC_ParseOptions opts = *options;
+	if (options->variables) opts.variables = usec_ht_from(options->variables);
+	USEC_ErrorList errors;
+	usec_errors_init(&errors, options);
+	USEC_Context ctx;
+	usec_context_init(&ctx);
+	value = usec_context_run(&ctx, input, length, &opts, &errors);
+	usec_context_release(&ctx);
+
+	if (value && errors.count == 0 && !errors.truncated) {
+		store(path.buffer, value, &opts);
+		if (options->variables) {
+			for (size_t i = 0; i < opts.variables->size; ++i) {
+				Usec_HashNode* var = &opts.variables->entries[i];
+				usec_ht_set(options->variables, var->key, usec_clone(var->value));
+			}
+		}
+	} else {
+		usec_free(value);
+		value = usec_parse_n(input, length, options);
+	}
+	if (options->variables) usec_ht_free(opts.variables);
+	usec_errors_free(&errors);
+	sb_free(&path);
+	return value;
+}
@@ -0,0 +1,10 @@
+#ifndef USEC_CACHE_H
+#define USEC_CACHE_H
+
+#include <usec/usec.h>
+#include <stddef.h>
+
+// Parses like usec_parse_n, reusing the tree of an earlier parse of the same input from options->cacheDir
+USEC_Value* usec_cache_parse(const char* input, size_t length, const USEC_ParseOptions* options);
+
+#endif
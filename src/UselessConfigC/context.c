@@ -0,0 +1,181 @@
+#include "context.h"
+#include "mapping.h"
+#include "atom.h"
+#include <stdlib.h>
+#include <string.h>
+
+void usec_context_init(USEC_Context* ctx) {
+	usec_tokenizer_init(&ctx->tokenizer, NULL, 0, false, true, false);
+	usec_parser_init(&ctx->parser, &ctx->tokenizer, NULL);
+	ctx->spare_arena = NULL;
+	ctx->shared_variables = NULL;
+	ctx->push = NULL;
+}
+
+void usec_context_release(USEC_Context* ctx) {
+	usec_push_destroy(ctx->push);
+	usec_parser_free(&ctx->parser);
+	usec_tokenizer_destroy(&ctx->tokenizer);
+	usec_arena_destroy(ctx->spare_arena);
+}
+
+USEC_Value* usec_context_run(USEC_Context* ctx, const char* input, size_t length, const USEC_ParseOptions* options, USEC_ErrorList* errors) {
+	return usec_context_run_fragment(ctx, input, length, NULL, options, errors);
+}
+
+// Tokenizes the input, unless streaming, and readies the parser. False on a tokenizer error.
+static bool prepare(USEC_Context* ctx, const char* input, size_t length, const USEC_Fragment* fragment, const USEC_ParseOptions* options, USEC_ErrorList* errors, bool stream) {
+	// Tokenize
+	USEC_Tokenizer* tokenizer = &ctx->tokenizer;
+	usec_tokenizer_reset(tokenizer, input, length, fragment && fragment->compact, options->pedantic, options->debugTokens);
+	tokenizer->errors = errors;
+	if (fragment) {
+		tokenizer->fragment = true;
+		tokenizer->continued = fragment->continued;
+		tokenizer->line = fragment->line;
+		tokenizer->col = fragment->col;
+	}
+	tokenizer->streaming = stream;
+	if (stream) {
+		usec_tokenizer_start(tokenizer);
+	} else {
+		usec_tokenizer_tokenize(tokenizer);
+		if (tokenizer->has_error) return false;
+	}
+
+	USEC_Parser* parser = &ctx->parser;
+	usec_parser_reset(parser, tokenizer, options->variables);
+	parser->base = ctx->shared_variables;
+	parser->pedantic = options->pedantic;
+	parser->keep_variables = options->keepVariables;
+	parser->pack_arrays = options->packArrays;
+	parser->compact = tokenizer->compact;
+	parser->debug = options->debugParser;
+	parser->errors = errors;
+	return true;
+}
+
+// Lends the spare arena to the parser
+static void take_arena(USEC_Context* ctx) {
+	ctx->parser.arena = ctx->spare_arena ? ctx->spare_arena : usec_arena_create();
+	ctx->spare_arena = NULL;
+}
+
+// Failed arena parses leave the reset arena with the parser
+static void return_arena(USEC_Context* ctx) {
+	if (ctx->parser.arena) {
+		ctx->spare_arena = ctx->parser.arena;
+		ctx->parser.arena = NULL;
+	}
+}
+
+USEC_Value* usec_context_run_fragment(USEC_Context* ctx, const char* input, size_t length, const USEC_Fragment* fragment, const USEC_ParseOptions* options, USEC_ErrorList* errors) {
+	USEC_ParseOptions default_opts;
+	if (!options) {
+		default_opts = usec_get_default_parse_options();
+		options = &default_opts;
+	}
+
+	if (!prepare(ctx, input, length, fragment, options, errors, options->streaming)) return NULL;
+	if (options->useArena) take_arena(ctx);
+
+	USEC_Value* result = usec_parser_parse(&ctx->parser);
+	return_arena(ctx);
+	return result;
+}
+
+bool usec_context_check_fragment(USEC_Context* ctx, const char* input, size_t length, const USEC_Fragment* fragment, const USEC_ParseOptions* options, USEC_ErrorList* errors) {
+	return prepare(ctx, input, length, fragment, options, errors, false);
+}
+
+void usec_context_run_events(USEC_Context* ctx, const char* input, size_t length, const USEC_ParseOptions* options, USEC_ErrorList* errors, USEC_EventFn fn, void* user) {
+	USEC_ParseOptions opts = options ? *options : usec_get_default_parse_options();
+	// The caller's variables are only read, declarations live in the arena until the parse ends
+	Usec_Hashtable* variables = opts.variables;
+	opts.variables = NULL;
+
+	if (!prepare(ctx, input, length, NULL, &opts, errors, true)) return;
+	ctx->parser.base = variables;
+	take_arena(ctx);
+
+	usec_parser_emit(&ctx->parser, fn, user);
+	return_arena(ctx);
+}
+
+void usec_merge_root(USEC_Value* root, USEC_Value* part) {
+	USEC_Arena* arena = (root->flags & USEC_VALUE_ARENA_ROOT) ? usec_arena_of_root(root) : NULL;
+	Usec_Hashtable* entries = part->objectValue;
+	for (size_t i = 0; i < entries->size; ++i) {
+		Usec_HashNode* entry = &entries->entries[i];
+		// Keys are shared: heap keys are atoms, arena keys move into the root's arena with the part's
+		USEC_Value* old = usec_ht_swap_shared(root->objectValue, entry->key, strlen(entry->key), entry->hash, entry->value);
+		if (old && !arena) usec_free(old);
+		if (!arena) entry->value = NULL;
+	}
+
+	if (arena) usec_arena_merge(arena, usec_arena_of_root(part));
+	else usec_free(part);
+}
+
+USEC_ParseResult usec_context_run_file(USEC_Context* ctx, const char* path, const USEC_ParseOptions* options) {
+	USEC_ErrorList errors;
+	usec_errors_init(&errors, options);
+	if (!path) return usec_errors_result(NULL, &errors);
+
+	USEC_FileMapping mapping;
+	if (!usec_map_file(path, &mapping)) {
+		usec_errors_add_io(&errors, path);
+		return usec_errors_result(NULL, &errors);
+	}
+
+	USEC_Value* value = usec_context_run(ctx, mapping.data, mapping.length, options, &errors);
+	usec_unmap_file(&mapping);
+	return usec_errors_result(value, &errors);
+}
+
+// Public API
+
+USEC_Context* usec_context_create(void) {
+	USEC_Context* ctx = malloc(sizeof(USEC_Context));
+	if (!ctx) return NULL;
+	usec_context_init(ctx);
+	return ctx;
+}
+
+void usec_context_destroy(USEC_Context* ctx) {
+	if (!ctx) return;
+	usec_context_release(ctx);
+	free(ctx);
+}
+
+USEC_Value* usec_context_parse(USEC_Context* ctx, const char* input, size_t length, const USEC_ParseOptions* options) {
+	if (!input) return NULL;
+	return usec_context_run(ctx, input, length, options, NULL);
+}
+
+USEC_ParseResult usec_context_parse_result(USEC_Context* ctx, const char* input, size_t length, const USEC_ParseOptions* options) {
+	USEC_ErrorList errors;
+	usec_errors_init(&errors, options);
+	USEC_Value* value = input ? usec_context_run(ctx, input, length, options, &errors) : NULL;
+	return usec_errors_result(value, &errors);
+}
+
+USEC_ParseResult usec_context_parse_events(USEC_Context* ctx, const char* input, size_t length, const USEC_ParseOptions* options, USEC_EventFn fn, void* user) {
+	USEC_ErrorList errors;
+	usec_errors_init(&errors, options);
+	if (input && fn) usec_context_run_events(ctx, input, length, options, &errors, fn, user);
+	return usec_errors_result(NULL, &errors);
+}
+
+void usec_context_free(USEC_Context* ctx, USEC_Value* root) {
+	if (!root) return;
+
+	// Keep the arena of the document for the next arena parse
+	if ((root->flags & USEC_VALUE_ARENA_ROOT) && !ctx->spare_arena) {
+		USEC_Arena* arena = usec_arena_of_root(root);
+		usec_arena_reset(arena);
+		ctx->spare_arena = arena;
+		return;
+	}
+	usec_free(root);
+}
@@ -0,0 +1,50 @@
+#ifndef USEC_CONTEXT_H
+#define USEC_CONTEXT_H
+
+#include <usec/usec.h>
+#include "tokenizer.h"
+#include "parser.h"
+#include "arena.h"
+#include "errors.h"
+
+// Piece of a larger document, cut after a top-level newline
+typedef struct {
+	bool compact; // the document starts with the compact marker
+	bool continued; // more of the document follows, so the newline ending the piece is kept
+	int line; // position of the piece in the document
+	int col;
+} USEC_Fragment;
+
+// State of a push parse, see push.c
+typedef struct USEC_Push USEC_Push;
+
+// Tokenizer and parser whose buffers are kept between parses
+struct USEC_Context {
+	USEC_Tokenizer tokenizer;
+	USEC_Parser parser;
+	USEC_Arena* spare_arena; // reset arena of a released document, used by the next arena parse
+	Usec_Hashtable* shared_variables; // read-only variables looked up below the global scope, see usec_parse_many
+	USEC_Push* push; // push parse in progress, see usec_feed
+};
+
+void usec_context_init(USEC_Context* ctx);
+void usec_context_release(USEC_Context* ctx);
+
+// Parses a document. With an error list, errors are collected into it instead of printed.
+USEC_Value* usec_context_run(USEC_Context* ctx, const char* input, size_t length, const USEC_ParseOptions* options, USEC_ErrorList* errors);
+// Parses a fragment of a document like a document of its own
+USEC_Value* usec_context_run_fragment(USEC_Context* ctx, const char* input, size_t length, const USEC_Fragment* fragment, const USEC_ParseOptions* options, USEC_ErrorList* errors);
+// Only tokenizes a fragment, for its errors. False if it has any.
+bool usec_context_check_fragment(USEC_Context* ctx, const char* input, size_t length, const USEC_Fragment* fragment, const USEC_ParseOptions* options, USEC_ErrorList* errors);
+// Parses a document into events, see usec_parse_events
+void usec_context_run_events(USEC_Context* ctx, const char* input, size_t length, const USEC_ParseOptions* options, USEC_ErrorList* errors, USEC_EventFn fn, void* user);
+// Moves the entries of the root object of a fragment into the one of an earlier fragment, later keys replacing
+// earlier ones, and frees it. Both are arena roots or neither is.
+void usec_merge_root(USEC_Value* root, USEC_Value* part);
+// Parses a memory-mapped file, collecting errors
+USEC_ParseResult usec_context_run_file(USEC_Context* ctx, const char* path, const USEC_ParseOptions* options);
+
+// Frees the state of a push parse, with the document parsed so far
+void usec_push_destroy(USEC_Push* push);
+
+#endif
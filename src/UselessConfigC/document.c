@@ -0,0 +1,457 @@
+#include "tokenizer.h"
+#include "parser.h"
+#include "errors.h"
+#include "mapping.h"
+#include "arena.h"
+#include "hash.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Objects up to this size are searched by scanning their members, without an index
+#define NODE_LINEAR_MAX 8
+
+// Value in an indexed container. Array items have no key.
+typedef struct {
+	const char* key;
+	size_t key_length;
+	uint64_t hash;
+	size_t token; // first token of the value, 0 for the top level of the file
+	size_t decls; // declarations of the object that precede the member
+	size_t node; // node of a container value + 1 once it's indexed
+	USEC_Value* value; // set once materialized
+	bool failed; // the value has errors
+} Member;
+
+typedef struct {
+	const char* key;
+	size_t key_length;
+	uint64_t hash;
+	USEC_Value* value;
+} Declaration;
+
+// Container whose members were indexed. Declarations are parsed when it's indexed, members when they're read.
+typedef struct {
+	bool object;
+	size_t scope; // node + 1 of the object whose declarations are visible at this container, 0 for none
+	size_t scope_decls; // how many of them
+
+	Member* members;
+	size_t count;
+	size_t capacity;
+	uint32_t* index; // member position + 1 per slot, for objects too large to scan
+	size_t index_capacity;
+
+	Declaration* decls;
+	size_t decl_count;
+	size_t decl_capacity;
+} Node;
+
+struct USEC_Document {
+	USEC_FileMapping mapping;
+	bool mapped;
+	bool valid; // tokenized without errors
+	bool keep_variables;
+
+	USEC_Tokenizer tokenizer;
+	USEC_Parser parser;
+	USEC_Arena* arena; // values and keys, freed with the document
+	USEC_ErrorList errors;
+
+	Member root;
+	Node* nodes;
+	size_t node_count;
+	size_t node_capacity;
+
+	Usec_Hashtable** scopes; // local scope tables by depth, rebuilt for every parse. [0] is unused.
+	size_t scope_count;
+	size_t* chain; // node and declaration count per scope, while enter_scope rebuilds them
+	size_t chain_capacity;
+};
+
+// Indexing state passed to the scan callback
+typedef struct {
+	USEC_Document* doc;
+	size_t node;
+	Usec_Hashtable* scope; // the node's own declarations, on the parser's scope stack
+} Indexer;
+
+static Node* node_at(USEC_Document* doc, size_t node) {
+	return &doc->nodes[node - 1];
+}
+
+static Member* cursor_member(const USEC_Cursor* cursor) {
+	USEC_Document* doc = cursor->doc;
+	return cursor->node ? &node_at(doc, cursor->node)->members[cursor->member] : &doc->root;
+}
+
+// === Scopes ===
+
+// Scope table for the depth, emptied by leave_scope
+static Usec_Hashtable* scope_table(USEC_Document* doc, size_t depth) {
+	if (depth >= doc->scope_count) {
+		size_t count = doc->scope_count ? doc->scope_count * 2 : 16;
+		while (count <= depth) count *= 2;
+		doc->scopes = realloc(doc->scopes, sizeof(Usec_Hashtable*) * count);
+		memset(doc->scopes + doc->scope_count, 0, sizeof(Usec_Hashtable*) * (count - doc->scope_count));
+		doc->scope_count = count;
+	}
+	if (!doc->scopes[depth]) doc->scopes[depth] = usec_ht_create(8);
+	return doc->scopes[depth];
+}
+
+// Rebuilds the parser's scope stack as it is inside the node after its first decls declarations
+static void enter_scope(USEC_Document* doc, size_t node, size_t decls) {
+	USEC_Parser* p = &doc->parser;
+	Usec_Hashtable* globals = p->var_stack[0].vars;
+
+	// Scopes innermost first. The top level of the file is the global scope, others only count once they declared something.
+	size_t depth = 0;
+	size_t global_decls = 0;
+	while (node) {
+		Node* n = node_at(doc, node);
+		if (node == doc->root.node && doc->root.token == 0) {
+			global_decls = decls;
+		} else if (decls > 0) {
+			if (depth * 2 + 2 > doc->chain_capacity) {
+				doc->chain_capacity = doc->chain_capacity ? doc->chain_capacity * 2 : 32;
+				doc->chain = realloc(doc->chain, sizeof(size_t) * doc->chain_capacity);
+			}
+			doc->chain[depth * 2] = node;
+			doc->chain[depth * 2 + 1] = decls;
+			++depth;
+		}
+		decls = n->scope_decls;
+		node = n->scope;
+	}
+
+	Node* file = global_decls ? node_at(doc, doc->root.node) : NULL;
+	for (size_t i = 0; i < global_decls; ++i) {
+		Declaration* decl = &file->decls[i];
+		usec_ht_set_hashed(globals, decl->key, decl->key_length, decl->hash, decl->value);
+	}
+
+	while (depth > 0) {
+		--depth;
+		Node* n = node_at(doc, doc->chain[depth * 2]);
+		Usec_Hashtable* scope = scope_table(doc, p->var_stack_size);
+		for (size_t i = 0; i < doc->chain[depth * 2 + 1]; ++i) {
+			Declaration* decl = &n->decls[i];
+			usec_ht_set_hashed(scope, decl->key, decl->key_length, decl->hash, decl->value);
+		}
+		usec_parser_push_scope(p, scope);
+	}
+}
+
+// Empties the scope tables. Their values live in the arena and stay.
+static void leave_scope(USEC_Document* doc) {
+	USEC_Parser* p = &doc->parser;
+	for (size_t i = 0; i < p->var_stack_size; ++i) {
+		usec_ht_clear(p->var_stack[i].vars);
+	}
+	while (p->var_stack_size > 1) usec_parser_pop_scope(p);
+}
+
+// === Indexing ===
+
+static Member* add_member(Node* node) {
+	if (node->count >= node->capacity) {
+		node->capacity = node->capacity ? node->capacity * 2 : 8;
+		node->members = realloc(node->members, sizeof(Member) * node->capacity);
+	}
+	Member* member = &node->members[node->count++];
+	memset(member, 0, sizeof(Member));
+	return member;
+}
+
+static void add_declaration(Node* node, const Member* key, USEC_Value* value) {
+	if (node->decl_count >= node->decl_capacity) {
+		node->decl_capacity = node->decl_capacity ? node->decl_capacity * 2 : 4;
+		node->decls = realloc(node->decls, sizeof(Declaration) * node->decl_capacity);
+	}
+	node->decls[node->decl_count++] = (Declaration){ key->key, key->key_length, key->hash, value };
+}
+
+static void index_statement(void* arg, USEC_Parser* p, const USEC_Statement* stmt) {
+	Indexer* indexer = arg;
+	USEC_Document* doc = indexer->doc;
+	Node* node = node_at(doc, indexer->node);
+	Member* member = add_member(node);
+	member->token = stmt->value_index;
+	member->decls = node->decl_count;
+	if (stmt->type == STATEMENT_ITEM) return;
+
+	const char* key = usec_parser_statement_key(p, stmt);
+	member->key = usec_arena_strndup(doc->arena, key, stmt->key_length);
+	member->key_length = stmt->key_length;
+	member->hash = stmt->key_hash;
+	if (stmt->type != STATEMENT_DECLARATION) return;
+
+	// Declarations are in scope for the statements after them
+	add_declaration(node, member, stmt->value);
+	usec_ht_set_hashed(indexer->scope, member->key, member->key_length, member->hash, stmt->value);
+
+	if (doc->keep_variables) {
+		// Kept as a member named $key, like usec_parse does
+		char* name = usec_arena_alloc(doc->arena, stmt->key_length + 2);
+		name[0] = '$';
+		memcpy(name + 1, member->key, stmt->key_length + 1);
+		member->key = name;
+		member->key_length = stmt->key_length + 1;
+		member->hash = usec_hash(name, member->key_length);
+		member->value = stmt->value;
+	} else {
+		node->count--;
+	}
+}
+
+static Member* find_member(const Node* node, const char* key, size_t length, uint64_t hash) {
+	if (!node->index) {
+		for (size_t i = 0; i < node->count; ++i) {
+			Member* member = &node->members[i];
+			if (member->hash == hash && member->key_length == length && memcmp(member->key, key, length) == 0) return member;
+		}
+		return NULL;
+	}
+
+	size_t mask = node->index_capacity - 1;
+	for (size_t slot = (size_t)hash & mask; node->index[slot]; slot = (slot + 1) & mask) {
+		Member* member = &node->members[node->index[slot] - 1];
+		if (member->hash == hash && member->key_length == length && memcmp(member->key, key, length) == 0) return member;
+	}
+	return NULL;
+}
+
+// Later members with the key of an earlier one replace its value in place, like usec_ht_set does
+static void finish_object(Node* node) {
+	size_t total = node->count;
+	if (total > NODE_LINEAR_MAX) {
+		node->index_capacity = 16;
+		while (total * 4 > node->index_capacity * 3) node->index_capacity *= 2;
+		node->index = calloc(node->index_capacity, sizeof(uint32_t));
+	}
+
+	node->count = 0;
+	for (size_t i = 0; i < total; ++i) {
+		Member member = node->members[i];
+		Member* existing = find_member(node, member.key, member.key_length, member.hash);
+		if (existing) {
+			existing->token = member.token;
+			existing->decls = member.decls;
+			existing->value = member.value;
+			continue;
+		}
+
+		node->members[node->count++] = member;
+		if (node->index) {
+			size_t mask = node->index_capacity - 1;
+			size_t slot = (size_t)member.hash & mask;
+			while (node->index[slot]) slot = (slot + 1) & mask;
+			node->index[slot] = (uint32_t)node->count;
+		}
+	}
+}
+
+// Node of the container the cursor points at, indexed on first use. 0 if it isn't a container or fails.
+static size_t node_of(const USEC_Cursor* cursor) {
+	USEC_Document* doc = cursor->doc;
+	Member* member = cursor_member(cursor);
+	if (member->node) return member->node;
+
+	size_t token = member->token;
+	USEC_TokenType type = doc->tokenizer.tokens[token].type;
+	if (token != 0 && type != TOK_BRACE_OPEN && type != TOK_ARRAY_OPEN) return 0;
+
+	if (doc->node_count >= doc->node_capacity) {
+		doc->node_capacity = doc->node_capacity ? doc->node_capacity * 2 : 16;
+		doc->nodes = realloc(doc->nodes, sizeof(Node) * doc->node_capacity);
+		member = cursor_member(cursor);
+	}
+	size_t index = ++doc->node_count;
+	Node* node = node_at(doc, index);
+	memset(node, 0, sizeof(Node));
+	node->object = type != TOK_ARRAY_OPEN;
+
+	// Scope at the container: the declarations of the enclosing object before it
+	if (cursor->node) {
+		Node* parent = node_at(doc, cursor->node);
+		node->scope = parent->object ? cursor->node : parent->scope;
+		node->scope_decls = parent->object ? member->decls : parent->scope_decls;
+	}
+	member->node = index;
+
+	USEC_Parser* p = &doc->parser;
+	enter_scope(doc, node->scope, node->scope_decls);
+	Indexer indexer = { doc, index, p->var_stack[0].vars };
+	if (token != 0) {
+		// Scope table of the container's own declarations
+		indexer.scope = scope_table(doc, p->var_stack_size);
+		usec_parser_push_scope(p, indexer.scope);
+	}
+
+	usec_parser_scan(p, token, index_statement, &indexer);
+	leave_scope(doc);
+
+	node = node_at(doc, index);
+	if (node->object) finish_object(node);
+	return index;
+}
+
+// === Public API ===
+
+USEC_Document* usec_document_parse(const char* input, size_t length, const USEC_ParseOptions* options) {
+	USEC_Document* doc = calloc(1, sizeof(USEC_Document));
+	if (!doc) return NULL;
+	USEC_ParseOptions opts = options ? *options : usec_get_default_parse_options();
+	usec_errors_init(&doc->errors, &opts);
+	doc->errors.unique = true; // values that fail are found again when an enclosing container is read
+	doc->keep_variables = opts.keepVariables;
+	doc->arena = usec_arena_create();
+
+	usec_tokenizer_init(&doc->tokenizer, input, length, false, opts.pedantic, opts.debugTokens);
+	usec_parser_init(&doc->parser, &doc->tokenizer, NULL);
+	if (!input) return doc;
+
+	USEC_Tokenizer* tokenizer = &doc->tokenizer;
+	tokenizer->errors = &doc->errors;
+	usec_tokenizer_tokenize(tokenizer);
+	if (tokenizer->has_error) return doc;
+
+	USEC_Parser* parser = &doc->parser;
+	usec_parser_reset(parser, tokenizer, NULL);
+	parser->base = opts.variables;
+	parser->pedantic = opts.pedantic;
+	parser->keep_variables = opts.keepVariables;
+	parser->pack_arrays = opts.packArrays;
+	parser->compact = tokenizer->compact;
+	parser->errors = &doc->errors;
+	parser->arena = doc->arena;
+
+	// The top level of the file, or the root value after '!'
+	bool has_root = tokenizer->token_count > 1 && tokenizer->tokens[1].type == TOK_EXCLAMATION;
+	doc->root.token = has_root ? 2 : 0;
+	doc->valid = true;
+	return doc;
+}
+
+USEC_Document* usec_document_open(const char* path, const USEC_ParseOptions* options) {
+	USEC_FileMapping mapping;
+	if (!path || !usec_map_file(path, &mapping)) {
+		USEC_Document* doc = usec_document_parse(NULL, 0, options);
+		if (doc && path) usec_errors_add_io(&doc->errors, path);
+		return doc;
+	}
+
+	USEC_Document* doc = usec_document_parse(mapping.data, mapping.length, options);
+	if (!doc) {
+		usec_unmap_file(&mapping);
+		return NULL;
+	}
+	doc->mapping = mapping;
+	doc->mapped = true;
+	return doc;
+}
+
+void usec_document_free(USEC_Document* doc) {
+	if (!doc) return;
+
+	for (size_t i = 0; i < doc->node_count; ++i) {
+		free(doc->nodes[i].members);
+		free(doc->nodes[i].index);
+		free(doc->nodes[i].decls);
+	}
+	free(doc->nodes);
+	for (size_t i = 0; i < doc->scope_count; ++i) {
+		if (doc->scopes[i]) usec_ht_free(doc->scopes[i]);
+	}
+	free(doc->scopes);
+	free(doc->chain);
+
+	doc->parser.arena = NULL;
+	usec_parser_free(&doc->parser);
+	usec_tokenizer_destroy(&doc->tokenizer);
+	usec_arena_destroy(doc->arena);
+	usec_errors_free(&doc->errors);
+	if (doc->mapped) usec_unmap_file(&doc->mapping);
+	free(doc);
+}
+
+const USEC_Error* usec_document_errors(const USEC_Document* doc, size_t* count) {
+	*count = doc->errors.count;
+	return doc->errors.items;
+}
+
+bool usec_document_root(USEC_Document* doc, USEC_Cursor* out) {
+	if (!doc || !doc->valid) return false;
+	*out = (USEC_Cursor){ doc, 0, 0 };
+	return true;
+}
+
+USEC_Value* usec_cursor_value(const USEC_Cursor* cursor) {
+	USEC_Document* doc = cursor->doc;
+	Member* member = cursor_member(cursor);
+	if (member->value || member->failed) return member->value;
+
+	Node* node = cursor->node ? node_at(doc, cursor->node) : NULL;
+	if (!node) enter_scope(doc, 0, 0);
+	else if (node->object) enter_scope(doc, cursor->node, member->decls);
+	else enter_scope(doc, node->scope, node->scope_decls);
+	USEC_Value* value = usec_parser_parse_at(&doc->parser, member->token);
+	leave_scope(doc);
+
+	member = cursor_member(cursor);
+	member->value = value;
+	member->failed = !value;
+	return value;
+}
+
+USEC_ValueType usec_cursor_type(const USEC_Cursor* cursor) {
+	USEC_Document* doc = cursor->doc;
+	Member* member = cursor_member(cursor);
+	if (member->value) return member->value->type;
+	if (member->token == 0) return VALUE_OBJECT;
+
+	USEC_Token* tok = &doc->tokenizer.tokens[member->token];
+	switch (tok->type) {
+	case TOK_BRACE_OPEN: return VALUE_OBJECT;
+	case TOK_ARRAY_OPEN: return VALUE_ARRAY;
+	case TOK_CHAR: return VALUE_CHAR;
+	case TOK_STRING_START:
+	case TOK_IDENTIFIER: // variables are read as strings
+		return VALUE_STRING;
+	case TOK_KEYWORD:
+		return tok->length == 4 && memcmp(usec_token_text(&doc->tokenizer, tok), "null", 4) == 0 ? VALUE_NULL : VALUE_BOOL;
+	default: {
+		// Numbers are cheap, whether one is an int or a double is only known once it's read
+		USEC_Value* value = usec_cursor_value(cursor);
+		return value ? value->type : VALUE_NULL;
+	}
+	}
+}
+
+size_t usec_cursor_count(const USEC_Cursor* cursor) {
+	size_t node = node_of(cursor);
+	return node ? node_at(cursor->doc, node)->count : 0;
+}
+
+bool usec_cursor_at(const USEC_Cursor* cursor, size_t index, USEC_Cursor* out) {
+	size_t node = node_of(cursor);
+	if (!node || index >= node_at(cursor->doc, node)->count) return false;
+	*out = (USEC_Cursor){ cursor->doc, node, index };
+	return true;
+}
+
+bool usec_cursor_get(const USEC_Cursor* cursor, const char* key, USEC_Cursor* out) {
+	size_t node = node_of(cursor);
+	if (!node || !node_at(cursor->doc, node)->object) return false;
+
+	Node* n = node_at(cursor->doc, node);
+	size_t length = strlen(key);
+	Member* member = find_member(n, key, length, usec_hash(key, length));
+	if (!member) return false;
+	*out = (USEC_Cursor){ cursor->doc, node, (size_t)(member - n->members) };
+	return true;
+}
+
+const char* usec_cursor_key(const USEC_Cursor* cursor) {
+	return cursor->node ? cursor_member(cursor)->key : NULL;
+}
@@ -0,0 +1,67 @@
+#include "errors.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+void usec_errors_init(USEC_ErrorList* list, const USEC_ParseOptions* options) {
+	list->items = NULL;
+	list->count = 0;
+	list->capacity = 0;
+	list->max = options ? options->maxErrors : usec_get_default_parse_options().maxErrors;
+	list->truncated = false;
+	list->unique = false;
+}
+
+bool usec_errors_add(USEC_ErrorList* list, USEC_ErrorCode code, int line, int col, const char* message) {
+	if (list->unique) {
+		for (size_t i = 0; i < list->count; ++i) {
+			USEC_Error* error = &list->items[i];
+			if (error->code == code && error->line == line && error->col == col) return true;
+		}
+	}
+
+	if (list->max && list->count >= list->max) {
+		list->truncated = true;
+		return false;
+	}
+
+	if (list->count >= list->capacity) {
+		list->capacity = list->capacity ? list->capacity * 2 : 8;
+		list->items = realloc(list->items, sizeof(USEC_Error) * list->capacity);
+	}
+
+	USEC_Error* error = &list->items[list->count++];
+	error->code = code;
+	error->line = line;
+	error->col = col;
+	strncpy(error->message, message, sizeof(error->message) - 1);
+	error->message[sizeof(error->message) - 1] = '\0';
+	return true;
+}
+
+void usec_errors_add_io(USEC_ErrorList* list, const char* path) {
+	char message[sizeof(((USEC_Error*)0)->message)];
+	snprintf(message, sizeof(message), "Could not open file '%s'", path);
+	usec_errors_add(list, USEC_ERROR_IO, 0, 0, message);
+}
+
+void usec_errors_free(USEC_ErrorList* list) {
+	free(list->items);
+	list->items = NULL;
+	list->count = 0;
+	list->capacity = 0;
+	list->truncated = false;
+}
+
+USEC_ParseResult usec_errors_result(USEC_Value* value, USEC_ErrorList* list) {
+	USEC_ParseResult result;
+	result.value = value;
+	result.errors = list->items;
+	result.error_count = list->count;
+	result.truncated = list->truncated;
+
+	list->items = NULL;
+	list->count = 0;
+	list->capacity = 0;
+	return result;
+}
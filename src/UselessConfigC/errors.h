@@ -0,0 +1,30 @@
+#ifndef USEC_ERRORS_H
+#define USEC_ERRORS_H
+
+#include <usec/usec.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Errors collected instead of printed, see usec_parse_result
+typedef struct {
+	USEC_Error* items;
+	size_t count;
+	size_t capacity;
+	size_t max; // 0 for no limit
+	bool truncated;
+	bool unique; // drops errors already recorded at the same position, for input that is parsed more than once
+
+} USEC_ErrorList;
+
+// Limited to options->maxErrors, options may be NULL for defaults
+void usec_errors_init(USEC_ErrorList* list, const USEC_ParseOptions* options);
+// Records an error. Returns false if the list is full, the error is dropped then and processing should stop.
+bool usec_errors_add(USEC_ErrorList* list, USEC_ErrorCode code, int line, int col, const char* message);
+// Records a USEC_ERROR_IO for a file that can't be read
+void usec_errors_add_io(USEC_ErrorList* list, const char* path);
+void usec_errors_free(USEC_ErrorList* list);
+
+// Moves the collected errors into a result
+USEC_ParseResult usec_errors_result(USEC_Value* value, USEC_ErrorList* list);
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef USEC_FORMAT_H
+#define USEC_FORMAT_H
+
+#include "utils.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Room for any number written by the formatters, with the NUL
+#define USEC_FORMAT_MAX 32
+
+// Write the number null-terminated into out and return its length
+size_t usec_format_uint(uint64_t value, char* out);
+size_t usec_format_int(int64_t value, char* out);
+
+// Shortest decimal that parses back to the same double, the closest one if there are several. Always has a
+// '.' or an exponent, so it reads back as a double. Infinities and NaN are written as "inf", "-inf" and "nan".
+size_t usec_format_double(double value, char* out);
+
+// Append the number to the builder, formatted like above
+void sb_append_uint(SB* sb, uint64_t value);
+void sb_append_int(SB* sb, int64_t value);
+void sb_append_double(SB* sb, double value);
+
+#endif
@@ -0,0 +1,98 @@
+#include "hash.h"
+#include "bits.h"
+#include "thread.h"
+#include <time.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+static const uint64_t secret[4] = {
+	0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull
+};
+
+static uint64_t process_seed;
+static USEC_Once seed_once = USEC_ONCE_INIT;
+
+static inline uint64_t mix(uint64_t a, uint64_t b) {
+	uint64_t hi;
+	uint64_t lo = usec_mul128(a, b, &hi);
+	return lo ^ hi;
+}
+
+// 1 to 3 bytes
+static inline uint64_t read_small(const uint8_t* p, size_t len) {
+	return ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+}
+
+uint64_t usec_hash_with_seed(const void* data, size_t len, uint64_t seed) {
+	const uint8_t* p = (const uint8_t*)data;
+	uint64_t a, b;
+	seed ^= mix(seed ^ secret[0], secret[1]);
+
+	if (len <= 16) {
+		if (len >= 4) {
+			size_t mid = (len >> 3) << 2;
+			a = ((uint64_t)usec_read32(p) << 32) | usec_read32(p + mid);
+			b = ((uint64_t)usec_read32(p + len - 4) << 32) | usec_read32(p + len - 4 - mid);
+		} else if (len > 0) {
+			a = read_small(p, len);
+			b = 0;
+		} else {
+			a = b = 0;
+		}
+	} else {
+		size_t i = len;
+		if (i > 48) {
+			uint64_t seed1 = seed, seed2 = seed;
+			do {
+				seed = mix(usec_read64(p) ^ secret[1], usec_read64(p + 8) ^ seed);
+				seed1 = mix(usec_read64(p + 16) ^ secret[2], usec_read64(p + 24) ^ seed1);
+				seed2 = mix(usec_read64(p + 32) ^ secret[3], usec_read64(p + 40) ^ seed2);
+				p += 48;
+				i -= 48;
+			} while (i > 48);
+			seed ^= seed1 ^ seed2;
+		}
+		while (i > 16) {
+			seed = mix(usec_read64(p) ^ secret[1], usec_read64(p + 8) ^ seed);
+			i -= 16;
+			p += 16;
+		}
+		a = usec_read64(p + i - 16);
+		b = usec_read64(p + i - 8);
+	}
+
+	a ^= secret[1];
+	b ^= seed;
+	a = usec_mul128(a, b, &b);
+	return mix(a ^ secret[0] ^ len, b ^ secret[1]);
+}
+
+static void init_seed(void) {
+	uint64_t entropy = (uint64_t)time(NULL);
+	entropy = mix(entropy ^ secret[2], (uint64_t)clock() ^ secret[3]);
+	entropy = mix(entropy ^ (uint64_t)(uintptr_t)&process_seed, secret[1]); // address space layout
+#ifdef _WIN32
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	entropy = mix(entropy ^ (uint64_t)counter.QuadPart, (uint64_t)GetCurrentProcessId() ^ secret[0]);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	entropy = mix(entropy ^ (uint64_t)ts.tv_nsec, (uint64_t)getpid() ^ secret[0]);
+#endif
+	process_seed = entropy;
+}
+
+uint64_t usec_hash_seed(void) {
+	usec_once(&seed_once, init_seed);
+	return process_seed;
+}
+
+uint64_t usec_hash(const void* data, size_t len) {
+	return usec_hash_with_seed(data, len, usec_hash_seed());
+}
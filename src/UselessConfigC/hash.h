@@ -0,0 +1,15 @@
+#ifndef USEC_HASH_H
+#define USEC_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Keyed 64-bit hash of the bytes (wyhash construction)
+uint64_t usec_hash_with_seed(const void* data, size_t len, uint64_t seed);
+
+// Hash used for object keys and variable names. Seeded randomly once per process,
+// so values must never be persisted or compared across processes.
+uint64_t usec_hash(const void* data, size_t len);
+uint64_t usec_hash_seed(void);
+
+#endif
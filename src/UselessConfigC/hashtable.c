@@ -1,91 +1,370 @@
 #include <usec/usec.h>
+#include "arena.h"
+#include "atom.h"
+#include "hash.h"
+#include "utils.h"
+#include "thread.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
-// Simple hash function (djb2)
-static unsigned long djb2(const char* str) {
-	unsigned long hash = 5381;
-	int c;
-	while ((c = *(str++)))
-		hash = ((hash << 5) + hash) + c;
-	return hash;
+// Tables up to this size are searched by scanning the entries, without an index
+#define HT_LINEAR_MAX 8
+#define HT_MIN_INDEX 16
+// Keys per bucket of a frozen index, and the displacements tried per bucket before giving up on the index size
+#define HT_FROZEN_BUCKET 4
+#define HT_FROZEN_TRIES 4096
+
+// Keys interned by the parser are shared, those compare by pointer. Keys with the same hash can still differ in
+// length, the stored one is only compared once it's known to be as long, so a shorter one isn't read past its end.
+static bool key_equals(const Usec_HashNode* entry, const char* key, size_t length, uint64_t hash) {
+	return entry->hash == hash && (entry->key == key || (strnlen(entry->key, length + 1) == length && memcmp(entry->key, key, length) == 0));
+}
+
+static void* ht_alloc(Usec_Hashtable* ht, size_t size) {
+	return ht->arena ? usec_arena_alloc(ht->arena, size) : malloc(size);
+}
+
+// Indexes start after a reference count, tables with the same keys in the same order share one.
+// A shared index isn't written to, a table adding a key rebuilds its own.
+typedef struct {
+	volatile long refs;
+} IndexHeader;
+
+static IndexHeader* index_header(const uint32_t* index) {
+	return (IndexHeader*)index - 1;
+}
+
+static uint32_t* alloc_index(Usec_Hashtable* ht, size_t slots) {
+	IndexHeader* header = ht_alloc(ht, sizeof(IndexHeader) + sizeof(uint32_t) * slots);
+	header->refs = 1;
+	uint32_t* index = (uint32_t*)(header + 1);
+	memset(index, 0, sizeof(uint32_t) * slots);
+	return index;
+}
+
+// Arena indexes are released with the arena, their count only tells whether they were ever shared
+static void release_index(Usec_Hashtable* ht, uint32_t* index) {
+	if (index && !ht->arena && usec_atomic_decrement(&index_header(index)->refs) == 0) free(index_header(index));
+}
+
+static bool index_shared(const Usec_Hashtable* ht) {
+	return index_header(ht->index)->refs > 1;
 }
 
 Usec_Hashtable* usec_ht_create(size_t capacity) {
-	Usec_Hashtable* ht = malloc(sizeof(Usec_Hashtable));
-	ht->capacity = capacity;
+	return usec_ht_create_in(NULL, capacity);
+}
+
+Usec_Hashtable* usec_ht_create_in(USEC_Arena* arena, size_t capacity) {
+	Usec_Hashtable* ht = arena ? usec_arena_alloc(arena, sizeof(Usec_Hashtable)) : malloc(sizeof(Usec_Hashtable));
+	ht->arena = arena;
+	ht->capacity = 0;
 	ht->size = 0;
-	ht->buckets = calloc(capacity, sizeof(Usec_HashNode*));
-	ht->order_head = NULL;
-	ht->order_tail = NULL;
+	ht->index = NULL;
+	ht->displace = NULL;
+	ht->buckets = 0;
+	ht->entries_capacity = capacity;
+	ht->entries = capacity ? ht_alloc(ht, sizeof(Usec_HashNode) * capacity) : NULL;
 	return ht;
 }
 
-void usec_ht_set(Usec_Hashtable* ht, const char* key, USEC_Value* value) {
-	unsigned long hash = djb2(key) % ht->capacity;
-	Usec_HashNode* node = ht->buckets[hash];
-
-	while (node) {
-		if (strcmp(node->key, key) == 0) {
-			// Replace existing value
-			if (node->value) usec_free(node->value);
-			node->value = value;
-			return;
+// Slot of the key in the index, or of the empty slot where it would go
+static size_t find_slot(const Usec_Hashtable* ht, const char* key, size_t length, uint64_t hash) {
+	size_t mask = ht->capacity - 1;
+	size_t slot = (size_t)hash & mask;
+	while (ht->index[slot]) {
+		if (key_equals(&ht->entries[ht->index[slot] - 1], key, length, hash)) return slot;
+		slot = (slot + 1) & mask;
+	}
+	return slot;
+}
+
+// Rebuilds the index with the given number of slots (a power of two)
+static void rebuild_index(Usec_Hashtable* ht, size_t capacity) {
+	release_index(ht, ht->index);
+	ht->displace = NULL;
+	ht->buckets = 0;
+	ht->capacity = capacity;
+	ht->index = alloc_index(ht, capacity);
+
+	size_t mask = capacity - 1;
+	for (size_t i = 0; i < ht->size; ++i) {
+		size_t slot = (size_t)ht->entries[i].hash & mask;
+		while (ht->index[slot]) slot = (slot + 1) & mask;
+		ht->index[slot] = (uint32_t)(i + 1);
+	}
+}
+
+// Frozen tables put the keys into buckets by the high half of their hash. Each bucket has a displacement
+// that moves its keys to slots no other key uses, so lookups need no probing.
+static size_t frozen_bucket(const Usec_Hashtable* ht, uint64_t hash) {
+	return (size_t)(((hash >> 32) * ht->buckets) >> 32);
+}
+
+static size_t frozen_slot(const Usec_Hashtable* ht, uint64_t hash, uint32_t displace) {
+	uint32_t step = (uint32_t)(hash >> 32) | 1;
+	return ((uint32_t)hash + displace * step) & (ht->capacity - 1);
+}
+
+static Usec_HashNode* find_entry(const Usec_Hashtable* ht, const char* key, size_t length, uint64_t hash) {
+	if (!ht->index) {
+		for (size_t i = 0; i < ht->size; ++i) {
+			Usec_HashNode* entry = &ht->entries[i];
+			if (key_equals(entry, key, length, hash)) return entry;
 		}
-		node = node->next;
+		return NULL;
+	}
+
+	if (ht->displace) {
+		// Frozen: the key can only be in one slot
+		uint32_t pos = ht->index[frozen_slot(ht, hash, ht->displace[frozen_bucket(ht, hash)])];
+		return pos && key_equals(&ht->entries[pos - 1], key, length, hash) ? &ht->entries[pos - 1] : NULL;
+	}
+
+	uint32_t pos = ht->index[find_slot(ht, key, length, hash)];
+	return pos ? &ht->entries[pos - 1] : NULL;
+}
+
+uint64_t usec_ht_hash(const char* key, size_t length) {
+	return usec_hash(key, length);
+}
+
+void usec_ht_set(Usec_Hashtable* ht, const char* key, USEC_Value* value) {
+	size_t length = strlen(key);
+	usec_ht_set_hashed(ht, key, length, usec_hash(key, length), value);
+}
+
+void usec_ht_set_hashed(Usec_Hashtable* ht, const char* key, size_t length, uint64_t hash, USEC_Value* value) {
+	USEC_Value* old = usec_ht_swap_hashed(ht, key, length, hash, value);
+
+	// Arena tables keep the old value alive until the arena is released
+	if (old && !ht->arena) usec_free(old);
+}
+
+// Heap tables own an atom per key, see atom.h. A shared key is kept instead of copied.
+static USEC_Value* swap(Usec_Hashtable* ht, const char* key, size_t length, uint64_t hash, USEC_Value* value, bool shared) {
+	Usec_HashNode* entry = find_entry(ht, key, length, hash);
+
+	if (ht->arena) usec_arena_adopt(ht->arena, value);
+
+	if (entry) {
+		USEC_Value* old = entry->value;
+		entry->value = value;
+		return old;
 	}
 
 	// New entry
-	node = malloc(sizeof(Usec_HashNode));
-	node->key = strdup(key);
-	node->value = value;
-	node->next = ht->buckets[hash];
-	node->order_next = NULL;
-	node->order_prev = ht->order_tail;
-
-	ht->buckets[hash] = node;
-	ht->size++;
-
-	// Update insertion order list
-	if (ht->order_tail) {
-		ht->order_tail->order_next = node;
-		ht->order_tail = node;
+	if (ht->size >= ht->entries_capacity) {
+		size_t capacity = ht->entries_capacity ? ht->entries_capacity * 2 : 4;
+		if (ht->arena) {
+			Usec_HashNode* entries = usec_arena_alloc(ht->arena, sizeof(Usec_HashNode) * capacity);
+			if (ht->size) memcpy(entries, ht->entries, sizeof(Usec_HashNode) * ht->size);
+			ht->entries = entries;
+		} else {
+			ht->entries = realloc(ht->entries, sizeof(Usec_HashNode) * capacity);
+		}
+		ht->entries_capacity = capacity;
+	}
+
+	entry = &ht->entries[ht->size++];
+	if (shared) {
+		if (!ht->arena) usec_atom_retain(key);
+		entry->key = (char*)key;
 	} else {
-		ht->order_head = ht->order_tail = node;
+		entry->key = ht->arena ? usec_arena_strndup(ht->arena, key, length) : usec_atom_new(key, length);
 	}
+	entry->value = value;
+	entry->hash = hash;
+
+	// Keep the index at most 3/4 full. Frozen and shared indexes get rebuilt as a regular one.
+	if (ht->index && !ht->displace && !index_shared(ht) && ht->size * 4 <= ht->capacity * 3) {
+		ht->index[find_slot(ht, key, length, hash)] = (uint32_t)ht->size;
+	} else if (ht->index || ht->size > HT_LINEAR_MAX) {
+		size_t capacity = ht->capacity ? ht->capacity : HT_MIN_INDEX;
+		while (ht->size * 4 > capacity * 3) capacity *= 2;
+		rebuild_index(ht, capacity);
+	}
+	return NULL;
+}
+
+USEC_Value* usec_ht_swap_hashed(Usec_Hashtable* ht, const char* key, size_t length, uint64_t hash, USEC_Value* value) {
+	return swap(ht, key, length, hash, value, false);
+}
+
+USEC_Value* usec_ht_swap_shared(Usec_Hashtable* ht, const char* key, size_t length, uint64_t hash, USEC_Value* value) {
+	return swap(ht, key, length, hash, value, true);
 }
 
 USEC_Value* usec_ht_get(Usec_Hashtable* ht, const char* key) {
-	unsigned long hash = djb2(key) % ht->capacity;
-	Usec_HashNode* node = ht->buckets[hash];
+	size_t length = strlen(key);
+	return usec_ht_get_hashed(ht, key, length, usec_hash(key, length));
+}
 
-	while (node) {
-		if (strcmp(node->key, key) == 0)
-			return node->value;
-		node = node->next;
-	}
-	return NULL;
+USEC_Value* usec_ht_get_hashed(Usec_Hashtable* ht, const char* key, size_t length, uint64_t hash) {
+	Usec_HashNode* entry = find_entry(ht, key, length, hash);
+	return entry ? entry->value : NULL;
 }
 
 void usec_ht_free(Usec_Hashtable* ht) {
-	Usec_HashNode* node = ht->order_head;
-	while (node) {
-		Usec_HashNode* next = node->order_next;
-		free(node->key);
-		usec_free(node->value);
-		free(node);
-		node = next;
-	}
-	free(ht->buckets);
+	if (ht->arena) return; // released with its arena
+
+	for (size_t i = 0; i < ht->size; ++i) {
+		usec_atom_release(ht->entries[i].key);
+		usec_free(ht->entries[i].value);
+	}
+	free(ht->entries);
+	release_index(ht, ht->index);
 	free(ht);
 }
 
+void usec_ht_clear(Usec_Hashtable* ht) {
+	if (!ht->arena) {
+		for (size_t i = 0; i < ht->size; ++i) {
+			usec_atom_release(ht->entries[i].key);
+			usec_free(ht->entries[i].value);
+		}
+	}
+	ht->size = 0;
+
+	// Back to a linear scan, an index the size of the old contents would slow down small tables
+	release_index(ht, ht->index);
+	ht->index = NULL;
+	ht->displace = NULL;
+	ht->buckets = 0;
+	ht->capacity = 0;
+}
+
+typedef struct {
+	size_t bucket;
+	size_t size;
+} FrozenBucket;
+
+static int compare_buckets(const void* a, const void* b) {
+	size_t size_a = ((const FrozenBucket*)a)->size, size_b = ((const FrozenBucket*)b)->size;
+	return size_a < size_b ? 1 : size_a > size_b ? -1 : 0;
+}
+
+// Finds a displacement for every bucket so that all keys get their own slot in an index of the given
+// capacity, fullest buckets first. False if a bucket fits nowhere.
+static bool place_buckets(Usec_Hashtable* ht, uint32_t* index, uint32_t* displace) {
+	size_t buckets = ht->buckets;
+	size_t* starts = calloc(buckets + 1, sizeof(size_t));
+	size_t* members = malloc(sizeof(size_t) * ht->size);
+	FrozenBucket* order = malloc(sizeof(FrozenBucket) * buckets);
+	size_t* slots = malloc(sizeof(size_t) * ht->size);
+
+	// Group the entries by bucket
+	for (size_t i = 0; i < ht->size; ++i) ++starts[frozen_bucket(ht, ht->entries[i].hash) + 1];
+	for (size_t b = 0; b < buckets; ++b) {
+		order[b].bucket = b;
+		order[b].size = starts[b + 1];
+		starts[b + 1] += starts[b];
+	}
+	for (size_t i = 0; i < ht->size; ++i) {
+		size_t b = frozen_bucket(ht, ht->entries[i].hash);
+		members[starts[b] + --order[b].size] = i; // each bucket fills back to front
+	}
+	for (size_t b = 0; b < buckets; ++b) order[b].size = starts[b + 1] - starts[b];
+	qsort(order, buckets, sizeof(FrozenBucket), compare_buckets);
+
+	bool ok = true;
+	for (size_t o = 0; o < buckets && ok && order[o].size > 0; ++o) {
+		size_t b = order[o].bucket;
+		size_t* keys = members + starts[b];
+		size_t count = order[o].size;
+		ok = false;
+		for (uint32_t d = 0; d < HT_FROZEN_TRIES && !ok; ++d) {
+			size_t placed = 0;
+			for (; placed < count; ++placed) {
+				size_t slot = frozen_slot(ht, ht->entries[keys[placed]].hash, d);
+				if (index[slot]) break;
+				index[slot] = (uint32_t)(keys[placed] + 1);
+				slots[placed] = slot;
+			}
+			if (placed == count) {
+				displace[b] = d;
+				ok = true;
+			} else {
+				while (placed > 0) index[slots[--placed]] = 0;
+			}
+		}
+	}
+
+	free(starts);
+	free(members);
+	free(order);
+	free(slots);
+	return ok;
+}
+
+void usec_ht_freeze(Usec_Hashtable* ht) {
+	if (ht->displace) return;
+
+	// Exactly sized entries
+	if (!ht->arena && ht->entries_capacity > ht->size) {
+		if (ht->size == 0) {
+			free(ht->entries);
+			ht->entries = NULL;
+		} else {
+			ht->entries = realloc(ht->entries, sizeof(Usec_HashNode) * ht->size);
+		}
+		ht->entries_capacity = ht->size;
+	}
+
+	if (ht->size <= HT_LINEAR_MAX) {
+		// Scanning a few entries beats any index
+		release_index(ht, ht->index);
+		ht->index = NULL;
+		ht->capacity = 0;
+		return;
+	}
+
+	size_t capacity = HT_MIN_INDEX;
+	while (capacity < ht->size) capacity *= 2;
+	size_t buckets = (ht->size + HT_FROZEN_BUCKET - 1) / HT_FROZEN_BUCKET;
+
+	// A fuller index is smaller, a twice as large one is much easier to place. Tables where neither
+	// works out keep their regular index.
+	for (int attempt = 0; attempt < 2; ++attempt, capacity *= 2) {
+		uint32_t* index = alloc_index(ht, capacity + buckets);
+		uint32_t* displace = index + capacity;
+
+		size_t old_capacity = ht->capacity;
+		ht->capacity = capacity;
+		ht->buckets = buckets;
+		if (place_buckets(ht, index, displace)) {
+			release_index(ht, ht->index);
+			ht->index = index;
+			ht->displace = displace;
+			return;
+		}
+		ht->capacity = old_capacity;
+		ht->buckets = 0;
+		release_index(ht, index);
+	}
+}
+
+bool usec_ht_share_shape(Usec_Hashtable* ht, const Usec_Hashtable* like) {
+	if (!like->index || ht->index == like->index || ht->size != like->size || ht->arena != like->arena) return false;
+	for (size_t i = 0; i < ht->size; ++i) {
+		const Usec_HashNode* a = &ht->entries[i];
+		const Usec_HashNode* b = &like->entries[i];
+		if (a->hash != b->hash || (a->key != b->key && strcmp(a->key, b->key) != 0)) return false;
+	}
+
+	usec_atomic_increment(&index_header(like->index)->refs);
+	release_index(ht, ht->index);
+	ht->index = like->index;
+	ht->capacity = like->capacity;
+	ht->displace = like->displace;
+	ht->buckets = like->buckets;
+	return true;
+}
+
 void usec_ht_foreach(Usec_Hashtable* ht, void (*fn)(const char* key, USEC_Value* value)) {
-	Usec_HashNode* node = ht->order_head;
-	while (node) {
-		fn(node->key, node->value);
-		node = node->order_next;
+	for (size_t i = 0; i < ht->size; ++i) {
+		fn(ht->entries[i].key, ht->entries[i].value);
 	}
 }
 
@@ -93,15 +372,13 @@ void usec_ht_foreach(Usec_Hashtable* ht, void (*fn)(const char* key, USEC_Value*
 Usec_Hashtable* usec_ht_from(const Usec_Hashtable* source) {
 	if (!source) return NULL;
 
-	Usec_Hashtable* dest = usec_ht_create(source->capacity);
+	Usec_Hashtable* dest = usec_ht_create(source->size);
 
-	for (size_t i = 0; i < source->capacity; ++i) {
-		Usec_HashNode* node = source->buckets[i];
-		while (node) {
-			USEC_Value* copy = usec_clone(node->value);
-			usec_ht_set(dest, node->key, copy);
-			node = node->next;
-		}
+	for (size_t i = 0; i < source->size; ++i) {
+		const Usec_HashNode* entry = &source->entries[i];
+		// Keys of heap tables are atoms the copy can share
+		if (source->arena) usec_ht_set_hashed(dest, entry->key, strlen(entry->key), entry->hash, usec_clone(entry->value));
+		else usec_ht_swap_shared(dest, entry->key, strlen(entry->key), entry->hash, usec_clone(entry->value));
 	}
 
 	return dest;
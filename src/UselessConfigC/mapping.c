@@ -0,0 +1,112 @@
+#include "mapping.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static const char empty_file[1] = { 0 };
+
+#ifdef _WIN32
+
+bool usec_map_file(const char* path, USEC_FileMapping* out) {
+	out->data = NULL;
+	out->length = 0;
+	out->file = NULL;
+	out->mapping = NULL;
+
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)) {
+		CloseHandle(file);
+		return false;
+	}
+
+	if (size.QuadPart == 0) {
+		CloseHandle(file);
+		out->data = empty_file;
+		return true;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!mapping) {
+		CloseHandle(file);
+		return false;
+	}
+
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!view) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	out->data = (const char*)view;
+	out->length = (size_t)size.QuadPart;
+	out->file = file;
+	out->mapping = mapping;
+	return true;
+}
+
+void usec_unmap_file(USEC_FileMapping* mapping) {
+	if (mapping->mapping) {
+		UnmapViewOfFile(mapping->data);
+		CloseHandle(mapping->mapping);
+		CloseHandle(mapping->file);
+	}
+	mapping->data = NULL;
+	mapping->length = 0;
+	mapping->file = NULL;
+	mapping->mapping = NULL;
+}
+
+#else
+
+bool usec_map_file(const char* path, USEC_FileMapping* out) {
+	out->data = NULL;
+	out->length = 0;
+	out->mapped = false;
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+		close(fd);
+		return false;
+	}
+
+	if (st.st_size == 0) {
+		close(fd);
+		out->data = empty_file;
+		return true;
+	}
+
+	void* view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); // the mapping keeps the file referenced
+	if (view == MAP_FAILED) return false;
+#ifdef MADV_SEQUENTIAL
+	madvise(view, (size_t)st.st_size, MADV_SEQUENTIAL);
+#endif
+
+	out->data = (const char*)view;
+	out->length = (size_t)st.st_size;
+	out->mapped = true;
+	return true;
+}
+
+void usec_unmap_file(USEC_FileMapping* mapping) {
+	if (mapping->mapped) munmap((void*)mapping->data, mapping->length);
+	mapping->data = NULL;
+	mapping->length = 0;
+	mapping->mapped = false;
+}
+
+#endif
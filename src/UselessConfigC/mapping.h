@@ -0,0 +1,23 @@
+#ifndef USEC_MAPPING_H
+#define USEC_MAPPING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Read-only memory mapping of a whole file
+typedef struct {
+	const char* data;
+	size_t length;
+#ifdef _WIN32
+	void* file;
+	void* mapping;
+#else
+	bool mapped;
+#endif
+} USEC_FileMapping;
+
+// Maps the file at path. Empty files map to a zero length, non-NULL data pointer.
+bool usec_map_file(const char* path, USEC_FileMapping* out);
+void usec_unmap_file(USEC_FileMapping* mapping);
+
+#endif
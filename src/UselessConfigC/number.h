@@ -0,0 +1,16 @@
+#ifndef USEC_NUMBER_H
+#define USEC_NUMBER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Significant digits kept in the mantissa of a number token, more don't fit in 64 bits
+#define USEC_NUMBER_DIGITS_MAX 19
+
+// Closest double to mantissa * 10^exponent, rounding half to even, without going through strtod.
+// With truncated set, nonzero digits after the mantissa were dropped. text is the unsigned number as
+// written, it's only read again when those digits could change the result.
+double usec_decimal_to_double(uint64_t mantissa, int32_t exponent, bool truncated, const char* text, size_t length);
+
+#endif
@@ -0,0 +1,100 @@
+#include "packed.h"
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+size_t usec_packed_size(USEC_ValueType type) {
+	switch (type) {
+	case VALUE_INT: return sizeof(int64_t);
+	case VALUE_UINT: return sizeof(uint64_t);
+	case VALUE_DOUBLE: return sizeof(double);
+	case VALUE_BOOL: return sizeof(bool);
+	default: return 0;
+	}
+}
+
+static const void* packed_data(const USEC_Value* value, USEC_ValueType type, size_t* count) {
+	if (!value || value->type != VALUE_PACKED_ARRAY || value->packedValue.elementType != type) {
+		if (count) *count = 0;
+		return NULL;
+	}
+	if (count) *count = value->packedValue.count;
+	return value->packedValue.data;
+}
+
+const int64_t* usec_packed_ints(const USEC_Value* value, size_t* count) {
+	return packed_data(value, VALUE_INT, count);
+}
+
+const uint64_t* usec_packed_uints(const USEC_Value* value, size_t* count) {
+	return packed_data(value, VALUE_UINT, count);
+}
+
+const double* usec_packed_doubles(const USEC_Value* value, size_t* count) {
+	return packed_data(value, VALUE_DOUBLE, count);
+}
+
+const bool* usec_packed_bools(const USEC_Value* value, size_t* count) {
+	return packed_data(value, VALUE_BOOL, count);
+}
+
+USEC_Value usec_packed_get(const USEC_Value* value, size_t index) {
+	USEC_Value item;
+	memset(&item, 0, sizeof(item));
+	item.type = VALUE_NULL;
+	if (!value || value->type != VALUE_PACKED_ARRAY || index >= value->packedValue.count) return item;
+
+	item.type = value->packedValue.elementType;
+	size_t size = usec_packed_size(item.type);
+	memcpy(&item.int64Value, (const unsigned char*)value->packedValue.data + index * size, size);
+	return item;
+}
+
+// Replaces the items by packed elements if they're all scalars of one packable type
+static bool pack_array(USEC_Value* array) {
+	USEC_Value** items = array->arrayValue.items;
+	size_t count = array->arrayValue.count;
+	if (count == 0 || count > UINT32_MAX || !items[0]) return false;
+
+	USEC_ValueType type = items[0]->type;
+	size_t size = usec_packed_size(type);
+	if (size == 0) return false;
+	for (size_t i = 1; i < count; ++i) {
+		if (!items[i] || items[i]->type != type) return false;
+	}
+
+	unsigned char* data = malloc(size * count);
+	if (!data) return false;
+	for (size_t i = 0; i < count; ++i) {
+		memcpy(data + i * size, &items[i]->int64Value, size);
+		usec_free(items[i]);
+	}
+	free(items);
+
+	array->type = VALUE_PACKED_ARRAY;
+	array->packedValue.data = data;
+	array->packedValue.count = (uint32_t)count;
+	array->packedValue.elementType = type;
+	return true;
+}
+
+void usec_pack(USEC_Value* root) {
+	if (!root || (root->flags & USEC_VALUE_ARENA)) return;
+
+	switch (root->type) {
+	case VALUE_ARRAY:
+		if (pack_array(root)) break;
+		for (size_t i = 0; i < root->arrayValue.count; ++i)
+			usec_pack(root->arrayValue.items[i]);
+		break;
+	case VALUE_OBJECT:
+		for (size_t i = 0; i < root->objectValue->size; ++i)
+			usec_pack(root->objectValue->entries[i].value);
+		break;
+	case VALUE_FORMAT:
+		usec_pack(root->formatNode->node);
+		break;
+	default:
+		break;
+	}
+}
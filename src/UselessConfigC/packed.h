@@ -0,0 +1,11 @@
+#ifndef USEC_PACKED_H
+#define USEC_PACKED_H
+
+#include <usec/usec.h>
+#include <stddef.h>
+
+// Bytes per element of packed arrays of the element type, 0 for types that aren't packed.
+// An element is stored as the bytes of the scalar's union member, which all start at the same address.
+size_t usec_packed_size(USEC_ValueType type);
+
+#endif
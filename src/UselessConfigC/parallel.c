@@ -0,0 +1,278 @@
+#include "context.h"
+#include "segment.h"
+#include "pool.h"
+#include "mapping.h"
+#include "thread.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Smallest piece worth a thread, and pieces per thread to even out their parse times
+#ifndef USEC_PARALLEL_MIN_CHUNK
+#define USEC_PARALLEL_MIN_CHUNK (256 * 1024)
+#endif
+#define PARALLEL_CHUNKS_PER_THREAD 4
+
+// Consecutive top-level statements, parsed as a fragment on one thread
+typedef struct {
+	size_t start;
+	size_t end;
+	int line;
+	int col;
+	Usec_Hashtable* snapshot; // top-level variables declared before the chunk, not owning its values
+	USEC_Value* value;
+	USEC_ErrorList errors;
+} Chunk;
+
+// Top-level declaration, resolved up front so that every chunk sees the variables declared before it
+typedef struct {
+	size_t start;
+	size_t end;
+	int line;
+	int col;
+} Declaration;
+
+typedef struct {
+	const char* input;
+	size_t length;
+	bool compact;
+	USEC_ParseOptions options; // without variables, chunks read them through their snapshot
+
+	Chunk* chunks;
+	size_t chunk_count;
+	size_t chunk_capacity;
+
+	Declaration* declarations;
+	size_t declaration_count;
+	size_t declaration_capacity;
+
+	bool sequential; // the document can't be split, like one with a root value
+} Job;
+
+static void add_chunk(Job* job, size_t start, int line, int col) {
+	if (job->chunk_count >= job->chunk_capacity) {
+		job->chunk_capacity = job->chunk_capacity ? job->chunk_capacity * 2 : 16;
+		job->chunks = realloc(job->chunks, sizeof(Chunk) * job->chunk_capacity);
+	}
+	Chunk* chunk = &job->chunks[job->chunk_count++];
+	memset(chunk, 0, sizeof(Chunk));
+	chunk->start = start;
+	chunk->end = job->length;
+	chunk->line = line;
+	chunk->col = col;
+}
+
+static void add_declaration(Job* job, const USEC_SegmentStatement* stmt) {
+	if (job->declaration_count >= job->declaration_capacity) {
+		job->declaration_capacity = job->declaration_capacity ? job->declaration_capacity * 2 : 16;
+		job->declarations = realloc(job->declarations, sizeof(Declaration) * job->declaration_capacity);
+	}
+	// A newline is kept so that a "\r\n" ending stays whole
+	size_t end = stmt->separator == '\n' ? stmt->end + 1 : stmt->end;
+	job->declarations[job->declaration_count++] = (Declaration){ stmt->start, end, stmt->line, stmt->col };
+}
+
+// Cuts the document into chunks of about target bytes after top-level newlines, collecting declarations on the way
+static void split(Job* job, size_t target, size_t max_chunks) {
+	size_t offset = job->compact ? 1 : 0;
+	USEC_Segmenter seg;
+	usec_segmenter_init(&seg, offset);
+	add_chunk(job, offset, 1, (int)offset + 1);
+
+	USEC_SegmentStatement stmt;
+	for (;;) {
+		bool found = usec_segmenter_next(&seg, job->input, job->length, &stmt);
+		if (!found && !usec_segmenter_finish(&seg, &stmt)) break;
+
+		if (stmt.first == '!') {
+			// A root value, or an error. Either way the first chunk has to see the whole document.
+			job->sequential = true;
+			break;
+		}
+		if (stmt.first == ':' && !job->options.keepVariables) add_declaration(job, &stmt);
+
+		if (!found) break;
+		Chunk* last = &job->chunks[job->chunk_count - 1];
+		if (stmt.separator == '\n' && stmt.end + 1 - last->start >= target && job->chunk_count < max_chunks && stmt.end + 1 < job->length) {
+			last->end = stmt.end + 1;
+			add_chunk(job, stmt.end + 1, seg.line, 1);
+		}
+	}
+	usec_segmenter_destroy(&seg);
+}
+
+// Table sharing the values of another one, freed without them
+static Usec_Hashtable* copy_view(Usec_Hashtable* source) {
+	Usec_Hashtable* view = usec_ht_create(source->size);
+	for (size_t i = 0; i < source->size; ++i) {
+		Usec_HashNode* entry = &source->entries[i];
+		usec_ht_swap_hashed(view, entry->key, strlen(entry->key), entry->hash, entry->value);
+	}
+	return view;
+}
+
+static void free_view(Usec_Hashtable* view) {
+	if (!view) return;
+	for (size_t i = 0; i < view->size; ++i) {
+		view->entries[i].value = NULL;
+	}
+	usec_ht_free(view);
+}
+
+// Parses the top-level declarations in order and snapshots the visible variables at the start of every chunk.
+// Returns the parsed values, owned by the caller. Errors are left for the chunks to report.
+static USEC_Value** resolve_declarations(Job* job, USEC_Context* ctx, Usec_Hashtable* variables, size_t* count) {
+	Usec_Hashtable* visible = variables ? copy_view(variables) : usec_ht_create(16);
+	Usec_Hashtable* declared = usec_ht_create(1);
+	USEC_Value** values = malloc(sizeof(USEC_Value*) * (job->declaration_count ? job->declaration_count : 1));
+	*count = 0;
+
+	USEC_ParseOptions options = job->options;
+	options.useArena = false;
+	options.debugParser = false;
+	options.debugTokens = false;
+	options.variables = declared;
+
+	size_t next_chunk = 0;
+	for (size_t i = 0; i < job->declaration_count; ++i) {
+		Declaration* decl = &job->declarations[i];
+		while (next_chunk < job->chunk_count && job->chunks[next_chunk].start <= decl->start) {
+			job->chunks[next_chunk++].snapshot = copy_view(visible);
+		}
+
+		USEC_ErrorList errors;
+		usec_errors_init(&errors, &options);
+		USEC_Fragment fragment = { job->compact, false, decl->line, decl->col };
+		ctx->shared_variables = visible;
+		USEC_Value* root = usec_context_run_fragment(ctx, job->input + decl->start, decl->end - decl->start, &fragment, &options, &errors);
+		usec_errors_free(&errors);
+
+		if (root && declared->size == 1) {
+			Usec_HashNode* entry = &declared->entries[0];
+			values[(*count)++] = entry->value;
+			usec_ht_swap_hashed(visible, entry->key, strlen(entry->key), entry->hash, entry->value);
+			entry->value = NULL;
+		}
+		usec_ht_clear(declared);
+		usec_free(root);
+	}
+
+	while (next_chunk < job->chunk_count) {
+		job->chunks[next_chunk++].snapshot = copy_view(visible);
+	}
+
+	ctx->shared_variables = NULL;
+	free_view(visible);
+	usec_ht_free(declared);
+	return values;
+}
+
+static void parse_chunk(void* arg, USEC_Context* ctx, size_t index) {
+	Job* job = arg;
+	Chunk* chunk = &job->chunks[index];
+
+	USEC_Fragment fragment = { job->compact, false, chunk->line, chunk->col };
+	usec_errors_init(&chunk->errors, &job->options);
+	ctx->shared_variables = chunk->snapshot;
+	chunk->value = usec_context_run_fragment(ctx, job->input + chunk->start, chunk->end - chunk->start, &fragment, &job->options, &chunk->errors);
+	ctx->shared_variables = NULL;
+}
+
+// Parses the document in one piece like usec_parse_result. The caller's variables are only read, like
+// usec_parse_many reads them, so declarations don't end up in them.
+static USEC_ParseResult parse_whole(const char* input, size_t length, const USEC_ParseOptions* options) {
+	if (!input || !options || !options->variables) return usec_parse_result(input, length, options);
+
+	USEC_ParseOptions opts = *options;
+	opts.variables = NULL;
+	USEC_ErrorList errors;
+	usec_errors_init(&errors, &opts);
+	USEC_Context ctx;
+	usec_context_init(&ctx);
+	ctx.shared_variables = options->variables;
+	USEC_Value* value = usec_context_run(&ctx, input, length, &opts, &errors);
+	ctx.shared_variables = NULL;
+	usec_context_release(&ctx);
+	return usec_errors_result(value, &errors);
+}
+
+// Moves the entries of the later chunks into the root object of the first
+static USEC_Value* merge_chunks(Job* job) {
+	USEC_Value* root = job->chunks[0].value;
+	for (size_t i = 1; i < job->chunk_count; ++i) {
+		usec_merge_root(root, job->chunks[i].value);
+		job->chunks[i].value = NULL;
+	}
+	return root;
+}
+
+USEC_ParseResult usec_parse_parallel(const char* input, size_t length, const USEC_ParseOptions* options, size_t threads) {
+	if (threads == 0) threads = usec_cpu_count();
+	size_t max_chunks = threads * PARALLEL_CHUNKS_PER_THREAD;
+	if (max_chunks > length / USEC_PARALLEL_MIN_CHUNK) max_chunks = length / USEC_PARALLEL_MIN_CHUNK;
+	if (!input || threads < 2 || max_chunks < 2) return parse_whole(input, length, options);
+
+	Job job;
+	memset(&job, 0, sizeof(Job));
+	job.input = input;
+	job.length = length;
+	job.compact = length > 0 && input[0] == '%';
+	job.options = options ? *options : usec_get_default_parse_options();
+	Usec_Hashtable* variables = job.options.variables;
+	job.options.variables = NULL;
+
+	split(&job, length / max_chunks, max_chunks);
+	if (job.sequential || job.chunk_count < 2) {
+		free(job.chunks);
+		free(job.declarations);
+		return parse_whole(input, length, options);
+	}
+
+	// Declarations in order, then the chunks in parallel
+	USEC_Context ctx;
+	usec_context_init(&ctx);
+	size_t value_count;
+	USEC_Value** values = resolve_declarations(&job, &ctx, variables, &value_count);
+	usec_context_release(&ctx);
+
+	usec_pool_run(job.chunk_count, threads, parse_chunk, &job);
+
+	// A document with errors is parsed again in one piece, as recovery depends on what came before
+	bool failed = false;
+	for (size_t i = 0; i < job.chunk_count; ++i) {
+		Chunk* chunk = &job.chunks[i];
+		if (!chunk->value || chunk->errors.count > 0) failed = true;
+		usec_errors_free(&chunk->errors);
+		free_view(chunk->snapshot);
+	}
+
+	USEC_Value* value = NULL;
+	if (failed) {
+		for (size_t i = 0; i < job.chunk_count; ++i) usec_free(job.chunks[i].value);
+	} else {
+		value = merge_chunks(&job);
+	}
+
+	for (size_t i = 0; i < value_count; ++i) usec_free(values[i]);
+	free(values);
+	free(job.chunks);
+	free(job.declarations);
+	if (failed) return parse_whole(input, length, options);
+
+	USEC_ErrorList errors;
+	usec_errors_init(&errors, &job.options);
+	return usec_errors_result(value, &errors);
+}
+
+USEC_ParseResult usec_parse_file_parallel(const char* path, const USEC_ParseOptions* options, size_t threads) {
+	USEC_FileMapping mapping;
+	if (!path || !usec_map_file(path, &mapping)) {
+		USEC_ErrorList errors;
+		usec_errors_init(&errors, options);
+		if (path) usec_errors_add_io(&errors, path);
+		return usec_errors_result(NULL, &errors);
+	}
+
+	USEC_ParseResult result = usec_parse_parallel(mapping.data, mapping.length, options, threads);
+	usec_unmap_file(&mapping);
+	return result;
+}
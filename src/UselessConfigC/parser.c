@@ -1,59 +1,37 @@
 #include "parser.h"
 #include "utils.h"
+#include "hash.h"
+#include "number.h"
+#include "format.h"
+#include "packed.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
-#include <errno.h>
-#include <inttypes.h>
 #include <math.h>
 
 #define SCOPE_MIN_CAPACITY 4
+#define NAMES_MIN_CAPACITY 32
+
+// Helper for errors. When collecting, pedantic parses stop at the first error.
+static void parser_error(USEC_Parser* p, USEC_Token* token, USEC_ErrorCode code, const char* message) {
+	if (p->errors) {
+		if (p->failed) return; // errors cascading from the one that aborted
+		if (!usec_errors_add(p->errors, code, token->line, token->col, message) || p->pedantic) p->failed = true;
+		return;
+	}
 
-// Helper for errors
-static void parser_error(USEC_Parser* p, USEC_Token* token, const char* message) {
 	fprintf(stderr, "[USEC PARSER] [%d:%d] Error: %s\n", token->line, token->col, message);
 	if (p->pedantic) exit(2);
 }
 
-// Number parsing helpers
-// Parses a NAN or INF-safe double
-static double safe_strtod(const char* str, bool* is_valid) {
-	errno = 0;
-	char* endptr = NULL;
-	double result = strtod(str, &endptr);
-	if (is_valid) *is_valid = (errno == 0 && endptr != str && isfinite(result));
-	return result;
-}
-
-// Parses 64-bit signed int safely
-static bool try_parse_int64(const char* str, int64_t* out) {
-	errno = 0;
-	char* endptr = NULL;
-	long long v = strtoll(str, &endptr, 10);
-	if (errno != 0 || endptr == str) return false;
-	*out = v;
-	return true;
-}
-
-// Parses 64-bit unsigned int safely
-static bool try_parse_uint64(const char* str, uint64_t* out) {
-	errno = 0;
-	char* endptr = NULL;
-	unsigned long long v = strtoull(str, &endptr, 10);
-	if (errno != 0 || endptr == str) return false;
-	*out = v;
-	return true;
-}
-
 // String builder helpers
 static bool sb_append_value_repr(SB* sb, USEC_Value* val) {
 	if (!val) return false;
-	char buf[64];
 	switch (val->type) {
 	case VALUE_STRING: sb_append_str(sb, val->stringValue); break;
-	case VALUE_INT: snprintf(buf, sizeof(buf), "%" PRId64, val->int64Value); sb_append_str(sb, buf); break;
-	case VALUE_UINT: snprintf(buf, sizeof(buf), "%" PRIu64, val->uint64Value); sb_append_str(sb, buf); break;
-	case VALUE_DOUBLE: snprintf(buf, sizeof(buf), "%f", val->doubleValue); sb_append_str(sb, buf); break;
+	case VALUE_INT: sb_append_int(sb, val->int64Value); break;
+	case VALUE_UINT: sb_append_uint(sb, val->uint64Value); break;
+	case VALUE_DOUBLE: sb_append_double(sb, val->doubleValue); break;
 	case VALUE_BOOL: sb_append_str(sb, val->boolValue ? "true" : "false"); break;
 	case VALUE_NULL: sb_append_str(sb, "null"); break;
 	default: return false;
@@ -62,65 +40,187 @@ static bool sb_append_value_repr(SB* sb, USEC_Value* val) {
 	return true;
 }
 
-// Helper for variable scopes
-static void scope_push(USEC_Parser* p, Usec_Hashtable* vars) {
-	if (p->var_stack_size >= USEC_VAR_STACK_MAX) {
-		fprintf(stderr, "[USEC PARSER] Error: Exceeded variable scope stack\n");
-		exit(3);
+// === Scopes ===
+// Every name declared in a local scope maps to its innermost binding, the depth and entry slot of the
+// declaration. A reference then resolves with one probe of the name map before the global scope and the base.
+// Entries of the top scope are bound lazily, on the next lookup or push, since declarations only go there.
+
+// Slot of the name in the name map. Missing names are added if add is set, otherwise SIZE_MAX.
+static size_t name_slot(USEC_Parser* p, const char* name, size_t length, uint64_t hash, bool add) {
+	if (add && (p->name_count + 1) * 2 > p->name_capacity) {
+		// At most half full
+		size_t capacity = p->name_capacity ? p->name_capacity * 2 : NAMES_MIN_CAPACITY;
+		USEC_BindingName* names = calloc(capacity, sizeof(USEC_BindingName));
+		size_t* moved = malloc(sizeof(size_t) * (p->name_capacity + 1));
+		for (size_t i = 0; i < p->name_capacity; ++i) {
+			if (!p->names[i].offset) continue;
+			size_t at = (size_t)p->names[i].hash & (capacity - 1);
+			while (names[at].offset) at = (at + 1) & (capacity - 1);
+			names[at] = p->names[i];
+			moved[i] = at;
+		}
+		// Bindings refer to their name by slot, which moved
+		for (size_t i = 0; i < p->binding_count; ++i) p->bindings[i].name = moved[p->bindings[i].name];
+		free(moved);
+		free(p->names);
+		p->names = names;
+		p->name_capacity = capacity;
+	}
+	if (p->name_capacity == 0) return SIZE_MAX;
+
+	size_t mask = p->name_capacity - 1;
+	size_t at = (size_t)hash & mask;
+	for (; p->names[at].offset; at = (at + 1) & mask) {
+		USEC_BindingName* slot = &p->names[at];
+		if (slot->hash == hash && slot->length == length &&
+			memcmp(p->binding_names.buffer + slot->offset - 1, name, length) == 0) return at;
+	}
+	if (!add) return SIZE_MAX;
+
+	USEC_BindingName* slot = &p->names[at];
+	slot->hash = hash;
+	slot->offset = p->binding_names.length + 1;
+	slot->length = length;
+	slot->binding = SIZE_MAX;
+	sb_append_data(&p->binding_names, name, length);
+	++p->name_count;
+	return at;
+}
+
+// Binds the entries declared in the local scope at depth since it was last bound
+static void bind_scope(USEC_Parser* p, size_t depth) {
+	USEC_Scope* scope = &p->var_stack[depth];
+	Usec_Hashtable* vars = scope->vars;
+	for (; scope->bound < vars->size; ++scope->bound) {
+		Usec_HashNode* entry = &vars->entries[scope->bound];
+		size_t name = name_slot(p, entry->key, strlen(entry->key), entry->hash, true);
+		if (p->binding_count >= p->binding_capacity) {
+			p->binding_capacity = p->binding_capacity ? p->binding_capacity * 2 : 16;
+			p->bindings = realloc(p->bindings, sizeof(USEC_Binding) * p->binding_capacity);
+		}
+		USEC_Binding* binding = &p->bindings[p->binding_count];
+		binding->name = name;
+		binding->depth = depth;
+		binding->slot = scope->bound;
+		binding->shadowed = p->names[name].binding;
+		p->names[name].binding = p->binding_count++;
 	}
-	p->var_stack[p->var_stack_size++] = vars;
 }
 
-static void scope_pop(USEC_Parser* p) {
-	if (p->var_stack_size > 0) {
-		p->var_stack_size--;
+void usec_parser_push_scope(USEC_Parser* p, Usec_Hashtable* vars) {
+	if (p->var_stack_size > 1) bind_scope(p, p->var_stack_size - 1); // the global scope is never bound
+	if (p->var_stack_size >= p->var_stack_capacity) {
+		p->var_stack_capacity = p->var_stack_capacity ? p->var_stack_capacity * 2 : 16;
+		p->var_stack = realloc(p->var_stack, sizeof(USEC_Scope) * p->var_stack_capacity);
 	}
+	USEC_Scope* scope = &p->var_stack[p->var_stack_size++];
+	scope->vars = vars;
+	scope->bound = 0;
+	scope->bindings = p->binding_count;
+}
+
+void usec_parser_pop_scope(USEC_Parser* p) {
+	if (p->var_stack_size <= 1) return;
+	USEC_Scope* scope = &p->var_stack[--p->var_stack_size];
+	while (p->binding_count > scope->bindings) {
+		USEC_Binding* binding = &p->bindings[--p->binding_count];
+		p->names[binding->name].binding = binding->shadowed;
+	}
+}
+
+// Local scope tables come from the pool and go back to it cleared
+static Usec_Hashtable* scope_take(USEC_Parser* p) {
+	if (p->scope_pool_size > 0) return p->scope_pool[--p->scope_pool_size];
+	return usec_ht_create(8);
+}
+
+static void scope_return(USEC_Parser* p, Usec_Hashtable* scope) {
+	usec_ht_clear(scope);
+	if (p->scope_pool_size >= p->scope_pool_capacity) {
+		p->scope_pool_capacity = p->scope_pool_capacity ? p->scope_pool_capacity * 2 : 8;
+		p->scope_pool = realloc(p->scope_pool, sizeof(Usec_Hashtable*) * p->scope_pool_capacity);
+	}
+	p->scope_pool[p->scope_pool_size++] = scope;
+}
+
+// Token text
+static const char* token_text(USEC_Parser* p, USEC_Token* tok) {
+	return usec_token_text(p->tokenizer, tok);
+}
+
+static bool token_equals(USEC_Parser* p, USEC_Token* tok, const char* text) {
+	size_t len = strlen(text);
+	return tok->length == len && memcmp(token_text(p, tok), text, len) == 0;
 }
 
 static USEC_Value* get_variable(USEC_Parser* p, USEC_Token* tok) {
-	const char* name = tok->value;
+	const char* name = token_text(p, tok);
 	USEC_Value* result = NULL;
 
-	// Search stack from top (n-1) to index 1 for local scopes
+	// Innermost local declaration of the name
 	if (p->var_stack_size > 1) {
-		for (int i = (int)p->var_stack_size - 1; i >= 1; --i) {
-			result = usec_ht_get(p->var_stack[i], name);
+		bind_scope(p, p->var_stack_size - 1);
+		size_t slot = name_slot(p, name, tok->length, tok->hash, false);
+		if (slot != SIZE_MAX && p->names[slot].binding != SIZE_MAX) {
+			USEC_Binding* binding = &p->bindings[p->names[slot].binding];
+			result = p->var_stack[binding->depth].vars->entries[binding->slot].value;
 			if (result) return result;
 		}
 	}
 
-	// Fallback to global (index 0)
-	result = usec_ht_get(p->var_stack[0], name);
+	// Fallback to global (index 0), then the shared base
+	result = usec_ht_get_hashed(p->var_stack[0].vars, name, tok->length, tok->hash);
+	if (!result && p->base) result = usec_ht_get_hashed(p->base, name, tok->length, tok->hash);
 
 	if (!result) {
-		parser_error(p, tok, "Undefined variable");
+		parser_error(p, tok, USEC_ERROR_UNDEFINED_VARIABLE, "Undefined variable");
 		return NULL;
 	}
 
 	return result;
 }
 
-// Current token
+// Makes the token at index available when streaming. The tokens before the previous one are dropped.
+static bool pull(USEC_Parser* p, size_t index) {
+	if (!p->stream) return false;
+	USEC_Tokenizer* t = p->tokenizer;
+	p->token_count = usec_tokenizer_pull(t, p->index > 0 ? p->index - 1 : 0, index);
+	p->tokens = t->tokens;
+	p->token_base = t->token_base;
+	if (t->has_error) p->failed = true; // the parse is discarded anyway
+	return index < p->token_count;
+}
+
+static USEC_Token* token_at(USEC_Parser* p, size_t index) {
+	return &p->tokens[index - p->token_base];
+}
+
+// End of file marker
+static USEC_Token* last_token(USEC_Parser* p) {
+	return token_at(p, p->token_count - 1);
+}
+
+// Current token, the end of file marker past the end
 static USEC_Token* current(USEC_Parser* p) {
-	return &p->tokens[p->index];
+	if (p->index >= p->token_count && !pull(p, p->index)) return last_token(p);
+	return token_at(p, p->index);
 }
 
 static USEC_Token* peek(USEC_Parser* p) {
-	if (p->index + 1 >= p->token_count) return NULL;
-	return &p->tokens[p->index + 1];
+	if (p->index + 1 >= p->token_count && !pull(p, p->index + 1)) return NULL;
+	return token_at(p, p->index + 1);
 }
 
 static bool eof(USEC_Parser* p) {
-	return p->index >= p->token_count;
+	return p->index >= p->token_count && !pull(p, p->index);
 }
 
-static USEC_Token* next(USEC_Parser* p) {
-	if (!eof(p)) return &p->tokens[++p->index];
-	return NULL;
+static void next(USEC_Parser* p) {
+	if (!eof(p)) ++p->index;
 }
 
 static bool check(USEC_Parser* p, USEC_TokenType type) {
-	return !eof(p) && p->tokens[p->index].type == type;
+	return !eof(p) && token_at(p, p->index)->type == type;
 }
 
 static bool optional(USEC_Parser* p, USEC_TokenType type) {
@@ -133,7 +233,7 @@ static bool optional(USEC_Parser* p, USEC_TokenType type) {
 
 static bool assert(USEC_Parser* p, USEC_TokenType type) {
 	if (!check(p, type)) {
-		parser_error(p, current(p), "Unexpected token");
+		parser_error(p, current(p), USEC_ERROR_UNEXPECTED_TOKEN, "Unexpected token");
 		return false;
 	}
 	return true;
@@ -147,91 +247,130 @@ static bool cons_ret(USEC_Parser* p, USEC_TokenType type) {
 
 // === Value Construction ===
 
-static USEC_Value* make_value(USEC_ValueType type) {
-	USEC_Value* val = calloc(1, sizeof(USEC_Value));
+static USEC_Value* make_value(USEC_Parser* p, USEC_ValueType type) {
+	USEC_Value* val;
+	if (p->arena) {
+		val = usec_arena_calloc(p->arena, sizeof(USEC_Value));
+		val->flags = USEC_VALUE_ARENA;
+	} else {
+		val = calloc(1, sizeof(USEC_Value));
+	}
 	val->type = type;
 	return val;
 }
 
-static USEC_Value* parse_value(USEC_Parser* p);
+// Values are followed by the text of strings, the next value starts aligned
+#define VALUE_ALIGN 8
 
-static USEC_Value* parse_number(USEC_Parser* p) {
-	const char* raw = current(p)->value;
-	next(p);
+static size_t string_value_size(size_t len) {
+	return (sizeof(USEC_Value) + len + 1 + VALUE_ALIGN - 1) & ~(size_t)(VALUE_ALIGN - 1);
+}
 
-	// Check if it's clearly floating point syntax
-	bool is_float = strchr(raw, '.') || strchr(raw, 'e') || strchr(raw, 'E');
+// Points a string value at the text stored right behind it
+static void init_string_value(USEC_Value* val, uint32_t flags, const char* data, size_t len) {
+	val->type = VALUE_STRING;
+	val->flags = flags | USEC_VALUE_INLINE;
+	val->stringValue = (char*)(val + 1);
+	memcpy(val->stringValue, data, len);
+	val->stringValue[len] = '\0';
+}
 
-	// CASE: clearly a float -> parse as double
-	if (is_float) {
-		bool ok = false;
-		double val = safe_strtod(raw, &ok);
-		if (!ok) {
-			parser_error(p, current(p), "Invalid floating-point number");
-			return NULL;
-		}
-		USEC_Value* v = make_value(VALUE_DOUBLE);
-		v->doubleValue = val;
-		return v;
+USEC_Value* usec_parser_string_value(const char* data, size_t length) {
+	USEC_Value* val = malloc(string_value_size(length));
+	init_string_value(val, 0, data, length);
+	return val;
+}
+
+static USEC_Value* make_string_value(USEC_Parser* p, const SB* sb) {
+	if (!p->arena) return usec_parser_string_value(sb->buffer, sb->length);
+	USEC_Value* val = usec_arena_alloc(p->arena, string_value_size(sb->length));
+	init_string_value(val, USEC_VALUE_ARENA, sb->buffer, sb->length);
+	return val;
+}
+
+static USEC_ParsedItem* push_item(USEC_Parser* p) {
+	if (p->item_stack_size >= p->item_stack_capacity) {
+		p->item_stack_capacity = p->item_stack_capacity ? p->item_stack_capacity * 2 : 64;
+		p->item_stack = realloc(p->item_stack, sizeof(USEC_ParsedItem) * p->item_stack_capacity);
 	}
+	return &p->item_stack[p->item_stack_size++];
+}
 
-	// Try parsing as signed/unsigned int (if no dot/e/E seen)
-	int64_t s_val = 0;
-	uint64_t u_val = 0;
+static USEC_Value* parse_value(USEC_Parser* p);
+
+// Reads the number at the current token into out, from the digits the tokenizer accumulated
+static bool read_number(USEC_Parser* p, USEC_Value* out) {
+	USEC_Token* tok = current(p);
+	uint64_t mantissa = tok->mantissa;
+	int32_t exponent = tok->number.exponent;
+	uint8_t flags = tok->number.flags;
+	bool negative = flags & USEC_NUMBER_NEGATIVE;
+	const char* text = token_text(p, tok) + negative;
+	size_t length = tok->length - negative;
+	next(p);
 
-	if (raw[0] == '-') {
-		if (try_parse_int64(raw, &s_val)) {
-			USEC_Value* v = make_value(VALUE_INT);
-			v->int64Value = s_val;
-			return v;
+	if (!(flags & USEC_NUMBER_FLOAT)) {
+		// 20 digits can still fit, their last one is the only digit that was dropped
+		if (exponent == 1 && !negative) {
+			uint64_t last = (uint64_t)(text[length - 1] - '0');
+			if (mantissa <= (UINT64_MAX - last) / 10) {
+				out->type = VALUE_UINT;
+				out->uint64Value = mantissa * 10 + last;
+				return true;
+			}
 		}
-	} else {
-		if (try_parse_uint64(raw, &u_val)) {
-			USEC_Value* v = make_value(VALUE_UINT);
-			v->uint64Value = u_val;
-			return v;
+		if (exponent == 0) {
+			if (!negative) {
+				out->type = VALUE_UINT;
+				out->uint64Value = mantissa;
+				return true;
+			}
+			if (mantissa <= (uint64_t)INT64_MAX + 1) {
+				out->type = VALUE_INT;
+				out->int64Value = mantissa == (uint64_t)INT64_MAX + 1 ? INT64_MIN : -(int64_t)mantissa;
+				return true;
+			}
 		}
+		// Doesn't fit into int/uint64, so it's read as a double
 	}
 
-	// Fallback: can't fit into int/uint64, so parse as double
-	bool ok = false;
-	double fallback = safe_strtod(raw, &ok);
-	if (!ok) {
-		parser_error(p, current(p), "Invalid fallback double parse");
-		return NULL;
+	double value = usec_decimal_to_double(mantissa, exponent, flags & USEC_NUMBER_TRUNCATED, text, length);
+	// Out of range: overflowing, or a nonzero number rounding to zero. Subnormals are fine.
+	if (isinf(value) || (mantissa != 0 && value == 0.0)) {
+		parser_error(p, current(p), USEC_ERROR_INVALID_NUMBER, (flags & USEC_NUMBER_FLOAT) ? "Invalid floating-point number" : "Invalid fallback double parse");
+		return false;
 	}
-
-	USEC_Value* v = make_value(VALUE_DOUBLE);
-	v->doubleValue = fallback;
-	return v;
+	out->type = VALUE_DOUBLE;
+	out->doubleValue = negative ? -value : value;
+	return true;
 }
 
-static USEC_Value* parse_string(USEC_Parser* p) {
+// Parses a string into p->string_buf
+static void parse_string_text(USEC_Parser* p) {
 	assert(p, TOK_STRING_START);
 	next(p);
-	SB sb = sb_create();
+	SB* sb = &p->string_buf;
+	sb_reset(sb);
 
-	while (!eof(p)) {
+	while (!eof(p) && !p->failed) {
 		USEC_Token* tok = current(p);
 		if (tok->type == TOK_STRING) {
 			// Add literal string content
-			sb_append_str(&sb, tok->value);
+			sb_append_data(sb, token_text(p, tok), tok->length);
 			next(p);
 		} else if (tok->type == TOK_IDENTIFIER) {
 			// Variable interpolation
 			if (p->keep_variables) {
-				sb_append_str(&sb, "$(");
-				sb_append_str(&sb, tok->value);
-				sb_append_char(&sb, ')');
+				sb_append_str(sb, "$(");
+				sb_append_data(sb, token_text(p, tok), tok->length);
+				sb_append_char(sb, ')');
 			} else {
 				// Resolve interpolated value from scope
 				USEC_Value* resolved = get_variable(p, tok);
 				if (resolved && resolved->type == VALUE_STRING) {
-					sb_append_str(&sb, resolved->stringValue);
+					sb_append_str(sb, resolved->stringValue);
 				} else if (resolved) {
-					if (!sb_append_value_repr(&sb, resolved)) parser_error(p, tok, "Unsupported string interpolation");
-				} else {
-					parser_error(p, tok, "Undefined variable");
+					if (!sb_append_value_repr(sb, resolved)) parser_error(p, tok, USEC_ERROR_INTERPOLATION, "Unsupported string interpolation");
 				}
 			}
 			next(p);
@@ -239,270 +378,480 @@ static USEC_Value* parse_string(USEC_Parser* p) {
 			next(p);
 			break;
 		} else {
-			parser_error(p, tok, "Unexpected token in string");
+			parser_error(p, tok, USEC_ERROR_UNEXPECTED_TOKEN, "Unexpected token in string");
 			next(p);
 		}
 	}
 
-	char* final = sb_build(&sb);
-	USEC_Value* val = make_value(VALUE_STRING);
-	val->stringValue = final ? final : strdup("");
-	return val;
 }
 
-static USEC_Value* parse_char(USEC_Parser* p) {
-	if (!check(p, TOK_CHAR))
-		parser_error(p, current(p), "Expected character literal");
-
-	USEC_Value* val = make_value(VALUE_CHAR);
-	val->charValue = current(p)->value[0];
-	next(p);
-	return val;
-}
+// Reads a variable reference into p->string_buf
+static bool read_identifier(USEC_Parser* p) {
+	USEC_Token* tok = current(p);
 
-static USEC_Value* parse_identifier(USEC_Parser* p) {
-	const char* name = current(p)->value;
+	SB* sb = &p->string_buf;
+	sb_reset(sb);
 
 	if (p->keep_variables) {
 		// Return string: $($name)
-		SB sb = sb_create();
-		sb_append_str(&sb, "$($");
-		sb_append_str(&sb, name);
-		sb_append_char(&sb, ')');
+		sb_append_str(sb, "$($");
+		sb_append_data(sb, token_text(p, tok), tok->length);
+		sb_append_char(sb, ')');
 
-		USEC_Value* val = make_value(VALUE_STRING);
-		val->stringValue = sb_build(&sb);
 		next(p);
-		return val;
+		return true;
 	} else {
 		// Lookup variable value from scope
 		USEC_Value* resolved = get_variable(p, current(p));
-		if (!resolved) {
-			parser_error(p, current(p), "Undefined variable");
-			return NULL;
-		}
+		if (!resolved) return false;
 		next(p);
 
 		// Use string builder to serialize any primitive into a VALUE_STRING
-		SB sb = sb_create();
-		if (!sb_append_value_repr(&sb, resolved)) {
-			parser_error(p, current(p), "Unsupported string interpolation");
-			sb_free(&sb);
-			return NULL;
+		if (!sb_append_value_repr(sb, resolved)) {
+			parser_error(p, current(p), USEC_ERROR_INTERPOLATION, "Unsupported string interpolation");
+			return false;
 		}
 
-		USEC_Value* val = make_value(VALUE_STRING);
-		val->stringValue = sb_build(&sb);
-		return val;
+		return true;
 	}
 }
 
-static USEC_Statement* parse_statement(USEC_Parser* p);
+// Reads the scalar at the current token into out without allocating. The text of strings is left in p->string_buf.
+static bool read_scalar(USEC_Parser* p, USEC_Value* out) {
+	USEC_Token* tok = current(p);
+	memset(out, 0, sizeof(USEC_Value));
 
-static USEC_Statement* parse_declaration(USEC_Parser* p) {
-	next(p);  // consume ':'
+	switch (tok->type) {
+	case TOK_KEYWORD:
+		if (token_equals(p, tok, "true")) {
+			out->type = VALUE_BOOL;
+			out->boolValue = true;
+		} else if (token_equals(p, tok, "false")) {
+			out->type = VALUE_BOOL;
+			out->boolValue = false;
+		} else if (token_equals(p, tok, "null")) {
+			out->type = VALUE_NULL;
+		} else {
+			return false;
+		}
+		next(p);
+		return true;
 
-	char* key = NULL;
+	case TOK_NUMBER:
+		return read_number(p, out);
 
-	if (check(p, TOK_IDENTIFIER)) {
-		key = strdup(current(p)->value);
+	case TOK_CHAR:
+		out->type = VALUE_CHAR;
+		out->charValue = token_text(p, tok)[0];
 		next(p);
-	} else {
-		if (check(p, TOK_NEWLINE)) return NULL;
-		parser_error(p, current(p), "Expected identifier key in declaration");
-		return NULL;
+		return true;
+
+	case TOK_STRING_START:
+		parse_string_text(p);
+		out->type = VALUE_STRING;
+		out->stringValue = p->string_buf.buffer;
+		return true;
+
+	case TOK_IDENTIFIER:
+		if (!read_identifier(p)) return false;
+		out->type = VALUE_STRING;
+		out->stringValue = p->string_buf.buffer;
+		return true;
+
+	default:
+		parser_error(p, tok, USEC_ERROR_UNEXPECTED_TOKEN, "Unexpected token in value");
+		return false;
 	}
+}
 
-	if (!p->compact && cons_ret(p, TOK_SPACE)) return NULL;
-	if (cons_ret(p, TOK_EQUALS)) return NULL;
-	if (!p->compact && cons_ret(p, TOK_SPACE)) return NULL;
+// Allocated copy of a scalar from read_scalar
+static USEC_Value* make_scalar(USEC_Parser* p, const USEC_Value* scalar) {
+	if (scalar->type == VALUE_STRING) return make_string_value(p, &p->string_buf);
+
+	USEC_Value* val = make_value(p, scalar->type);
+	uint32_t flags = val->flags;
+	*val = *scalar;
+	val->flags = flags;
+	return val;
+}
 
-	USEC_Value* val = parse_value(p);
-	if (!val) return NULL;
+// Pushes a scalar from read_scalar, copying the text of strings to item_strings
+static void push_scalar(USEC_Parser* p, const USEC_Value* scalar) {
+	USEC_ParsedItem* item = push_item(p);
+	item->value = *scalar;
+	if (scalar->type == VALUE_STRING) {
+		item->string_offset = p->item_strings.length;
+		item->string_length = p->string_buf.length;
+		sb_append_data(&p->item_strings, p->string_buf.buffer, p->string_buf.length);
+	}
+}
 
-	USEC_Statement* stmt = malloc(sizeof(USEC_Statement));
-	stmt->type = STATEMENT_DECLARATION;
-	stmt->key = key;
-	stmt->value = val;
-	return stmt;
+static void key_from_token(USEC_Parser* p, USEC_Statement* stmt) {
+	USEC_Token* tok = current(p);
+	stmt->key_text = token_text(p, tok);
+	stmt->key_length = tok->length;
+	stmt->key_hash = tok->hash;
+	next(p);
 }
 
-static USEC_Statement* parse_assignment(USEC_Parser* p) {
-	char* key = NULL;
+static const char* statement_key(USEC_Parser* p, const USEC_Statement* stmt) {
+	return stmt->key_text ? stmt->key_text : p->key_stack.buffer + stmt->key_offset;
+}
 
-	if (check(p, TOK_IDENTIFIER)) {
-		key = strdup(current(p)->value);
-		next(p);
-	} else if (check(p, TOK_STRING_START)) {
-		USEC_Value* sval = parse_string(p);
-		if (!sval || sval->type != VALUE_STRING) {
-			parser_error(p, current(p), "String key parse error");
-			return NULL;
-		}
-		key = strdup(sval->stringValue);
-		usec_parser_free_value(sval);
-	} else {
-		if (check(p, TOK_NEWLINE)) return NULL;
-		parser_error(p, current(p), "Expected identifier or string key in assignment");
-		return NULL;
+// Pops a string key off the key stack
+static void release_key(USEC_Parser* p, USEC_Statement* stmt) {
+	if (!stmt->key_text) {
+		p->key_stack.length = stmt->key_offset;
+		p->key_stack.buffer[stmt->key_offset] = '\0';
 	}
+}
 
-	if (!p->compact && cons_ret(p, TOK_SPACE)) return NULL;
-	if (cons_ret(p, TOK_EQUALS)) return NULL;
-	if (!p->compact && cons_ret(p, TOK_SPACE)) return NULL;
+static bool parse_declaration(USEC_Parser* p, USEC_Statement* stmt) {
+	next(p);  // consume ':'
 
-	USEC_Value* val = parse_value(p);
-	if (!val) return NULL;
+	if (check(p, TOK_IDENTIFIER)) {
+		key_from_token(p, stmt);
+	} else {
+		if (check(p, TOK_NEWLINE)) return false;
+		parser_error(p, current(p), USEC_ERROR_UNEXPECTED_TOKEN, "Expected identifier key in declaration");
+		return false;
+	}
 
-	USEC_Statement* stmt = malloc(sizeof(USEC_Statement));
-	stmt->type = STATEMENT_ASSIGNMENT;
-	stmt->key = key;
-	stmt->value = val;
-	return stmt;
+	stmt->type = STATEMENT_DECLARATION;
+	return true;
 }
 
-static USEC_Statement* parse_statement(USEC_Parser* p) {
-	if (check(p, TOK_COLON)) {
-		return parse_declaration(p);
+static bool parse_assignment(USEC_Parser* p, USEC_Statement* stmt) {
+	if (check(p, TOK_IDENTIFIER)) {
+		key_from_token(p, stmt);
+	} else if (check(p, TOK_STRING_START)) {
+		parse_string_text(p);
+		stmt->key_text = NULL;
+		stmt->key_offset = p->key_stack.length;
+		stmt->key_length = p->string_buf.length;
+		stmt->key_hash = usec_hash(p->string_buf.buffer, p->string_buf.length);
+		sb_append_data(&p->key_stack, p->string_buf.buffer, p->string_buf.length);
+		sb_append_char(&p->key_stack, '\0');
 	} else {
-		return parse_assignment(p);
+		if (check(p, TOK_NEWLINE)) return false;
+		parser_error(p, current(p), USEC_ERROR_UNEXPECTED_TOKEN, "Expected identifier or string key in assignment");
+		return false;
 	}
+
+	stmt->type = STATEMENT_ASSIGNMENT;
+	return true;
 }
 
-static USEC_Value* parse_array(USEC_Parser* p) {
-	assert(p, TOK_ARRAY_OPEN);
-	next(p);
+// Parses the key of a statement and the '=' after it, leaving the parser at the value
+static bool parse_statement_key(USEC_Parser* p, USEC_Statement* stmt) {
+	stmt->key_text = NULL;
+	stmt->key_offset = p->key_stack.length;
+	stmt->value = NULL;
 
-	USEC_Value* arr = make_value(VALUE_ARRAY);
-	arr->arrayValue.items = NULL;
-	arr->arrayValue.count = 0;
-	size_t capacity = 0;
+	bool ok = check(p, TOK_COLON) ? parse_declaration(p, stmt) : parse_assignment(p, stmt);
+	if (!ok) return false;
 
-	if (check(p, TOK_NEWLINE)) {
-		if (p->compact) parser_error(p, current(p), "Unnecessary newline");
+	if ((!p->compact && cons_ret(p, TOK_SPACE)) ||
+		cons_ret(p, TOK_EQUALS) ||
+		(!p->compact && cons_ret(p, TOK_SPACE))) {
+		release_key(p, stmt);
+		return false;
+	}
+
+	stmt->value_index = p->index;
+	return true;
+}
+
+// Steps over the value at the current token without building it. Errors inside the value are left
+// for when it's parsed, only a token that can't start a value is reported.
+static bool skip_value(USEC_Parser* p) {
+	USEC_Token* tok = current(p);
+	switch (tok->type) {
+	case TOK_ARRAY_OPEN:
+	case TOK_BRACE_OPEN:
+		p->index = tok->pair + 1;
+		return true;
+	case TOK_STRING_START:
+		while (!eof(p) && current(p)->type != TOK_STRING_END) next(p);
+		next(p);
+		return true;
+	case TOK_KEYWORD:
+	case TOK_NUMBER:
+	case TOK_CHAR:
+	case TOK_IDENTIFIER:
 		next(p);
+		return true;
+	default:
+		parser_error(p, tok, USEC_ERROR_UNEXPECTED_TOKEN, "Unexpected token in value");
+		return false;
 	}
+}
 
-	while (!check(p, TOK_ARRAY_CLOSE)) {
-		USEC_Value* item = parse_value(p);
-		if (item) {
-			if (arr->arrayValue.count >= capacity) {
-				capacity = capacity ? (capacity * 2) : 4;
-				arr->arrayValue.items = realloc(arr->arrayValue.items, sizeof(USEC_Value*) * capacity);
-			}
-			arr->arrayValue.items[arr->arrayValue.count++] = item;
-		}
+// Parses a statement into stmt. On success the caller has to release_key after storing it.
+// Lazy statements skip assigned values, leaving them at stmt->value_index.
+static bool parse_statement(USEC_Parser* p, USEC_Statement* stmt, bool lazy) {
+	if (!parse_statement_key(p, stmt)) return false;
 
-		if (check(p, TOK_NEWLINE)) {
-			if (peek(p)->type == TOK_ARRAY_CLOSE && p->compact) parser_error(p, current(p), "Unnecessary newline");
-			next(p);
-		} else assert(p, TOK_ARRAY_CLOSE);
+	if (lazy && stmt->type == STATEMENT_ASSIGNMENT) {
+		if (skip_value(p)) return true;
+		release_key(p, stmt);
+		return false;
 	}
-	next(p);
 
-	// Shrink to fit
-	if (arr->arrayValue.count < capacity) {
-		arr->arrayValue.items = realloc(arr->arrayValue.items, sizeof(USEC_Value*) * arr->arrayValue.count);
+	stmt->value = parse_value(p);
+	if (!stmt->value) {
+		release_key(p, stmt);
+		return false;
 	}
+	return true;
+}
 
-	return arr;
+// Members of the tables of a parse share their keys. Heap tables of arena parses, like the caller's
+// variables, get copies.
+static void set_member(USEC_Parser* p, Usec_Hashtable* table, const char* key, size_t length, uint64_t hash, USEC_Value* value) {
+	if (table->arena != p->arena) {
+		usec_ht_set_hashed(table, key, length, hash, value);
+		return;
+	}
+	const char* atom = usec_atoms_intern(&p->atoms, p->arena, key, length, hash);
+	USEC_Value* old = usec_ht_swap_shared(table, atom, length, hash, value);
+	if (old && !table->arena) usec_free(old);
 }
 
-static USEC_Value* parse_object(USEC_Parser* p) {
-	assert(p, TOK_BRACE_OPEN);
+// Stores a parsed statement, declarations go into the scope table
+static void store_statement(USEC_Parser* p, Usec_Hashtable* object, Usec_Hashtable* scope, USEC_Statement* stmt) {
+	const char* key = statement_key(p, stmt);
+
+	if (stmt->type == STATEMENT_DECLARATION) {
+		// The caller's table outlives arena documents, it gets heap copies
+		bool copy = p->arena && scope == p->variables && scope != p->globals;
+		set_member(p, scope, key, stmt->key_length, stmt->key_hash, copy ? usec_clone(stmt->value) : stmt->value);
+
+		if (p->keep_variables) {
+			SB* out_key = &p->scratch;
+			sb_reset(out_key);
+			sb_append_char(out_key, '$');
+			sb_append_data(out_key, key, stmt->key_length);
+			// The scope owns heap values, the object gets its own copy
+			set_member(p, object, out_key->buffer, out_key->length, usec_hash(out_key->buffer, out_key->length),
+				p->arena ? stmt->value : usec_clone(stmt->value));
+		}
+	} else if (stmt->type == STATEMENT_ASSIGNMENT) {
+		set_member(p, object, key, stmt->key_length, stmt->key_hash, stmt->value);
+	}
+}
+
+// Consumes the opener of an array or object and a newline after it
+static void open_container(USEC_Parser* p, USEC_TokenType opener) {
+	assert(p, opener);
 	next(p);
 
-	USEC_Value* obj = malloc(sizeof(USEC_Value));
-	obj->type = VALUE_OBJECT;
-	obj->objectValue = usec_ht_create(8);
+	if (check(p, TOK_NEWLINE)) {
+		if (p->compact) parser_error(p, current(p), USEC_ERROR_FORMAT, "Unnecessary newline");
+		next(p);
+	}
+}
 
-	// Local scope
-	Usec_Hashtable* local = NULL;
+static bool in_container(USEC_Parser* p, USEC_TokenType closer) {
+	return !eof(p) && !p->failed && !check(p, closer);
+}
 
+// Consumes the newline after an item or statement that started at start, unless the closer follows
+static void separate_item(USEC_Parser* p, USEC_TokenType closer, size_t start) {
 	if (check(p, TOK_NEWLINE)) {
-		if (p->compact) parser_error(p, current(p), "Unnecessary newline");
+		if (peek(p)->type == closer && p->compact) parser_error(p, current(p), USEC_ERROR_FORMAT, "Unnecessary newline");
 		next(p);
+	} else if (!assert(p, closer) && p->index == start) {
+		next(p); // skip the offending token to make progress
 	}
+}
 
-	while (!check(p, TOK_BRACE_CLOSE)) {
-		size_t line = current(p)->line;
-		size_t col = current(p)->col;
+static void pack_item(USEC_Parser* p, const USEC_Value* scalar) {
+	size_t size = usec_packed_size(scalar->type);
+	if (p->pack_stack_size + size > p->pack_stack_capacity) {
+		p->pack_stack_capacity = p->pack_stack_capacity ? p->pack_stack_capacity * 2 : 512;
+		p->pack_stack = realloc(p->pack_stack, p->pack_stack_capacity);
+	}
+	memcpy(p->pack_stack + p->pack_stack_size, &scalar->int64Value, size);
+	p->pack_stack_size += size;
+}
 
-		USEC_Statement* stmt = parse_statement(p);
-		if (stmt && stmt->key) {
-			if (stmt->type == STATEMENT_DECLARATION) {
-				if (!local) {
-					local = usec_ht_create(8);
-					scope_push(p, local);
-				}
+// Turns the elements packed since base into items, once an item doesn't fit
+static void unpack_items(USEC_Parser* p, USEC_ValueType type, size_t base) {
+	size_t size = usec_packed_size(type);
+	for (size_t at = base; size > 0 && at < p->pack_stack_size; at += size) {
+		USEC_Value scalar;
+		memset(&scalar, 0, sizeof(scalar));
+		scalar.type = type;
+		memcpy(&scalar.int64Value, p->pack_stack + at, size);
+		push_scalar(p, &scalar);
+	}
+	p->pack_stack_size = base;
+}
+
+// Moves the items pushed since base into one block: the item pointers, then the values, each string
+// followed by its text. The block is freed with the array, its items are only flagged as embedded.
+static void build_items(USEC_Parser* p, USEC_Value* arr, size_t base, size_t strings_base) {
+	size_t count = p->item_stack_size - base;
+	if (count > 0) {
+		size_t header = (sizeof(USEC_Value*) * count + VALUE_ALIGN - 1) & ~(size_t)(VALUE_ALIGN - 1);
+		size_t size = header;
+		for (size_t i = base; i < p->item_stack_size; ++i) {
+			USEC_ParsedItem* item = &p->item_stack[i];
+			size += item->value.type == VALUE_STRING ? string_value_size(item->string_length) : sizeof(USEC_Value);
+		}
 
-				// Store in scope
-				usec_ht_set(local, stmt->key, stmt->value);
+		char* block = p->arena ? usec_arena_alloc(p->arena, size) : malloc(size);
+		USEC_Value** items = (USEC_Value**)block;
+		char* at = block + header;
+		uint32_t flags = p->arena ? USEC_VALUE_ARENA : USEC_VALUE_EMBEDDED;
+		for (size_t i = 0; i < count; ++i) {
+			USEC_ParsedItem* item = &p->item_stack[base + i];
+			USEC_Value* val = (USEC_Value*)at;
+			if (item->value.type == VALUE_STRING) {
+				init_string_value(val, flags, p->item_strings.buffer + item->string_offset, item->string_length);
+				at += string_value_size(item->string_length);
+			} else {
+				*val = item->value;
+				val->flags = flags;
+				at += sizeof(USEC_Value);
+			}
+			items[i] = val;
+		}
+		arr->arrayValue.items = items;
+		arr->arrayValue.count = count;
+	}
+	p->item_stack_size = base;
+	p->item_strings.length = strings_base;
+	p->item_strings.buffer[strings_base] = '\0';
+}
 
-				if (p->keep_variables) {
-					char* out_key = NULL;
-					asprintf(&out_key, "$%s", stmt->key);
-					usec_ht_set(obj->objectValue, out_key, stmt->value);
-					free(out_key);
+static void parse_object_into(USEC_Parser* p, USEC_Value* obj, const Usec_Hashtable* like);
+
+static void parse_array_into(USEC_Parser* p, USEC_Value* arr) {
+	open_container(p, TOK_ARRAY_OPEN);
+
+	arr->type = VALUE_ARRAY;
+	arr->arrayValue.items = NULL;
+	arr->arrayValue.count = 0;
+	size_t base = p->item_stack_size;
+	size_t strings_base = p->item_strings.length;
+
+	// Scalar items of one type are packed without allocating them, until an item of another kind comes
+	bool packing = p->pack_arrays;
+	bool typed = false; // packed_type is set once the first element is packed
+	USEC_ValueType packed_type = VALUE_NULL;
+	size_t pack_base = p->pack_stack_size;
+
+	// Records of an array mostly have the keys of the record before them
+	const Usec_Hashtable* previous = NULL;
+
+	while (in_container(p, TOK_ARRAY_CLOSE)) {
+		size_t start = p->index;
+		if (check(p, TOK_ARRAY_OPEN) || check(p, TOK_BRACE_OPEN)) {
+			if (packing) {
+				unpack_items(p, packed_type, pack_base);
+				packing = false;
+			}
+			// Built in place, the item stack may move while the container is parsed
+			USEC_Value container;
+			memset(&container, 0, sizeof(container));
+			if (check(p, TOK_ARRAY_OPEN)) {
+				parse_array_into(p, &container);
+			} else {
+				parse_object_into(p, &container, previous);
+				previous = container.objectValue;
+			}
+			push_item(p)->value = container;
+		} else {
+			USEC_Value scalar;
+			if (read_scalar(p, &scalar)) {
+				if (packing && usec_packed_size(scalar.type) > 0 && (!typed || scalar.type == packed_type)) {
+					typed = true;
+					packed_type = scalar.type;
+					pack_item(p, &scalar);
+				} else {
+					if (packing) {
+						unpack_items(p, packed_type, pack_base);
+						packing = false;
+					}
+					push_scalar(p, &scalar);
 				}
-			} else if (stmt->type == STATEMENT_ASSIGNMENT) {
-				// Store in object
-				usec_ht_set(obj->objectValue, stmt->key, stmt->value);
 			}
 		}
+		separate_item(p, TOK_ARRAY_CLOSE, start);
+	}
+	next(p);
+
+	if (packing && typed) {
+		size_t size = p->pack_stack_size - pack_base;
+		size_t count = size / usec_packed_size(packed_type);
+		if (count <= UINT32_MAX) {
+			arr->type = VALUE_PACKED_ARRAY;
+			arr->packedValue.data = p->arena ? usec_arena_alloc(p->arena, size) : malloc(size);
+			memcpy(arr->packedValue.data, p->pack_stack + pack_base, size);
+			arr->packedValue.count = (uint32_t)count;
+			arr->packedValue.elementType = packed_type;
+			p->pack_stack_size = pack_base;
+			return;
+		}
+		unpack_items(p, packed_type, pack_base);
+	}
 
-		if (check(p, TOK_NEWLINE)) {
-			if (peek(p)->type == TOK_BRACE_CLOSE && p->compact) parser_error(p, current(p), "Unnecessary newline");
-			next(p);
-		} else assert(p, TOK_BRACE_CLOSE);
+	build_items(p, arr, base, strings_base);
+}
+
+// like is a table the object probably has the keys of. Its entries are sized after it and share its index if they match
+// and it has one, see usec_ht_share_shape.
+static void parse_object_into(USEC_Parser* p, USEC_Value* obj, const Usec_Hashtable* like) {
+	open_container(p, TOK_BRACE_OPEN);
+
+	obj->type = VALUE_OBJECT;
+	obj->objectValue = usec_ht_create_in(p->arena, like ? like->size : 8);
+
+	// Local scope
+	Usec_Hashtable* local = NULL;
 
-		// cleanup
-		if (stmt) free(stmt->key), free(stmt);
+	while (in_container(p, TOK_BRACE_CLOSE)) {
+		size_t start = p->index;
+		USEC_Statement stmt;
+		if (parse_statement(p, &stmt, false)) {
+			if (stmt.type == STATEMENT_DECLARATION && !local) {
+				local = scope_take(p);
+				usec_parser_push_scope(p, local);
+			}
+			store_statement(p, obj->objectValue, local, &stmt);
+			release_key(p, &stmt);
+		}
+		separate_item(p, TOK_BRACE_CLOSE, start);
 	}
 	next(p);
 
 	if (local) {
-		usec_ht_free(local);
-		scope_pop(p);
+		usec_parser_pop_scope(p);
+		scope_return(p, local);
 	}
-
-	return obj;
+	if (like) usec_ht_share_shape(obj->objectValue, like);
 }
 
 static USEC_Value* parse_file(USEC_Parser* p) {
-	USEC_Value* obj = malloc(sizeof(USEC_Value));
-	obj->type = VALUE_OBJECT;
-	obj->objectValue = usec_ht_create(8);
+	USEC_Value* obj = make_value(p, VALUE_OBJECT);
+	obj->objectValue = usec_ht_create_in(p->arena, 8);
 
-	while (!eof(p)) {
+	while (!eof(p) && !p->failed) {
 		size_t line = current(p)->line;
 		size_t col = current(p)->col;
 
-		USEC_Statement* stmt = parse_statement(p);
-		if (stmt && stmt->key) {
-			if (stmt->type == STATEMENT_DECLARATION) {
-				// Store in scope
-				usec_ht_set(p->variables, stmt->key, stmt->value);
-
-				if (p->keep_variables) {
-					char* out_key = NULL;
-					asprintf(&out_key, "$%s", stmt->key);
-					usec_ht_set(obj->objectValue, out_key, stmt->value);
-					free(out_key);
-				}
-			} else if (stmt->type == STATEMENT_ASSIGNMENT) {
-				// Store in object
-				usec_ht_set(obj->objectValue, stmt->key, stmt->value);
-			}
+		USEC_Statement stmt;
+		if (parse_statement(p, &stmt, false)) {
+			store_statement(p, obj->objectValue, p->variables, &stmt);
 
-			if (p->debug) printf("[Value] %d:%d '%s%s = %s'\n", line, col, stmt->type == STATEMENT_DECLARATION ? ":" : "", stmt->key, usec_to_value_string(stmt->value, NULL));
+			if (p->debug) printf("[Value] %d:%d '%s%.*s = %s'\n", (int)line, (int)col, stmt.type == STATEMENT_DECLARATION ? ":" : "", (int)stmt.key_length, statement_key(p, &stmt), usec_to_value_string(stmt.value, NULL));
+			release_key(p, &stmt);
 		}
 
 		if (!eof(p)) assert(p, TOK_NEWLINE);
 		next(p);
-
-		// cleanup
-		if (stmt) free(stmt->key), free(stmt);
 	}
 
 	return obj;
@@ -510,85 +859,379 @@ static USEC_Value* parse_file(USEC_Parser* p) {
 
 static USEC_Value* parse_value(USEC_Parser* p) {
 	if (eof(p)) return NULL;
-	USEC_Token* tok = current(p);
-	switch (tok->type) {
-	case TOK_KEYWORD:
-		if (strcmp(tok->value, "true") == 0) {
-			next(p);
-			USEC_Value* val = make_value(VALUE_BOOL);
-			val->boolValue = true;
-			return val;
-		} else if (strcmp(tok->value, "false") == 0) {
-			next(p);
-			USEC_Value* val = make_value(VALUE_BOOL);
-			val->boolValue = false;
-			return val;
-		} else if (strcmp(tok->value, "null") == 0) {
-			next(p);
-			return make_value(VALUE_NULL);
-		}
-		break;
 
-	case TOK_NUMBER:
-		return parse_number(p);
-	case TOK_CHAR:
-		return parse_char(p);
-	case TOK_STRING_START:
-		return parse_string(p);
+	switch (current(p)->type) {
+	case TOK_ARRAY_OPEN: {
+		USEC_Value* arr = make_value(p, VALUE_ARRAY);
+		parse_array_into(p, arr);
+		return arr;
+	}
 
-	case TOK_IDENTIFIER:
-		return parse_identifier(p);
+	case TOK_BRACE_OPEN: {
+		USEC_Value* obj = make_value(p, VALUE_OBJECT);
+		parse_object_into(p, obj, NULL);
+		return obj;
+	}
 
-	case TOK_ARRAY_OPEN:
-		return parse_array(p);
+	default: {
+		USEC_Value scalar;
+		if (!read_scalar(p, &scalar)) return NULL;
+		return make_scalar(p, &scalar);
+	}
+	}
+}
 
-	case TOK_BRACE_OPEN:
-		return parse_object(p);
+// === Streaming ===
+
+// Parser errors of a streaming parse are held back until the whole input is tokenized, like usec_parser_parse
+// never sees tokens of input with errors. Returns the caller's error list, NULL when printing.
+static USEC_ErrorList* stream_begin(USEC_Parser* p) {
+	USEC_ErrorList* errors = p->errors;
+	p->deferred.count = 0;
+	p->deferred.truncated = false;
+	p->deferred.max = errors ? errors->max : 0;
+	p->errors = &p->deferred;
+	return errors;
+}
 
-	default:
-		parser_error(p, tok, "Unexpected token in value");
-		return NULL;
+// Reports the held back errors, or fails the parse if the rest of the input has tokenizer errors
+static void stream_end(USEC_Parser* p, USEC_ErrorList* errors) {
+	p->errors = errors;
+	if (!p->cancelled) usec_tokenizer_drain(p->tokenizer);
+	if (p->tokenizer->has_error) {
+		p->failed = true;
+		return;
+	}
+
+	for (size_t i = 0; i < p->deferred.count; ++i) {
+		USEC_Error* error = &p->deferred.items[i];
+		if (errors) {
+			usec_errors_add(errors, error->code, error->line, error->col, error->message);
+		} else {
+			fprintf(stderr, "[USEC PARSER] [%d:%d] Error: %s\n", error->line, error->col, error->message);
+			if (p->pedantic) exit(2);
+		}
 	}
-	return NULL;
+	if (errors && p->deferred.truncated) errors->truncated = true;
 }
 
 // === Entry point ===
 USEC_Value* usec_parser_parse(USEC_Parser* p) {
+	USEC_ErrorList* errors = p->stream ? stream_begin(p) : NULL;
+
+	USEC_Value* result;
+	if (check(p, TOK_EXCLAMATION)) {
+		next(p);
+		result = parse_value(p);
+	} else {
+		result = parse_file(p);
+	}
+	if (p->stream) stream_end(p, errors);
+
+	// Partial trees of failed parses are discarded
+	if (p->failed && result) {
+		if (!p->arena) usec_parser_free_value(result);
+		result = NULL;
+	}
+
+	if (p->variables == p->globals) usec_ht_clear(p->globals);
+	usec_atoms_clear(&p->atoms); // the tree keeps its keys
+
+	// Hand the arena over to the document. After a failed parse it stays with the parser, reset.
+	if (p->arena) {
+		if (result) {
+			result = usec_arena_make_root(p->arena, result);
+			p->arena = NULL;
+		} else {
+			usec_arena_reset(p->arena);
+		}
+	}
+	return result;
+}
+
+// === Events ===
+
+static USEC_Event event_at(USEC_EventType type, const USEC_Token* tok) {
+	USEC_Event event;
+	memset(&event, 0, sizeof(USEC_Event));
+	event.type = type;
+	event.line = tok->line;
+	event.col = tok->col;
+	return event;
+}
+
+// A consumer returning false stops the parse like an error, without one being recorded
+static void emit(USEC_Parser* p, const USEC_Event* event) {
+	if (p->failed) return;
+	if (!p->emit(p->emit_arg, event)) {
+		p->cancelled = true;
+		p->failed = true;
+	}
+}
+
+static void emit_statement(USEC_Parser* p, Usec_Hashtable** scope);
+
+// Emits the value at the current token, preceded by the key event of its statement if given. Scalars that fail
+// are dropped along with their key, like parse_statement drops them. With declared set, the value is copied for
+// the scope. Containers become empty placeholders there, they can't be interpolated anyway.
+static bool emit_value(USEC_Parser* p, const USEC_Event* key, USEC_Value** declared) {
+	if (eof(p)) return false;
+	USEC_Token* tok = current(p);
+
+	if (tok->type == TOK_ARRAY_OPEN || tok->type == TOK_BRACE_OPEN) {
+		bool array = tok->type == TOK_ARRAY_OPEN;
+		USEC_TokenType closer = array ? TOK_ARRAY_CLOSE : TOK_BRACE_CLOSE;
+		if (key) emit(p, key);
+		USEC_Event event = event_at(array ? USEC_EVENT_ARRAY_BEGIN : USEC_EVENT_OBJECT_BEGIN, tok);
+		emit(p, &event);
+		open_container(p, tok->type);
+
+		Usec_Hashtable* local = NULL;
+		while (in_container(p, closer)) {
+			size_t start = p->index;
+			if (array) emit_value(p, NULL, NULL);
+			else emit_statement(p, &local);
+			separate_item(p, closer, start);
+		}
+
+		if (!eof(p)) {
+			event = event_at(array ? USEC_EVENT_ARRAY_END : USEC_EVENT_OBJECT_END, current(p));
+			emit(p, &event);
+		}
+		next(p);
+
+		if (local) {
+			usec_parser_pop_scope(p);
+			scope_return(p, local);
+		}
+		if (declared) *declared = make_value(p, array ? VALUE_ARRAY : VALUE_OBJECT);
+		return true;
+	}
+
+	USEC_Event event = event_at(USEC_EVENT_SCALAR, tok);
+	if (!read_scalar(p, &event.value)) return false;
+	if (event.value.type == VALUE_STRING) {
+		event.text = p->string_buf.buffer;
+		event.length = p->string_buf.length;
+	}
+	if (key) emit(p, key);
+	emit(p, &event);
+
+	if (declared) *declared = make_scalar(p, &event.value);
+	return true;
+}
+
+// Emits a statement. Declarations go into *scope, a local scope is taken from the pool on the first one.
+static void emit_statement(USEC_Parser* p, Usec_Hashtable** scope) {
+	USEC_Event key = event_at(USEC_EVENT_KEY, current(p));
+	USEC_Statement stmt;
+	if (!parse_statement_key(p, &stmt)) return;
+
+	// Identifier keys move to the key stack to be null-terminated
+	if (stmt.key_text) {
+		sb_append_data(&p->key_stack, stmt.key_text, stmt.key_length);
+		sb_append_char(&p->key_stack, '\0');
+		stmt.key_text = NULL;
+	}
+
+	bool declaration = stmt.type == STATEMENT_DECLARATION;
+	if (declaration) key.type = USEC_EVENT_DECLARATION;
+	key.text = statement_key(p, &stmt);
+	key.length = stmt.key_length;
+
+	USEC_Value* value = NULL;
+	emit_value(p, &key, declaration ? &value : NULL);
+	if (value) {
+		if (!*scope) {
+			*scope = scope_take(p);
+			usec_parser_push_scope(p, *scope);
+		}
+		usec_ht_set_hashed(*scope, statement_key(p, &stmt), stmt.key_length, stmt.key_hash, value);
+	}
+	release_key(p, &stmt);
+}
+
+void usec_parser_emit(USEC_Parser* p, USEC_EventFn fn, void* arg) {
+	USEC_ErrorList* errors = p->stream ? stream_begin(p) : NULL;
+	p->emit = fn;
+	p->emit_arg = arg;
+	p->cancelled = false;
+
 	if (check(p, TOK_EXCLAMATION)) {
 		next(p);
-		return parse_value(p);
+		emit_value(p, NULL, NULL);
+	} else {
+		USEC_Event event = event_at(USEC_EVENT_OBJECT_BEGIN, current(p));
+		emit(p, &event);
+
+		Usec_Hashtable* scope = p->variables;
+		while (!eof(p) && !p->failed) {
+			emit_statement(p, &scope);
+
+			if (!eof(p)) assert(p, TOK_NEWLINE);
+			next(p);
+		}
+
+		event = event_at(USEC_EVENT_OBJECT_END, last_token(p));
+		emit(p, &event);
+	}
+	if (p->stream) stream_end(p, errors);
+
+	if (p->variables == p->globals) usec_ht_clear(p->globals);
+	usec_atoms_clear(&p->atoms);
+	usec_arena_reset(p->arena);
+	p->emit = NULL;
+}
+
+// === Lazy parsing ===
+
+USEC_Value* usec_parser_parse_at(USEC_Parser* p, size_t index) {
+	p->index = index;
+	p->failed = false;
+
+	USEC_Value* result;
+	if (index == 0) {
+		p->index = 1;
+		result = parse_file(p);
+	} else {
+		result = parse_value(p);
+	}
+	return p->failed ? NULL : result;
+}
+
+void usec_parser_scan(USEC_Parser* p, size_t index, USEC_ScanFn fn, void* arg) {
+	p->index = index;
+	p->failed = false;
+
+	if (index == 0) {
+		p->index = 1;
+		while (!eof(p) && !p->failed) {
+			USEC_Statement stmt;
+			if (parse_statement(p, &stmt, true)) {
+				fn(arg, p, &stmt);
+				release_key(p, &stmt);
+			}
+
+			if (!eof(p)) assert(p, TOK_NEWLINE);
+			next(p);
+		}
+	} else if (check(p, TOK_ARRAY_OPEN)) {
+		open_container(p, TOK_ARRAY_OPEN);
+		while (in_container(p, TOK_ARRAY_CLOSE)) {
+			size_t start = p->index;
+			USEC_Statement item = { .type = STATEMENT_ITEM, .value_index = start };
+			if (skip_value(p)) fn(arg, p, &item);
+			separate_item(p, TOK_ARRAY_CLOSE, start);
+		}
+	} else {
+		open_container(p, TOK_BRACE_OPEN);
+		while (in_container(p, TOK_BRACE_CLOSE)) {
+			size_t start = p->index;
+			USEC_Statement stmt;
+			if (parse_statement(p, &stmt, true)) {
+				fn(arg, p, &stmt);
+				release_key(p, &stmt);
+			}
+			separate_item(p, TOK_BRACE_CLOSE, start);
+		}
 	}
-	return parse_file(p);
 }
 
-void usec_parser_init(USEC_Parser* p, USEC_Token* tokens, size_t token_count, Usec_Hashtable* variables) {
-	p->tokens = tokens;
-	p->token_count = token_count;
+const char* usec_parser_statement_key(USEC_Parser* p, const USEC_Statement* stmt) {
+	return statement_key(p, stmt);
+}
+
+void usec_parser_init(USEC_Parser* p, USEC_Tokenizer* tokenizer, Usec_Hashtable* variables) {
+	p->globals = NULL;
+	p->base = NULL;
+	p->scope_pool = NULL;
+	p->scope_pool_size = 0;
+	p->scope_pool_capacity = 0;
+	p->var_stack = NULL;
+	p->var_stack_capacity = 0;
+	p->bindings = NULL;
+	p->binding_capacity = 0;
+	p->names = NULL;
+	p->name_capacity = 0;
+	p->name_count = 0;
+	sb_init(&p->binding_names);
+	sb_init(&p->scratch);
+	sb_init(&p->string_buf);
+	sb_init(&p->key_stack);
+	sb_init(&p->item_strings);
+	usec_atoms_init(&p->atoms);
+	p->item_stack = NULL;
+	p->item_stack_capacity = 0;
+	p->pack_stack = NULL;
+	p->pack_stack_capacity = 0;
+	usec_errors_init(&p->deferred, NULL);
+	p->arena = NULL;
+	usec_parser_reset(p, tokenizer, variables);
+}
+
+void usec_parser_reset(USEC_Parser* p, USEC_Tokenizer* tokenizer, Usec_Hashtable* variables) {
+	p->tokenizer = tokenizer;
+	p->tokens = tokenizer->tokens;
+	p->token_base = 0;
+	p->token_count = tokenizer->streaming ? 0 : tokenizer->token_count;
+	p->stream = tokenizer->streaming;
 	p->index = 1;
 	p->pedantic = true;
 	p->compact = false;
 	p->keep_variables = false;
+	p->pack_arrays = false;
 	p->debug = false;
+	p->errors = NULL;
+	p->failed = false;
+	p->emit = NULL;
+	p->cancelled = false;
 
-	p->variables = variables ? variables : usec_ht_create(SCOPE_MIN_CAPACITY);
+	if (!variables && !p->globals) p->globals = usec_ht_create(SCOPE_MIN_CAPACITY);
+	p->variables = variables ? variables : p->globals;
 	p->var_stack_size = 0;
-	scope_push(p, p->variables); // push global scope
+	p->binding_count = 0;
+	if (p->name_count > 0) {
+		memset(p->names, 0, sizeof(USEC_BindingName) * p->name_capacity);
+		p->name_count = 0;
+		sb_reset(&p->binding_names);
+	}
+	usec_parser_push_scope(p, p->variables); // push global scope
+
+	sb_reset(&p->key_stack);
+	usec_atoms_clear(&p->atoms);
+	p->item_stack_size = 0;
+	sb_reset(&p->item_strings);
+	p->pack_stack_size = 0;
 }
 
 // === Cleanup ===
 
 void usec_parser_free_value(USEC_Value* val) {
 	if (!val) return;
+	if (val->flags & USEC_VALUE_ARENA) {
+		if (val->flags & USEC_VALUE_ARENA_ROOT) usec_arena_destroy(usec_arena_of_root(val));
+		return;
+	}
 	switch (val->type) {
-	case VALUE_STRING: free(val->stringValue); break;
+	case VALUE_STRING:
+		// A string the caller put in place of the inline text is theirs to hand over, like before
+		if (!(val->flags & USEC_VALUE_INLINE) || val->stringValue != (char*)(val + 1)) free(val->stringValue);
+		break;
 	case VALUE_ARRAY:
 		for (size_t i = 0; i < val->arrayValue.count; ++i)
 			usec_parser_free_value(val->arrayValue.items[i]);
 		free(val->arrayValue.items);
 		break;
+	case VALUE_PACKED_ARRAY:
+		free(val->packedValue.data);
+		break;
 	case VALUE_OBJECT:
 		usec_ht_free(val->objectValue);
 		break;
+	case VALUE_COMMENT:
+	case VALUE_MULTILINE_COMMENT:
+		free(val->commentText);
+		break;
 	case VALUE_FORMAT: {
 		USEC_FormatNode* fmt = val->formatNode;
 		usec_parser_free_value(fmt->node);
@@ -603,9 +1246,25 @@ void usec_parser_free_value(USEC_Value* val) {
 	}
 	default: break;
 	}
-	free(val);
+	if (!(val->flags & USEC_VALUE_EMBEDDED)) free(val);
 }
 
 void usec_parser_free(USEC_Parser* p) {
-	usec_ht_free(p->variables);
+	if (p->globals) usec_ht_free(p->globals);
+	for (size_t i = 0; i < p->scope_pool_size; ++i)
+		usec_ht_free(p->scope_pool[i]);
+	free(p->scope_pool);
+	free(p->var_stack);
+	free(p->bindings);
+	free(p->names);
+	sb_free(&p->binding_names);
+	sb_free(&p->scratch);
+	sb_free(&p->string_buf);
+	sb_free(&p->key_stack);
+	free(p->item_stack);
+	sb_free(&p->item_strings);
+	usec_atoms_free(&p->atoms);
+	free(p->pack_stack);
+	usec_errors_free(&p->deferred);
+	usec_arena_destroy(p->arena);
 }
\ No newline at end of file
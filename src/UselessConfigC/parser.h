@@ -2,44 +2,154 @@
 #define USEC_PARSER_H
 
 #include "tokenizer.h"
+#include "arena.h"
+#include "atom.h"
 #include <usec/usec.h>
 #include <stdbool.h>
 #include <stdint.h>
 
 // Parser configuration and context
-#define USEC_VAR_STACK_MAX 32
 
+// Local scope on the parser's scope stack
 typedef struct {
+	Usec_Hashtable* vars;
+	size_t bound; // entries of vars with a binding, later ones were declared since the last lookup
+	size_t bindings; // start of the scope's bindings
+} USEC_Scope;
+
+// Declaration a name resolves to: the entry at slot in the scope at depth
+typedef struct {
+	size_t name; // slot in the name map
+	size_t depth;
+	size_t slot;
+	size_t shadowed; // binding of the same name in an outer scope, SIZE_MAX if none
+} USEC_Binding;
+
+// Name that was declared in a local scope during the parse, with its innermost binding
+typedef struct {
+	uint64_t hash;
+	size_t offset; // text in binding_names
+	size_t length;
+	size_t binding; // SIZE_MAX while no local scope declares it
+} USEC_BindingName;
+
+// Array item held by value until its array is complete
+typedef struct {
+	USEC_Value value;
+	size_t string_offset; // text of strings in item_strings
+	size_t string_length;
+} USEC_ParsedItem;
+
+typedef struct {
+	USEC_Tokenizer* tokenizer;
 	USEC_Token* tokens;
-	size_t token_count;
+	size_t token_base; // index of tokens[0], only streamed tokens start later
+	size_t token_count; // tokens available so far when streaming
 	size_t index;
+	bool stream; // tokens are pulled from the tokenizer as needed, see usec_tokenizer_pull
 	bool pedantic;
 	bool keep_variables;
+	bool pack_arrays;
 	bool compact;
 	bool debug;
 
 	// Variables + stack of scopes
-	Usec_Hashtable* variables; // toplevel/global
-	Usec_Hashtable* var_stack[USEC_VAR_STACK_MAX];
+	Usec_Hashtable* variables; // toplevel/global, either the caller's table or globals
+	Usec_Hashtable* globals; // owned global scope for parses without caller variables, cleared after each parse
+	Usec_Hashtable* base; // read-only fallback below the global scope, may be shared between threads
+	USEC_Scope* var_stack; // [0] is the global scope, local scopes nest on top
 	size_t var_stack_size;
+	size_t var_stack_capacity;
+
+	// Local declarations by name, so a reference finds its scope and slot with one probe instead of
+	// searching every scope. Bindings stack like the scopes and are undone when their scope is popped.
+	USEC_Binding* bindings;
+	size_t binding_count;
+	size_t binding_capacity;
+	USEC_BindingName* names; // open addressing, a power of two, 0 before the first name
+	size_t name_capacity;
+	size_t name_count;
+	SB binding_names;
+
+	// Cleared local scope tables, reused by later objects and parses
+	Usec_Hashtable** scope_pool;
+	size_t scope_pool_size;
+	size_t scope_pool_capacity;
+
+	SB scratch; // null-terminated keys built from token text
+	SB string_buf; // content of the string being parsed
+	SB key_stack; // string keys of the statements being parsed, nested statements stack on top
+	USEC_AtomTable atoms; // keys of the tables built by the current parse
+
+	// Items of the arrays being parsed, nested arrays stack on top of their parents.
+	// The text of string items waits in item_strings until their array is built.
+	USEC_ParsedItem* item_stack;
+	size_t item_stack_size;
+	size_t item_stack_capacity;
+	SB item_strings;
+
+	// Elements of the packed arrays being parsed, like item_stack. Only the innermost array can still be packed.
+	unsigned char* pack_stack;
+	size_t pack_stack_size;
+	size_t pack_stack_capacity;
+
+	USEC_ErrorList* errors; // Collects errors instead of printing them and exiting when set
+	bool failed; // Set by collected errors that abort the parse
+	USEC_ErrorList deferred; // Errors of a streaming parse, only reported if the tokenizer finds none
+
+	// Consumer of usec_parser_emit
+	USEC_EventFn emit;
+	void* emit_arg;
+	bool cancelled; // the consumer stopped the parse
+
+	// Set in arena mode, owned by the parser until handed to the parsed root
+	USEC_Arena* arena;
 } USEC_Parser;
 
 typedef enum {
 	STATEMENT_ASSIGNMENT,
-	STATEMENT_DECLARATION
+	STATEMENT_DECLARATION,
+	STATEMENT_ITEM // array item, only seen by usec_parser_scan
 } USEC_StatementType;
 
 typedef struct {
 	USEC_StatementType type;
-	char* key;
-	USEC_Value* value;
+	const char* key_text; // identifier keys, in the input. NULL for string keys.
+	size_t key_offset; // string keys live on the parser's key stack
+	size_t key_length;
+	uint64_t key_hash;
+	size_t value_index; // first token of the value
+	USEC_Value* value; // NULL for values skipped by usec_parser_scan
 } USEC_Statement;
 
+// Called for every statement of a scanned container
+typedef void (*USEC_ScanFn)(void* arg, USEC_Parser* parser, const USEC_Statement* stmt);
+
 // === Functions ===
 
-void usec_parser_init(USEC_Parser* parser, USEC_Token* tokens, size_t token_count, Usec_Hashtable* variables);
+// The caller keeps ownership of variables. Without them, declarations go into a table owned by the parser.
+void usec_parser_init(USEC_Parser* parser, USEC_Tokenizer* tokenizer, Usec_Hashtable* variables);
+// Prepares for parsing another token stream, keeping the allocated buffers and tables
+void usec_parser_reset(USEC_Parser* parser, USEC_Tokenizer* tokenizer, Usec_Hashtable* variables);
 USEC_Value* usec_parser_parse(USEC_Parser* parser);
+// Parses into events instead of a tree. Only declarations are allocated, in parser->arena, which has to be set.
+void usec_parser_emit(USEC_Parser* parser, USEC_EventFn fn, void* arg);
 void usec_parser_free_value(USEC_Value* value);
+// Heap string value holding a copy of data in the same allocation
+USEC_Value* usec_parser_string_value(const char* data, size_t length);
+
+// Lazy parsing, see document.c. Token index 0 stands for the top-level statements of the file.
+// Parses the value at the token index with the current scopes. NULL if it fails.
+USEC_Value* usec_parser_parse_at(USEC_Parser* parser, size_t index);
+// Walks the statements of the object or the items of the array opened at the token index, without building
+// assigned values or items. Declarations are parsed and have to be put in scope by fn for the statements after them.
+void usec_parser_scan(USEC_Parser* parser, size_t index, USEC_ScanFn fn, void* arg);
+// Key of a statement passed to a USEC_ScanFn, valid during the call
+const char* usec_parser_statement_key(USEC_Parser* parser, const USEC_Statement* stmt);
+// Puts a local scope on top of the scope stack. Declarations may go into the top scope until the next one is pushed.
+void usec_parser_push_scope(USEC_Parser* parser, Usec_Hashtable* vars);
+// Pops the top local scope, the global scope stays
+void usec_parser_pop_scope(USEC_Parser* parser);
 void usec_parser_free(USEC_Parser* parser);
 
 #endif
\ No newline at end of file
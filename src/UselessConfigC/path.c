@@ -0,0 +1,249 @@
+#include <usec/usec.h>
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Compiled paths keep their keys in one buffer, pre-hashed with the hash of the object tables.
+// A path set merges the segments its paths have in common into a tree, so a lookup of the set walks
+// every shared prefix once.
+
+#define PATH_NONE SIZE_MAX
+
+typedef struct {
+	bool is_index;
+	size_t index;
+	size_t key_offset; // into the keys of the path or set
+	size_t key_length;
+	uint64_t key_hash;
+} PathSegment;
+
+typedef struct {
+	PathSegment* items;
+	size_t count;
+	size_t capacity;
+} PathSegments;
+
+struct USEC_Path {
+	PathSegment* segments;
+	size_t count;
+	char* keys;
+};
+
+typedef struct {
+	PathSegment segment; // unused for the root node
+	size_t first_child;
+	size_t next_sibling;
+	size_t first_path; // paths ending here, chained through path_next
+} PathNode;
+
+struct USEC_PathSet {
+	PathNode* nodes; // nodes[0] is the root
+	size_t node_count;
+	size_t node_capacity;
+	size_t* path_next;
+	size_t count;
+	char* keys;
+};
+
+static void push_segment(PathSegments* segments, const PathSegment* segment) {
+	if (segments->count >= segments->capacity) {
+		segments->capacity = segments->capacity ? segments->capacity * 2 : 8;
+		segments->items = realloc(segments->items, sizeof(PathSegment) * segments->capacity);
+	}
+	segments->items[segments->count++] = *segment;
+}
+
+// Appends the segments of text to out, with their keys null-terminated in keys. False if the path is malformed.
+static bool parse_path(const char* text, PathSegments* out, SB* keys) {
+	const char* c = text;
+	if (*c == '\0') return true;
+
+	for (;;) {
+		PathSegment segment;
+		memset(&segment, 0, sizeof(segment));
+		segment.key_offset = keys->length;
+
+		if (*c == '[') {
+			++c;
+			if (*c == '"') {
+				// Quoted key, for keys with '.', '[' or '"' in them
+				++c;
+				while (*c != '"') {
+					if (*c == '\0') return false;
+					if (*c == '\\' && (c[1] == '"' || c[1] == '\\')) ++c;
+					sb_append_char(keys, *c++);
+				}
+				++c;
+				segment.key_length = keys->length - segment.key_offset;
+			} else {
+				if (*c < '0' || *c > '9') return false;
+				segment.is_index = true;
+				while (*c >= '0' && *c <= '9') {
+					size_t digit = (size_t)(*c++ - '0');
+					if (segment.index > (SIZE_MAX - digit) / 10) return false;
+					segment.index = segment.index * 10 + digit;
+				}
+			}
+			if (*c++ != ']') return false;
+		} else {
+			const char* start = c;
+			while (*c && *c != '.' && *c != '[') ++c;
+			if (c == start) return false;
+			sb_append_data(keys, start, (size_t)(c - start));
+			segment.key_length = (size_t)(c - start);
+		}
+
+		if (!segment.is_index) {
+			segment.key_hash = usec_ht_hash(keys->buffer + segment.key_offset, segment.key_length);
+			sb_append_char(keys, '\0');
+		}
+		push_segment(out, &segment);
+
+		if (*c == '\0') return true;
+		if (*c == '.') {
+			++c;
+			if (*c == '[') return false;
+		} else if (*c != '[') {
+			return false;
+		}
+	}
+}
+
+// Value the segment leads to, NULL if there is none. Elements of packed arrays are copied into scratch.
+static const USEC_Value* step(const USEC_Value* value, const PathSegment* segment, const char* keys, USEC_Value* scratch) {
+	if (segment->is_index) return usec_value_at(value, segment->index, scratch);
+
+	while (value && value->type == VALUE_FORMAT) value = value->formatNode->node;
+	if (!value || value->type != VALUE_OBJECT) return NULL;
+	return usec_ht_get_hashed(value->objectValue, keys + segment->key_offset, segment->key_length, segment->key_hash);
+}
+
+USEC_Path* usec_path_compile(const char* text) {
+	if (!text) return NULL;
+
+	PathSegments segments = { NULL, 0, 0 };
+	SB keys;
+	sb_init(&keys);
+	if (!parse_path(text, &segments, &keys)) {
+		free(segments.items);
+		sb_free(&keys);
+		return NULL;
+	}
+
+	USEC_Path* path = malloc(sizeof(USEC_Path));
+	path->segments = segments.items;
+	path->count = segments.count;
+	path->keys = sb_build(&keys);
+	return path;
+}
+
+void usec_path_free(USEC_Path* path) {
+	if (!path) return;
+	free(path->segments);
+	free(path->keys);
+	free(path);
+}
+
+const USEC_Value* usec_path_get(const USEC_Value* root, const USEC_Path* path, USEC_Value* scratch) {
+	const USEC_Value* value = root;
+	for (size_t i = 0; i < path->count && value; ++i)
+		value = step(value, &path->segments[i], path->keys, scratch);
+	return value;
+}
+
+static bool segments_equal(const PathSegment* a, const char* a_keys, const PathSegment* b, const char* b_keys) {
+	if (a->is_index != b->is_index) return false;
+	if (a->is_index) return a->index == b->index;
+	return a->key_hash == b->key_hash && a->key_length == b->key_length &&
+		memcmp(a_keys + a->key_offset, b_keys + b->key_offset, a->key_length) == 0;
+}
+
+static size_t add_node(USEC_PathSet* set, const PathSegment* segment) {
+	if (set->node_count >= set->node_capacity) {
+		set->node_capacity = set->node_capacity ? set->node_capacity * 2 : 16;
+		set->nodes = realloc(set->nodes, sizeof(PathNode) * set->node_capacity);
+	}
+	PathNode* node = &set->nodes[set->node_count];
+	if (segment) node->segment = *segment;
+	else memset(&node->segment, 0, sizeof(node->segment));
+	node->first_child = PATH_NONE;
+	node->next_sibling = PATH_NONE;
+	node->first_path = PATH_NONE;
+	return set->node_count++;
+}
+
+// Child of parent with the segment, added after its siblings if there is none yet
+static size_t child_node(USEC_PathSet* set, size_t parent, const PathSegment* segment, const char* keys) {
+	size_t last = PATH_NONE;
+	for (size_t child = set->nodes[parent].first_child; child != PATH_NONE; child = set->nodes[child].next_sibling) {
+		if (segments_equal(&set->nodes[child].segment, keys, segment, keys)) return child;
+		last = child;
+	}
+
+	size_t node = add_node(set, segment); // may move the nodes, only indices are kept
+	if (last == PATH_NONE) set->nodes[parent].first_child = node;
+	else set->nodes[last].next_sibling = node;
+	return node;
+}
+
+USEC_PathSet* usec_path_set_compile(const char* const* paths, size_t count) {
+	USEC_PathSet* set = calloc(1, sizeof(USEC_PathSet));
+	set->count = count;
+	set->path_next = count ? malloc(sizeof(size_t) * count) : NULL;
+	add_node(set, NULL);
+
+	PathSegments segments = { NULL, 0, 0 };
+	SB keys;
+	sb_init(&keys);
+	bool ok = true;
+	for (size_t i = 0; i < count && ok; ++i) {
+		segments.count = 0;
+		ok = paths[i] && parse_path(paths[i], &segments, &keys);
+		if (!ok) break;
+
+		size_t node = 0;
+		for (size_t s = 0; s < segments.count; ++s)
+			node = child_node(set, node, &segments.items[s], keys.buffer);
+		set->path_next[i] = set->nodes[node].first_path;
+		set->nodes[node].first_path = i;
+	}
+	free(segments.items);
+	set->keys = sb_build(&keys);
+
+	if (!ok) {
+		usec_path_set_free(set);
+		return NULL;
+	}
+	return set;
+}
+
+void usec_path_set_free(USEC_PathSet* set) {
+	if (!set) return;
+	free(set->nodes);
+	free(set->path_next);
+	free(set->keys);
+	free(set);
+}
+
+static void resolve_paths(const USEC_PathSet* set, size_t node, const USEC_Value* value, const USEC_Value* element,
+	const USEC_Value** out, USEC_Value* scratch) {
+	for (size_t path = set->nodes[node].first_path; path != PATH_NONE; path = set->path_next[path]) {
+		if (value == element) {
+			scratch[path] = *element;
+			out[path] = &scratch[path];
+		} else {
+			out[path] = value;
+		}
+	}
+
+	for (size_t child = set->nodes[node].first_child; child != PATH_NONE; child = set->nodes[child].next_sibling) {
+		USEC_Value child_element;
+		const USEC_Value* child_value = step(value, &set->nodes[child].segment, set->keys, &child_element);
+		if (child_value) resolve_paths(set, child, child_value, &child_element, out, scratch);
+	}
+}
+
+void usec_path_set_get(const USEC_Value* root, const USEC_PathSet* set, const USEC_Value** out, USEC_Value* scratch) {
+	for (size_t i = 0; i < set->count; ++i) out[i] = NULL;
+	if (root) resolve_paths(set, 0, root, NULL, out, scratch);
+}
@@ -0,0 +1,61 @@
+#include "pool.h"
+#include "thread.h"
+#include <stdlib.h>
+
+typedef struct {
+	size_t count;
+	void (*fn)(void* arg, USEC_Context* ctx, size_t index);
+	void* arg;
+
+	USEC_Mutex mutex;
+	size_t next;
+} Pool;
+
+static bool claim(Pool* pool, size_t* index) {
+	usec_mutex_lock(&pool->mutex);
+	*index = pool->next;
+	if (pool->next < pool->count) pool->next++;
+	usec_mutex_unlock(&pool->mutex);
+	return *index < pool->count;
+}
+
+static void worker(void* arg) {
+	Pool* pool = arg;
+	USEC_Context ctx;
+	usec_context_init(&ctx);
+
+	size_t i;
+	while (claim(pool, &i)) {
+		pool->fn(pool->arg, &ctx, i);
+	}
+
+	usec_context_release(&ctx);
+}
+
+void usec_pool_run(size_t count, size_t threads, void (*fn)(void* arg, USEC_Context* ctx, size_t index), void* arg) {
+	if (count == 0) return;
+
+	Pool pool;
+	pool.count = count;
+	pool.fn = fn;
+	pool.arg = arg;
+	pool.next = 0;
+	usec_mutex_init(&pool.mutex);
+
+	if (threads == 0) threads = usec_cpu_count();
+	if (threads > count) threads = count;
+
+	USEC_Thread* handles = threads > 1 ? malloc(sizeof(USEC_Thread) * (threads - 1)) : NULL;
+	size_t started = 0;
+	if (handles) {
+		while (started < threads - 1 && usec_thread_start(&handles[started], worker, &pool)) started++;
+	}
+
+	worker(&pool);
+
+	for (size_t i = 0; i < started; ++i) {
+		usec_thread_join(handles[i]);
+	}
+	free(handles);
+	usec_mutex_destroy(&pool.mutex);
+}
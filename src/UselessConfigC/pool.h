@@ -0,0 +1,11 @@
+#ifndef USEC_POOL_H
+#define USEC_POOL_H
+
+#include "context.h"
+#include <stddef.h>
+
+// Calls fn(arg, ctx, index) for every index in [0, count) on up to threads threads, 0 for one per processor.
+// The calling thread is one of them. Each thread parses with its own context, indices are claimed in order.
+void usec_pool_run(size_t count, size_t threads, void (*fn)(void* arg, USEC_Context* ctx, size_t index), void* arg);
+
+#endif
@@ -0,0 +1,217 @@
+#include "context.h"
+#include "segment.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+// Input that arrives in pieces is parsed a run of complete top-level statements at a time, cut after top-level
+// newlines like parallel.c cuts documents. Only the unfinished statements at the end of a piece are copied,
+// until the rest of them arrives.
+struct USEC_Push {
+	USEC_ParseOptions options; // with variables set to the table declarations go into
+	Usec_Hashtable* own_variables; // when the caller gave none
+	USEC_Segmenter seg;
+	bool started; // the compact marker has been looked for
+	bool compact;
+	bool root_value; // a document with a root value can't be cut
+
+	// A cut after a statement is only taken once the next one is known not to be a root value
+	bool after_newline; // the last statement ended with a newline
+	size_t after_end; // offset after that newline
+	int after_line;
+
+	SB pending; // input from pending_start on that hasn't been parsed
+	size_t pending_start;
+	int line; // position of pending_start
+	int col;
+	size_t fed; // bytes fed so far
+	size_t end; // offset of a NUL byte ending the document, SIZE_MAX before one is found
+
+	USEC_Value* root;
+	bool parsed; // a fragment has been parsed
+	USEC_ErrorList errors; // tokenizer errors, they fail the whole parse
+	USEC_ErrorList parse_errors; // reported if there are no tokenizer errors, like a parse of the whole input
+	bool parse_failed; // the parse stopped at an error, later fragments are only tokenized for their errors
+	bool full; // the error limit was reached, later input is ignored
+};
+
+static USEC_Push* begin(USEC_Context* ctx, const USEC_ParseOptions* options) {
+	usec_push_destroy(ctx->push);
+	USEC_Push* push = calloc(1, sizeof(USEC_Push));
+	push->options = options ? *options : usec_get_default_parse_options();
+	if (!push->options.variables) {
+		push->own_variables = usec_ht_create(16);
+		push->options.variables = push->own_variables;
+	}
+	sb_init(&push->pending);
+	push->line = 1;
+	push->col = 1;
+	push->end = SIZE_MAX;
+	usec_errors_init(&push->errors, &push->options);
+	usec_errors_init(&push->parse_errors, &push->options);
+	ctx->push = push;
+	return push;
+}
+
+void usec_push_destroy(USEC_Push* push) {
+	if (!push) return;
+	usec_ht_free(push->own_variables);
+	sb_free(&push->pending);
+	usec_free(push->root);
+	usec_errors_free(&push->errors);
+	usec_errors_free(&push->parse_errors);
+	usec_segmenter_destroy(&push->seg);
+	free(push);
+}
+
+static void start(USEC_Push* push, char first) {
+	push->started = true;
+	push->compact = first == '%';
+	size_t offset = push->compact ? 1 : 0;
+	usec_segmenter_init(&push->seg, offset);
+	push->pending_start = offset;
+	push->col = (int)offset + 1;
+}
+
+// Takes the cut before a statement starting with first, if there is one
+static void statement_seen(USEC_Push* push, char first, size_t* cut, int* cut_line) {
+	if (first == '!' && push->after_end == 0) push->root_value = true; // the first statement
+	if (push->after_newline && first != '!' && !push->root_value) {
+		*cut = push->after_end;
+		*cut_line = push->after_line;
+	}
+}
+
+// Scans the fed input for the last place it can be cut, 0 if there is none
+static size_t find_cut(USEC_Push* push, const char* data, int* cut_line) {
+	size_t cut = 0;
+	USEC_SegmentStatement stmt;
+	while (usec_segmenter_next(&push->seg, data, push->fed, &stmt)) {
+		statement_seen(push, stmt.first, &cut, cut_line);
+		push->after_newline = stmt.separator == '\n';
+		push->after_end = stmt.end + 1;
+		push->after_line = push->seg.line;
+	}
+	if (push->seg.in_statement) statement_seen(push, push->seg.statement.first, &cut, cut_line);
+	if (push->seg.state == SEG_END) push->end = push->seg.offset;
+	return cut;
+}
+
+// Returns false once into is full
+static bool add_errors(USEC_ErrorList* into, const USEC_ErrorList* errors) {
+	bool room = true;
+	for (size_t i = 0; i < errors->count; ++i) {
+		const USEC_Error* error = &errors->items[i];
+		if (!usec_errors_add(into, error->code, error->line, error->col, error->message)) room = false;
+	}
+	if (errors->truncated) {
+		into->truncated = true;
+		room = false;
+	}
+	return room;
+}
+
+static void parse_fragment(USEC_Context* ctx, USEC_Push* push, const char* text, size_t length, bool continued) {
+	USEC_Fragment fragment = { push->compact, continued, push->line, push->col };
+	USEC_ErrorList errors;
+	usec_errors_init(&errors, &push->options);
+	if (!text) text = "";
+	push->parsed = true;
+
+	if (push->errors.count > 0 || push->parse_failed) {
+		// Only tokenizer errors can still change the outcome
+		usec_context_check_fragment(ctx, text, length, &fragment, &push->options, &errors);
+		if (!add_errors(&push->errors, &errors)) push->full = true;
+		usec_errors_free(&errors);
+		return;
+	}
+
+	USEC_Value* value = usec_context_run_fragment(ctx, text, length, &fragment, &push->options, &errors);
+	bool tokenizer_failed = ctx->tokenizer.has_error;
+	if (!add_errors(tokenizer_failed ? &push->errors : &push->parse_errors, &errors)) {
+		if (tokenizer_failed) push->full = true;
+		else push->parse_failed = true;
+	}
+	usec_errors_free(&errors);
+
+	if (!value || push->parse_failed) {
+		// The document is lost, only errors are left to collect
+		if (!tokenizer_failed) push->parse_failed = true;
+		usec_free(value);
+		usec_free(push->root);
+		push->root = NULL;
+	} else if (push->root) {
+		usec_merge_root(push->root, value);
+	} else {
+		push->root = value;
+	}
+}
+
+// Parses the input before the cut and moves pending_start to it
+static void parse_until(USEC_Context* ctx, USEC_Push* push, const char* data, size_t base, size_t cut, int cut_line) {
+	SB* pending = &push->pending;
+	if (cut <= base) {
+		// The cut is within the pending copy
+		size_t length = cut - push->pending_start;
+		parse_fragment(ctx, push, pending->buffer, length, true);
+		memmove(pending->buffer, pending->buffer + length, pending->length - length);
+		pending->length -= length;
+		pending->buffer[pending->length] = '\0';
+	} else if (pending->length > 0) {
+		sb_append_data(pending, data, cut - base);
+		parse_fragment(ctx, push, pending->buffer, pending->length, true);
+		sb_reset(pending);
+	} else {
+		parse_fragment(ctx, push, data + (push->pending_start - base), cut - push->pending_start, true);
+	}
+	push->pending_start = cut;
+	push->line = cut_line;
+	push->col = 1;
+}
+
+// Public API
+
+void usec_feed_begin(USEC_Context* ctx, const USEC_ParseOptions* options) {
+	begin(ctx, options);
+}
+
+bool usec_feed(USEC_Context* ctx, const char* data, size_t length) {
+	USEC_Push* push = ctx->push ? ctx->push : begin(ctx, NULL);
+	if (push->full) return false;
+	if (!data || length == 0 || push->end != SIZE_MAX) return true;
+	if (!push->started) start(push, data[0]);
+
+	size_t base = push->fed;
+	push->fed += length;
+	push->seg.base = base;
+
+	int cut_line = 0;
+	size_t cut = find_cut(push, data, &cut_line);
+	if (cut > push->pending_start) parse_until(ctx, push, data, base, cut, cut_line);
+
+	// Keep the rest for the next piece
+	size_t stop = push->fed < push->end ? push->fed : push->end;
+	size_t from = push->pending_start > base ? push->pending_start : base;
+	if (stop > from) sb_append_data(&push->pending, data + (from - base), stop - from);
+	return !push->full;
+}
+
+USEC_ParseResult usec_finish(USEC_Context* ctx) {
+	USEC_Push* push = ctx->push ? ctx->push : begin(ctx, NULL);
+	if (!push->full && (push->pending.length > 0 || !push->parsed)) {
+		parse_fragment(ctx, push, push->pending.buffer, push->pending.length, false);
+	}
+
+	USEC_ParseResult result;
+	if (push->errors.count > 0) {
+		result = usec_errors_result(NULL, &push->errors);
+	} else {
+		USEC_Value* value = push->parse_failed ? NULL : push->root;
+		if (value) push->root = NULL;
+		result = usec_errors_result(value, &push->parse_errors);
+	}
+
+	usec_push_destroy(push);
+	ctx->push = NULL;
+	return result;
+}
@@ -0,0 +1,148 @@
+#include "scan.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SCAN_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SCAN_SSE2 1
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+static inline unsigned first_bit(uint32_t mask) {
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (unsigned)index;
+}
+#else
+static inline unsigned first_bit(uint32_t mask) {
+	return (unsigned)__builtin_ctz(mask);
+}
+#endif
+
+#define NEEDLES_STRING '"', '\\', '$', '\n', '\0'
+#define NEEDLES_MULTILINE_STRING '`', '\\', '$', '\r', '\n', '\0'
+#define NEEDLES_LINE '\n', '\0'
+#define NEEDLES_MULTILINE_COMMENT '%', '\\', '\n', '\0'
+
+static bool is_identifier_byte(unsigned char ch) {
+	return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') || ch == '_';
+}
+
+// Scalar scan over needles, used for tails and targets without SIMD
+static inline size_t scan_scalar(const unsigned char* p, size_t i, size_t len, const char* needles, int count) {
+	for (; i < len; ++i) {
+		for (int n = 0; n < count; ++n) {
+			if (p[i] == (unsigned char)needles[n]) return i;
+		}
+	}
+	return len;
+}
+
+#if defined(SCAN_AVX2)
+
+static inline size_t scan_needles(const char* p, size_t len, const char* needles, int count) {
+	size_t i = 0;
+	for (; i + 32 <= len; i += 32) {
+		__m256i chunk = _mm256_loadu_si256((const __m256i*)(p + i));
+		__m256i hits = _mm256_setzero_si256();
+		for (int n = 0; n < count; ++n) {
+			hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(needles[n])));
+		}
+		uint32_t mask = (uint32_t)_mm256_movemask_epi8(hits);
+		if (mask) return i + first_bit(mask);
+	}
+	return scan_scalar((const unsigned char*)p, i, len, needles, count);
+}
+
+static inline size_t scan_identifier(const char* p, size_t len) {
+	size_t i = 0;
+	for (; i + 32 <= len; i += 32) {
+		__m256i chunk = _mm256_loadu_si256((const __m256i*)(p + i));
+		__m256i lower = _mm256_or_si256(chunk, _mm256_set1_epi8(0x20));
+		__m256i alpha = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+		__m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(chunk, _mm256_set1_epi8('0' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), chunk));
+		__m256i under = _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('_'));
+		uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(alpha, digit), under));
+		if (mask) return i + first_bit(mask);
+	}
+	for (; i < len; ++i) {
+		if (!is_identifier_byte((unsigned char)p[i])) return i;
+	}
+	return len;
+}
+
+#elif defined(SCAN_SSE2)
+
+static inline size_t scan_needles(const char* p, size_t len, const char* needles, int count) {
+	size_t i = 0;
+	for (; i + 16 <= len; i += 16) {
+		__m128i chunk = _mm_loadu_si128((const __m128i*)(p + i));
+		__m128i hits = _mm_setzero_si128();
+		for (int n = 0; n < count; ++n) {
+			hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, _mm_set1_epi8(needles[n])));
+		}
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(hits);
+		if (mask) return i + first_bit(mask);
+	}
+	return scan_scalar((const unsigned char*)p, i, len, needles, count);
+}
+
+static inline size_t scan_identifier(const char* p, size_t len) {
+	size_t i = 0;
+	for (; i + 16 <= len; i += 16) {
+		__m128i chunk = _mm_loadu_si128((const __m128i*)(p + i));
+		__m128i lower = _mm_or_si128(chunk, _mm_set1_epi8(0x20));
+		__m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+		__m128i digit = _mm_and_si128(_mm_cmpgt_epi8(chunk, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(chunk, _mm_set1_epi8('9' + 1)));
+		__m128i under = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('_'));
+		uint32_t mask = ~(uint32_t)_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(alpha, digit), under)) & 0xFFFFu;
+		if (mask) return i + first_bit(mask);
+	}
+	for (; i < len; ++i) {
+		if (!is_identifier_byte((unsigned char)p[i])) return i;
+	}
+	return len;
+}
+
+#else
+
+static inline size_t scan_needles(const char* p, size_t len, const char* needles, int count) {
+	return scan_scalar((const unsigned char*)p, 0, len, needles, count);
+}
+
+static inline size_t scan_identifier(const char* p, size_t len) {
+	for (size_t i = 0; i < len; ++i) {
+		if (!is_identifier_byte((unsigned char)p[i])) return i;
+	}
+	return len;
+}
+
+#endif
+
+size_t usec_scan_string(const char* p, size_t len) {
+	static const char needles[] = { NEEDLES_STRING };
+	return scan_needles(p, len, needles, (int)sizeof(needles));
+}
+
+size_t usec_scan_multiline_string(const char* p, size_t len) {
+	static const char needles[] = { NEEDLES_MULTILINE_STRING };
+	return scan_needles(p, len, needles, (int)sizeof(needles));
+}
+
+size_t usec_scan_line(const char* p, size_t len) {
+	static const char needles[] = { NEEDLES_LINE };
+	return scan_needles(p, len, needles, (int)sizeof(needles));
+}
+
+size_t usec_scan_multiline_comment(const char* p, size_t len) {
+	static const char needles[] = { NEEDLES_MULTILINE_COMMENT };
+	return scan_needles(p, len, needles, (int)sizeof(needles));
+}
+
+size_t usec_scan_identifier(const char* p, size_t len) {
+	return scan_identifier(p, len);
+}
@@ -0,0 +1,25 @@
+#ifndef USEC_SCAN_H
+#define USEC_SCAN_H
+
+#include <stddef.h>
+
+// Bulk scanners for the tokenizer. Each returns the offset of the first byte that needs
+// attention within p[0, len), or len if there is none. A NUL byte always stops the scan.
+// Uses AVX2 or SSE2 when the target supports them, with a scalar fallback.
+
+// Quoted strings: " \ $ \n
+size_t usec_scan_string(const char* p, size_t len);
+
+// Multiline strings: ` \ $ \r \n
+size_t usec_scan_multiline_string(const char* p, size_t len);
+
+// Single line comments: \n
+size_t usec_scan_line(const char* p, size_t len);
+
+// Multiline comments: % \ \n
+size_t usec_scan_multiline_comment(const char* p, size_t len);
+
+// Identifiers: the first byte outside [A-Za-z0-9_], NUL included
+size_t usec_scan_identifier(const char* p, size_t len);
+
+#endif
@@ -0,0 +1,202 @@
+#include "segment.h"
+#include "scan.h"
+#include <stdlib.h>
+
+void usec_segmenter_init(USEC_Segmenter* s, size_t offset) {
+	s->state = SEG_CODE;
+	s->depth = 0;
+	s->openers = NULL;
+	s->openers_capacity = 0;
+	s->offset = offset;
+	s->base = 0;
+	s->line = 1;
+	s->line_start = 0;
+	s->in_statement = false;
+}
+
+void usec_segmenter_destroy(USEC_Segmenter* s) {
+	free(s->openers);
+	s->openers = NULL;
+	s->openers_capacity = 0;
+}
+
+static void open_bracket(USEC_Segmenter* s, char ch) {
+	if (s->depth >= s->openers_capacity) {
+		s->openers_capacity = s->openers_capacity ? s->openers_capacity * 2 : 16;
+		s->openers = realloc(s->openers, (size_t)s->openers_capacity);
+	}
+	s->openers[s->depth++] = ch;
+}
+
+static void close_bracket(USEC_Segmenter* s, char opener) {
+	if (s->depth > 0 && s->openers[s->depth - 1] == opener) s->depth--;
+}
+
+static void begin_statement(USEC_Segmenter* s, size_t offset, char first) {
+	if (s->in_statement || s->depth > 0) return;
+	s->in_statement = true;
+	s->statement.start = offset;
+	s->statement.line = s->line;
+	s->statement.col = (int)(offset - s->line_start) + 1;
+	s->statement.first = first;
+}
+
+// Ends the current statement at a separator. Returns true if there was one.
+static bool end_statement(USEC_Segmenter* s, size_t offset, char separator, USEC_SegmentStatement* out) {
+	if (!s->in_statement) return false;
+	s->in_statement = false;
+	*out = s->statement;
+	out->end = offset;
+	out->separator = separator;
+	return true;
+}
+
+static void newline(USEC_Segmenter* s, size_t offset) {
+	s->line++;
+	s->line_start = offset + 1;
+}
+
+// Skips ahead with one of the tokenizer's scanners, counting lines isn't needed as they stop at '\n'
+static size_t skip(const USEC_Segmenter* s, const char* data, size_t i, size_t length, size_t (*scan)(const char*, size_t)) {
+	return i + scan(data + (i - s->base), length - i);
+}
+
+bool usec_segmenter_next(USEC_Segmenter* s, const char* data, size_t length, USEC_SegmentStatement* out) {
+	size_t i = s->offset;
+	while (i < length) {
+		char ch = data[i - s->base];
+		switch (s->state) {
+		case SEG_CODE:
+			switch (ch) {
+			case '\0': s->state = SEG_END; s->offset = i; return false;
+			case ' ': case '\r': break;
+			case '\n':
+				newline(s, i);
+				if (s->depth == 0 && end_statement(s, i, '\n', out)) {
+					s->offset = i + 1;
+					return true;
+				}
+				break;
+			case ',':
+				if (s->depth == 0 && end_statement(s, i, ',', out)) {
+					s->offset = i + 1;
+					return true;
+				}
+				break;
+			case '"': begin_statement(s, i, ch); s->state = SEG_STRING; break;
+			case '`': begin_statement(s, i, ch); s->state = SEG_MULTILINE_STRING; break;
+			case '\'': begin_statement(s, i, ch); s->state = SEG_CHAR; break;
+			case '#': s->state = SEG_COMMENT; break;
+			case '%': s->state = SEG_PERCENT; break;
+			case '[': case '{': begin_statement(s, i, ch); open_bracket(s, ch); break;
+			case ']': begin_statement(s, i, ch); close_bracket(s, '['); break;
+			case '}': begin_statement(s, i, ch); close_bracket(s, '{'); break;
+			default: begin_statement(s, i, ch); break;
+			}
+			i++;
+			break;
+
+		case SEG_PERCENT:
+			if (ch == '%') {
+				s->state = SEG_MULTILINE_COMMENT;
+				i++;
+			} else {
+				begin_statement(s, i - 1, '%'); // stray '%', rescan the byte as code
+				s->state = SEG_CODE;
+			}
+			break;
+
+		case SEG_STRING:
+			i = skip(s, data, i, length, usec_scan_string);
+			if (i >= length) break;
+			ch = data[i - s->base];
+			if (ch == '"') s->state = SEG_CODE;
+			else if (ch == '\\') s->state = SEG_STRING_ESCAPE;
+			else if (ch == '\0') { s->state = SEG_END; s->offset = i; return false; }
+			else if (ch == '\n') { s->state = SEG_CODE; newline(s, i); } // unclosed, the tokenizer drops the newline
+			i++;
+			break;
+
+		case SEG_STRING_ESCAPE:
+		case SEG_MULTILINE_STRING_ESCAPE:
+			if (ch == '\0') { s->state = SEG_END; s->offset = i; return false; }
+			if (ch == '\n') newline(s, i);
+			s->state = s->state == SEG_STRING_ESCAPE ? SEG_STRING : SEG_MULTILINE_STRING;
+			i++;
+			break;
+
+		case SEG_MULTILINE_STRING:
+			i = skip(s, data, i, length, usec_scan_multiline_string);
+			if (i >= length) break;
+			ch = data[i - s->base];
+			if (ch == '`') s->state = SEG_CODE;
+			else if (ch == '\\') s->state = SEG_MULTILINE_STRING_ESCAPE;
+			else if (ch == '\0') { s->state = SEG_END; s->offset = i; return false; }
+			else if (ch == '\n') newline(s, i);
+			i++;
+			break;
+
+		case SEG_COMMENT:
+			i = skip(s, data, i, length, usec_scan_line);
+			if (i >= length) break;
+			if (data[i - s->base] == '\0') { s->state = SEG_END; s->offset = i; return false; }
+			s->state = SEG_CODE; // the newline ends statements like in code
+			break;
+
+		case SEG_MULTILINE_COMMENT:
+			i = skip(s, data, i, length, usec_scan_multiline_comment);
+			if (i >= length) break;
+			ch = data[i - s->base];
+			if (ch == '%') s->state = SEG_MULTILINE_COMMENT_PERCENT;
+			else if (ch == '\\') s->state = SEG_MULTILINE_COMMENT_ESCAPE;
+			else if (ch == '\0') { s->state = SEG_END; s->offset = i; return false; }
+			else if (ch == '\n') newline(s, i);
+			i++;
+			break;
+
+		case SEG_MULTILINE_COMMENT_ESCAPE:
+			// Skips any byte, even NUL
+			if (ch == '\n') newline(s, i);
+			s->state = SEG_MULTILINE_COMMENT;
+			i++;
+			break;
+
+		case SEG_MULTILINE_COMMENT_PERCENT:
+			if (ch == '%') {
+				s->state = SEG_CODE;
+				i++;
+			} else {
+				s->state = SEG_MULTILINE_COMMENT; // rescan the byte inside the comment
+			}
+			break;
+
+		case SEG_CHAR:
+			// The content byte is taken as is, even NUL
+			if (ch == '\n') newline(s, i);
+			s->state = ch == '\\' ? SEG_CHAR_ESCAPE : SEG_CHAR_END;
+			i++;
+			break;
+
+		case SEG_CHAR_ESCAPE:
+			if (ch == '\n') newline(s, i);
+			s->state = SEG_CHAR_END;
+			i++;
+			break;
+
+		case SEG_CHAR_END:
+			s->state = SEG_CODE;
+			if (ch == '\'') i++; // otherwise unclosed, rescan the byte as code
+			break;
+
+		case SEG_END:
+			s->offset = i;
+			return false;
+		}
+	}
+	s->offset = i;
+	return false;
+}
+
+bool usec_segmenter_finish(USEC_Segmenter* s, USEC_SegmentStatement* out) {
+	return end_statement(s, s->offset, 0, out);
+}
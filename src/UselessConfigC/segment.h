@@ -0,0 +1,64 @@
+#ifndef USEC_SEGMENT_H
+#define USEC_SEGMENT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Finds the top-level statements of a document without tokenizing it. Follows the states of the
+// tokenizer (strings, backtick strings, comments, character literals and bracket depth) closely
+// enough that cutting the document after a top-level newline tokenizes the same as the whole.
+// The scan is resumable, input can arrive in pieces.
+
+typedef enum {
+	SEG_CODE,
+	SEG_PERCENT, // a '%' in code, a second one starts a multiline comment
+	SEG_STRING,
+	SEG_STRING_ESCAPE,
+	SEG_MULTILINE_STRING,
+	SEG_MULTILINE_STRING_ESCAPE,
+	SEG_COMMENT,
+	SEG_MULTILINE_COMMENT,
+	SEG_MULTILINE_COMMENT_ESCAPE,
+	SEG_MULTILINE_COMMENT_PERCENT,
+	SEG_CHAR,
+	SEG_CHAR_ESCAPE,
+	SEG_CHAR_END,
+	SEG_END // a NUL byte ends the document like it ends tokenizing
+} USEC_SegmentState;
+
+// A non-empty top-level statement
+typedef struct {
+	size_t start; // offset of its first byte
+	size_t end; // offset of the separating '\n' or ',', or of the end of the document
+	int line; // position of start
+	int col;
+	char first; // first byte, ':' for declarations and '!' for root values
+	char separator; // '\n', ',' or 0 at the end of the document
+} USEC_SegmentStatement;
+
+typedef struct {
+	USEC_SegmentState state;
+	int depth; // open brackets and braces
+	char* openers; // '[' or '{' per open bracket, a closer only closes the innermost one if it matches, like in the tokenizer
+	int openers_capacity;
+	size_t offset; // offset of the next byte to scan
+	size_t base; // offset of data[0], bytes before it may be gone. 0 unless set by the caller.
+	int line;
+	size_t line_start; // offset of the first byte of the line
+
+	bool in_statement;
+	USEC_SegmentStatement statement; // the statement being scanned
+} USEC_Segmenter;
+
+// Starts scanning at offset, which begins line 1 at col offset + 1 (after a compact marker)
+void usec_segmenter_init(USEC_Segmenter* s, size_t offset);
+void usec_segmenter_destroy(USEC_Segmenter* s);
+
+// Scans data up to offset length, where data points to offset s->base of the document and all bytes from
+// s->offset on are available. Returns true with the next statement, false once everything available was scanned.
+bool usec_segmenter_next(USEC_Segmenter* s, const char* data, size_t length, USEC_SegmentStatement* out);
+
+// After the last piece of input: returns the unterminated last statement, if any
+bool usec_segmenter_finish(USEC_Segmenter* s, USEC_SegmentStatement* out);
+
+#endif
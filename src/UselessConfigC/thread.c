@@ -0,0 +1,146 @@
+#include "thread.h"
+#include <stdlib.h>
+
+// Function and argument of a starting thread, freed by the thread
+typedef struct {
+	void (*fn)(void*);
+	void* arg;
+} ThreadStart;
+
+static ThreadStart* make_start(void (*fn)(void*), void* arg) {
+	ThreadStart* start = malloc(sizeof(ThreadStart));
+	if (!start) return NULL;
+	start->fn = fn;
+	start->arg = arg;
+	return start;
+}
+
+static void run_start(ThreadStart* start) {
+	void (*fn)(void*) = start->fn;
+	void* arg = start->arg;
+	free(start);
+	fn(arg);
+}
+
+#ifdef _WIN32
+
+static BOOL CALLBACK once_trampoline(PINIT_ONCE flag, PVOID param, PVOID* context) {
+	(void)flag;
+	(void)context;
+	void (*fn)(void) = (void (*)(void))param;
+	fn();
+	return TRUE;
+}
+
+void usec_once(USEC_Once* flag, void (*fn)(void)) {
+	InitOnceExecuteOnce(flag, once_trampoline, (PVOID)fn, NULL);
+}
+
+static DWORD WINAPI thread_trampoline(LPVOID param) {
+	run_start(param);
+	return 0;
+}
+
+bool usec_thread_start(USEC_Thread* thread, void (*fn)(void*), void* arg) {
+	ThreadStart* start = make_start(fn, arg);
+	if (!start) return false;
+	*thread = CreateThread(NULL, 0, thread_trampoline, start, 0, NULL);
+	if (!*thread) {
+		free(start);
+		return false;
+	}
+	return true;
+}
+
+void usec_thread_join(USEC_Thread thread) {
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+}
+
+void usec_mutex_init(USEC_Mutex* mutex) {
+	InitializeSRWLock(mutex);
+}
+
+void usec_mutex_lock(USEC_Mutex* mutex) {
+	AcquireSRWLockExclusive(mutex);
+}
+
+void usec_mutex_unlock(USEC_Mutex* mutex) {
+	ReleaseSRWLockExclusive(mutex);
+}
+
+void usec_mutex_destroy(USEC_Mutex* mutex) {
+	(void)mutex;
+}
+
+size_t usec_cpu_count(void) {
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? (size_t)info.dwNumberOfProcessors : 1;
+}
+
+long usec_atomic_increment(volatile long* value) {
+	return InterlockedIncrement(value);
+}
+
+long usec_atomic_decrement(volatile long* value) {
+	return InterlockedDecrement(value);
+}
+
+#else
+
+#include <unistd.h>
+
+void usec_once(USEC_Once* flag, void (*fn)(void)) {
+	pthread_once(flag, fn);
+}
+
+static void* thread_trampoline(void* param) {
+	run_start(param);
+	return NULL;
+}
+
+bool usec_thread_start(USEC_Thread* thread, void (*fn)(void*), void* arg) {
+	ThreadStart* start = make_start(fn, arg);
+	if (!start) return false;
+	if (pthread_create(thread, NULL, thread_trampoline, start) != 0) {
+		free(start);
+		return false;
+	}
+	return true;
+}
+
+void usec_thread_join(USEC_Thread thread) {
+	pthread_join(thread, NULL);
+}
+
+void usec_mutex_init(USEC_Mutex* mutex) {
+	pthread_mutex_init(mutex, NULL);
+}
+
+void usec_mutex_lock(USEC_Mutex* mutex) {
+	pthread_mutex_lock(mutex);
+}
+
+void usec_mutex_unlock(USEC_Mutex* mutex) {
+	pthread_mutex_unlock(mutex);
+}
+
+void usec_mutex_destroy(USEC_Mutex* mutex) {
+	pthread_mutex_destroy(mutex);
+}
+
+size_t usec_cpu_count(void) {
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (size_t)count : 1;
+}
+
+long usec_atomic_increment(volatile long* value) {
+	return __atomic_add_fetch(value, 1, __ATOMIC_RELAXED);
+}
+
+long usec_atomic_decrement(volatile long* value) {
+	return __atomic_sub_fetch(value, 1, __ATOMIC_ACQ_REL);
+}
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef USEC_THREAD_H
+#define USEC_THREAD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+typedef INIT_ONCE USEC_Once;
+#define USEC_ONCE_INIT INIT_ONCE_STATIC_INIT
+typedef HANDLE USEC_Thread;
+typedef SRWLOCK USEC_Mutex;
+#else
+#include <pthread.h>
+typedef pthread_once_t USEC_Once;
+#define USEC_ONCE_INIT PTHREAD_ONCE_INIT
+typedef pthread_t USEC_Thread;
+typedef pthread_mutex_t USEC_Mutex;
+#endif
+
+// Runs fn exactly once per flag, concurrent callers wait for it to finish
+void usec_once(USEC_Once* flag, void (*fn)(void));
+
+// Starts fn(arg) on a new thread, returns false if the thread couldn't be created
+bool usec_thread_start(USEC_Thread* thread, void (*fn)(void*), void* arg);
+void usec_thread_join(USEC_Thread thread);
+
+void usec_mutex_init(USEC_Mutex* mutex);
+void usec_mutex_lock(USEC_Mutex* mutex);
+void usec_mutex_unlock(USEC_Mutex* mutex);
+void usec_mutex_destroy(USEC_Mutex* mutex);
+
+// Number of online processors, at least 1
+size_t usec_cpu_count(void);
+
+// Atomic reference counting, both return the new count
+long usec_atomic_increment(volatile long* value);
+long usec_atomic_decrement(volatile long* value);
+
+#endif
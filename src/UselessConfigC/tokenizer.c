@@ -4,31 +4,55 @@
 #include <stdio.h>
 #include <ctype.h>
 #include "utils.h"
+#include "hash.h"
+#include "scan.h"
+#include "number.h"
 
+// Tokens read ahead of the one a streaming parser asked for, so that pulls are rare
+#define STREAM_LOOKAHEAD 64
 
-void usec_tokenizer_init(USEC_Tokenizer* t, const char* input, bool compact, bool pedantic, bool debug) {
+void usec_tokenizer_init(USEC_Tokenizer* t, const char* input, size_t length, bool compact, bool pedantic, bool debug) {
+	t->token_capacity = 0;
+	t->tokens = NULL;
+	t->opener_stack = NULL;
+	t->opener_stack_capacity = 0;
+	sb_init(&t->decoded);
+	usec_tokenizer_reset(t, input, length, compact, pedantic, debug);
+}
+
+void usec_tokenizer_reset(USEC_Tokenizer* t, const char* input, size_t length, bool compact, bool pedantic, bool debug) {
 	t->input = input;
+	t->length = length;
 	t->index = 0;
 	t->line = 1;
 	t->col = 1;
 	t->compact = compact;
 	t->pedantic = pedantic;
 	t->debug = debug;
+	t->fragment = false;
+	t->continued = false;
 	t->has_error = false;
+	t->errors = NULL;
+	t->stopped = false;
+	t->hash_seed = usec_hash_seed();
 	t->token_count = 0;
-	t->token_capacity = 0;
-	t->tokens = NULL;
-	t->opener_stack = NULL;
+	t->streaming = false;
+	t->token_base = 0;
+	t->started = false;
+	t->finished = false;
+	t->early_end = false;
 	t->opener_stack_size = 0;
-	t->opener_stack_capacity = 0;
+	sb_reset(&t->decoded);
 }
 
 void usec_tokenizer_destroy(USEC_Tokenizer* t) {
-	for (size_t i = 0; i < t->token_count; ++i) {
-		free(t->tokens[i].value);
-	}
 	free(t->tokens);
 	free(t->opener_stack);
+	sb_free(&t->decoded);
+}
+
+const char* usec_token_text(const USEC_Tokenizer* t, const USEC_Token* token) {
+	return token->decoded ? t->decoded.buffer + token->offset : t->input + token->offset;
 }
 
 static void grow_token_array(USEC_Tokenizer* t) {
@@ -64,30 +88,63 @@ static void next(USEC_Tokenizer* t) {
 	t->index++;
 }
 
-static void add_token(USEC_Tokenizer* t, USEC_TokenType type, const char* value, size_t len) {
-	grow_token_array(t);
+// Skips n bytes known not to contain newlines
+static void advance(USEC_Tokenizer* t, size_t n) {
+	t->index += n;
+	t->col += (int)n;
+}
 
-	char* copy = malloc(len + 1);
-	memcpy(copy, value, len);
-	copy[len] = 0;
+// Skips ahead to the first byte the scanner stops at
+static void skip_run(USEC_Tokenizer* t, size_t (*scan)(const char*, size_t)) {
+	if (t->index < t->length) advance(t, scan(t->input + t->index, t->length - t->index));
+}
 
-	t->tokens[t->token_count++] = (USEC_Token){
+static void add_token_span(USEC_Tokenizer* t, USEC_TokenType type, bool decoded, size_t offset, size_t len) {
+	grow_token_array(t);
+
+	USEC_Token* token = &t->tokens[t->token_count++];
+	*token = (USEC_Token){
 		.type = type,
-		.value = copy,
+		.decoded = decoded,
+		.offset = offset,
+		.length = len,
 		.line = t->line,
-		.col = t->col
+		.col = t->col,
+		.hash = 0,
+		.pair = 0
 	};
 
 	if (t->debug) {
-		printf("[Token] %d:%d %d '%s'\n", t->line, t->col, type, copy);
+		printf("[Token] %d:%d %d '%.*s'\n", t->line, t->col, type, (int)len, usec_token_text(t, token));
 	}
 }
 
+// Token whose text is the input span [offset, offset + len)
+static void add_token(USEC_Tokenizer* t, USEC_TokenType type, size_t offset, size_t len) {
+	add_token_span(t, type, false, offset, len);
+}
+
+static void add_identifier(USEC_Tokenizer* t, size_t offset, size_t len) {
+	add_token(t, TOK_IDENTIFIER, offset, len);
+	t->tokens[t->token_count - 1].hash = usec_hash_with_seed(t->input + offset, len, t->hash_seed);
+}
+
+// Token without text (start and end of file markers)
+static void add_marker(USEC_Tokenizer* t, USEC_TokenType type) {
+	add_token_span(t, type, false, t->index, 0);
+}
+
 static void push_opener(USEC_Tokenizer* t, USEC_Token* token) {
 	grow_stack(t);
 	t->opener_stack[t->opener_stack_size++] = *token;
 }
 
+// Pairs the opener on top of the stack with the closer just added. Streamed openers are gone by then, they stay unpaired.
+static void pop_opener(USEC_Tokenizer* t) {
+	USEC_Token* opener = &t->opener_stack[--t->opener_stack_size];
+	if (!t->streaming) t->tokens[opener->pair].pair = t->token_count - 1;
+}
+
 static const char* opener_for_closer(char close) {
 	switch (close) {
 	case '}': return "{";
@@ -99,54 +156,88 @@ static const char* opener_for_closer(char close) {
 	}
 }
 
-static void error(USEC_Tokenizer* t, const char* message) {
-	fprintf(stderr, "[USEC] [%d:%d] Error: %s\n", t->line, t->col, message);
-	if (t->pedantic) {
-		exit(1);
-	} else {
-		t->has_error = true;
+static void error_at(USEC_Tokenizer* t, USEC_ErrorCode code, int line, int col, const char* message) {
+	t->has_error = true;
+	if (t->errors) {
+		if (!usec_errors_add(t->errors, code, line, col, message)) t->stopped = true;
+		return;
 	}
+
+	fprintf(stderr, "[USEC] [%d:%d] Error: %s\n", line, col, message);
+	if (t->pedantic) exit(1);
 }
 
-static void error_t(USEC_Tokenizer* t, const char* message, USEC_Token* token) {
-	fprintf(stderr, "[USEC] [%d:%d] Error: %s\n", token->line, token->col, message);
-	if (t->pedantic) {
-		exit(1);
-	} else {
-		t->has_error = true;
-	}
+static void error(USEC_Tokenizer* t, USEC_ErrorCode code, const char* message) {
+	error_at(t, code, t->line, t->col, message);
+}
+
+static void error_t(USEC_Tokenizer* t, USEC_ErrorCode code, const char* message, USEC_Token* token) {
+	error_at(t, code, token->line, token->col, message);
 }
 
 static bool is_start_identifier(char ch) {
 	return isalpha(ch) || ch == '_';
 }
 
-static bool is_identifier_char(char ch) {
-	return isalnum(ch) || ch == '_';
+static char escape_char(char ch) {
+	switch (ch) {
+	case 'n': return '\n';
+	case 'r': return '\r';
+	case 't': return '\t';
+	default: return ch;
+	}
+}
+
+// String pieces
+
+// A run of string content. Stays a plain input span until the first escape or line ending fixup,
+// from then on the piece is built up in the decoded buffer.
+typedef struct {
+	size_t run_start;   // input offset of the pending, not yet copied run
+	bool decoding;
+	size_t decoded_start;
+} StringPiece;
+
+static void piece_begin(USEC_Tokenizer* t, StringPiece* piece) {
+	piece->run_start = t->index;
+	piece->decoding = false;
+	piece->decoded_start = 0;
 }
 
-static const char* escape_char(char ch) {
-	switch (ch) {
-	case 'n': return "\n";
-	case 'r': return "\r";
-	case 't': return "\t";
-	case '"': return "\"";
-	case '\'': return "\'";
-	case '\\': return "\\";
-	default: {
-		static char fallback[2];
-		fallback[0] = ch;
-		fallback[1] = '\0';
-		return fallback;
+// Moves the pending run into the decoded buffer, switching the piece to decoding
+static void piece_decode(USEC_Tokenizer* t, StringPiece* piece) {
+	if (!piece->decoding) {
+		piece->decoding = true;
+		piece->decoded_start = t->decoded.length;
 	}
+	sb_append_data(&t->decoded, t->input + piece->run_start, t->index - piece->run_start);
+}
+
+// Replaces the input span [index, index + skip) with replacement text
+static void piece_replace(USEC_Tokenizer* t, StringPiece* piece, const char* replacement, size_t replacement_len, size_t skip) {
+	piece_decode(t, piece);
+	sb_append_data(&t->decoded, replacement, replacement_len);
+	for (size_t i = 0; i < skip; ++i) next(t);
+	piece->run_start = t->index;
+}
+
+// Emits the piece up to the current position as a TOK_STRING, if non-empty
+static void piece_flush(USEC_Tokenizer* t, StringPiece* piece) {
+	if (piece->decoding) {
+		piece_decode(t, piece);
+		size_t len = t->decoded.length - piece->decoded_start;
+		if (len > 0) add_token_span(t, TOK_STRING, true, piece->decoded_start, len);
+	} else if (t->index > piece->run_start) {
+		add_token(t, TOK_STRING, piece->run_start, t->index - piece->run_start);
 	}
+	piece_begin(t, piece);
 }
 
 // READ
 
 static void read_identifier(USEC_Tokenizer* t) {
 	size_t start = t->index;
-	while (is_identifier_char(current(t))) next(t);
+	skip_run(t, usec_scan_identifier);
 
 	size_t len = t->index - start;
 	const char* text = t->input + start;
@@ -154,77 +245,124 @@ static void read_identifier(USEC_Tokenizer* t) {
 	if ((len == 4 && strncmp(text, "null", 4) == 0) ||
 		(len == 4 && strncmp(text, "true", 4) == 0) ||
 		(len == 5 && strncmp(text, "false", 5) == 0)) {
-		add_token(t, TOK_KEYWORD, text, len);
+		add_token(t, TOK_KEYWORD, start, len);
 	} else {
-		add_token(t, TOK_IDENTIFIER, text, len);
+		add_identifier(t, start, len);
 	}
 }
 
+static bool is_digit(char ch) {
+	return ch >= '0' && ch <= '9';
+}
+
+// Scans a number, accumulating its significant digits for the parser
 static void read_number(USEC_Tokenizer* t) {
 	size_t start = t->index;
+	uint64_t mantissa = 0;
+	int digits = 0; // significant digits in the mantissa
+	int64_t exponent = 0;
+	uint8_t flags = 0;
 
 	// Optional leading minus
-	if (current(t) == '-') next(t);
+	if (current(t) == '-') {
+		flags |= USEC_NUMBER_NEGATIVE;
+		next(t);
+	}
 
 	// Integer part
 	if (current(t) == '0') {
 		next(t); // Leading zero allowed ONLY if zero, no more digits
-	} else if (isdigit(current(t))) {
-		while (isdigit(current(t))) next(t);
+	} else if (is_digit(current(t))) {
+		while (is_digit(current(t))) {
+			if (digits < USEC_NUMBER_DIGITS_MAX) {
+				mantissa = mantissa * 10 + (uint64_t)(current(t) - '0');
+				digits++;
+			} else {
+				exponent++;
+				if (current(t) != '0') flags |= USEC_NUMBER_TRUNCATED;
+			}
+			advance(t, 1);
+		}
 	} else {
-		error(t, "Invalid number: expected digit");
+		error(t, USEC_ERROR_INVALID_NUMBER, "Invalid number: expected digit");
 		return;
 	}
 
 	// Fraction part (optional)
 	if (current(t) == '.') {
+		flags |= USEC_NUMBER_FLOAT;
 		next(t);
-		if (!isdigit(current(t))) {
-			error(t, "Invalid number: expected digit after decimal point");
+		if (!is_digit(current(t))) {
+			error(t, USEC_ERROR_INVALID_NUMBER, "Invalid number: expected digit after decimal point");
 			return;
 		}
-		while (isdigit(current(t))) next(t);
+		while (is_digit(current(t))) {
+			if (digits < USEC_NUMBER_DIGITS_MAX) {
+				mantissa = mantissa * 10 + (uint64_t)(current(t) - '0');
+				if (mantissa != 0) digits++; // leading zeros of the fraction aren't significant
+				exponent--;
+			} else if (current(t) != '0') {
+				flags |= USEC_NUMBER_TRUNCATED;
+			}
+			advance(t, 1);
+		}
 	}
 
 	// Exponent part (optional): e or E
 	if (current(t) == 'e' || current(t) == 'E') {
+		flags |= USEC_NUMBER_FLOAT;
 		next(t);
-		if (current(t) == '+' || current(t) == '-') next(t);
-		if (!isdigit(current(t))) {
-			error(t, "Invalid number: expected digit after exponent");
+		bool negative = false;
+		if (current(t) == '+' || current(t) == '-') {
+			negative = current(t) == '-';
+			next(t);
+		}
+		if (!is_digit(current(t))) {
+			error(t, USEC_ERROR_INVALID_NUMBER, "Invalid number: expected digit after exponent");
 			return;
 		}
-		while (isdigit(current(t))) next(t);
+		int64_t value = 0;
+		while (is_digit(current(t))) {
+			if (value < 1000000) value = value * 10 + (current(t) - '0'); // far past any double either way
+			advance(t, 1);
+		}
+		exponent += negative ? -value : value;
 	}
 
 	size_t len = t->index - start;
-	add_token(t, TOK_NUMBER, t->input + start, len);
+	add_token(t, TOK_NUMBER, start, len);
+	USEC_Token* token = &t->tokens[t->token_count - 1];
+	token->mantissa = mantissa;
+	if (exponent > INT32_MAX / 2) exponent = INT32_MAX / 2;
+	if (exponent < INT32_MIN / 2) exponent = INT32_MIN / 2;
+	token->number.exponent = (int32_t)exponent;
+	token->number.flags = flags;
 }
 
 static void read_char(USEC_Tokenizer* t) {
 	next(t); // skip opening quote
 
-	char buff[2] = { 0 };
+	bool escaped = false;
+	size_t offset = t->index;
 	if (current(t) == '\\') {
 		next(t);
-		const char* esc = escape_char(current(t));
-		buff[0] = esc[0];
-	} else {
-		buff[0] = current(t);
+		escaped = true;
+		offset = t->decoded.length;
+		sb_append_char(&t->decoded, escape_char(current(t)));
 	}
 	next(t);
 
 	if (current(t) != '\'') {
-		error(t, "Expected closing single quote");
+		error(t, USEC_ERROR_SYNTAX, "Expected closing single quote");
 		return;
 	}
 	next(t); // skip closing quote
-	add_token(t, TOK_CHAR, buff, 1);
+	add_token_span(t, TOK_CHAR, escaped, offset, 1);
 }
 
 static void read_comment(USEC_Tokenizer* t) {
 	const size_t start = t->index + 1;
-	while (current(t) && current(t) != '\n') next(t);
+	skip_run(t, usec_scan_line);
 	size_t len = t->index - start;
 	//add_token(t, TOK_COMMENT, t->input + start, len); // comments are simply ignored
 }
@@ -234,7 +372,9 @@ static void read_multiline_comment(USEC_Tokenizer* t) {
 	next(t); // %
 	next(t); // %
 
-	while (current(t) && !(current(t) == '%' && peek(t) == '%')) {
+	for (;;) {
+		skip_run(t, usec_scan_multiline_comment);
+		if (!current(t) || (current(t) == '%' && peek(t) == '%')) break;
 		if (current(t) == '\\') next(t);
 		next(t);
 	}
@@ -253,127 +393,115 @@ static void read_interpolation(USEC_Tokenizer* t) {
 	next(t); // skip (
 
 	if (!is_start_identifier(current(t))) {
-		error(t, "Invalid interpolation character (expected identifier)");
+		error(t, USEC_ERROR_SYNTAX, "Invalid interpolation character (expected identifier)");
 		return;
 	}
 
 	size_t start = t->index;
-	while (is_identifier_char(current(t))) next(t);
+	skip_run(t, usec_scan_identifier);
 
 	size_t len = t->index - start;
 	if (current(t) != ')') {
-		error(t, "Unclosed interpolation");
+		error(t, USEC_ERROR_UNBALANCED, "Unclosed interpolation");
 		return;
 	}
 
-	add_token(t, TOK_IDENTIFIER, t->input + start, len);
+	add_identifier(t, start, len);
 	next(t); // skip closing ')'
 }
 
+// Escape sequence inside a string, a trailing backslash at the end of input is dropped
+static void read_escape(USEC_Tokenizer* t, StringPiece* piece) {
+	char pk = peek(t);
+	char esc = escape_char(pk);
+	if (pk == '\0') piece_replace(t, piece, NULL, 0, 1);
+	else piece_replace(t, piece, &esc, 1, 2);
+}
+
 static void read_string(USEC_Tokenizer* t) {
 	// Push string opener
-	add_token(t, TOK_STRING_START, "\"", 1);
+	add_token(t, TOK_STRING_START, t->index, 1);
 	next(t); // skip opening "
 
-	size_t start_col = t->col;
-	int start_line = t->line;
-	SB sb = sb_create();
+	StringPiece piece;
+	piece_begin(t, &piece);
 
-	while (current(t) != '\0') {
+	for (;;) {
+		skip_run(t, usec_scan_string);
 		char ch = current(t);
+		if (ch == '\0') break;
 
 		if (ch == '"') {
-			if (sb.length > 0) {
-				add_token(t, TOK_STRING, sb.buffer, sb.length);
-				sb_clear(&sb);
-			}
-			add_token(t, TOK_STRING_END, "\"", 1);
+			piece_flush(t, &piece);
+			add_token(t, TOK_STRING_END, t->index, 1);
 			next(t);
-			break;
+			return;
 		} else if (ch == '$' && peek(t) == '(') {
-			if (sb.length > 0) {
-				add_token(t, TOK_STRING, sb.buffer, sb.length);
-				sb_clear(&sb);
-			}
+			piece_flush(t, &piece);
 			read_interpolation(t);
+			piece_begin(t, &piece);
 			continue;
 		} else if (ch == '\\') {
-			next(t);
-			sb_append_str(&sb, escape_char(current(t)));
+			read_escape(t, &piece);
+			continue;
 		} else if (ch == '\n') {
-			if (sb.length > 0) {
-				add_token(t, TOK_STRING, sb.buffer, sb.length);
-				sb_clear(&sb);
-			}
-			error(t, "Unclosed string");
+			piece_flush(t, &piece);
+			error(t, USEC_ERROR_UNBALANCED, "Unclosed string");
 			next(t);
-			break;
-		} else {
-			sb_append_char(&sb, ch);
+			return;
 		}
 
 		next(t);
 	}
-	if (sb.length > 0) {
-		add_token(t, TOK_STRING, sb.buffer, sb.length);
-	}
-
-	sb_free(&sb);
+	piece_flush(t, &piece);
 }
 
 static void read_multiline_string(USEC_Tokenizer* t) {
-	add_token(t, TOK_STRING_START, "`", 1);
+	add_token(t, TOK_STRING_START, t->index, 1);
 	next(t); // skip `
 
-	size_t start_col = t->col;
-	int start_line = t->line;
-	SB sb = sb_create();
-
 	// Skip first newline if exists right after opening `
 	if (current(t) == '\r') next(t);
 	if (current(t) == '\n') next(t);
 
-	while (current(t) != '\0') {
+	StringPiece piece;
+	piece_begin(t, &piece);
+
+	for (;;) {
+		skip_run(t, usec_scan_multiline_string);
 		char ch = current(t);
+		if (ch == '\0') break;
 		char pk = peek(t);
 
 		if (ch == '`') {
-			if (sb.length > 0) {
-				add_token(t, TOK_STRING, sb.buffer, sb.length);
-				sb_clear(&sb);
-			}
-			add_token(t, TOK_STRING_END, "`", 1);
+			piece_flush(t, &piece);
+			add_token(t, TOK_STRING_END, t->index, 1);
 			next(t);
-			break;
+			return;
 		} else if (ch == '$' && pk == '(') {
-			if (sb.length > 0) {
-				add_token(t, TOK_STRING, sb.buffer, sb.length);
-				sb_clear(&sb);
-			}
+			piece_flush(t, &piece);
 			read_interpolation(t);
+			piece_begin(t, &piece);
 			continue;
 		} else if (ch == '\r') {
-			next(t);
-			if (current(t) == '\n') next(t);
-			if (current(t) != '`') sb_append_char(&sb, '\n');
+			// Normalize \r\n and lone \r to \n, dropped entirely before the closing backtick
+			size_t skip = (pk == '\n') ? 2 : 1;
+			bool closing = t->index + skip < t->length && t->input[t->index + skip] == '`';
+			piece_replace(t, &piece, "\n", closing ? 0 : 1, skip);
 			continue;
 		} else if (ch == '\n' && pk == '`') {
-			next(t); // skip newline before closing backtick
+			piece_flush(t, &piece); // skip newline before closing backtick
+			next(t);
+			piece_begin(t, &piece);
 			continue;
 		} else if (ch == '\\') {
-			next(t);
-			sb_append_str(&sb, escape_char(current(t)));
-		} else {
-			sb_append_char(&sb, ch);
+			read_escape(t, &piece);
+			continue;
 		}
 
 		next(t);
 	}
-	if (sb.length > 0) {
-		add_token(t, TOK_STRING, sb.buffer, sb.length);
-	}
-
-	sb_free(&sb);
+	piece_flush(t, &piece);
 }
 
 static void read_statement(USEC_Tokenizer* t) {
@@ -390,54 +518,56 @@ static void read_statement(USEC_Tokenizer* t) {
 
 	// Comments
 	else if (ch == '#') {
-		if (t->compact) error(t, "Comments are not allowed in compact mode");
+		if (t->compact) error(t, USEC_ERROR_FORMAT, "Comments are not allowed in compact mode");
 		read_comment(t);
 	} else if (ch == '%' && pk == '%') {
-		if (t->compact) error(t, "Comments are not allowed in compact mode");
+		if (t->compact) error(t, USEC_ERROR_FORMAT, "Comments are not allowed in compact mode");
 		read_multiline_comment(t);
 	}
 
 	// Operators
 	else if (ch == '!') {
-		add_token(t, TOK_EXCLAMATION, "!", 1);
+		add_token(t, TOK_EXCLAMATION, t->index, 1);
 		next(t);
 	} else if (ch == ':') {
-		add_token(t, TOK_COLON, ":", 1);
+		add_token(t, TOK_COLON, t->index, 1);
 		next(t);
 	} else if (ch == '=') {
-		add_token(t, TOK_EQUALS, "=", 1);
+		add_token(t, TOK_EQUALS, t->index, 1);
 		next(t);
 	}
 
 	// Closers
 	else if (ch == '[') {
-		add_token(t, TOK_ARRAY_OPEN, "[", 1);
+		add_token(t, TOK_ARRAY_OPEN, t->index, 1);
 		USEC_Token o = t->tokens[t->token_count - 1];
+		o.pair = t->token_count - 1;
 		push_opener(t, &o);
 		next(t);
 	} else if (ch == ']') {
-		add_token(t, TOK_ARRAY_CLOSE, "]", 1);
+		add_token(t, TOK_ARRAY_CLOSE, t->index, 1);
 		if (t->opener_stack_size > 0 &&
-			strcmp(t->opener_stack[t->opener_stack_size - 1].value, "[") == 0) {
-			t->opener_stack_size--;
+			t->opener_stack[t->opener_stack_size - 1].type == TOK_ARRAY_OPEN) {
+			pop_opener(t);
 		} else {
-			error(t, "Unopened closer ']'");
+			error(t, USEC_ERROR_UNBALANCED, "Unopened closer ']'");
 		}
 		next(t);
 	}
 
 	else if (ch == '{') {
-		add_token(t, TOK_BRACE_OPEN, "{", 1);
+		add_token(t, TOK_BRACE_OPEN, t->index, 1);
 		USEC_Token o = t->tokens[t->token_count - 1];
+		o.pair = t->token_count - 1;
 		push_opener(t, &o);
 		next(t);
 	} else if (ch == '}') {
-		add_token(t, TOK_BRACE_CLOSE, "}", 1);
+		add_token(t, TOK_BRACE_CLOSE, t->index, 1);
 		if (t->opener_stack_size > 0 &&
-			strcmp(t->opener_stack[t->opener_stack_size - 1].value, "{") == 0) {
-			t->opener_stack_size--;
+			t->opener_stack[t->opener_stack_size - 1].type == TOK_BRACE_OPEN) {
+			pop_opener(t);
 		} else {
-			error(t, "Unopened closer '}'");
+			error(t, USEC_ERROR_UNBALANCED, "Unopened closer '}'");
 		}
 		next(t);
 	}
@@ -465,38 +595,38 @@ static void read_statement(USEC_Tokenizer* t) {
 	// Space
 	else if (ch == ' ') {
 		if (last && last->type != TOK_SPACE && last->type != TOK_NEWLINE)
-			add_token(t, TOK_SPACE, " ", 1);
-		else if (t->compact) error(t, "Unnecessary space");
+			add_token(t, TOK_SPACE, t->index, 1);
+		else if (t->compact) error(t, USEC_ERROR_FORMAT, "Unnecessary space");
 		next(t);
 	}
 
 	// Commas treated as newlines
 	else if (ch == ',') {
 		if (!t->compact && pk != '\0' && pk != ' ' && pk != '\n' && pk != '\r') {
-			error(t, "Missing whitespace after comma");
+			error(t, USEC_ERROR_FORMAT, "Missing whitespace after comma");
 		}
 		if (!last || last->type == TOK_SPACE || last->type == TOK_NEWLINE)
-			error(t, "Invalid comma");
+			error(t, USEC_ERROR_FORMAT, "Invalid comma");
 
-		add_token(t, TOK_NEWLINE, ",", 1);
+		add_token(t, TOK_NEWLINE, t->index, 1);
 		next(t);
 	}
 
 	// Line endings
 	else if (ch == '\n') {
 		if (last && last->type == TOK_SPACE) {
-			if (t->compact) error(t, "Unnecessary space");
+			if (t->compact) error(t, USEC_ERROR_FORMAT, "Unnecessary space");
 			// replace space with newline
 			t->tokens[t->token_count - 1].type = TOK_NEWLINE;
-			t->tokens[t->token_count - 1].value[0] = '\n';
+			t->tokens[t->token_count - 1].offset = t->index;
 		} else if (last && last->type == TOK_NEWLINE) {
-			if (t->compact) error(t, "Unnecessary newline");
+			if (t->compact) error(t, USEC_ERROR_FORMAT, "Unnecessary newline");
 		} else {
-			add_token(t, TOK_NEWLINE, "\n", 1);
+			add_token(t, TOK_NEWLINE, t->index, 1);
 		}
 		next(t);
 	} else if (ch == '\r' && pk == '\n') {
-		add_token(t, TOK_NEWLINE, "\r\n", 2);
+		add_token(t, TOK_NEWLINE, t->index, 2);
 		next(t);
 		next(t);
 	}
@@ -505,41 +635,92 @@ static void read_statement(USEC_Tokenizer* t) {
 	else {
 		char msg[64];
 		snprintf(msg, sizeof(msg), "Unexpected character '%c'", ch);
-		error(t, msg);
+		error(t, USEC_ERROR_SYNTAX, msg);
 		next(t);
 	}
 }
 
-void usec_tokenizer_tokenize(USEC_Tokenizer* t) {
-	if (!t->input) return;
-	t->length = strlen(t->input);
-
-	if (current(t) == '%') {
+void usec_tokenizer_start(USEC_Tokenizer* t) {
+	t->started = true;
+	if (!t->fragment && current(t) == '%') {
 		t->compact = true;
 		next(t);
 	}
 
-	add_token(t, TOK_NEWLINE, "sof", 3);
-	bool early_end = (current(t) == '\0');
+	add_marker(t, TOK_NEWLINE); // start of file
+	t->early_end = (current(t) == '\0');
+}
 
-	while (current(t)) {
-		read_statement(t);
-	}
+static void finish(USEC_Tokenizer* t) {
+	t->finished = true;
 
 	// Trailing space/newline cleanup
-	if (!early_end && t->token_count > 0) {
+	if (!t->early_end && !t->continued && t->token_count > 0) {
 		USEC_Token* last = &t->tokens[t->token_count - 1];
 		if (last->type == TOK_SPACE || last->type == TOK_NEWLINE) {
 			t->token_count--;
 		}
 	}
 
-	add_token(t, TOK_NEWLINE, "eof", 3);
+	add_marker(t, TOK_NEWLINE); // end of file
 
 	// Unclosed openers
 	if (t->opener_stack_size > 0) {
 		for (size_t i = 0; i < t->opener_stack_size; ++i) {
-			error_t(t, "Unclosed opener", &t->opener_stack[i]);
+			error_t(t, USEC_ERROR_UNBALANCED, "Unclosed opener", &t->opener_stack[i]);
 		}
 	}
-}
\ No newline at end of file
+}
+
+void usec_tokenizer_tokenize(USEC_Tokenizer* t) {
+	if (!t->input) return;
+
+	usec_tokenizer_start(t);
+	while (current(t) && !t->stopped) {
+		read_statement(t);
+	}
+	finish(t);
+}
+
+// Drops the tokens before keep, and the decoded text only they referenced
+static void drop_tokens(USEC_Tokenizer* t, size_t keep) {
+	if (keep <= t->token_base) return;
+	size_t drop = keep - t->token_base;
+	if (drop > t->token_count) drop = t->token_count;
+	memmove(t->tokens, t->tokens + drop, sizeof(USEC_Token) * (t->token_count - drop));
+	t->token_count -= drop;
+	t->token_base += drop;
+
+	size_t used = t->decoded.length;
+	for (size_t i = 0; i < t->token_count; ++i) {
+		if (t->tokens[i].decoded && t->tokens[i].offset < used) used = t->tokens[i].offset;
+	}
+	if (used == 0) return;
+
+	memmove(t->decoded.buffer, t->decoded.buffer + used, t->decoded.length - used);
+	t->decoded.length -= used;
+	t->decoded.buffer[t->decoded.length] = '\0';
+	for (size_t i = 0; i < t->token_count; ++i) {
+		if (t->tokens[i].decoded) t->tokens[i].offset -= used;
+	}
+}
+
+size_t usec_tokenizer_pull(USEC_Tokenizer* t, size_t keep, size_t index) {
+	if (!t->started) usec_tokenizer_start(t);
+	drop_tokens(t, keep);
+
+	while (!t->finished && t->token_base + t->token_count <= index + STREAM_LOOKAHEAD) {
+		if (current(t) && !t->stopped) read_statement(t);
+		else finish(t);
+	}
+	return t->token_base + t->token_count - (t->finished ? 0 : 1);
+}
+
+void usec_tokenizer_drain(USEC_Tokenizer* t) {
+	if (!t->started) usec_tokenizer_start(t);
+	while (!t->finished) {
+		// The pending token is kept, the next one read depends on it
+		size_t pending = t->token_base + t->token_count - 1;
+		usec_tokenizer_pull(t, pending, pending);
+	}
+}
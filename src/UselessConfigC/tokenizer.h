@@ -3,6 +3,9 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include "utils.h"
+#include "errors.h"
 
 typedef enum {
 	TOK_NEWLINE,
@@ -31,13 +34,33 @@ typedef enum {
 	TOK_COMMENT
 } USEC_TokenType;
 
+// Tokens don't own their text. They reference a span of the original input, or of the
+// tokenizer's decoded buffer for string pieces that contained escapes or line ending fixups.
 typedef struct USEC_Token {
 	USEC_TokenType type;
-	char* value;
+	bool decoded;
+	size_t offset;
+	size_t length;
 	int line;
 	int col;
+	union {
+		uint64_t hash; // usec_hash of the text for TOK_IDENTIFIER, computed once here and reused for every lookup
+		uint64_t mantissa; // TOK_NUMBER: the first USEC_NUMBER_DIGITS_MAX significant digits
+	};
+	union {
+		size_t pair; // index of the matching closer for TOK_ARRAY_OPEN and TOK_BRACE_OPEN, of the opener itself on the opener stack
+		struct {
+			int32_t exponent; // the number is mantissa * 10^exponent
+			uint8_t flags; // USEC_NUMBER_*
+		} number; // TOK_NUMBER
+	};
 } USEC_Token;
 
+// Shape of a TOK_NUMBER, recorded while it's scanned
+#define USEC_NUMBER_NEGATIVE 1
+#define USEC_NUMBER_FLOAT 2 // written with a fraction or exponent
+#define USEC_NUMBER_TRUNCATED 4 // nonzero digits didn't fit in the mantissa
+
 typedef struct USEC_Tokenizer {
 	const char* input;
 	size_t length;
@@ -47,20 +70,48 @@ typedef struct USEC_Tokenizer {
 	bool compact;
 	bool pedantic;
 	bool debug;
+	bool fragment; // input is a piece of a larger document, without its compact marker
+	bool continued; // a fragment followed by more of the document, its trailing newline is kept
 
 	USEC_Token* tokens;
 	size_t token_count;
 	size_t token_capacity;
 
+	// Streaming: tokens are read as the parser pulls them and only a window of them is kept
+	bool streaming;
+	size_t token_base; // index of tokens[0] in the whole stream
+	bool started;
+	bool finished; // the end of file marker has been added
+	bool early_end; // the input is empty after the compact marker
+
 	USEC_Token* opener_stack;
 	size_t opener_stack_size;
 	size_t opener_stack_capacity;
 
+	SB decoded; // escape-decoded text of string pieces, referenced by tokens with decoded set
+
 	bool has_error;
+	USEC_ErrorList* errors; // Collects errors instead of printing them and exiting when set
+	bool stopped; // The error list is full
+	uint64_t hash_seed;
 } USEC_Tokenizer;
 
-void usec_tokenizer_init(USEC_Tokenizer* t, const char* input, bool compact, bool pedantic, bool debug);
+// The input is length bytes and doesn't need to be null-terminated
+void usec_tokenizer_init(USEC_Tokenizer* t, const char* input, size_t length, bool compact, bool pedantic, bool debug);
+// Prepares for tokenizing another input, keeping the allocated buffers
+void usec_tokenizer_reset(USEC_Tokenizer* t, const char* input, size_t length, bool compact, bool pedantic, bool debug);
 void usec_tokenizer_tokenize(USEC_Tokenizer* t);
+// Streaming: reads the compact marker and adds the start of file marker, done by the first pull otherwise
+void usec_tokenizer_start(USEC_Tokenizer* t);
+// Streaming: reads on until the token at index and a few after it are final or the input ends, dropping the
+// tokens before keep. Returns the number of final tokens so far, the newest one stays pending until the one
+// after it is read, as it can still turn into a newline or be dropped at the end of the input.
+size_t usec_tokenizer_pull(USEC_Tokenizer* t, size_t keep, size_t index);
+// Streaming: reads the rest of the input for its errors, dropping the tokens
+void usec_tokenizer_drain(USEC_Tokenizer* t);
 void usec_tokenizer_destroy(USEC_Tokenizer* t);
 
+// Text of a token. Not null-terminated, use token->length.
+const char* usec_token_text(const USEC_Tokenizer* t, const USEC_Token* token);
+
 #endif
\ No newline at end of file
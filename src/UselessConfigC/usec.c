@@ -2,6 +2,12 @@
 #include "parser.h"
 #include "tokenizer.h"
 #include "utils.h"
+#include "mapping.h"
+#include "errors.h"
+#include "context.h"
+#include "cache.h"
+#include "format.h"
+#include "packed.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -108,7 +114,12 @@ USEC_ParseOptions usec_get_default_parse_options(void) {
 	opts.keepVariables = false;
 	opts.debugTokens = false;
 	opts.debugParser = false;
+	opts.useArena = false;
+	opts.packArrays = false;
+	opts.streaming = false;
+	opts.maxErrors = 20;
 	opts.variables = NULL;
+	opts.cacheDir = NULL;
 	return opts;
 }
 
@@ -120,14 +131,13 @@ USEC_ToStringOptions usec_get_default_tostring_options(void) {
 USEC_Value* usec_clone(const USEC_Value* val) {
 	if (!val) return NULL;
 
+	if (val->type == VALUE_STRING) return usec_parser_string_value(val->stringValue, strlen(val->stringValue));
+
 	USEC_Value* out = malloc(sizeof(USEC_Value));
 	out->type = val->type;
+	out->flags = 0;
 
 	switch (val->type) {
-	case VALUE_STRING:
-		out->stringValue = strdup(val->stringValue);
-		break;
-
 	case VALUE_BOOL:
 		out->boolValue = val->boolValue;
 		break;
@@ -152,6 +162,10 @@ USEC_Value* usec_clone(const USEC_Value* val) {
 		// nothing to copy
 		break;
 
+	case VALUE_STRING:
+		// cloned above, into one allocation with its text
+		break;
+
 	case VALUE_ARRAY: {
 		out->arrayValue.count = val->arrayValue.count;
 		if (val->arrayValue.count == 0) {
@@ -165,15 +179,16 @@ USEC_Value* usec_clone(const USEC_Value* val) {
 		break;
 	}
 
+	case VALUE_PACKED_ARRAY: {
+		size_t size = usec_packed_size(val->packedValue.elementType) * val->packedValue.count;
+		out->packedValue = val->packedValue;
+		out->packedValue.data = malloc(size);
+		memcpy(out->packedValue.data, val->packedValue.data, size);
+		break;
+	}
+
 	case VALUE_OBJECT: {
-		out->objectValue = usec_ht_create(val->objectValue->capacity);
-		for (size_t i = 0; i < val->objectValue->capacity; ++i) {
-			Usec_HashNode* cur = val->objectValue->buckets[i];
-			while (cur) {
-				usec_ht_set(out->objectValue, cur->key, usec_clone(cur->value));
-				cur = cur->next;
-			}
-		}
+		out->objectValue = usec_ht_from(val->objectValue);
 		break;
 	}
 
@@ -209,45 +224,109 @@ USEC_Value* usec_clone(const USEC_Value* val) {
 
 USEC_Value* usec_parse(const char* input, const USEC_ParseOptions* options) {
 	if (!input) return NULL;
+	return usec_parse_n(input, strlen(input), options);
+}
 
-	USEC_ParseOptions default_opts;
-	if (!options) {
-		default_opts = usec_get_default_parse_options();
-		options = &default_opts;
-	}
+USEC_Value* usec_parse_n(const char* input, size_t length, const USEC_ParseOptions* options) {
+	if (!input) return NULL;
 
-	// Tokenize
-	USEC_Tokenizer tokenizer;
-	usec_tokenizer_init(&tokenizer, input, false, options->pedantic, options->debugTokens);
-	usec_tokenizer_tokenize(&tokenizer);
+	USEC_Context ctx;
+	usec_context_init(&ctx);
+	USEC_Value* result = usec_context_run(&ctx, input, length, options, NULL);
+	usec_context_release(&ctx);
+	return result;
+}
+
+USEC_Value* usec_parse_file(const char* path, const USEC_ParseOptions* options) {
+	if (!path) return NULL;
 
-	if (tokenizer.has_error) {
-		usec_tokenizer_destroy(&tokenizer);
+	USEC_FileMapping mapping;
+	if (!usec_map_file(path, &mapping)) {
+		fprintf(stderr, "[USEC] Error: Could not open file '%s'\n", path);
 		return NULL;
 	}
 
-	// Parse
-	USEC_Parser parser;
-	usec_parser_init(&parser, tokenizer.tokens, tokenizer.token_count, options->variables);
-	parser.pedantic = options->pedantic;
-	parser.keep_variables = options->keepVariables;
-	parser.compact = tokenizer.compact;
-	parser.debug = options->debugParser;
+	// Debug output only comes from a real parse
+	bool cached = options && options->cacheDir && !options->debugTokens && !options->debugParser;
+	USEC_Value* result = cached ? usec_cache_parse(mapping.data, mapping.length, options) : usec_parse_n(mapping.data, mapping.length, options);
+	usec_unmap_file(&mapping);
+	return result;
+}
 
-	USEC_Value* result = usec_parser_parse(&parser);
+USEC_ParseResult usec_parse_result(const char* input, size_t length, const USEC_ParseOptions* options) {
+	USEC_ErrorList errors;
+	usec_errors_init(&errors, options);
+	USEC_Value* value = NULL;
+	if (input) {
+		USEC_Context ctx;
+		usec_context_init(&ctx);
+		value = usec_context_run(&ctx, input, length, options, &errors);
+		usec_context_release(&ctx);
+	}
+	return usec_errors_result(value, &errors);
+}
 
-	usec_parser_free(&parser);
-	usec_tokenizer_destroy(&tokenizer);
+USEC_ParseResult usec_parse_file_result(const char* path, const USEC_ParseOptions* options) {
+	USEC_Context ctx;
+	usec_context_init(&ctx);
+	USEC_ParseResult result = usec_context_run_file(&ctx, path, options);
+	usec_context_release(&ctx);
+	return result;
+}
 
+USEC_ParseResult usec_parse_events(const char* input, size_t length, const USEC_ParseOptions* options, USEC_EventFn fn, void* user) {
+	USEC_Context ctx;
+	usec_context_init(&ctx);
+	USEC_ParseResult result = usec_context_parse_events(&ctx, input, length, options, fn, user);
+	usec_context_release(&ctx);
 	return result;
 }
 
+USEC_ParseResult usec_parse_file_events(const char* path, const USEC_ParseOptions* options, USEC_EventFn fn, void* user) {
+	USEC_FileMapping mapping;
+	if (!path || !usec_map_file(path, &mapping)) {
+		USEC_ErrorList errors;
+		usec_errors_init(&errors, options);
+		if (path) usec_errors_add_io(&errors, path);
+		return usec_errors_result(NULL, &errors);
+	}
+
+	USEC_ParseResult result = usec_parse_events(mapping.data, mapping.length, options, fn, user);
+	usec_unmap_file(&mapping);
+	return result;
+}
+
+void usec_free_result(USEC_ParseResult* result) {
+	if (!result) return;
+	usec_free(result->value);
+	free(result->errors);
+	result->value = NULL;
+	result->errors = NULL;
+	result->error_count = 0;
+	result->truncated = false;
+}
+
 void usec_free(USEC_Value* root) {
 	usec_parser_free_value(root);
 }
 
+// Arrays are equal whether they're packed or not
+static bool arrays_equal(const USEC_Value* a, const USEC_Value* b) {
+	size_t count = usec_value_count(a);
+	if (count != usec_value_count(b)) return false;
+	if (a->type == VALUE_PACKED_ARRAY && b->type == VALUE_PACKED_ARRAY && a->packedValue.elementType != b->packedValue.elementType) return false;
+	for (size_t i = 0; i < count; ++i) {
+		USEC_Value scratch_a, scratch_b;
+		if (!usec_equals(usec_value_at(a, i, &scratch_a), usec_value_at(b, i, &scratch_b))) return false;
+	}
+	return true;
+}
+
 bool usec_equals(const USEC_Value* a, const USEC_Value* b) {
 	if (!a || !b) return a == b;
+	if ((a->type == VALUE_ARRAY || a->type == VALUE_PACKED_ARRAY) && (b->type == VALUE_ARRAY || b->type == VALUE_PACKED_ARRAY)) {
+		return arrays_equal(a, b);
+	}
 	if (a->type != b->type) return false;
 
 	switch (a->type) {
@@ -261,24 +340,13 @@ bool usec_equals(const USEC_Value* a, const USEC_Value* b) {
 	case VALUE_STRING:
 		return strcmp(a->stringValue, b->stringValue) == 0;
 
-	case VALUE_ARRAY: {
-		if (a->arrayValue.count != b->arrayValue.count) return false;
-		for (size_t i = 0; i < a->arrayValue.count; ++i) {
-			if (!usec_equals(a->arrayValue.items[i], b->arrayValue.items[i])) return false;
-		}
-		return true;
-	}
-
 	case VALUE_OBJECT: {
 		if (a->objectValue->size != b->objectValue->size) return false;
 
-		for (size_t i = 0; i < a->objectValue->capacity; ++i) {
-			Usec_HashNode* nodeA = a->objectValue->buckets[i];
-			while (nodeA) {
-				USEC_Value* valB = usec_ht_get(b->objectValue, nodeA->key);
-				if (!valB || !usec_equals(nodeA->value, valB)) return false;
-				nodeA = nodeA->next;
-			}
+		for (size_t i = 0; i < a->objectValue->size; ++i) {
+			Usec_HashNode* nodeA = &a->objectValue->entries[i];
+			USEC_Value* valB = usec_ht_get_hashed(b->objectValue, nodeA->key, strlen(nodeA->key), nodeA->hash);
+			if (!valB || !usec_equals(nodeA->value, valB)) return false;
 		}
 		return true;
 	}
@@ -288,6 +356,27 @@ bool usec_equals(const USEC_Value* a, const USEC_Value* b) {
 	}
 }
 
+void usec_freeze(USEC_Value* root) {
+	if (!root) return;
+
+	switch (root->type) {
+	case VALUE_ARRAY:
+		for (size_t i = 0; i < root->arrayValue.count; ++i)
+			usec_freeze(root->arrayValue.items[i]);
+		break;
+	case VALUE_OBJECT:
+		usec_ht_freeze(root->objectValue);
+		for (size_t i = 0; i < root->objectValue->size; ++i)
+			usec_freeze(root->objectValue->entries[i].value);
+		break;
+	case VALUE_FORMAT:
+		usec_freeze(root->formatNode->node);
+		break;
+	default:
+		break;
+	}
+}
+
 // ==============================
 //      Stringification
 // ==============================
@@ -307,8 +396,8 @@ static void to_object_string(const USEC_Value* object, SB* sb, bool readable, bo
 	if (!is_file) sb_append_char(sb, '{');
 	if (!is_file && readable) sb_append_char(sb, '\n');
 
-	Usec_HashNode* node = ht->order_head;
-	while (node) {
+	for (size_t i = 0; i < ht->size; ++i) {
+		Usec_HashNode* node = &ht->entries[i];
 		if (count++ > 0) {
 			if (readable) sb_append_char(sb, '\n');
 			else sb_append_char(sb, ',');
@@ -328,8 +417,6 @@ static void to_object_string(const USEC_Value* object, SB* sb, bool readable, bo
 
 		sb_append_str(sb, readable ? " = " : "=");
 		to_string_value_internal(node->value, sb, readable, enable_vars, is_file ? level : level + 1);
-
-		node = node->order_next;
 	}
 
 	if (!is_file && readable) {
@@ -341,7 +428,8 @@ static void to_object_string(const USEC_Value* object, SB* sb, bool readable, bo
 }
 
 static void to_array_string(const USEC_Value* array, SB* sb, bool readable, bool enable_vars, int level) {
-	if (!array || array->arrayValue.count == 0) {
+	size_t count = usec_value_count(array);
+	if (count == 0) {
 		sb_append_str(sb, "[]");
 		return;
 	}
@@ -349,11 +437,12 @@ static void to_array_string(const USEC_Value* array, SB* sb, bool readable, bool
 	sb_append_char(sb, '[');
 	if (readable) sb_append_char(sb, '\n');
 
-	for (size_t i = 0; i < array->arrayValue.count; ++i) {
+	for (size_t i = 0; i < count; ++i) {
 		if (i > 0) sb_append_str(sb, readable ? "\n" : ",");
 
 		if (readable) indent_level(sb, level + 1);
-		to_string_value_internal(array->arrayValue.items[i], sb, readable, enable_vars, level + 1);
+		USEC_Value scratch;
+		to_string_value_internal(usec_value_at(array, i, &scratch), sb, readable, enable_vars, level + 1);
 	}
 
 	if (readable) {
@@ -379,26 +468,17 @@ static void to_string_internal(const USEC_Value* val, SB* sb, bool readable, boo
 		sb_append_str(sb, val->boolValue ? "true" : "false");
 		break;
 
-	case VALUE_INT: {
-		char buf[32];
-		snprintf(buf, sizeof(buf), "%lld", (long long)val->int64Value);
-		sb_append_str(sb, buf);
+	case VALUE_INT:
+		sb_append_int(sb, val->int64Value);
 		break;
-	}
 
-	case VALUE_UINT: {
-		char buf[32];
-		snprintf(buf, sizeof(buf), "%llu", (unsigned long long)val->uint64Value);
-		sb_append_str(sb, buf);
+	case VALUE_UINT:
+		sb_append_uint(sb, val->uint64Value);
 		break;
-	}
 
-	case VALUE_DOUBLE: {
-		char buf[64];
-		snprintf(buf, sizeof(buf), "%g", val->doubleValue);
-		sb_append_str(sb, buf);
+	case VALUE_DOUBLE:
+		sb_append_double(sb, val->doubleValue);
 		break;
-	}
 
 	case VALUE_CHAR: {
 		char escaped[8];
@@ -441,6 +521,7 @@ static void to_string_internal(const USEC_Value* val, SB* sb, bool readable, boo
 		break;
 
 	case VALUE_ARRAY:
+	case VALUE_PACKED_ARRAY:
 		to_array_string(val, sb, readable, enable_vars, level);
 		break;
 
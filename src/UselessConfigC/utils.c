@@ -37,6 +37,14 @@ int asprintf(char** str, const char* fmt, ...) {
 	return written;
 }
 
+char* usec_strndup(const char* str, size_t len) {
+	char* copy = (char*)malloc(len + 1);
+	if (!copy) return NULL;
+	memcpy(copy, str, len);
+	copy[len] = '\0';
+	return copy;
+}
+
 // Stringbuilder
 
 SB sb_create(void) {
@@ -68,7 +76,16 @@ void sb_append_str(SB* sb, const char* str) {
 }
 
 void sb_append_data(SB* sb, const char* data, size_t len) {
-	if (!sb->buffer || !data) return;
+	if (!data) return;
+	char* out = sb_reserve(sb, len);
+	if (!out) return;
+	memcpy(out, data, len);
+	sb->length += len;
+	sb->buffer[sb->length] = '\0';
+}
+
+char* sb_reserve(SB* sb, size_t len) {
+	if (!sb->buffer) return NULL;
 
 	if (sb->length + len + 1 > sb->capacity) {
 		while (sb->length + len + 1 > sb->capacity) {
@@ -76,9 +93,7 @@ void sb_append_data(SB* sb, const char* data, size_t len) {
 		}
 		sb->buffer = (char*)realloc(sb->buffer, sb->capacity);
 	}
-	memcpy(sb->buffer + sb->length, data, len);
-	sb->length += len;
-	sb->buffer[sb->length] = '\0';
+	return sb->buffer + sb->length;
 }
 
 char* sb_build(SB* sb) {
@@ -98,6 +113,15 @@ void sb_clear(SB* sb) {
 	sb_init(sb);
 }
 
+void sb_reset(SB* sb) {
+	if (!sb->buffer) {
+		sb_init(sb);
+		return;
+	}
+	sb->length = 0;
+	sb->buffer[0] = '\0';
+}
+
 void sb_free(SB* sb) {
 	if (sb->buffer) {
 		free(sb->buffer);
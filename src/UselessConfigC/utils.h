@@ -10,6 +10,9 @@ extern "C" {
 	// Portable asprintf fallback
 	int asprintf(char** str, const char* fmt, ...);
 
+	// Null-terminated malloc'd copy of the first len bytes of str
+	char* usec_strndup(const char* str, size_t len);
+
 	// ======================
 	// Dynamic String Builder
 	// ======================
@@ -33,9 +36,16 @@ extern "C" {
 	// Append arbitrary bytes (e.g., binary strings)
 	void sb_append_data(SB* sb, const char* data, size_t len);
 
+	// Make room for len more bytes and the null, returns where they go (NULL if the builder failed).
+	// The caller writes them and adds their count to length.
+	char* sb_reserve(SB* sb, size_t len);
+
 	// Reset the builder (reinit)
 	void sb_clear(SB* sb);
 
+	// Empty the builder but keep its buffer for reuse
+	void sb_reset(SB* sb);
+
 	// Finalize and get the underlying string
 	// Returns malloc'd string caller must free
 	char* sb_build(SB* sb);
@@ -0,0 +1,106 @@
+#include <usec/usec.h>
+#include "packed.h"
+#include <string.h>
+
+// Formatting wrappers are looked through, readers only see the value they carry
+static const USEC_Value* unwrap(const USEC_Value* value) {
+	while (value && value->type == VALUE_FORMAT) value = value->formatNode->node;
+	return value;
+}
+
+USEC_ValueType usec_value_type(const USEC_Value* value) {
+	value = unwrap(value);
+	if (!value) return VALUE_NULL;
+	return value->type == VALUE_PACKED_ARRAY ? VALUE_ARRAY : value->type;
+}
+
+bool usec_value_bool(const USEC_Value* value) {
+	value = unwrap(value);
+	return value && value->type == VALUE_BOOL && value->boolValue;
+}
+
+char usec_value_char(const USEC_Value* value) {
+	value = unwrap(value);
+	return value && value->type == VALUE_CHAR ? value->charValue : 0;
+}
+
+int64_t usec_value_int(const USEC_Value* value) {
+	value = unwrap(value);
+	if (!value) return 0;
+	switch (value->type) {
+	case VALUE_INT: return value->int64Value;
+	case VALUE_UINT: return (int64_t)value->uint64Value;
+	default: return 0;
+	}
+}
+
+uint64_t usec_value_uint(const USEC_Value* value) {
+	value = unwrap(value);
+	if (!value) return 0;
+	switch (value->type) {
+	case VALUE_UINT: return value->uint64Value;
+	case VALUE_INT: return (uint64_t)value->int64Value;
+	default: return 0;
+	}
+}
+
+double usec_value_double(const USEC_Value* value) {
+	value = unwrap(value);
+	if (!value) return 0;
+	switch (value->type) {
+	case VALUE_DOUBLE: return value->doubleValue;
+	case VALUE_INT: return (double)value->int64Value;
+	case VALUE_UINT: return (double)value->uint64Value;
+	default: return 0;
+	}
+}
+
+const char* usec_value_string(const USEC_Value* value, size_t* length) {
+	value = unwrap(value);
+	if (!value || value->type != VALUE_STRING) {
+		if (length) *length = 0;
+		return NULL;
+	}
+	if (length) *length = strlen(value->stringValue);
+	return value->stringValue;
+}
+
+size_t usec_value_count(const USEC_Value* value) {
+	value = unwrap(value);
+	if (!value) return 0;
+	switch (value->type) {
+	case VALUE_ARRAY: return value->arrayValue.count;
+	case VALUE_PACKED_ARRAY: return value->packedValue.count;
+	case VALUE_OBJECT: return value->objectValue->size;
+	default: return 0;
+	}
+}
+
+const USEC_Value* usec_value_at(const USEC_Value* array, size_t index, USEC_Value* scratch) {
+	array = unwrap(array);
+	if (!array) return NULL;
+	if (array->type == VALUE_PACKED_ARRAY) {
+		if (index >= array->packedValue.count) return NULL;
+		*scratch = usec_packed_get(array, index);
+		return scratch;
+	}
+	if (array->type != VALUE_ARRAY || index >= array->arrayValue.count) return NULL;
+	return array->arrayValue.items[index];
+}
+
+const USEC_Value* usec_value_get(const USEC_Value* object, const char* key) {
+	object = unwrap(object);
+	if (!object || object->type != VALUE_OBJECT || !key) return NULL;
+	return usec_ht_get(object->objectValue, key);
+}
+
+const char* usec_value_entry(const USEC_Value* object, size_t index, const USEC_Value** value) {
+	object = unwrap(object);
+	if (!object || object->type != VALUE_OBJECT || index >= object->objectValue->size) {
+		if (value) *value = NULL;
+		return NULL;
+	}
+	Usec_HashNode* entry = &object->objectValue->entries[index];
+	if (value) *value = entry->value;
+	return entry->key;
+}
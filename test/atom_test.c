@@ -0,0 +1,215 @@
+#include "check.h"
+
+// Object keys are shared atoms: members with the same key in one parse share it, clones and copies keep
+// sharing it, and any of the trees can be freed first
+
+#define MAX_KEYS 4096
+
+typedef struct {
+	const char* keys[MAX_KEYS];
+	size_t count;
+} Keys;
+
+// Key pointers of every member, depth first in insertion order
+static void collect(const USEC_Value* value, Keys* keys) {
+	while (value && value->type == VALUE_FORMAT) value = value->formatNode->node;
+	if (!value) return;
+	if (value->type == VALUE_ARRAY) {
+		for (size_t i = 0; i < value->arrayValue.count; ++i) collect(value->arrayValue.items[i], keys);
+	} else if (value->type == VALUE_OBJECT) {
+		for (size_t i = 0; i < value->objectValue->size; ++i) {
+			if (keys->count < MAX_KEYS) keys->keys[keys->count++] = value->objectValue->entries[i].key;
+			collect(value->objectValue->entries[i].value, keys);
+		}
+	}
+}
+
+static const char* document =
+	"name = \"root\"\n"
+	"records = [\n"
+	"    {id = 1, name = \"a\", tags = {red = true, blue = false}},\n"
+	"    {id = 2, name = \"b\", tags = {red = false, blue = true}},\n"
+	"    {id = 3, name = \"c\", tags = {red = true, blue = true}, extra = {id = 4}}\n"
+	"]\n"
+	"nested = {name = {name = {name = \"deep\"}}}\n";
+
+// Members with the same key share one atom
+static void check_interned(const USEC_Value* root) {
+	Keys keys = { .count = 0 };
+	collect(root, &keys);
+	CHECK(keys.count > 20);
+	for (size_t i = 0; i < keys.count; ++i) {
+		for (size_t j = i + 1; j < keys.count; ++j) {
+			if (strcmp(keys.keys[i], keys.keys[j]) == 0) CHECK(keys.keys[i] == keys.keys[j]);
+		}
+	}
+}
+
+// The copy has the keys of the original, the same atoms when sharing
+static void check_keys(const USEC_Value* original, const USEC_Value* copy, bool shared) {
+	Keys a = { .count = 0 }, b = { .count = 0 };
+	collect(original, &a);
+	collect(copy, &b);
+	CHECK(a.count == b.count);
+	for (size_t i = 0; i < a.count && i < b.count; ++i) {
+		CHECK(strcmp(a.keys[i], b.keys[i]) == 0);
+		if (shared) CHECK(a.keys[i] == b.keys[i]);
+	}
+}
+
+static USEC_ParseOptions options_for(bool arena) {
+	USEC_ParseOptions options = usec_get_default_parse_options();
+	options.useArena = arena;
+	return options;
+}
+
+// Clones share the keys of heap trees and copy those of arena trees. Either tree can go first, and what's
+// left still reads and compares the same.
+static void test_clone_order(void) {
+	for (int arena = 0; arena <= 1; ++arena) {
+		USEC_ParseOptions options = options_for(arena);
+		for (int order = 0; order <= 1; ++order) {
+			USEC_Value* original = usec_parse(document, &options);
+			check_interned(original);
+			USEC_Value* clone = usec_clone(original);
+			check_keys(original, clone, !arena);
+			CHECK(usec_equals(original, clone) && usec_equals(clone, original));
+
+			USEC_Value* reference = usec_parse(document, &options);
+			CHECK(usec_equals(reference, clone));
+			Keys before = { .count = 0 };
+			collect(reference, &before);
+			if (order == 0) {
+				usec_free(original);
+				CHECK_SAME_TREE(reference, clone);
+				check_keys(reference, clone, false);
+				usec_free(clone);
+			} else {
+				usec_free(clone);
+				CHECK_SAME_TREE(reference, original);
+				check_keys(reference, original, false);
+				usec_free(original);
+			}
+			usec_free(reference);
+		}
+	}
+}
+
+// Clones of clones and copies of single tables, freed in every order
+static void test_chains(void) {
+	USEC_ParseOptions options = options_for(false);
+	USEC_Value* reference = usec_parse(document, &options);
+	static const int orders[6][3] = { {0, 1, 2}, {0, 2, 1}, {1, 0, 2}, {1, 2, 0}, {2, 0, 1}, {2, 1, 0} };
+	for (int o = 0; o < 6; ++o) {
+		USEC_Value* trees[3];
+		trees[0] = usec_parse(document, &options);
+		trees[1] = usec_clone(trees[0]);
+		trees[2] = usec_clone(trees[1]);
+		check_keys(trees[0], trees[2], true);
+		for (int i = 0; i < 3; ++i) {
+			usec_free(trees[orders[o][i]]);
+			for (int j = i + 1; j < 3; ++j) CHECK_SAME_TREE(reference, trees[orders[o][j]]);
+		}
+	}
+
+	// A copy of one table shares the keys of its members
+	USEC_Value* original = usec_parse(document, &options);
+	const USEC_Value* records = usec_ht_get(original->objectValue, "records");
+	const USEC_Value* record = records->arrayValue.items[0];
+	Usec_Hashtable* copy = usec_ht_from(record->objectValue);
+	CHECK(copy->size == record->objectValue->size);
+	for (size_t i = 0; i < copy->size; ++i) CHECK(copy->entries[i].key == record->objectValue->entries[i].key);
+	usec_free(original);
+	USEC_Value* id = usec_ht_get(copy, "id");
+	CHECK(id && id->type == VALUE_UINT && id->uint64Value == 1);
+	CHECK(usec_ht_get(copy, "tags") != NULL);
+	usec_ht_free(copy);
+	usec_free(reference);
+}
+
+// Changing a clone leaves the original alone, new keys are atoms of their own
+static void test_changes(void) {
+	USEC_ParseOptions options = options_for(false);
+	USEC_Value* original = usec_parse(document, &options);
+	USEC_Value* reference = usec_parse(document, &options);
+	USEC_Value* clone = usec_clone(original);
+
+	usec_ht_set(clone->objectValue, "name", usec_parse("!\"changed\"", &options));
+	usec_ht_set(clone->objectValue, "added", usec_parse("!1", &options));
+	char key[] = "temporary";
+	usec_ht_set(clone->objectValue, key, usec_parse("!2", &options));
+	memcpy(key, "overwrite", sizeof(key));
+	CHECK(usec_ht_get(clone->objectValue, "temporary") != NULL);
+	CHECK(usec_ht_get(clone->objectValue, "overwrite") == NULL);
+	CHECK(!usec_equals(original, clone));
+	CHECK_SAME_TREE(reference, original);
+
+	usec_ht_clear(clone->objectValue);
+	CHECK_SAME_TREE(reference, original);
+	usec_free(clone);
+	usec_free(original);
+	usec_free(reference);
+}
+
+// Trees compare equal with shared keys, with keys of other parses and with keys of arena parses, and keys
+// that differ don't
+static void test_equals(void) {
+	USEC_ParseOptions heap = options_for(false);
+	USEC_ParseOptions arena = options_for(true);
+	USEC_Value* a = usec_parse(document, &heap);
+	USEC_Value* b = usec_parse(document, &heap);
+	USEC_Value* c = usec_parse(document, &arena);
+	USEC_Value* shared = usec_clone(a);
+	CHECK(usec_equals(a, shared) && usec_equals(a, b) && usec_equals(b, c) && usec_equals(c, shared));
+
+	USEC_Value* renamed = usec_parse("name = \"root\"\nrecords = []\nnested = {name = {name = {nmae = \"deep\"}}}\n", &heap);
+	USEC_Value* other = usec_parse("name = \"root\"\nrecords = []\nnested = {name = {name = {name = \"deep\"}}}\n", &heap);
+	CHECK(!usec_equals(renamed, other) && !usec_equals(other, renamed));
+	CHECK(!usec_equals(a, other));
+
+	usec_free(a);
+	CHECK(usec_equals(shared, b));
+	usec_free(renamed);
+	usec_free(other);
+	usec_free(shared);
+	usec_free(b);
+	usec_free(c);
+}
+
+// Trees merged from the parts of a parallel parse keep sharing keys through clones
+static void test_parallel(void) {
+	char* input = NULL;
+	size_t length = 0, capacity = 0;
+	for (int i = 0; i < 2000; ++i) {
+		char line[128];
+		int written = snprintf(line, sizeof(line), "k%d = {id = %d, name = \"n%d\", tags = {red = true}}\n", i % 50 + i, i, i);
+		if (length + (size_t)written + 1 > capacity) {
+			capacity = (length + (size_t)written + 1) * 2;
+			input = realloc(input, capacity);
+		}
+		memcpy(input + length, line, (size_t)written + 1);
+		length += (size_t)written;
+	}
+	USEC_ParseOptions options = options_for(false);
+	USEC_ParseResult result = usec_parse_parallel(input, length, &options, 4);
+	USEC_Value* reference = usec_parse(input, &options);
+	CHECK(result.value && result.error_count == 0);
+	if (result.value) {
+		USEC_Value* clone = usec_clone(result.value);
+		check_keys(result.value, clone, true);
+		usec_free_result(&result);
+		CHECK_SAME_TREE(reference, clone);
+		usec_free(clone);
+	}
+	usec_free(reference);
+	free(input);
+}
+
+int main(void) {
+	test_clone_order();
+	test_chains();
+	test_changes();
+	test_equals();
+	test_parallel();
+	return check_result();
+}
@@ -0,0 +1,129 @@
+#include "check.h"
+
+static const char* input =
+	":base = \"/srv\"\n"
+	"name = \"binary \\\"test\\\" \\\\ \\n\"\n"
+	"path = \"$(base)/data\"\n"
+	"char = 'c'\n"
+	"flag = true\n"
+	"off = false\n"
+	"nothing = null\n"
+	"small = 7\n"
+	"negative = -9000000000\n"
+	"large = 18446744073709551615\n"
+	"ratio = 0.1\n"
+	"empty = \"\"\n"
+	"list = [1, \"two\", 3.5, null, [], {}, [true, false]]\n"
+	"numbers = [1, 2, 3, 4]\n"
+	"records = [{id = 1, version = \"a\"}, {id = 2, version = \"b\"}]\n"
+	"wide = {k0 = 0, k1 = 1, k2 = 2, k3 = 3, k4 = 4, k5 = 5, k6 = 6, k7 = 7, k8 = 8, k9 = 9, k10 = 10, k11 = 11}\n"
+	"nested = {a = {b = {c = \"deep\"}}}\n";
+
+// Walks the binary document next to the tree it was written from
+static void check_ref(const USEC_BinaryRef* ref, const USEC_Value* value) {
+	USEC_ValueType type = usec_value_type(value);
+	CHECK(usec_binary_type(ref) == type);
+	if (usec_binary_type(ref) != type) return;
+
+	switch (type) {
+	case VALUE_OBJECT: {
+		size_t count = usec_value_count(value);
+		CHECK(usec_binary_count(ref) == count);
+		for (size_t i = 0; i < count; ++i) {
+			const USEC_Value* member;
+			const char* key = usec_value_entry(value, i, &member);
+			USEC_BinaryRef at, found;
+			CHECK(usec_binary_at(ref, i, &at));
+			CHECK(usec_binary_key(&at) && strcmp(usec_binary_key(&at), key) == 0);
+			CHECK(usec_binary_get(ref, key, &found));
+			check_ref(&found, member);
+		}
+		USEC_BinaryRef missing;
+		CHECK(!usec_binary_get(ref, "missing key", &missing));
+		break;
+	}
+	case VALUE_ARRAY: {
+		size_t count = usec_value_count(value);
+		CHECK(usec_binary_count(ref) == count);
+		for (size_t i = 0; i < count; ++i) {
+			USEC_Value scratch;
+			USEC_BinaryRef item;
+			CHECK(usec_binary_at(ref, i, &item));
+			CHECK(usec_binary_key(&item) == NULL);
+			check_ref(&item, usec_value_at(value, i, &scratch));
+		}
+		USEC_BinaryRef past;
+		CHECK(!usec_binary_at(ref, count, &past));
+		break;
+	}
+	case VALUE_STRING: {
+		size_t length, expected_length;
+		const char* expected = usec_value_string(value, &expected_length);
+		const char* text = usec_binary_string(ref, &length);
+		CHECK(text && length == expected_length && memcmp(text, expected, length) == 0 && text[length] == '\0');
+		break;
+	}
+	case VALUE_INT: CHECK(usec_binary_int(ref) == usec_value_int(value)); break;
+	case VALUE_UINT: CHECK(usec_binary_uint(ref) == usec_value_uint(value)); break;
+	case VALUE_DOUBLE: CHECK(usec_binary_double(ref) == usec_value_double(value)); break;
+	case VALUE_BOOL: CHECK(usec_binary_bool(ref) == usec_value_bool(value)); break;
+	case VALUE_CHAR: CHECK(usec_binary_char(ref) == usec_value_char(value)); break;
+	default: break;
+	}
+}
+
+static void check_document(const USEC_Binary* bin, const USEC_Value* root) {
+	CHECK(bin != NULL);
+	if (!bin) return;
+	USEC_BinaryRef ref;
+	CHECK(usec_binary_root(bin, &ref));
+	check_ref(&ref, root);
+
+	USEC_Value* copy = usec_binary_value(&ref);
+	CHECK_SAME_TREE(root, copy);
+	usec_free(copy);
+
+	USEC_BinaryRef wide, key;
+	CHECK(usec_binary_get(&ref, "wide", &wide) && usec_binary_get(&wide, "k11", &key) && usec_binary_int(&key) == 11);
+}
+
+static void test_round_trip(bool pack, bool arena) {
+	USEC_ParseOptions options = usec_get_default_parse_options();
+	options.packArrays = pack;
+	options.useArena = arena;
+	USEC_Value* root = usec_parse(input, &options);
+	CHECK(root != NULL);
+
+	size_t length;
+	char* data = usec_to_binary(root, &length);
+	CHECK(data != NULL);
+	USEC_Binary* bin = usec_binary_from(data, length);
+	check_document(bin, root);
+	usec_binary_close(bin);
+	free(data);
+	usec_free(root);
+}
+
+static void test_file(void) {
+	USEC_Value* root = usec_parse(input, NULL);
+	const char* path = "binary_test.useb";
+	CHECK(usec_save_binary(root, path));
+	USEC_Binary* bin = usec_binary_open(path);
+	check_document(bin, root);
+	usec_binary_close(bin);
+	remove(path);
+	usec_free(root);
+}
+
+static void test_rejected(void) {
+	CHECK(usec_binary_from("USEC", 4) == NULL);
+	CHECK(usec_binary_from("not a binary document at all", 28) == NULL);
+	CHECK(usec_binary_open("missing_binary_test.useb") == NULL);
+}
+
+int main(void) {
+	for (int mode = 0; mode < 4; ++mode) test_round_trip(mode & 1, mode & 2);
+	test_file();
+	test_rejected();
+	return check_result();
+}
@@ -0,0 +1,328 @@
+#include "check.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <direct.h>
+#else
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
+// usec_parse_file with a cache directory: hits, misses for every part of the key, damaged cache files and
+// inputs with errors, in a temporary directory removed at the end
+
+static char dir[512];
+
+static void make_dir(void) {
+#ifdef _WIN32
+	char base[MAX_PATH];
+	GetTempPathA(sizeof(base), base);
+	snprintf(dir, sizeof(dir), "%susec_cache_%lu", base, (unsigned long)GetCurrentProcessId());
+	CHECK(_mkdir(dir) == 0);
+#else
+	const char* base = getenv("TMPDIR");
+	snprintf(dir, sizeof(dir), "%s/usec_cache_XXXXXX", base && *base ? base : "/tmp");
+	CHECK(mkdtemp(dir) != NULL);
+#endif
+}
+
+// Calls fn with the path of every file in the directory, returns their count
+static size_t each_file(void (*fn)(const char* path)) {
+	char path[1024];
+	size_t count = 0;
+#ifdef _WIN32
+	WIN32_FIND_DATAA data;
+	snprintf(path, sizeof(path), "%s\\*", dir);
+	HANDLE find = FindFirstFileA(path, &data);
+	if (find == INVALID_HANDLE_VALUE) return 0;
+	do {
+		if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) continue;
+		snprintf(path, sizeof(path), "%s\\%s", dir, data.cFileName);
+		if (fn) fn(path);
+		++count;
+	} while (FindNextFileA(find, &data));
+	FindClose(find);
+#else
+	DIR* d = opendir(dir);
+	if (!d) return 0;
+	struct dirent* entry;
+	while ((entry = readdir(d))) {
+		if (entry->d_name[0] == '.') continue;
+		snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+		if (fn) fn(path);
+		++count;
+	}
+	closedir(d);
+#endif
+	return count;
+}
+
+static void remove_file(const char* path) {
+	remove(path);
+}
+
+static void remove_dir(void) {
+	each_file(remove_file);
+#ifdef _WIN32
+	_rmdir(dir);
+#else
+	rmdir(dir);
+#endif
+}
+
+static char cache_file[1024];
+
+static void find_cache_file(const char* path) {
+	size_t length = strlen(path);
+	if (length > 5 && strcmp(path + length - 5, ".useb") == 0) snprintf(cache_file, sizeof(cache_file), "%s", path);
+}
+
+// Number of cache files, the path of one of them in cache_file
+static size_t cache_files(void) {
+	cache_file[0] = '\0';
+	size_t count = each_file(find_cache_file);
+	return cache_file[0] ? count - 1 : 0; // the input file is the other one
+}
+
+static char input_file[1024];
+
+static void write_file(const char* path, const void* data, size_t length) {
+	FILE* file = fopen(path, "wb");
+	CHECK(file != NULL);
+	if (!file) return;
+	CHECK(fwrite(data, 1, length, file) == length);
+	fclose(file);
+}
+
+static char* read_file(const char* path, size_t* length) {
+	FILE* file = fopen(path, "rb");
+	CHECK(file != NULL);
+	if (!file) return NULL;
+	fseek(file, 0, SEEK_END);
+	*length = (size_t)ftell(file);
+	fseek(file, 0, SEEK_SET);
+	char* data = malloc(*length ? *length : 1);
+	CHECK(fread(data, 1, *length, file) == *length);
+	fclose(file);
+	return data;
+}
+
+static void write_input(const char* input) {
+	write_file(input_file, input, strlen(input));
+}
+
+static USEC_ParseOptions lenient(void) {
+	USEC_ParseOptions options = usec_get_default_parse_options();
+	options.pedantic = false;
+	return options;
+}
+
+// A cached parse gives the tree of an uncached one
+static void check_cached(const USEC_ParseOptions* options) {
+	USEC_ParseOptions plain = *options;
+	plain.cacheDir = NULL;
+	USEC_Value* expected = usec_parse_file(input_file, &plain);
+	USEC_Value* value = usec_parse_file(input_file, options);
+	CHECK_SAME_TREE(expected, value);
+	usec_free(expected);
+	usec_free(value);
+}
+
+static const char* document =
+	":version = \"2.1\"\n"
+	"array = [1, 2, \"3\", {object = {id = 12, version = version, path = \"/root/$(version)/project\"}}]\n"
+	"numbers = [1, 2, 3]\n"
+	"object = {\n"
+	"    :version = \"$(version).3\"\n"
+	"    id = 42\n"
+	"    version = version\n"
+	"}\n";
+
+// The second parse reads the cache file: replacing it changes what the parse returns
+static void test_hit(void) {
+	USEC_ParseOptions options = lenient();
+	options.cacheDir = dir;
+	write_input(document);
+	check_cached(&options);
+	CHECK(cache_files() == 1);
+	check_cached(&options);
+	CHECK(cache_files() == 1);
+
+	// Moves the cache file of another input in its place
+	char path[1024];
+	snprintf(path, sizeof(path), "%s", cache_file);
+	remove(path);
+	write_input("planted = 1\n");
+	check_cached(&options);
+	CHECK(cache_files() == 1);
+	size_t length;
+	char* other = read_file(cache_file, &length);
+	if (!other) return;
+	remove(cache_file);
+	write_file(path, other, length);
+	free(other);
+	write_input(document);
+	USEC_Value* planted = usec_parse("planted = 1\n", &options);
+	USEC_Value* value = usec_parse_file(input_file, &options);
+	CHECK_SAME_TREE(planted, value);
+	usec_free(value);
+	usec_free(planted);
+
+	// Packed arrays are stored unpacked and packed again on a hit
+	remove(path);
+	options.packArrays = true;
+	check_cached(&options);
+	check_cached(&options);
+	options.packArrays = false;
+	check_cached(&options);
+	CHECK(cache_files() == 1);
+	remove(cache_file);
+}
+
+// Each part of the key gets a cache file of its own, and a hit declares the cached variables like a parse
+static void test_misses(void) {
+	USEC_ParseOptions options = lenient();
+	options.cacheDir = dir;
+	write_input(document);
+	check_cached(&options);
+	CHECK(cache_files() == 1);
+
+	write_input("a = 1\n");
+	check_cached(&options);
+	CHECK(cache_files() == 2);
+
+	write_input(document);
+	options.keepVariables = true;
+	check_cached(&options);
+	CHECK(cache_files() == 3);
+	check_cached(&options);
+	CHECK(cache_files() == 3);
+
+	options.keepVariables = false;
+	options.pedantic = true;
+	check_cached(&options);
+	CHECK(cache_files() == 4);
+
+	options.pedantic = false;
+	const char* presets[] = { "", "name = \"first\"\n", "name = \"second\"\n", "name = \"first\"\nother = 1\n" };
+	for (size_t i = 0; i < sizeof(presets) / sizeof(presets[0]); ++i) {
+		USEC_Value* preset = usec_parse(presets[i], &options);
+		for (int round = 0; round < 2; ++round) {
+			USEC_ParseOptions plain = options;
+			plain.variables = usec_ht_from(preset->objectValue);
+			USEC_Value* expected = usec_parse_file(input_file, &plain);
+			options.variables = usec_ht_from(preset->objectValue);
+			USEC_Value* value = usec_parse_file(input_file, &options);
+			CHECK_SAME_TREE(expected, value);
+			USEC_Value expected_vars = { .type = VALUE_OBJECT, .objectValue = plain.variables };
+			USEC_Value vars = { .type = VALUE_OBJECT, .objectValue = options.variables };
+			CHECK_SAME_TREE(&expected_vars, &vars);
+			usec_ht_free(plain.variables);
+			usec_ht_free(options.variables);
+			usec_free(expected);
+			usec_free(value);
+		}
+		CHECK(cache_files() == 5 + i);
+		usec_free(preset);
+	}
+	options.variables = NULL;
+	each_file(remove_file);
+}
+
+static size_t damaged_length;
+static const char* damage;
+
+static void damage_cache_file(const char* path) {
+	size_t length = strlen(path);
+	if (length > 5 && strcmp(path + length - 5, ".useb") == 0) write_file(path, damage, damaged_length);
+}
+
+// Damaged cache files are misses, parsed and stored again
+static void test_damaged(void) {
+	USEC_ParseOptions options = lenient();
+	options.cacheDir = dir;
+	write_input(document);
+	check_cached(&options);
+	CHECK(cache_files() == 1);
+	size_t length;
+	char* good = read_file(cache_file, &length);
+	if (!good) return;
+
+	char garbage[64];
+	for (size_t i = 0; i < sizeof(garbage); ++i) garbage[i] = (char)(i * 37 + 11);
+	const char* damages[] = { "", garbage, garbage, good, good, good };
+	size_t lengths[] = { 0, sizeof(garbage), 3, 4, length / 2, length - 1 };
+	for (size_t i = 0; i < sizeof(damages) / sizeof(damages[0]); ++i) {
+		damage = damages[i];
+		damaged_length = lengths[i];
+		each_file(damage_cache_file);
+		check_cached(&options);
+		CHECK(cache_files() == 1);
+
+		size_t stored_length;
+		char* stored = read_file(cache_file, &stored_length);
+		CHECK(stored && stored_length == length && memcmp(stored, good, length) == 0);
+		free(stored);
+	}
+
+	// A cut anywhere in the file
+	for (size_t cut = 0; cut < length; ++cut) {
+		damage = good;
+		damaged_length = cut;
+		each_file(damage_cache_file);
+		check_cached(&options);
+	}
+
+	// A byte changed anywhere in the file
+	char* flipped = malloc(length);
+	for (size_t at = 0; at < length; ++at) {
+		memcpy(flipped, good, length);
+		flipped[at] ^= 0x5a;
+		damage = flipped;
+		damaged_length = length;
+		each_file(damage_cache_file);
+		check_cached(&options);
+	}
+	free(flipped);
+	free(good);
+	each_file(remove_file);
+}
+
+// Inputs with errors aren't cached: every parse misses and runs again to print its errors
+static void test_errors(void) {
+	USEC_ParseOptions options = lenient();
+	options.cacheDir = dir;
+	const char* inputs[] = {
+		"a = 1\nb = undefined\nc = 2\n",
+		"a = [1, 2\n",
+		"a = \"unclosed\n",
+		"a = {b = 1}}\n",
+	};
+	for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); ++i) {
+		write_input(inputs[i]);
+		check_cached(&options);
+		check_cached(&options);
+		CHECK(cache_files() == 0);
+	}
+
+	// Errors past maxErrors too
+	char input[4096] = "";
+	for (int i = 0; i < 30; ++i) snprintf(input + strlen(input), sizeof(input) - strlen(input), "k%d = missing\n", i);
+	write_input(input);
+	options.maxErrors = 5;
+	check_cached(&options);
+	CHECK(cache_files() == 0);
+	each_file(remove_file);
+}
+
+int main(void) {
+	make_dir();
+	snprintf(input_file, sizeof(input_file), "%s/input.usec", dir);
+	test_hit();
+	test_misses();
+	test_damaged();
+	test_errors();
+	remove_dir();
+	return check_result();
+}
@@ -0,0 +1,50 @@
+#ifndef USEC_TEST_CHECK_H
+#define USEC_TEST_CHECK_H
+
+#include <usec/usec.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Minimal checks for the behavior tests: failures are printed and counted, main returns check_result()
+
+static int check_failures = 0;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		++check_failures; \
+	} \
+} while (0)
+
+// Trees are the same if they're equal and print the same
+#define CHECK_SAME_TREE(a, b) CHECK(check_same_tree((a), (b)))
+
+static inline int check_same_tree(const USEC_Value* a, const USEC_Value* b) {
+	if (!a || !b) return a == b;
+	char* sa = usec_to_string(a, NULL);
+	char* sb = usec_to_string(b, NULL);
+	int same = usec_equals(a, b) && usec_equals(b, a) && strcmp(sa, sb) == 0;
+	if (!same) fprintf(stderr, "expected:\n%s\ngot:\n%s\n", sa, sb);
+	free(sa);
+	free(sb);
+	return same;
+}
+
+// Results are the same if their values and errors are
+static inline int check_same_result(const USEC_ParseResult* a, const USEC_ParseResult* b) {
+	if (!check_same_tree(a->value, b->value) || a->error_count != b->error_count || a->truncated != b->truncated) return 0;
+	for (size_t i = 0; i < a->error_count; ++i) {
+		const USEC_Error* x = &a->errors[i];
+		const USEC_Error* y = &b->errors[i];
+		if (x->code != y->code || x->line != y->line || x->col != y->col || strcmp(x->message, y->message) != 0) return 0;
+	}
+	return 1;
+}
+
+static inline int check_result(void) {
+	if (check_failures) fprintf(stderr, "%d checks failed\n", check_failures);
+	return check_failures ? 1 : 0;
+}
+
+#endif
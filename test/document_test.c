@@ -0,0 +1,202 @@
+#include "check.h"
+
+// Cursors of a document walk and read the same tree usec_parse builds
+
+static const char* documents[] = {
+	"a = 1\nb = \"text\"\nc = 'c'\nd = -2.5\ne = true\nf = null\n",
+	":version = \"2.1\"\n"
+	"array = [1, 2, \"3\", {\n"
+	"    object = {\n"
+	"        id = 12\n"
+	"        version = version\n"
+	"        path = \"/root/$(version)/project\"\n"
+	"    }, object2 = {id = 24, version = version}\n"
+	"}]\n"
+	"object = {\n"
+	"    :version = \"$(version).3\"\n"
+	"    id = 42\n"
+	"    version = version\n"
+	"}\n"
+	"after = version\n",
+	"nested = [[1, [2, [3, []]]], {}, [{a = {b = {c = [true, false]}}}]]\n"
+	"\"quoted key\" = {\"x.y\" = 1}\n",
+	"dup = 1\nother = 2\ndup = 3\n",
+	"![1, {a = 2}, \"three\"]\n",
+	"!42\n",
+	"%a=1\nb={c=[1,2]}",
+	"",
+};
+#define DOCUMENT_COUNT (sizeof(documents) / sizeof(documents[0]))
+
+static void check_walk(const USEC_Cursor* cursor, const USEC_Value* value) {
+	while (value && value->type == VALUE_FORMAT) value = value->formatNode->node;
+	CHECK(usec_cursor_type(cursor) == usec_value_type(value));
+	CHECK(usec_cursor_count(cursor) == usec_value_count(value));
+
+	// The value read at the cursor is the same, and read only once
+	USEC_Value* read = usec_cursor_value(cursor);
+	CHECK_SAME_TREE(value, read);
+	CHECK(usec_cursor_value(cursor) == read);
+
+	USEC_Cursor child;
+	size_t count = usec_value_count(value);
+	if (usec_value_type(value) == VALUE_OBJECT) {
+		for (size_t i = 0; i < count; ++i) {
+			const USEC_Value* member;
+			const char* key = usec_value_entry(value, i, &member);
+			CHECK(usec_cursor_at(cursor, i, &child));
+			CHECK(strcmp(usec_cursor_key(&child), key) == 0);
+			check_walk(&child, member);
+
+			CHECK(usec_cursor_get(cursor, key, &child));
+			CHECK(strcmp(usec_cursor_key(&child), key) == 0);
+			CHECK_SAME_TREE(member, usec_cursor_value(&child));
+		}
+		CHECK(!usec_cursor_get(cursor, "missing key", &child));
+	} else if (usec_value_type(value) == VALUE_ARRAY) {
+		USEC_Value scratch;
+		for (size_t i = 0; i < count; ++i) {
+			CHECK(usec_cursor_at(cursor, i, &child));
+			CHECK(usec_cursor_key(&child) == NULL);
+			check_walk(&child, usec_value_at(value, i, &scratch));
+		}
+		CHECK(!usec_cursor_get(cursor, "0", &child));
+	} else {
+		CHECK(!usec_cursor_get(cursor, "a", &child));
+	}
+	CHECK(!usec_cursor_at(cursor, count, &child));
+}
+
+static void test_documents(void) {
+	for (size_t i = 0; i < DOCUMENT_COUNT; ++i) {
+		const char* input = documents[i];
+		USEC_ParseResult result = usec_parse_result(input, strlen(input), NULL);
+		CHECK(result.error_count == 0);
+
+		USEC_Document* doc = usec_document_parse(input, strlen(input), NULL);
+		CHECK(doc != NULL);
+		USEC_Cursor root;
+		CHECK(usec_document_root(doc, &root));
+		CHECK(usec_cursor_key(&root) == NULL);
+		check_walk(&root, result.value);
+
+		size_t count;
+		usec_document_errors(doc, &count);
+		CHECK(count == 0);
+		usec_document_free(doc);
+		usec_free_result(&result);
+	}
+}
+
+// Lookups straight from the root, before anything else is read
+static void test_lookups(void) {
+	const char* input = documents[1];
+	USEC_Value* tree = usec_parse(input, NULL);
+	USEC_Document* doc = usec_document_parse(input, strlen(input), NULL);
+	USEC_Cursor root, object, item;
+	CHECK(usec_document_root(doc, &root));
+
+	CHECK(usec_cursor_get(&root, "after", &object));
+	CHECK_SAME_TREE(usec_value_get(tree, "after"), usec_cursor_value(&object));
+
+	CHECK(usec_cursor_get(&root, "array", &object));
+	CHECK(usec_cursor_at(&object, 3, &item));
+	CHECK(usec_cursor_get(&item, "object", &item));
+	CHECK(usec_cursor_get(&item, "path", &item));
+	USEC_Value scratch;
+	const USEC_Value* expected = usec_value_get(usec_value_get(usec_value_at(usec_value_get(tree, "array"), 3, &scratch), "object"), "path");
+	CHECK_SAME_TREE(expected, usec_cursor_value(&item));
+
+	CHECK(usec_cursor_get(&root, "object", &object));
+	CHECK(usec_cursor_get(&object, "version", &item));
+	CHECK_SAME_TREE(usec_value_get(usec_value_get(tree, "object"), "version"), usec_cursor_value(&item));
+
+	usec_document_free(doc);
+	usec_free(tree);
+}
+
+// Errors inside a value are found when it's read, like usec_parse_result finds them
+static void test_errors(void) {
+	const char* input = "good = 1\nbad = {a = undefined_name}\nlater = 2\n";
+	USEC_ParseOptions options = usec_get_default_parse_options();
+	options.pedantic = false;
+	USEC_ParseResult result = usec_parse_result(input, strlen(input), &options);
+	CHECK(result.error_count > 0);
+
+	USEC_Document* doc = usec_document_parse(input, strlen(input), &options);
+	USEC_Cursor root, cursor;
+	CHECK(usec_document_root(doc, &root));
+	CHECK(usec_cursor_get(&root, "later", &cursor));
+	CHECK_SAME_TREE(usec_value_get(result.value, "later"), usec_cursor_value(&cursor));
+
+	CHECK(usec_cursor_get(&root, "bad", &cursor));
+	usec_cursor_value(&cursor);
+	size_t count;
+	const USEC_Error* errors = usec_document_errors(doc, &count);
+	CHECK(count > 0);
+	if (count > 0) {
+		CHECK(errors[0].code == USEC_ERROR_UNDEFINED_VARIABLE);
+		CHECK(errors[0].code == result.errors[0].code && errors[0].line == result.errors[0].line && errors[0].col == result.errors[0].col);
+	}
+	usec_document_free(doc);
+	usec_free_result(&result);
+}
+
+// The caller's variables are read, not written
+static void test_variables(void) {
+	USEC_Value* preset = usec_parse("name = \"preset\"\n", NULL);
+	Usec_Hashtable* variables = usec_ht_from(preset->objectValue);
+	USEC_ParseOptions options = usec_get_default_parse_options();
+	options.variables = variables;
+	const char* input = ":local = \"l\"\na = name\nb = \"$(name)-$(local)\"\n";
+
+	USEC_Document* doc = usec_document_parse(input, strlen(input), &options);
+	USEC_Cursor root;
+	CHECK(usec_document_root(doc, &root));
+	USEC_Value* expected = usec_parse("a = \"preset\"\nb = \"preset-l\"\n", NULL);
+	CHECK_SAME_TREE(expected, usec_cursor_value(&root));
+	CHECK(variables->size == 1);
+
+	usec_free(expected);
+	usec_document_free(doc);
+	usec_ht_free(variables);
+	usec_free(preset);
+}
+
+// Mapped files read like strings
+static void test_open(void) {
+	const char* path = "document_test.usec";
+	FILE* file = fopen(path, "wb");
+	CHECK(file != NULL);
+	if (!file) return;
+	fputs(documents[1], file);
+	fclose(file);
+
+	USEC_Value* tree = usec_parse(documents[1], NULL);
+	USEC_Document* doc = usec_document_open(path, NULL);
+	USEC_Cursor root;
+	CHECK(doc && usec_document_root(doc, &root));
+	if (doc) {
+		check_walk(&root, tree);
+		usec_document_free(doc);
+	}
+	usec_free(tree);
+	remove(path);
+
+	doc = usec_document_open("missing_document_test.usec", NULL);
+	if (doc) {
+		size_t count;
+		usec_document_errors(doc, &count);
+		CHECK(count == 1 && usec_document_errors(doc, &count)[0].code == USEC_ERROR_IO);
+		usec_document_free(doc);
+	}
+}
+
+int main(void) {
+	test_documents();
+	test_lookups();
+	test_errors();
+	test_variables();
+	test_open();
+	return check_result();
+}
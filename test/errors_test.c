@@ -0,0 +1,169 @@
+#include "check.h"
+
+// Errors collected by usec_parse_result: their codes, positions and messages, recovery, and maxErrors
+
+typedef struct {
+	USEC_ErrorCode code;
+	int line;
+	int col;
+	const char* message;
+} Expected;
+
+typedef struct {
+	const char* input;
+	bool value; // a lenient parse recovers a value
+	Expected errors[8];
+	size_t error_count;
+} Case;
+
+static const Case cases[] = {
+	{ "a = 1\nb = 2\n", true, { { 0 } }, 0 },
+	{ "a = 1\nb = missing\nc = 2", true, {
+		{ USEC_ERROR_UNDEFINED_VARIABLE, 2, 12, "Undefined variable" },
+		{ USEC_ERROR_UNEXPECTED_TOKEN, 2, 12, "Unexpected token" } }, 2 },
+	{ "a = 1e999\nb = 00\nc = 3", true, {
+		{ USEC_ERROR_INVALID_NUMBER, 1, 10, "Invalid floating-point number" },
+		{ USEC_ERROR_UNEXPECTED_TOKEN, 2, 7, "Unexpected token" } }, 2 },
+	{ "a = \"$(nope)\"\nb = \"x\"", true, {
+		{ USEC_ERROR_UNDEFINED_VARIABLE, 1, 12, "Undefined variable" } }, 1 },
+	{ "a = {b = x, c = [y, 1]}\nd = z", true, {
+		{ USEC_ERROR_UNDEFINED_VARIABLE, 1, 11, "Undefined variable" },
+		{ USEC_ERROR_UNEXPECTED_TOKEN, 1, 11, "Unexpected token" },
+		{ USEC_ERROR_UNEXPECTED_TOKEN, 1, 11, "Unexpected token" },
+		{ USEC_ERROR_UNDEFINED_VARIABLE, 1, 19, "Undefined variable" },
+		{ USEC_ERROR_UNEXPECTED_TOKEN, 1, 19, "Unexpected token" },
+		{ USEC_ERROR_UNEXPECTED_TOKEN, 1, 19, "Unexpected token in value" },
+		{ USEC_ERROR_UNDEFINED_VARIABLE, 2, 6, "Undefined variable" },
+		{ USEC_ERROR_UNEXPECTED_TOKEN, 2, 6, "Unexpected token" } }, 8 },
+	{ "a = 1 b = 2", true, { { USEC_ERROR_UNEXPECTED_TOKEN, 1, 6, "Unexpected token" } }, 1 },
+
+	// Tokenizer errors fail the whole parse
+	{ "a = [1, 2\nb = 3", false, { { USEC_ERROR_UNBALANCED, 1, 5, "Unclosed opener" } }, 1 },
+	{ "a = 1}", false, { { USEC_ERROR_UNBALANCED, 1, 6, "Unopened closer '}'" } }, 1 },
+	{ "a = @", false, { { USEC_ERROR_SYNTAX, 1, 5, "Unexpected character '@'" } }, 1 },
+	{ "a = 'ab'", false, {
+		{ USEC_ERROR_SYNTAX, 1, 7, "Expected closing single quote" },
+		{ USEC_ERROR_SYNTAX, 1, 10, "Expected closing single quote" } }, 2 },
+};
+#define CASE_COUNT (sizeof(cases) / sizeof(cases[0]))
+
+static void check_errors(const USEC_ParseResult* result, const Expected* expected, size_t count) {
+	CHECK(result->error_count == count);
+	for (size_t i = 0; i < count && i < result->error_count; ++i) {
+		const USEC_Error* error = &result->errors[i];
+		bool same = error->code == expected[i].code && error->line == expected[i].line && error->col == expected[i].col &&
+			strcmp(error->message, expected[i].message) == 0;
+		if (!same) {
+			fprintf(stderr, "error %zu: expected %d %d:%d %s, got %d %d:%d %s\n", i, expected[i].code, expected[i].line,
+				expected[i].col, expected[i].message, error->code, error->line, error->col, error->message);
+		}
+		CHECK(same);
+	}
+}
+
+// Lenient parses recover a value and report every error, pedantic ones fail at the first
+static void test_contents(void) {
+	for (size_t i = 0; i < CASE_COUNT; ++i) {
+		const Case* c = &cases[i];
+		USEC_ParseOptions options = usec_get_default_parse_options();
+		options.pedantic = false;
+		USEC_ParseResult result = usec_parse_result(c->input, strlen(c->input), &options);
+		CHECK((result.value != NULL) == c->value);
+		CHECK(!result.truncated);
+		check_errors(&result, c->errors, c->error_count);
+
+		// The same errors from a reused context
+		USEC_Context* ctx = usec_context_create();
+		USEC_ParseResult reused = usec_context_parse_result(ctx, c->input, strlen(c->input), &options);
+		CHECK(check_same_result(&result, &reused));
+		usec_free_result(&reused);
+		usec_context_destroy(ctx);
+		usec_free_result(&result);
+
+		// Pedantic parses don't exit, they give no value and the first error
+		options.pedantic = true;
+		result = usec_parse_result(c->input, strlen(c->input), &options);
+		CHECK((result.value != NULL) == (c->error_count == 0));
+		if (c->value) check_errors(&result, c->errors, c->error_count ? 1 : 0);
+		usec_free_result(&result);
+	}
+}
+
+// n statements that each give one parser error
+static char* make_failing(int n) {
+	size_t capacity = (size_t)n * 32 + 1;
+	char* input = malloc(capacity);
+	size_t length = 0;
+	input[0] = '\0';
+	for (int i = 0; i < n; ++i) length += (size_t)snprintf(input + length, capacity - length, "k%d = \"$(m%d)\"\n", i, i);
+	return input;
+}
+
+// Parsing stops past maxErrors, keeping the first errors and no value. 0 collects them all.
+static void test_truncation(void) {
+	USEC_ParseOptions options = usec_get_default_parse_options();
+	options.pedantic = false;
+	CHECK(options.maxErrors == 20);
+
+	size_t limits[] = { 1, 5, 20 };
+	for (size_t l = 0; l < sizeof(limits) / sizeof(limits[0]); ++l) {
+		for (int n = 0; n <= 30; ++n) {
+			char* input = make_failing(n);
+			options.maxErrors = 0;
+			USEC_ParseResult all = usec_parse_result(input, strlen(input), &options);
+			CHECK(all.error_count == (size_t)n && !all.truncated && all.value != NULL);
+
+			options.maxErrors = limits[l];
+			USEC_ParseResult result = usec_parse_result(input, strlen(input), &options);
+			bool over = (size_t)n > limits[l];
+			CHECK(result.truncated == over);
+			CHECK(result.error_count == (over ? limits[l] : (size_t)n));
+			CHECK((result.value != NULL) == !over);
+			for (size_t i = 0; i < result.error_count && i < all.error_count; ++i) {
+				CHECK(result.errors[i].code == USEC_ERROR_UNDEFINED_VARIABLE);
+				CHECK(result.errors[i].line == (int)i + 1);
+				CHECK(result.errors[i].line == all.errors[i].line && result.errors[i].col == all.errors[i].col);
+			}
+			if (!over) CHECK(check_same_result(&all, &result));
+			usec_free_result(&result);
+			usec_free_result(&all);
+			free(input);
+		}
+	}
+
+	// Tokenizer errors are limited too
+	char input[1024] = "";
+	for (int i = 0; i < 30; ++i) snprintf(input + strlen(input), sizeof(input) - strlen(input), "k%d = 'ab'\n", i);
+	options.maxErrors = 7;
+	USEC_ParseResult result = usec_parse_result(input, strlen(input), &options);
+	CHECK(result.truncated && result.error_count == 7 && result.value == NULL);
+	for (size_t i = 0; i < result.error_count; ++i) CHECK(result.errors[i].code == USEC_ERROR_SYNTAX);
+	usec_free_result(&result);
+}
+
+// Files that can't be read are an error without a position
+static void test_io(void) {
+	USEC_ParseResult result = usec_parse_file_result("errors_test_missing.usec", NULL);
+	CHECK(result.value == NULL && result.error_count == 1 && !result.truncated);
+	if (result.error_count == 1) {
+		CHECK(result.errors[0].code == USEC_ERROR_IO);
+		CHECK(result.errors[0].line == 0 && result.errors[0].col == 0);
+		CHECK(strstr(result.errors[0].message, "errors_test_missing.usec") != NULL);
+	}
+	usec_free_result(&result);
+
+	// Taking the value before freeing the result keeps it
+	result = usec_parse_result("a = 1", 5, NULL);
+	USEC_Value* value = result.value;
+	result.value = NULL;
+	usec_free_result(&result);
+	CHECK(value && usec_value_count(value) == 1);
+	usec_free(value);
+}
+
+int main(void) {
+	test_contents();
+	test_truncation();
+	test_io();
+	return check_result();
+}
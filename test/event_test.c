@@ -0,0 +1,315 @@
+#include "check.h"
+#include <stdarg.h>
+
+// Event parsing: the recorded sequence of events, and the same tree and errors usec_parse_result gives
+
+static USEC_ParseOptions lenient(void) {
+	USEC_ParseOptions options = usec_get_default_parse_options();
+	options.pedantic = false;
+	return options;
+}
+
+// Events recorded as text: { } [ ] for containers, key= and :name=, scalars by type
+typedef struct {
+	char log[4096];
+	size_t length;
+	size_t count;
+	size_t stop_after; // 0 to never stop
+	bool lines; // prefix events with their line
+} Recorder;
+
+static void record(Recorder* r, const char* format, ...) {
+	va_list args;
+	va_start(args, format);
+	int written = vsnprintf(r->log + r->length, sizeof(r->log) - r->length, format, args);
+	va_end(args);
+	if (written > 0) r->length += (size_t)written;
+	if (r->length >= sizeof(r->log)) r->length = sizeof(r->log) - 1;
+}
+
+static bool on_event(void* user, const USEC_Event* event) {
+	Recorder* r = user;
+	if (r->length) record(r, " ");
+	if (r->lines) record(r, "%d:", event->line);
+	switch (event->type) {
+	case USEC_EVENT_OBJECT_BEGIN: record(r, "{"); break;
+	case USEC_EVENT_OBJECT_END: record(r, "}"); break;
+	case USEC_EVENT_ARRAY_BEGIN: record(r, "["); break;
+	case USEC_EVENT_ARRAY_END: record(r, "]"); break;
+	case USEC_EVENT_KEY: record(r, "%s=", event->text); break;
+	case USEC_EVENT_DECLARATION: record(r, ":%s=", event->text); break;
+	case USEC_EVENT_SCALAR:
+		switch (event->value.type) {
+		case VALUE_STRING: record(r, "\"%s\"", event->text); break;
+		case VALUE_INT: record(r, "%lld", (long long)event->value.int64Value); break;
+		case VALUE_UINT: record(r, "%llu", (unsigned long long)event->value.uint64Value); break;
+		case VALUE_DOUBLE: record(r, "%g", event->value.doubleValue); break;
+		case VALUE_BOOL: record(r, event->value.boolValue ? "true" : "false"); break;
+		case VALUE_CHAR: record(r, "'%c'", event->value.charValue); break;
+		case VALUE_NULL: record(r, "null"); break;
+		default: record(r, "?"); break;
+		}
+		break;
+	}
+	++r->count;
+	return !r->stop_after || r->count < r->stop_after;
+}
+
+static Recorder events_of(const char* input, const USEC_ParseOptions* options, USEC_ParseResult* result) {
+	Recorder r;
+	memset(&r, 0, sizeof(r));
+	*result = usec_parse_events(input, strlen(input), options, on_event, &r);
+	CHECK(result->value == NULL);
+	return r;
+}
+
+static void check_events_with(const char* input, const USEC_ParseOptions* options, const char* expected, size_t error_count) {
+	USEC_ParseResult result;
+	Recorder r = events_of(input, options, &result);
+	if (strcmp(r.log, expected) != 0) fprintf(stderr, "input:\n%s\nexpected: %s\ngot:      %s\n", input, expected, r.log);
+	CHECK(strcmp(r.log, expected) == 0);
+	CHECK(result.error_count == error_count);
+	usec_free_result(&result);
+}
+
+static void check_events(const char* input, const char* expected, size_t error_count) {
+	USEC_ParseOptions options = lenient();
+	check_events_with(input, &options, expected, error_count);
+}
+
+static void test_sequences(void) {
+	check_events("a = 1\nb = {c = [1, -2, 2.5, \"s\"], d = {}}\ne = []\n",
+		"{ a= 1 b= { c= [ 1 -2 2.5 \"s\" ] d= { } } e= [ ] }", 0);
+	check_events("nested = [[1, [2, []]], {x = {y = [true]}}]\n",
+		"{ nested= [ [ 1 [ 2 [ ] ] ] { x= { y= [ true ] } } ] }", 0);
+	check_events("a = null\nb = false\nc = 'z'\n", "{ a= null b= false c= 'z' }", 0);
+	check_events("![1, {a = true}]\n", "[ 1 { a= true } ]", 0);
+	check_events("!42\n", "42", 0);
+	check_events("", "{ }", 0);
+
+	// Declarations come with their value, references and interpolation with the declared text
+	check_events(":v = \"x\"\na = v\nb = \"$(v)!\"\nc = {:w = 7, d = \"$(w)$(v)\"}\n",
+		"{ :v= \"x\" a= \"x\" b= \"x!\" c= { :w= 7 d= \"7x\" } }", 0);
+	check_events(":o = {a = [1, 2]}\nb = 1\n", "{ :o= { a= [ 1 2 ] } b= 1 }", 0);
+
+	// A value that fails is dropped with its key, the parse goes on
+	check_events("a = 1\nb = undefined\nc = 2\n", "{ a= 1 c= 2 }", 2);
+	check_events("c = {:w = [1, 2], d = w}\n", "{ c= { :w= [ 1 2 ] } }", 1);
+
+	// An unbalanced document aborts before any event
+	check_events("a = [1, 2\nb = 3\n", "", 1);
+
+	// Kept references are the text usec_parse keeps in the tree
+	USEC_ParseOptions options = lenient();
+	options.keepVariables = true;
+	const char* input = ":v = \"x\"\na = v\nb = \"$(v)!\"\n";
+	check_events_with(input, &options, "{ :v= \"x\" a= \"$($v)\" b= \"$(v)!\" }", 0);
+	USEC_Value* tree = usec_parse(input, &options);
+	const USEC_Value* member;
+	CHECK(strcmp(usec_value_entry(tree, 1, &member), "a") == 0 && strcmp(usec_value_string(member, NULL), "$($v)") == 0);
+	CHECK(strcmp(usec_value_entry(tree, 2, &member), "b") == 0 && strcmp(usec_value_string(member, NULL), "$(v)!") == 0);
+	usec_free(tree);
+}
+
+// Events carry the line of the token they start at
+static void test_lines(void) {
+	const char* input =
+		"a = 1\n"
+		"b = {\n"
+		"    c = [\n"
+		"        2\n"
+		"    ]\n"
+		"}\n"
+		":v = 3\n";
+	USEC_ParseOptions options = lenient();
+	Recorder r;
+	memset(&r, 0, sizeof(r));
+	r.lines = true;
+	USEC_ParseResult result = usec_parse_events(input, strlen(input), &options, on_event, &r);
+	CHECK(result.error_count == 0);
+	const char* expected = "1:{ 1:a= 1:1 2:b= 2:{ 3:c= 3:[ 4:2 5:] 6:} 7::v= 7:3 8:}";
+	if (strcmp(r.log, expected) != 0) fprintf(stderr, "expected: %s\ngot:      %s\n", expected, r.log);
+	CHECK(strcmp(r.log, expected) == 0);
+	usec_free_result(&result);
+}
+
+// Rebuilds the document the events describe as USEC text, leaving out declarations
+typedef struct {
+	char text[8192];
+	size_t length;
+	bool separate; // a comma goes before the next member or item
+	int skip; // depth of the declared value being skipped, -1 for none
+	bool declared; // the next value is declared
+	size_t events;
+} Builder;
+
+static void append(Builder* b, const char* text) {
+	size_t length = strlen(text);
+	if (b->length + length < sizeof(b->text)) {
+		memcpy(b->text + b->length, text, length + 1);
+		b->length += length;
+	}
+}
+
+// Appends a value as text, without the ! of a root value
+static void append_value(Builder* b, const USEC_Value* value) {
+	char* text = usec_to_string(value, NULL);
+	append(b, text[0] == '!' ? text + 1 : text);
+	free(text);
+}
+
+static bool on_build(void* user, const USEC_Event* event) {
+	Builder* b = user;
+	++b->events;
+	if (b->declared) {
+		// The declared value is a scalar or a container, skipped to its end
+		b->declared = false;
+		if (event->type == USEC_EVENT_SCALAR) return true;
+		b->skip = 1;
+		return true;
+	}
+	if (b->skip > 0) {
+		if (event->type == USEC_EVENT_OBJECT_BEGIN || event->type == USEC_EVENT_ARRAY_BEGIN) ++b->skip;
+		if (event->type == USEC_EVENT_OBJECT_END || event->type == USEC_EVENT_ARRAY_END) --b->skip;
+		return true;
+	}
+	USEC_Value key;
+	switch (event->type) {
+	case USEC_EVENT_OBJECT_BEGIN:
+	case USEC_EVENT_ARRAY_BEGIN:
+		if (b->separate) append(b, ", ");
+		append(b, event->type == USEC_EVENT_OBJECT_BEGIN ? "{" : "[");
+		b->separate = false;
+		break;
+	case USEC_EVENT_OBJECT_END: append(b, "}"); b->separate = true; break;
+	case USEC_EVENT_ARRAY_END: append(b, "]"); b->separate = true; break;
+	case USEC_EVENT_DECLARATION: b->declared = true; break;
+	case USEC_EVENT_KEY:
+		if (b->separate) append(b, ", ");
+		memset(&key, 0, sizeof(key));
+		key.type = VALUE_STRING;
+		key.stringValue = (char*)event->text;
+		append_value(b, &key);
+		append(b, " = ");
+		b->separate = false;
+		break;
+	case USEC_EVENT_SCALAR:
+		if (b->separate) append(b, ", ");
+		append_value(b, &event->value);
+		b->separate = true;
+		break;
+	}
+	return true;
+}
+
+// Events rebuild the tree usec_parse_result builds, with the same errors. Each parse gets its own copy of
+// the preset variables, usec_parse_result adds the declarations to them.
+static void check_rebuild(const char* input, USEC_ParseOptions options, const USEC_Value* preset) {
+	Builder b;
+	memset(&b, 0, sizeof(b));
+	append(&b, "!");
+	options.variables = preset ? usec_ht_from(preset->objectValue) : NULL;
+	USEC_ParseResult events = usec_parse_events(input, strlen(input), &options, on_build, &b);
+	if (options.variables) usec_ht_free(options.variables);
+	options.variables = preset ? usec_ht_from(preset->objectValue) : NULL;
+	USEC_ParseResult tree = usec_parse_result(input, strlen(input), &options);
+	if (options.variables) usec_ht_free(options.variables);
+	CHECK(b.skip == 0 && !b.declared);
+	if (b.events) {
+		USEC_ParseOptions plain = lenient();
+		events.value = usec_parse(b.text, &plain);
+	}
+	if (!check_same_result(&tree, &events)) fprintf(stderr, "input:\n%s\nrebuilt: %s\n", input, b.text);
+	CHECK(check_same_result(&tree, &events));
+	usec_free_result(&events);
+	usec_free_result(&tree);
+}
+
+static const char* documents[] = {
+	"a = 1\nb = \"text with \\\"quotes\\\"\"\nc = 'c'\nd = -2.5\ne = true\nf = null\ng = 18446744073709551615\n",
+	":version = \"2.1\"\n"
+	"array = [1, 2, \"3\", {\n"
+	"    object = {\n"
+	"        id = 12\n"
+	"        version = version\n"
+	"        path = \"/root/$(version)/project\"\n"
+	"    }, object2 = {id = 24, version = version}\n"
+	"}]\n"
+	"object = {\n"
+	"    :version = \"$(version).3\"\n"
+	"    id = 42\n"
+	"    version = version\n"
+	"}\n"
+	"after = version\n",
+	"nested = [[1, [2, [3, []]]], {}, [{a = {b = {c = [true, false]}}}]]\n"
+	"\"quoted key\" = {\"x.y\" = 1}\n",
+	":skipped = {a = [1, {b = 2}], c = {}}\nkept = 1\n",
+	"dup = 1\nother = 2\ndup = 3\n",
+	"![1, {a = 2}, \"three\"]\n",
+	"!\"root\"\n",
+	"%a=1\nb={c=[1,2]}",
+	"a = 1\nb = undefined\nc = {d = missing, e = 2}\nf = 3\n",
+	"c = {:w = [1, 2], d = w, e = 1}\n",
+	"",
+};
+#define DOCUMENT_COUNT (sizeof(documents) / sizeof(documents[0]))
+
+static void test_rebuild(void) {
+	USEC_ParseOptions options = lenient();
+	for (size_t i = 0; i < DOCUMENT_COUNT; ++i) check_rebuild(documents[i], options, NULL);
+
+	// Caller's variables are read like declared ones, and kept references stay text
+	USEC_Value* preset = usec_parse("version = \"9\"\n", &options);
+	check_rebuild("a = version\nb = \"v$(version)\"\n", options, preset);
+	check_rebuild(documents[1], options, preset);
+	usec_free(preset);
+}
+
+// A callback returning false stops the parse after its event, without an error
+static void test_stop(void) {
+	const char* input = "a = 1\nb = {c = [1, 2], d = 3}\ne = 4\n";
+	USEC_ParseOptions options = lenient();
+	USEC_ParseResult result;
+	Recorder all = events_of(input, &options, &result);
+	usec_free_result(&result);
+	CHECK(all.count == 16);
+	for (size_t stop = 1; stop <= all.count; ++stop) {
+		Recorder r;
+		memset(&r, 0, sizeof(r));
+		r.stop_after = stop;
+		result = usec_parse_events(input, strlen(input), &options, on_event, &r);
+		CHECK(r.count == stop);
+		CHECK(strncmp(r.log, all.log, r.length) == 0);
+		CHECK(result.error_count == 0);
+		usec_free_result(&result);
+	}
+}
+
+// Parses reusing a context send the same events as fresh ones
+static void test_context(void) {
+	USEC_ParseOptions options = lenient();
+	USEC_Context* ctx = usec_context_create();
+	for (int round = 0; round < 2; ++round) {
+		for (size_t i = 0; i < DOCUMENT_COUNT; ++i) {
+			USEC_ParseResult fresh, reused;
+			Recorder expected = events_of(documents[i], &options, &fresh);
+			Recorder r;
+			memset(&r, 0, sizeof(r));
+			reused = usec_context_parse_events(ctx, documents[i], strlen(documents[i]), &options, on_event, &r);
+			CHECK(strcmp(r.log, expected.log) == 0);
+			CHECK(check_same_result(&fresh, &reused));
+			usec_free_result(&fresh);
+			usec_free_result(&reused);
+		}
+	}
+	usec_context_destroy(ctx);
+}
+
+int main(void) {
+	test_sequences();
+	test_lines();
+	test_rebuild();
+	test_stop();
+	test_context();
+	return check_result();
+}
@@ -0,0 +1,166 @@
+#include "check.h"
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+
+// Doubles written by usec_to_string parse back to the same bits, with as few digits as that takes
+
+static USEC_Value* root; // a root double, written with every value
+
+static uint64_t bits_of(double value) {
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+static double from_bits(uint64_t bits) {
+	double value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+// Neighbours and powers of two from the bits, so the test needs no libm
+static double next_up(double value) {
+	return value < 0.0 ? from_bits(bits_of(value) - 1) : from_bits(bits_of(value) + 1);
+}
+
+static double next_down(double value) {
+	return value > 0.0 ? from_bits(bits_of(value) - 1) : from_bits(bits_of(value) + 1);
+}
+
+static double power_of_two(int e) {
+	return e < -1022 ? from_bits(1ull << (e + 1074)) : from_bits((uint64_t)(e + 1023) << 52);
+}
+
+// Significant digits of a written number, without leading and trailing zeros
+static int significant_digits(const char* text) {
+	char digits[64];
+	int count = 0;
+	for (const char* c = text; *c && *c != 'e'; ++c) {
+		if (*c >= '0' && *c <= '9' && count < 63) digits[count++] = *c;
+	}
+	int start = 0;
+	while (start < count && digits[start] == '0') ++start;
+	while (count > start && digits[count - 1] == '0') --count;
+	return count > start ? count - start : 1;
+}
+
+// Fewest digits that read back as value. The shortest number isn't always the nearest one with as many
+// digits, so the neighbours of the nearest one in the last digit are tried too.
+static int shortest_digits(double value) {
+	char text[64];
+	for (int precision = 1; precision < 17; ++precision) {
+		snprintf(text, sizeof(text), "%.*e", precision - 1, value < 0.0 ? -value : value);
+		uint64_t mantissa = 0;
+		for (const char* c = text; *c != 'e'; ++c) {
+			if (*c != '.') mantissa = mantissa * 10 + (uint64_t)(*c - '0');
+		}
+		int exponent = atoi(strchr(text, 'e') + 1) - (precision - 1);
+		for (int delta = -1; delta <= 1; ++delta) {
+			char candidate[64];
+			snprintf(candidate, sizeof(candidate), "%llue%d", (unsigned long long)(mantissa + (uint64_t)(int64_t)delta), exponent);
+			double back = strtod(candidate, NULL);
+			if (back == value || back == -value) return significant_digits(candidate);
+		}
+	}
+	return 17;
+}
+
+static char* write_double(double value) {
+	root->doubleValue = value;
+	return usec_to_string(root, NULL);
+}
+
+static void check_round_trip(double value, bool shortest) {
+	char* text = write_double(value);
+	USEC_Value* back = usec_parse(text, NULL);
+	bool same = back && back->type == VALUE_DOUBLE && bits_of(back->doubleValue) == bits_of(value);
+	if (!same) fprintf(stderr, "%.17g written as %s doesn't read back\n", value, text);
+	CHECK(same);
+	if (shortest && value != 0.0) {
+		int digits = significant_digits(text + 1);
+		if (digits != shortest_digits(value)) fprintf(stderr, "%.17g written as %s isn't the shortest\n", value, text);
+		CHECK(digits == shortest_digits(value));
+	}
+	usec_free(back);
+	free(text);
+}
+
+static void check_written(double value, const char* expected) {
+	char* text = write_double(value);
+	if (strcmp(text + 1, expected) != 0) fprintf(stderr, "%.17g written as %s, expected %s\n", value, text, expected);
+	CHECK(strcmp(text + 1, expected) == 0);
+	free(text);
+}
+
+static void test_known(void) {
+	check_written(0.0, "0.0");
+	check_written(-0.0, "-0.0");
+	check_written(1.0, "1.0");
+	check_written(100.0, "100.0");
+	check_written(0.1, "0.1");
+	check_written(0.000001, "0.000001");
+	check_written(1e-7, "1e-7");
+	check_written(1e21, "1e21");
+	check_written(1e23, "1e23");
+	check_written(123456789012345678.0, "123456789012345680.0");
+	check_written(5e-324, "5e-324");
+	check_written(DBL_MIN, "2.2250738585072014e-308");
+	check_written(DBL_MAX, "1.7976931348623157e308");
+}
+
+static void test_powers(void) {
+	for (int e = -1074; e <= 1023; ++e) {
+		check_round_trip(power_of_two(e), true);
+		check_round_trip(-power_of_two(e), true);
+	}
+	char text[16];
+	for (int e = -323; e <= 308; ++e) {
+		snprintf(text, sizeof(text), "1e%d", e);
+		double power = strtod(text, NULL);
+		check_round_trip(power, true);
+		check_round_trip(next_down(power), true);
+		check_round_trip(next_up(power), true);
+	}
+}
+
+static void test_edges(void) {
+	const double edges[] = { 0.0, -0.0, DBL_MIN, -DBL_MIN, DBL_MAX, -DBL_MAX, DBL_EPSILON, 1.0 + DBL_EPSILON,
+		next_down(DBL_MIN), next_down(DBL_MAX), from_bits(1), from_bits(0x000FFFFFFFFFFFFFull),
+		9007199254740992.0, 9007199254740993.0, 18446744073709551616.0, 0.3, 2.0 / 3.0 };
+	for (size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); ++i) check_round_trip(edges[i], true);
+
+	// Integral doubles, some of them past the range of uint64. Past 2^53 every double is integral.
+	for (double value = 1.0; value < 1e300; value = value * 3.0 + 1.0) {
+		check_round_trip(value, true);
+		check_round_trip(-value, true);
+	}
+	for (int i = 0; i < 100000; i += 37) check_round_trip((double)i, true);
+}
+
+// Subnormals and any other bits, except infinities and NaN
+static void test_random(void) {
+	uint64_t state = 0x9E3779B97F4A7C15ull;
+	for (int i = 0; i < 100000; ++i) {
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		check_round_trip(from_bits(state & 0x800FFFFFFFFFFFFFull), i % 16 == 0); // subnormal
+		double value = from_bits(state);
+		if (isfinite(value)) check_round_trip(value, i % 16 == 0);
+	}
+}
+
+int main(void) {
+	root = usec_parse("!0.5", NULL);
+	CHECK(root && root->type == VALUE_DOUBLE);
+	if (!root) return check_result();
+
+	test_known();
+	test_powers();
+	test_edges();
+	test_random();
+
+	usec_free(root);
+	return check_result();
+}
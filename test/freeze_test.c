@@ -0,0 +1,156 @@
+#include "check.h"
+
+// A document with small tables, tables just past the linear scan, records of the same shape and one wide table
+static char* make_document(void) {
+	size_t capacity = 1 << 16, length = 0;
+	char* doc = malloc(capacity);
+	length += (size_t)sprintf(doc + length, "small = {id = 1, version = 2, path = \"a\"}\n");
+	length += (size_t)sprintf(doc + length, "nine = {");
+	for (int i = 0; i < 9; ++i) length += (size_t)sprintf(doc + length, "%sn%d = %d", i ? ", " : "", i, i);
+	length += (size_t)sprintf(doc + length, "}\nrecords = [");
+	for (int i = 0; i < 20; ++i) {
+		length += (size_t)sprintf(doc + length, "%s{id = %d, version = %d, path = \"p%d\"", i ? ", " : "", i, i * 2, i);
+		if (i % 2) for (int k = 0; k < 12; ++k) length += (size_t)sprintf(doc + length, ", extra%d = %d", k, k);
+		length += (size_t)sprintf(doc + length, "}");
+	}
+	length += (size_t)sprintf(doc + length, "]\nwide = {");
+	for (int i = 0; i < 2000; ++i) length += (size_t)sprintf(doc + length, "%skey_%d = %d", i ? ", " : "", i, i);
+	sprintf(doc + length, "}\nempty = {}\n");
+	return doc;
+}
+
+// Every key of every object, and some that are missing, must resolve to the same values as before freezing
+typedef struct {
+	Usec_Hashtable* table;
+	const char* key;
+	USEC_Value* value;
+} Lookup;
+
+typedef struct {
+	Lookup* items;
+	size_t count;
+	size_t capacity;
+} Lookups;
+
+static const char* missing[] = { "", "missing", "key_2000", "n9", "ID", "key_" };
+#define MISSING_COUNT (sizeof(missing) / sizeof(missing[0]))
+
+static void add_lookup(Lookups* lookups, Usec_Hashtable* table, const char* key) {
+	if (lookups->count >= lookups->capacity) {
+		lookups->capacity = lookups->capacity ? lookups->capacity * 2 : 256;
+		lookups->items = realloc(lookups->items, sizeof(Lookup) * lookups->capacity);
+	}
+	Lookup* lookup = &lookups->items[lookups->count++];
+	lookup->table = table;
+	lookup->key = key;
+	lookup->value = usec_ht_get(table, key);
+}
+
+static void collect(Lookups* lookups, USEC_Value* value) {
+	if (value->type == VALUE_ARRAY) {
+		for (size_t i = 0; i < value->arrayValue.count; ++i) collect(lookups, value->arrayValue.items[i]);
+	} else if (value->type == VALUE_OBJECT) {
+		Usec_Hashtable* table = value->objectValue;
+		for (size_t i = 0; i < table->size; ++i) {
+			add_lookup(lookups, table, table->entries[i].key);
+			collect(lookups, table->entries[i].value);
+		}
+		for (size_t i = 0; i < MISSING_COUNT; ++i) add_lookup(lookups, table, missing[i]);
+	}
+}
+
+static void check_lookups(const Lookups* lookups) {
+	for (size_t i = 0; i < lookups->count; ++i) {
+		const Lookup* lookup = &lookups->items[i];
+		CHECK(usec_ht_get(lookup->table, lookup->key) == lookup->value);
+	}
+}
+
+static void test_freeze(bool arena) {
+	char* doc = make_document();
+	USEC_ParseOptions options = usec_get_default_parse_options();
+	options.useArena = arena;
+	USEC_Value* root = usec_parse(doc, &options);
+	CHECK(root != NULL);
+	if (!root) {
+		free(doc);
+		return;
+	}
+
+	Lookups lookups = { NULL, 0, 0 };
+	collect(&lookups, root);
+	char* before = usec_to_string(root, NULL);
+	USEC_Value* copy = usec_clone(root);
+
+	usec_freeze(root);
+	check_lookups(&lookups);
+	if (!arena) CHECK(root->objectValue->entries_capacity == root->objectValue->size);
+	CHECK_SAME_TREE(copy, root);
+	char* after = usec_to_string(root, NULL);
+	CHECK(strcmp(before, after) == 0);
+
+	// Freezing twice changes nothing
+	usec_freeze(root);
+	check_lookups(&lookups);
+
+	free(after);
+	free(before);
+	free(lookups.items);
+	usec_free(copy);
+	usec_free(root);
+	free(doc);
+}
+
+// Keys added to frozen tables are found along with the old ones, and the table can be frozen again
+static void test_add_after_freeze(void) {
+	char* doc = make_document();
+	USEC_Value* root = usec_parse(doc, NULL);
+	CHECK(root != NULL);
+	if (!root) {
+		free(doc);
+		return;
+	}
+	usec_freeze(root);
+	const USEC_Value* number = usec_value_get(usec_value_get(root, "small"), "id");
+
+	const char* tables[] = { "small", "nine", "wide", "empty" };
+	for (size_t t = 0; t < sizeof(tables) / sizeof(tables[0]); ++t) {
+		Usec_Hashtable* table = ((USEC_Value*)usec_value_get(root, tables[t]))->objectValue;
+		Lookups lookups = { NULL, 0, 0 };
+		for (size_t i = 0; i < table->size; ++i) add_lookup(&lookups, table, table->entries[i].key);
+		size_t size = table->size;
+
+		char key[32];
+		USEC_Value* added[40];
+		for (int i = 0; i < 40; ++i) {
+			sprintf(key, "added_%d", i);
+			added[i] = usec_clone(number);
+			usec_ht_set(table, key, added[i]);
+		}
+		CHECK(table->size == size + 40);
+		check_lookups(&lookups);
+		for (int i = 0; i < 40; ++i) {
+			sprintf(key, "added_%d", i);
+			CHECK(usec_ht_get(table, key) == added[i]);
+		}
+		CHECK(usec_ht_get(table, "missing") == NULL);
+
+		usec_ht_freeze(table);
+		check_lookups(&lookups);
+		for (int i = 0; i < 40; ++i) {
+			sprintf(key, "added_%d", i);
+			CHECK(usec_ht_get(table, key) == added[i]);
+		}
+		free(lookups.items);
+	}
+
+	usec_free(root);
+	free(doc);
+}
+
+int main(void) {
+	test_freeze(false);
+	test_freeze(true);
+	test_add_after_freeze();
+	return check_result();
+}
@@ -0,0 +1,123 @@
+#include "check.h"
+
+// Tables below and past the linear scan, keys of known length and keys whose hashes collide
+
+static USEC_Value* number(uint64_t n) {
+	char text[32];
+	snprintf(text, sizeof(text), "!%llu", (unsigned long long)n);
+	return usec_parse(text, NULL);
+}
+
+static bool holds(Usec_Hashtable* ht, const char* key, uint64_t n) {
+	USEC_Value* value = usec_ht_get(ht, key);
+	return value && value->type == VALUE_UINT && value->uint64Value == n;
+}
+
+// Grows from a linear scan to an index, replacing values and checking every key at every size
+static void test_growth(void) {
+	Usec_Hashtable* ht = usec_ht_create(0);
+	char key[32];
+	for (int i = 0; i < 300; ++i) {
+		snprintf(key, sizeof(key), "key%d", i);
+		usec_ht_set(ht, key, number((uint64_t)i));
+		CHECK(ht->size == (size_t)i + 1);
+		if (i % 10 == 0 || i <= 10) {
+			for (int j = 0; j <= i; ++j) {
+				snprintf(key, sizeof(key), "key%d", j);
+				CHECK(holds(ht, key, (uint64_t)j));
+			}
+			CHECK(usec_ht_get(ht, "key") == NULL);
+			CHECK(usec_ht_get(ht, "key1000") == NULL);
+		}
+	}
+	CHECK(ht->index != NULL);
+
+	// Replacing keeps the order and the size
+	usec_ht_set(ht, "key7", number(7000));
+	CHECK(ht->size == 300);
+	CHECK(holds(ht, "key7", 7000));
+	CHECK(strcmp(ht->entries[7].key, "key7") == 0);
+
+	Usec_Hashtable* copy = usec_ht_from(ht);
+	usec_ht_freeze(ht);
+	for (int i = 0; i < 300; ++i) {
+		snprintf(key, sizeof(key), "key%d", i);
+		CHECK(holds(ht, key, i == 7 ? 7000 : (uint64_t)i));
+		CHECK(holds(copy, key, i == 7 ? 7000 : (uint64_t)i));
+	}
+
+	// Cleared tables start over with a linear scan
+	usec_ht_clear(ht);
+	CHECK(ht->size == 0 && ht->index == NULL);
+	CHECK(usec_ht_get(ht, "key1") == NULL);
+	usec_ht_set(ht, "again", number(1));
+	CHECK(holds(ht, "again", 1));
+
+	usec_ht_free(copy);
+	usec_ht_free(ht);
+}
+
+// Prefixes of each other, looked up by length from one buffer that isn't terminated after them
+static void test_lengths(void) {
+	const char* text = "abcdefghijklmnopqrstuvwxyz";
+	for (size_t count = 4; count <= 26; count += 22) {
+		Usec_Hashtable* ht = usec_ht_create(0);
+		for (size_t length = 1; length <= count; ++length) {
+			usec_ht_set_hashed(ht, text, length, usec_ht_hash(text, length), number(length));
+		}
+		for (size_t length = 1; length <= count; ++length) {
+			USEC_Value* value = usec_ht_get_hashed(ht, text, length, usec_ht_hash(text, length));
+			CHECK(value && value->uint64Value == length);
+			char key[32];
+			memcpy(key, text, length);
+			key[length] = '\0';
+			CHECK(holds(ht, key, length));
+		}
+		CHECK(usec_ht_get_hashed(ht, text, count + 1 > 26 ? 0 : count + 1, usec_ht_hash(text, count + 1 > 26 ? 0 : count + 1)) == NULL);
+		usec_ht_free(ht);
+	}
+}
+
+// Keys with the same hash, of different lengths: short keys must not be read past their end
+static void test_collisions(void) {
+	const char* keys[] = { "a", "ab", "abcdefghijklmnopqrstuvwxyz0123456789", "b", "", "abc" };
+	const size_t count = sizeof(keys) / sizeof(keys[0]);
+	const uint64_t hash = 42;
+	for (size_t fill = 0; fill <= 20; fill += 20) {
+		Usec_Hashtable* ht = usec_ht_create(0);
+		char key[32];
+		// Enough other keys to put the colliding ones behind an index
+		for (size_t i = 0; i < fill; ++i) {
+			snprintf(key, sizeof(key), "fill%zu", i);
+			usec_ht_set(ht, key, number(1000 + i));
+		}
+		for (size_t i = 0; i < count; ++i) usec_ht_set_hashed(ht, keys[i], strlen(keys[i]), hash, number(i));
+		CHECK((ht->index != NULL) == (fill > 0));
+
+		for (size_t i = 0; i < count; ++i) {
+			USEC_Value* value = usec_ht_get_hashed(ht, keys[i], strlen(keys[i]), hash);
+			CHECK(value && value->uint64Value == i);
+		}
+		CHECK(usec_ht_get_hashed(ht, "abcd", 4, hash) == NULL);
+		CHECK(usec_ht_get_hashed(ht, "abcdefghijklmnopqrstuvwxyz0123456789!", 37, hash) == NULL);
+
+		usec_ht_freeze(ht);
+		for (size_t i = 0; i < count; ++i) {
+			USEC_Value* value = usec_ht_get_hashed(ht, keys[i], strlen(keys[i]), hash);
+			CHECK(value && value->uint64Value == i);
+		}
+		CHECK(usec_ht_get_hashed(ht, "abcd", 4, hash) == NULL);
+		for (size_t i = 0; i < fill; ++i) {
+			snprintf(key, sizeof(key), "fill%zu", i);
+			CHECK(holds(ht, key, 1000 + i));
+		}
+		usec_ht_free(ht);
+	}
+}
+
+int main(void) {
+	test_growth();
+	test_lengths();
+	test_collisions();
+	return check_result();
+}
@@ -0,0 +1,113 @@
+#include "check.h"
+
+// usec_parse_many gives every file the result of a sequential usec_parse_file_result, for any number of threads
+
+#define FILE_COUNT 48
+
+static char paths[FILE_COUNT][64];
+static const char* path_list[FILE_COUNT];
+
+// Clean files of several sizes, files with parser or tokenizer errors, an empty one and one never written
+static void write_files(void) {
+	for (int i = 0; i < FILE_COUNT; ++i) {
+		snprintf(paths[i], sizeof(paths[i]), "many_test_%d.usec", i);
+		path_list[i] = paths[i];
+		if (i == FILE_COUNT - 1) {
+			remove(paths[i]);
+			continue;
+		}
+		FILE* file = fopen(paths[i], "wb");
+		CHECK(file != NULL);
+		if (!file) continue;
+		switch (i % 6) {
+		case 0:
+			fprintf(file, ":local = \"%d\"\nid = %d\nname = \"file $(local)\"\n", i, i);
+			for (int j = 0; j < i * 20; ++j) fprintf(file, "k%d = [%d, %d.5, \"s%d\", {x = local}]\n", j, j, j, j);
+			break;
+		case 1: fprintf(file, "a = shared\nb = \"$(shared)-%d\"\n:shared = \"mine\"\nc = shared\n", i); break;
+		case 2:
+			for (int j = 0; j < 3 + i; ++j) fprintf(file, "bad%d = missing%d\n", j, j);
+			break;
+		case 3: fprintf(file, "a = [1, 2\nb = %d\n", i); break;
+		case 4: break;
+		case 5: fprintf(file, "![%d, {nested = {deeper = [true, null, 'c']}}]\n", i); break;
+		}
+		fclose(file);
+	}
+}
+
+static void remove_files(void) {
+	for (int i = 0; i < FILE_COUNT; ++i) remove(paths[i]);
+}
+
+// Compares each result with its own sequential parse, the shared variables copied for each file
+static void check_many(const USEC_ParseOptions* options, const USEC_Value* preset, size_t threads) {
+	USEC_ParseOptions shared = *options;
+	shared.variables = preset ? usec_ht_from(preset->objectValue) : NULL;
+	USEC_ParseResult* results = usec_parse_many(path_list, FILE_COUNT, &shared, threads);
+	CHECK(results != NULL);
+	if (!results) return;
+
+	// The shared table is only read
+	if (preset) {
+		USEC_Value after = { .type = VALUE_OBJECT, .objectValue = shared.variables };
+		CHECK_SAME_TREE(preset, &after);
+		usec_ht_free(shared.variables);
+	}
+
+	for (int i = 0; i < FILE_COUNT; ++i) {
+		USEC_ParseOptions sequential = *options;
+		sequential.variables = preset ? usec_ht_from(preset->objectValue) : NULL;
+		USEC_ParseResult expected = usec_parse_file_result(path_list[i], &sequential);
+		if (!check_same_result(&expected, &results[i])) fprintf(stderr, "file %d with %zu threads differs\n", i, threads);
+		CHECK(check_same_result(&expected, &results[i]));
+		usec_free_result(&expected);
+		if (sequential.variables) usec_ht_free(sequential.variables);
+	}
+	CHECK(results[FILE_COUNT - 1].error_count == 1 && results[FILE_COUNT - 1].errors[0].code == USEC_ERROR_IO);
+	usec_free_results(results, FILE_COUNT);
+}
+
+static void test_threads(void) {
+	size_t threads[] = { 0, 1, 2, 3, 4, 8, FILE_COUNT, FILE_COUNT * 2 };
+	USEC_ParseOptions options = usec_get_default_parse_options();
+	USEC_Value* preset = usec_parse("shared = \"preset\"\nother = 1\n", &options);
+	for (int round = 0; round < 3; ++round) {
+		for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); ++t) {
+			options = usec_get_default_parse_options();
+			check_many(&options, NULL, threads[t]);
+			check_many(&options, preset, threads[t]);
+
+			// Lenient parses with few errors allowed, some of them truncated
+			options.pedantic = false;
+			options.maxErrors = 4;
+			check_many(&options, preset, threads[t]);
+			options.maxErrors = 0;
+			options.useArena = true;
+			options.packArrays = true;
+			check_many(&options, preset, threads[t]);
+		}
+	}
+	usec_free(preset);
+}
+
+// No files, and fewer files than threads
+static void test_edges(void) {
+	USEC_ParseResult* results = usec_parse_many(path_list, 0, NULL, 4);
+	CHECK(results != NULL);
+	usec_free_results(results, 0);
+
+	results = usec_parse_many(path_list, 1, NULL, 8);
+	USEC_ParseResult expected = usec_parse_file_result(path_list[0], NULL);
+	CHECK(check_same_result(&expected, &results[0]));
+	usec_free_result(&expected);
+	usec_free_results(results, 1);
+}
+
+int main(void) {
+	write_files();
+	test_threads();
+	test_edges();
+	remove_files();
+	return check_result();
+}
@@ -0,0 +1,171 @@
+#include "check.h"
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+
+// Parses "a = text", returns the value of a or NULL if the number was rejected. Release root with usec_free.
+static const USEC_Value* parse_number(const char* text, USEC_Value** root) {
+	char doc[512];
+	snprintf(doc, sizeof(doc), "a = %s\n", text);
+	USEC_ParseResult result = usec_parse_result(doc, strlen(doc), NULL);
+	*root = result.value;
+	result.value = NULL;
+	bool failed = result.error_count > 0;
+	usec_free_result(&result);
+	return failed || !*root ? NULL : usec_value_get(*root, "a");
+}
+
+static void check_double(const char* text, double expected) {
+	USEC_Value* root;
+	const USEC_Value* value = parse_number(text, &root);
+	if (!value || value->type != VALUE_DOUBLE) fprintf(stderr, "%s: not read as a double\n", text);
+	CHECK(value && value->type == VALUE_DOUBLE);
+	if (value && value->type == VALUE_DOUBLE && memcmp(&value->doubleValue, &expected, sizeof(double)) != 0) {
+		fprintf(stderr, "%s: expected %.17g, got %.17g\n", text, expected, value->doubleValue);
+		CHECK(!"same double");
+	}
+	usec_free(root);
+}
+
+static void check_rejected(const char* text) {
+	USEC_Value* root;
+	const USEC_Value* value = parse_number(text, &root);
+	if (value) fprintf(stderr, "%s: should be rejected\n", text);
+	CHECK(value == NULL);
+	usec_free(root);
+}
+
+// Subnormals are numbers like any other, only overflowing and nonzero numbers rounding to zero are rejected
+static void test_range(void) {
+	check_double("4.9e-324", 4.9406564584124654e-324);
+	check_double("-4.9e-324", -4.9406564584124654e-324);
+	check_double("3e-324", 4.9406564584124654e-324);
+	check_double("1.2567434849616886e-308", 1.2567434849616886e-308);
+	check_double("2.2250738585072009e-308", 2.2250738585072009e-308);
+	check_double("2.2250738585072014e-308", DBL_MIN);
+	check_double("1.7976931348623157e308", DBL_MAX);
+	check_double("0.0e-999", 0.0);
+	check_double("0e99999", 0.0);
+
+	check_rejected("2e-324");
+	check_rejected("1e-400");
+	check_rejected("1.8e308");
+	check_rejected("1e99999");
+}
+
+static void check_uint(const char* text, uint64_t expected) {
+	USEC_Value* root;
+	const USEC_Value* value = parse_number(text, &root);
+	CHECK(value && value->type == VALUE_UINT && value->uint64Value == expected);
+	usec_free(root);
+}
+
+static void check_int(const char* text, int64_t expected) {
+	USEC_Value* root;
+	const USEC_Value* value = parse_number(text, &root);
+	CHECK(value && value->type == VALUE_INT && value->int64Value == expected);
+	usec_free(root);
+}
+
+// Same double as strtod, or rejected where strtod overflows or a nonzero number underflows to zero
+static void check_like_strtod(const char* text) {
+	double expected = strtod(text, NULL);
+	bool nonzero = false;
+	for (const char* c = text; *c && *c != 'e'; ++c) nonzero |= *c >= '1' && *c <= '9';
+	if (isinf(expected) || (nonzero && expected == 0.0)) check_rejected(text);
+	else check_double(text, expected);
+}
+
+static void test_integers(void) {
+	check_uint("0", 0);
+	check_int("-0", 0);
+	check_uint("9223372036854775807", INT64_MAX);
+	check_uint("9223372036854775808", (uint64_t)INT64_MAX + 1);
+	check_int("-9223372036854775807", -INT64_MAX);
+	check_int("-9223372036854775808", INT64_MIN);
+	check_like_strtod("-9223372036854775809");
+	// 20 digits fit up to UINT64_MAX
+	check_uint("10000000000000000000", 10000000000000000000ull);
+	check_uint("12345678901234567890", 12345678901234567890ull);
+	check_uint("18446744073709551615", UINT64_MAX);
+	check_like_strtod("18446744073709551616");
+	check_like_strtod("99999999999999999999");
+	check_like_strtod("123456789012345678901234567890");
+}
+
+static void test_doubles(void) {
+	check_double("-0.0", -0.0);
+	check_double("-0e10", -0.0);
+	check_double("0.0", 0.0);
+	check_double("1e308", 1e308);
+	check_rejected("1e309");
+	check_rejected("-1e309");
+	check_like_strtod("1.7976931348623158e308"); // rounds down to DBL_MAX
+	check_like_strtod("1.7976931348623159e308"); // rounds up to infinity
+
+	// Exactly halfway between two doubles round to the even one, any digit after that rounds up
+	check_like_strtod("9007199254740993.0");
+	check_like_strtod("9007199254740995.0");
+	check_like_strtod("9007199254740993.00000000000000000001");
+	check_like_strtod("9007199254740994.99999999999999999999");
+	check_like_strtod("1.00000000000000011102230246251565404236316680908203125");
+	check_like_strtod("1.000000000000000111022302462515654042363166809082031250000000001");
+	check_like_strtod("1.00000000000000011102230246251565404236316680908203124999999999");
+	check_like_strtod("2.470328229206232720882538e-324"); // half of the smallest subnormal
+	check_like_strtod("2.4703282292062327208828439643411068618252990130716238221279284125033775364e-324");
+	check_like_strtod("0.1000000000000000055511151231257827021181583404541015625");
+	check_like_strtod("7.2057594037927933e16");
+	check_like_strtod("2.2250738585072011e-308");
+
+	// Odd integers between 2^53 and 2^54 are halfway between two doubles, with more than 19 digits
+	// behind them the big decimal fallback decides
+	uint64_t state = 0x2545F4914F6CDD1Dull;
+	char text[128];
+	for (int i = 0; i < 2000; ++i) {
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		unsigned long long odd = ((1ull << 53) + (state & ((1ull << 53) - 1))) | 1;
+		snprintf(text, sizeof(text), "%llu.0", odd);
+		check_like_strtod(text);
+		snprintf(text, sizeof(text), "%llu.000000000000000000000000001", odd);
+		check_like_strtod(text);
+		snprintf(text, sizeof(text), "%llu.999999999999999999999999999", odd - 1);
+		check_like_strtod(text);
+	}
+}
+
+// Random digits, decimal points and exponents
+static void test_random(void) {
+	uint64_t state = 0x9E3779B97F4A7C15ull;
+	char text[128];
+	for (int i = 0; i < 30000; ++i) {
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		size_t digits = 1 + state % 40;
+		size_t point = (state >> 8) % (digits + 1);
+		size_t length = 0;
+		uint64_t random = state;
+		for (size_t d = 0; d < digits; ++d) {
+			if (d == point && d > 0) text[length++] = '.';
+			if (d % 16 == 0) random = random * 6364136223846793005ull + 1442695040888963407ull;
+			text[length++] = (char)('0' + (random >> (60 - (d % 16) * 3 % 56)) % 10);
+		}
+		if (text[0] == '0' && point != 1) text[0] = '1'; // no leading zeros
+		if (point == 0 || point == digits) {
+			text[length++] = '.';
+			text[length++] = '5';
+		}
+		snprintf(text + length, sizeof(text) - length, "e%d", (int)((state >> 20) % 700) - 350);
+		check_like_strtod(text);
+	}
+}
+
+int main(void) {
+	test_range();
+	test_integers();
+	test_doubles();
+	test_random();
+	return check_result();
+}
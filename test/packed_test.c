@@ -0,0 +1,117 @@
+#include "check.h"
+
+static USEC_Value* parse(const char* input, bool pack, bool arena) {
+	USEC_ParseOptions options = usec_get_default_parse_options();
+	options.packArrays = pack;
+	options.useArena = arena;
+	USEC_ParseResult result = usec_parse_result(input, strlen(input), &options);
+	CHECK(result.value && result.error_count == 0);
+	USEC_Value* value = result.value;
+	result.value = NULL;
+	usec_free_result(&result);
+	return value;
+}
+
+static const USEC_Value* member(const USEC_Value* root, const char* key) {
+	const USEC_Value* value = usec_value_get(root, key);
+	CHECK(value != NULL);
+	return value;
+}
+
+// Packed or not, the tree reads the same as an unpacked parse
+static void test_same_as_unpacked(const char* input) {
+	USEC_Value* plain = parse(input, false, false);
+	for (int arena = 0; arena < 2; ++arena) {
+		USEC_Value* packed = parse(input, true, arena);
+		CHECK_SAME_TREE(plain, packed);
+		usec_free(packed);
+	}
+
+	USEC_Value* repacked = usec_clone(plain);
+	usec_pack(repacked);
+	CHECK_SAME_TREE(plain, repacked);
+	usec_free(repacked);
+	usec_free(plain);
+}
+
+static void test_nulls(void) {
+	const char* input =
+		"a = [null]\n"
+		"b = [null, null, 1]\n"
+		"c = [1, 2, null, 3]\n"
+		"d = [null, true, false]\n"
+		"e = [1.5, null]\n";
+	test_same_as_unpacked(input);
+
+	USEC_Value* root = parse(input, true, false);
+	const USEC_Value* a = member(root, "a");
+	CHECK(a->type == VALUE_ARRAY && usec_value_count(a) == 1);
+	CHECK(usec_value_type(usec_value_at(a, 0, NULL)) == VALUE_NULL);
+
+	const USEC_Value* b = member(root, "b");
+	CHECK(b->type == VALUE_ARRAY && usec_value_count(b) == 3);
+	CHECK(usec_value_type(b->arrayValue.items[0]) == VALUE_NULL);
+	CHECK(usec_value_type(b->arrayValue.items[1]) == VALUE_NULL);
+	CHECK(usec_value_int(b->arrayValue.items[2]) == 1);
+
+	const USEC_Value* c = member(root, "c");
+	CHECK(c->type == VALUE_ARRAY && usec_value_count(c) == 4);
+	CHECK(usec_value_type(c->arrayValue.items[2]) == VALUE_NULL);
+	CHECK(usec_value_int(c->arrayValue.items[3]) == 3);
+	usec_free(root);
+}
+
+static void test_packed_types(void) {
+	const char* input =
+		"ints = [-1, -2, -3]\n"
+		"uints = [1, 18446744073709551615]\n"
+		"doubles = [1.5, 2.25]\n"
+		"bools = [true, false, true]\n"
+		"empty = []\n";
+	test_same_as_unpacked(input);
+
+	USEC_Value* root = parse(input, true, false);
+	size_t count;
+	const int64_t* ints = usec_packed_ints(member(root, "ints"), &count);
+	CHECK(ints && count == 3 && ints[0] == -1 && ints[1] == -2 && ints[2] == -3);
+	const uint64_t* uints = usec_packed_uints(member(root, "uints"), &count);
+	CHECK(uints && count == 2 && uints[0] == 1 && uints[1] == UINT64_MAX);
+	const double* doubles = usec_packed_doubles(member(root, "doubles"), &count);
+	CHECK(doubles && count == 2 && doubles[1] == 2.25);
+	const bool* bools = usec_packed_bools(member(root, "bools"), &count);
+	CHECK(bools && count == 3 && bools[0] && !bools[1]);
+	CHECK(member(root, "empty")->type == VALUE_ARRAY);
+
+	USEC_Value scratch;
+	CHECK(usec_value_int(usec_value_at(member(root, "ints"), 1, &scratch)) == -2);
+	CHECK(usec_value_at(member(root, "ints"), 3, &scratch) == NULL);
+	usec_free(root);
+}
+
+static void test_mixed(void) {
+	const char* input =
+		"a = [1, \"x\", 2]\n"
+		"b = [1, 2.5]\n"
+		"c = [true, 1]\n"
+		"d = [1, 2, [3, 4], 5]\n"
+		"e = [{x = 1}, 2, 3]\n"
+		"f = ['c', 1]\n"
+		"g = [1, -2, 3]\n"; // positive numbers are uints
+	test_same_as_unpacked(input);
+
+	USEC_Value* root = parse(input, true, false);
+	CHECK(member(root, "a")->type == VALUE_ARRAY);
+	CHECK(member(root, "b")->type == VALUE_ARRAY);
+	CHECK(member(root, "g")->type == VALUE_ARRAY);
+	const USEC_Value* d = member(root, "d");
+	CHECK(d->type == VALUE_ARRAY && usec_value_count(d) == 4);
+	CHECK(d->arrayValue.items[2]->type == VALUE_PACKED_ARRAY);
+	usec_free(root);
+}
+
+int main(void) {
+	test_nulls();
+	test_packed_types();
+	test_mixed();
+	return check_result();
+}
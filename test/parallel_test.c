@@ -0,0 +1,124 @@
+#include "check.h"
+
+#define THREADS 4
+
+// Appends count top-level statements with declarations, references and nested containers. Large enough
+// inputs are cut into chunks by usec_parse_parallel.
+static void append_statements(char** buffer, size_t* length, size_t* capacity, size_t first, size_t count) {
+	for (size_t i = first; i < first + count; ++i) {
+		char line[512];
+		int n = snprintf(line, sizeof(line),
+			":v%zu = %zu\n"
+			"k%zu = {\n"
+			"  a = v%zu\n"
+			"  b = pre\n"
+			"  s = \"x$(v%zu)]}\"\n"
+			"  arr = [1, -2, 3.5, \"[\", {q = '}'}]\n"
+			"}\n",
+			i, i, i, i, i);
+		if (*length + (size_t)n + 1 > *capacity) {
+			*capacity = *capacity ? *capacity * 2 : 4096;
+			*buffer = realloc(*buffer, *capacity);
+		}
+		memcpy(*buffer + *length, line, (size_t)n + 1);
+		*length += (size_t)n;
+	}
+}
+
+static char* make_document(size_t count, const char* middle, size_t* length) {
+	char* buffer = NULL;
+	size_t capacity = 0;
+	*length = 0;
+	append_statements(&buffer, length, &capacity, 0, count / 2);
+	size_t n = strlen(middle);
+	if (*length + n + 1 > capacity) buffer = realloc(buffer, capacity = *length + n + 1);
+	memcpy(buffer + *length, middle, n + 1);
+	*length += n;
+	append_statements(&buffer, length, &capacity, count / 2, count - count / 2);
+	return buffer;
+}
+
+static Usec_Hashtable* make_variables(void) {
+	Usec_Hashtable* variables = usec_ht_create(4);
+	USEC_Value* pre = calloc(1, sizeof(USEC_Value));
+	pre->type = VALUE_INT;
+	pre->int64Value = -7;
+	usec_ht_set(variables, "pre", pre);
+	return variables;
+}
+
+// The parallel parse gives the value and errors of usec_parse_result, and leaves the caller's variables as they were.
+// Returns the number of errors.
+static size_t check_like_whole(const char* input, size_t length, bool pedantic, bool arena) {
+	USEC_ParseOptions options = usec_get_default_parse_options();
+	options.pedantic = pedantic;
+	options.useArena = arena;
+	options.variables = make_variables();
+
+	USEC_ParseOptions whole_options = options;
+	whole_options.variables = usec_ht_from(options.variables);
+	USEC_ParseResult whole = usec_parse_result(input, length, &whole_options);
+	USEC_ParseResult parallel = usec_parse_parallel(input, length, &options, THREADS);
+	CHECK(check_same_result(&whole, &parallel));
+
+	CHECK(options.variables->size == 1);
+	CHECK(usec_value_int(usec_ht_get(options.variables, "pre")) == -7);
+
+	size_t errors = whole.error_count;
+	usec_free_result(&whole);
+	usec_free_result(&parallel);
+	usec_ht_free(whole_options.variables);
+	usec_ht_free(options.variables);
+	return errors;
+}
+
+static void test_documents(void) {
+	const char* middles[] = {
+		"", // clean, parsed in chunks
+		"bad = undefined\n", // errors, parsed again in one piece
+		"broken = { a = ] }\n", // a stray closer inside braces
+		"x = [1, 2\n",
+	};
+	for (size_t i = 0; i < sizeof(middles) / sizeof(middles[0]); ++i) {
+		size_t length;
+		char* input = make_document(6000, middles[i], &length);
+		CHECK(length > 512 * 1024); // at least two chunks
+		for (int mode = 0; mode < 4; ++mode) {
+			size_t errors = check_like_whole(input, length, mode & 1, mode & 2);
+			CHECK((errors == 0) == (i == 0));
+		}
+		free(input);
+	}
+}
+
+static void test_small_documents(void) {
+	const char* inputs[] = {
+		":x = 1\na = x\nb = pre\n",
+		":pre = 2\na = pre\n",
+		"! [1, 2, 3]",
+		"a = undefined\n",
+	};
+	for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); ++i) {
+		for (int mode = 0; mode < 4; ++mode) check_like_whole(inputs[i], strlen(inputs[i]), mode & 1, mode & 2);
+	}
+}
+
+static void test_root_value(void) {
+	// A root value can't be cut, the whole document is parsed on the calling thread
+	size_t length;
+	char* body = make_document(6000, "", &length);
+	char* input = malloc(length + 8);
+	memcpy(input, "!{\n", 3);
+	memcpy(input + 3, body, length);
+	memcpy(input + 3 + length, "}\n", 3);
+	CHECK(check_like_whole(input, length + 5, true, false) == 0);
+	free(input);
+	free(body);
+}
+
+int main(void) {
+	test_documents();
+	test_small_documents();
+	test_root_value();
+	return check_result();
+}
@@ -0,0 +1,107 @@
+#include "check.h"
+
+static const char* input =
+	"server = {\n"
+	"    host = \"localhost\"\n"
+	"    ports = [80, 443, 8080]\n"
+	"    \"dotted.key\" = {\"q\\\"uote\" = 1, \"back\\\\slash\" = 2}\n"
+	"    routes = [{path = \"/\", methods = [\"GET\"]}, {path = \"/api\", methods = [\"GET\", \"POST\"]}]\n"
+	"}\n"
+	"list = [[1, 2], [3, [4, 5]]]\n"
+	"name = \"top\"\n";
+
+// Resolves a path by hand with the accessors: the path and the steps it stands for
+static const USEC_Value* walk(const USEC_Value* root, const char* const keys[], const size_t indices[], size_t count, USEC_Value* scratch) {
+	const USEC_Value* value = root;
+	for (size_t i = 0; i < count && value; ++i) {
+		value = keys[i] ? usec_value_get(value, keys[i]) : usec_value_at(value, indices[i], scratch);
+	}
+	return value;
+}
+
+static void check_same_value(const USEC_Value* expected, const USEC_Value* got) {
+	CHECK((expected == NULL) == (got == NULL));
+	if (expected && got) CHECK_SAME_TREE(expected, got);
+}
+
+typedef struct {
+	const char* path;
+	const char* keys[5];
+	size_t indices[5];
+	size_t count;
+} PathCase;
+
+static const PathCase cases[] = {
+	{ "", { 0 }, { 0 }, 0 },
+	{ "name", { "name" }, { 0 }, 1 },
+	{ "server.host", { "server", "host" }, { 0 }, 2 },
+	{ "server.ports[1]", { "server", "ports", NULL }, { 0, 0, 1 }, 3 },
+	{ "server.ports[3]", { "server", "ports", NULL }, { 0, 0, 3 }, 3 },
+	{ "server[\"dotted.key\"][\"q\\\"uote\"]", { "server", "dotted.key", "q\"uote" }, { 0 }, 3 },
+	{ "server[\"dotted.key\"][\"back\\\\slash\"]", { "server", "dotted.key", "back\\slash" }, { 0 }, 3 },
+	{ "server.routes[1].methods[1]", { "server", "routes", NULL, "methods", NULL }, { 0, 0, 1, 0, 1 }, 5 },
+	{ "list[1][1][0]", { "list", NULL, NULL, NULL }, { 0, 1, 1, 0 }, 4 },
+	{ "server.missing", { "server", "missing" }, { 0 }, 2 },
+	{ "name.deeper", { "name", "deeper" }, { 0 }, 2 },
+	{ "name[0]", { "name", NULL }, { 0, 0 }, 2 },
+};
+#define CASE_COUNT (sizeof(cases) / sizeof(cases[0]))
+
+static void test_paths(const USEC_Value* root) {
+	for (size_t i = 0; i < CASE_COUNT; ++i) {
+		USEC_Path* path = usec_path_compile(cases[i].path);
+		CHECK(path != NULL);
+		if (!path) continue;
+		USEC_Value scratch, expected_scratch;
+		const USEC_Value* got = usec_path_get(root, path, &scratch);
+		const USEC_Value* expected = walk(root, cases[i].keys, cases[i].indices, cases[i].count, &expected_scratch);
+		check_same_value(expected, got);
+		usec_path_free(path);
+	}
+}
+
+static void test_path_set(const USEC_Value* root) {
+	const char* paths[CASE_COUNT + 1];
+	for (size_t i = 0; i < CASE_COUNT; ++i) paths[i] = cases[i].path;
+	paths[CASE_COUNT] = cases[3].path; // the same path twice
+
+	USEC_PathSet* set = usec_path_set_compile(paths, CASE_COUNT + 1);
+	CHECK(set != NULL);
+	if (!set) return;
+	const USEC_Value* out[CASE_COUNT + 1];
+	USEC_Value scratch[CASE_COUNT + 1];
+	usec_path_set_get(root, set, out, scratch);
+	for (size_t i = 0; i <= CASE_COUNT; ++i) {
+		USEC_Value expected_scratch;
+		const PathCase* c = &cases[i < CASE_COUNT ? i : 3];
+		check_same_value(walk(root, c->keys, c->indices, c->count, &expected_scratch), out[i]);
+	}
+	usec_path_set_free(set);
+}
+
+static void test_malformed(void) {
+	const char* malformed[] = { ".a", "a.", "a..b", "a[", "a[x]", "a.[0]", "a[\"b]", "a[1", "[-1]", "a[0]b" };
+	for (size_t i = 0; i < sizeof(malformed) / sizeof(malformed[0]); ++i) {
+		CHECK(usec_path_compile(malformed[i]) == NULL);
+		const char* paths[2] = { "a", malformed[i] };
+		CHECK(usec_path_set_compile(paths, 2) == NULL);
+	}
+	CHECK(usec_path_compile(NULL) == NULL);
+}
+
+int main(void) {
+	for (int mode = 0; mode < 4; ++mode) {
+		USEC_ParseOptions options = usec_get_default_parse_options();
+		options.packArrays = mode & 1;
+		options.useArena = mode & 2;
+		USEC_Value* root = usec_parse(input, &options);
+		CHECK(root != NULL);
+		test_paths(root);
+		test_path_set(root);
+		usec_freeze(root);
+		test_paths(root);
+		usec_free(root);
+	}
+	test_malformed();
+	return check_result();
+}
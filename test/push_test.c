@@ -0,0 +1,134 @@
+#include "check.h"
+
+static const char* documents[] = {
+	":version = \"2.1\"\n"
+	"num = 1\n"
+	"char = 'c'\n"
+	"array = [1, 2, \"3\", {\n"
+	"    object = {\n"
+	"        id = 12\n"
+	"        version = version\n"
+	"        # comment ] }\n"
+	"        path = \"/root/$(version) with \\\" inline \\\\ \\n escapes\" # $() interpolation\n"
+	"    }, object2 = {id = 24, version = version}\n"
+	"}]\n"
+	"\"weird +#_89() variable name\" = 5\n"
+	"\n"
+	"%%\n"
+	"multiline ] comment {\n"
+	"%%\n"
+	"object = {\n"
+	"    :version = \"$(version).3\"\n"
+	"    version = version\n"
+	"}\n"
+	"description = `\n"
+	"multiline } string\n"
+	"with $(version) interpolation\n"
+	"`\n",
+
+	"%a=1,b=\"x\\ty\",c=[1,2,{d=true}],:v=\"q\",e=\"$(v)!\"",
+	":x = 5\r\na = `\r\nline1\r\nline2 $(x)\r\n`\r\nb = x\r\nd = 1, e = 2\r\n",
+	"![\"a\", 1, -2, 3.5, 1e10, null, false, '\\n']",
+	"!{\n  a = 1\n  b = [2, 3]\n}\n",
+	"only = {\n  a = 1\n  b = {\n    c = [1, 2]\n  }\n}\n",
+	"a = 1\nb = undefined\nc = 3\n",
+	"a = [1, 2\nb = 2\n",
+	"a = { x = ] }\nb = 2\n",
+	"a = \"unterminated\nb = 1\n",
+	"",
+};
+
+// Feeds the document in pieces of the given sizes, cycling through them
+static USEC_ParseResult push_parse(USEC_Context* ctx, const char* input, size_t length, const USEC_ParseOptions* options,
+	const size_t* sizes, size_t size_count) {
+	usec_feed_begin(ctx, options);
+	size_t at = 0;
+	for (size_t i = 0; at < length; ++i) {
+		size_t size = sizes[i % size_count];
+		if (size > length - at) size = length - at;
+		// Pieces are copied, the parser may not keep pointers into them
+		char* piece = malloc(size ? size : 1);
+		memcpy(piece, input + at, size);
+		usec_feed(ctx, piece, size);
+		free(piece);
+		at += size;
+	}
+	return usec_finish(ctx);
+}
+
+static void check_document(USEC_Context* ctx, const char* input, bool pedantic, bool arena) {
+	USEC_ParseOptions options = usec_get_default_parse_options();
+	options.pedantic = pedantic;
+	options.useArena = arena;
+	size_t length = strlen(input);
+	USEC_ParseResult whole = usec_parse_result(input, length, &options);
+
+	static const size_t single[] = { 1 };
+	static const size_t odd[] = { 2, 3, 5, 7 };
+	static const size_t large[] = { 64, 1, 4096 };
+	const size_t* patterns[] = { single, odd, large };
+	const size_t pattern_sizes[] = { 1, 4, 3 };
+	for (size_t p = 0; p < 3; ++p) {
+		USEC_ParseResult pushed = push_parse(ctx, input, length, &options, patterns[p], pattern_sizes[p]);
+		// Recovery after an error depends on where the input was cut, only pedantic parses have to match exactly
+		if (pedantic || whole.error_count == 0) CHECK(check_same_result(&whole, &pushed));
+		else CHECK(pushed.error_count > 0 && pushed.errors[0].line == whole.errors[0].line);
+		usec_free_result(&pushed);
+	}
+
+	// Every place to cut the document in two
+	for (size_t cut = 0; cut <= length; ++cut) {
+		size_t sizes[2] = { cut, length - cut };
+		usec_feed_begin(ctx, &options);
+		usec_feed(ctx, input, sizes[0]);
+		usec_feed(ctx, input + cut, sizes[1]);
+		USEC_ParseResult pushed = usec_finish(ctx);
+		if (pedantic || whole.error_count == 0) CHECK(check_same_result(&whole, &pushed));
+		usec_free_result(&pushed);
+	}
+	usec_free_result(&whole);
+}
+
+static void test_documents(void) {
+	USEC_Context* ctx = usec_context_create();
+	for (size_t i = 0; i < sizeof(documents) / sizeof(documents[0]); ++i) {
+		for (int mode = 0; mode < 4; ++mode) check_document(ctx, documents[i], mode & 1, mode & 2);
+	}
+	usec_context_destroy(ctx);
+}
+
+static void test_random_pieces(void) {
+	// Many statements fed in pseudo-random pieces, so statements are completed across many feeds
+	size_t capacity = 1 << 16;
+	char* input = malloc(capacity);
+	size_t length = 0;
+	for (int i = 0; length + 256 < capacity; ++i) {
+		length += (size_t)snprintf(input + length, capacity - length,
+			":v%d = %d\nk%d = {a = v%d, s = \"$(v%d)}\", l = [1, 2, {x = 'y'}]} # ]\n", i, i, i, i, i);
+	}
+
+	USEC_ParseOptions options = usec_get_default_parse_options();
+	USEC_ParseResult whole = usec_parse_result(input, length, &options);
+	CHECK(whole.value && whole.error_count == 0);
+
+	USEC_Context* ctx = usec_context_create();
+	unsigned seed = 12345;
+	size_t sizes[64];
+	for (size_t i = 0; i < 64; ++i) {
+		seed = seed * 1103515245u + 12345u;
+		sizes[i] = (seed >> 16) % 300;
+	}
+	USEC_ParseResult pushed = push_parse(ctx, input, length, &options, sizes, 64);
+	CHECK(check_same_result(&whole, &pushed));
+	usec_free_result(&pushed);
+	usec_context_destroy(ctx);
+
+	usec_free_result(&whole);
+	free(input);
+}
+
+int main(void) {
+	test_documents();
+	test_random_pieces();
+	return check_result();
+}
@@ -0,0 +1,183 @@
+#include "check.h"
+
+// Variables declared in nested objects: deep nesting, shadowing and redeclaring across scopes
+
+#define DEPTH 40
+
+static void append(char** doc, size_t* length, size_t* capacity, const char* format, int indent, int a, int b) {
+	char line[256];
+	int written = snprintf(line, sizeof(line), "%*s", indent * 2, "");
+	written += snprintf(line + written, sizeof(line) - (size_t)written, format, a, b);
+	if (*length + (size_t)written + 1 > *capacity) {
+		*capacity = (*capacity + (size_t)written + 1) * 2;
+		*doc = realloc(*doc, *capacity);
+	}
+	memcpy(*doc + *length, line, (size_t)written + 1);
+	*length += (size_t)written;
+}
+
+// Every level declares v, shadowing the one above, and a name of its own. Every third level also redeclares
+// the global g. After its inner object closes, a level must see its own v again.
+static char* make_nested(void) {
+	char* doc = NULL;
+	size_t length = 0, capacity = 0;
+	append(&doc, &length, &capacity, ":g = %d\n:v = %d\n", 0, 0, -1);
+	for (int depth = 0; depth < DEPTH; ++depth) {
+		append(&doc, &length, &capacity, "o = {\n", depth, 0, 0);
+		append(&doc, &length, &capacity, ":v = %d\n", depth + 1, depth, 0);
+		append(&doc, &length, &capacity, ":x%d = %d\n", depth + 1, depth, depth);
+		if (depth % 3 == 0) append(&doc, &length, &capacity, ":g = %d\n", depth + 1, depth + 100, 0);
+		append(&doc, &length, &capacity, "v = v\n", depth + 1, 0, 0);
+		append(&doc, &length, &capacity, "g = g\n", depth + 1, 0, 0);
+		append(&doc, &length, &capacity, "first = x0\n", depth + 1, 0, 0);
+		append(&doc, &length, &capacity, "text = \"$(v)/$(x%d)\"\n", depth + 1, depth, 0);
+	}
+	for (int depth = DEPTH - 1; depth >= 0; --depth) {
+		append(&doc, &length, &capacity, "after = v\n", depth + 1, 0, 0);
+		append(&doc, &length, &capacity, "}\n", depth, 0, 0);
+	}
+	append(&doc, &length, &capacity, "v = v\ng = g\n", 0, 0, 0);
+	return doc;
+}
+
+// References read the variable's value as a string
+static bool has_text(const USEC_Value* object, const char* key, long long expected) {
+	char text[32];
+	snprintf(text, sizeof(text), "%lld", expected);
+	const char* got = usec_value_string(usec_value_get(object, key), NULL);
+	return got && strcmp(got, text) == 0;
+}
+
+static void test_nested(bool streaming) {
+	char* doc = make_nested();
+	USEC_ParseOptions options = usec_get_default_parse_options();
+	options.streaming = streaming;
+	USEC_ParseResult result = usec_parse_result(doc, strlen(doc), &options);
+	CHECK(result.error_count == 0);
+	CHECK(result.value != NULL);
+	if (!result.value) {
+		usec_free_result(&result);
+		free(doc);
+		return;
+	}
+
+	const USEC_Value* level = result.value;
+	int64_t g = 0;
+	char text[64];
+	for (int depth = 0; depth < DEPTH; ++depth) {
+		level = usec_value_get(level, "o");
+		CHECK(level != NULL);
+		if (!level) break;
+		if (depth % 3 == 0) g = depth + 100;
+		CHECK(has_text(level, "v", depth));
+		CHECK(has_text(level, "after", depth));
+		CHECK(has_text(level, "g", g));
+		CHECK(has_text(level, "first", 0));
+		snprintf(text, sizeof(text), "%d/%d", depth, depth);
+		const char* got = usec_value_string(usec_value_get(level, "text"), NULL);
+		CHECK(got && strcmp(got, text) == 0);
+		// Declarations stay out of the tree
+		CHECK(usec_value_get(level, "x0") == NULL);
+	}
+	CHECK(has_text(result.value, "v", -1));
+	CHECK(has_text(result.value, "g", 0));
+
+	usec_free_result(&result);
+	free(doc);
+}
+
+static USEC_ParseResult parse(const char* input) {
+	USEC_ParseOptions options = usec_get_default_parse_options();
+	options.pedantic = false;
+	return usec_parse_result(input, strlen(input), &options);
+}
+
+// Redeclaring in the same scope replaces the value from there on, a sibling scope doesn't see it
+static void test_redeclare(void) {
+	USEC_ParseResult result = parse(
+		":v = 1\n"
+		"a = {:v = 2, before = v, :v = 3, after = v}\n"
+		"b = {before = v, :v = 4, inner = {v = v, :v = 5, w = v}, after = v}\n"
+		":v = 6\n"
+		"c = {v = v}\n"
+		"v = v\n");
+	CHECK(result.error_count == 0);
+	USEC_Value* expected = usec_parse(
+		"a = {before = \"2\", after = \"3\"}\n"
+		"b = {before = \"1\", inner = {v = \"4\", w = \"5\"}, after = \"4\"}\n"
+		"c = {v = \"6\"}\n"
+		"v = \"6\"\n", NULL);
+	CHECK_SAME_TREE(expected, result.value);
+	usec_free(expected);
+	usec_free_result(&result);
+}
+
+// A scope declaring enough names to grow the name map, then a sibling reusing its table: the sibling must
+// still see the outer declaration, not whatever took the slot of the inner one
+static void test_many_names(void) {
+	char input[2048];
+	size_t length = (size_t)sprintf(input, ":v = \"global\"\no = {\n  :v = \"outer\"\n  a = {\n    :v = \"inner\"\n");
+	for (int i = 0; i < 40; ++i) length += (size_t)sprintf(input + length, "    :n%d = %d\n", i, i);
+	sprintf(input + length,
+		"    x = v\n"
+		"  }\n"
+		"  b = {\n"
+		"    :w = \"sibling\"\n"
+		"    y = v\n"
+		"    z = w\n"
+		"  }\n"
+		"  after = v\n"
+		"}\n"
+		"v = v\n");
+	USEC_ParseResult result = parse(input);
+	CHECK(result.error_count == 0);
+	USEC_Value* expected = usec_parse(
+		"o = {a = {x = \"inner\"}, b = {y = \"outer\", z = \"sibling\"}, after = \"outer\"}\nv = \"global\"\n", NULL);
+	CHECK_SAME_TREE(expected, result.value);
+	usec_free(expected);
+	usec_free_result(&result);
+}
+
+// Names declared in a scope are gone once it closes
+static void test_out_of_scope(void) {
+	USEC_ParseResult result = parse(
+		"a = {:inner = 1, b = {:deeper = 2, x = deeper}, y = inner}\n"
+		"c = deeper\n"
+		"d = inner\n");
+	// Each undefined reference is followed by an unexpected token error for the same spot
+	size_t undefined = 0;
+	for (size_t i = 0; i < result.error_count; ++i) {
+		if (result.errors[i].code != USEC_ERROR_UNDEFINED_VARIABLE) continue;
+		CHECK(result.errors[i].line == 2 + undefined);
+		++undefined;
+	}
+	CHECK(undefined == 2);
+	usec_free_result(&result);
+}
+
+// Scopes inside arrays of objects, over the caller's variables
+static void test_caller_variables(void) {
+	USEC_Value* preset = usec_parse("base = \"b\"\nv = 0\n", NULL);
+	Usec_Hashtable* variables = usec_ht_from(preset->objectValue);
+	USEC_ParseOptions options = usec_get_default_parse_options();
+	options.variables = variables;
+	const char* input = "list = [{:v = 1, v = v, base = base}, {v = v}, {:base = \"c\", base = base, v = v}]\nv = v\n";
+	USEC_ParseResult result = usec_parse_result(input, strlen(input), &options);
+	CHECK(result.error_count == 0);
+	USEC_Value* expected = usec_parse("list = [{v = \"1\", base = \"b\"}, {v = \"0\"}, {base = \"c\", v = \"0\"}]\nv = \"0\"\n", NULL);
+	CHECK_SAME_TREE(expected, result.value);
+	usec_free(expected);
+	usec_free_result(&result);
+	usec_ht_free(variables);
+	usec_free(preset);
+}
+
+int main(void) {
+	test_nested(false);
+	test_nested(true);
+	test_redeclare();
+	test_many_names();
+	test_out_of_scope();
+	test_caller_variables();
+	return check_result();
+}
@@ -0,0 +1,114 @@
+#include "check.h"
+
+// Records of an array with the same keys share the index of the first one, small records share their keys
+
+static const char* wide_keys[] = { "id", "version", "path", "a", "b", "c", "d", "e", "f", "g", "h", "i" };
+#define WIDE_COUNT (sizeof(wide_keys) / sizeof(wide_keys[0]))
+
+// count records of the first keys of wide_keys, every fifth in reverse order if shuffle is set
+static char* make_records(size_t keys, size_t count, bool shuffle) {
+	char* doc = malloc(count * keys * 32 + 32);
+	size_t length = (size_t)sprintf(doc, "records = [");
+	for (size_t r = 0; r < count; ++r) {
+		length += (size_t)sprintf(doc + length, "%s{", r ? ", " : "");
+		for (size_t k = 0; k < keys; ++k) {
+			size_t key = shuffle && r % 5 == 4 ? keys - 1 - k : k;
+			length += (size_t)sprintf(doc + length, "%s%s = %zu", k ? ", " : "", wide_keys[key], r * 100 + key);
+		}
+		length += (size_t)sprintf(doc + length, "}");
+	}
+	sprintf(doc + length, "]\n");
+	return doc;
+}
+
+static const USEC_Value* record(const USEC_Value* root, size_t i) {
+	USEC_Value scratch;
+	return usec_value_at(usec_value_get(root, "records"), i, &scratch);
+}
+
+static void check_record(const USEC_Value* rec, size_t r, size_t keys) {
+	CHECK(rec->objectValue->size == keys);
+	for (size_t k = 0; k < keys; ++k) {
+		const USEC_Value* value = usec_value_get(rec, wide_keys[k]);
+		CHECK(value && value->type == VALUE_UINT && value->uint64Value == r * 100 + k);
+	}
+	CHECK(usec_value_get(rec, "missing") == NULL);
+}
+
+static void test_records(size_t keys, bool shuffle, bool arena) {
+	const size_t count = 50;
+	char* doc = make_records(keys, count, shuffle);
+	USEC_ParseOptions options = usec_get_default_parse_options();
+	options.useArena = arena;
+	USEC_Value* root = usec_parse(doc, &options);
+	CHECK(root != NULL);
+	if (!root) {
+		free(doc);
+		return;
+	}
+
+	const Usec_Hashtable* first = record(root, 0)->objectValue;
+	const Usec_Hashtable* previous = NULL;
+	for (size_t r = 0; r < count; ++r) {
+		const USEC_Value* rec = record(root, r);
+		const Usec_Hashtable* table = rec->objectValue;
+		check_record(rec, r, keys);
+
+		// Sized after the record before it, and sharing its index if the keys are in the same order
+		bool reversed = shuffle && r % 5 == 4;
+		if (previous) {
+			bool same_order = reversed == (shuffle && (r - 1) % 5 == 4);
+			CHECK(table->entries_capacity == keys);
+			if (keys > 8) CHECK(table->index != NULL && (table->index == previous->index) == same_order);
+		}
+		if (keys <= 8) CHECK(table->index == NULL);
+		previous = table;
+		// Keys are interned once per parse
+		for (size_t k = 0; k < keys; ++k) {
+			size_t at = reversed ? keys - 1 - k : k;
+			CHECK(table->entries[at].key == first->entries[k].key);
+		}
+	}
+
+	usec_free(root);
+	free(doc);
+}
+
+// A record that gains a key builds its own index, the records it shared with are left as they were
+static void test_add_to_shared(void) {
+	char* doc = make_records(WIDE_COUNT, 3, false);
+	USEC_Value* root = usec_parse(doc, NULL);
+	CHECK(root != NULL);
+	if (!root) {
+		free(doc);
+		return;
+	}
+
+	USEC_Value* middle = (USEC_Value*)record(root, 1);
+	const uint32_t* shared = middle->objectValue->index;
+	usec_ht_set(middle->objectValue, "added", usec_clone(usec_value_get(middle, "id")));
+	CHECK(middle->objectValue->index != shared);
+	CHECK(record(root, 0)->objectValue->index == shared);
+	CHECK(record(root, 2)->objectValue->index == shared);
+
+	const USEC_Value* added = usec_value_get(middle, "added");
+	CHECK(added && added->type == VALUE_UINT && added->uint64Value == 100);
+	for (size_t r = 0; r < 3; ++r) {
+		if (r != 1) check_record(record(root, r), r, WIDE_COUNT);
+	}
+
+	usec_free(root);
+	free(doc);
+}
+
+int main(void) {
+	for (int arena = 0; arena < 2; ++arena) {
+		test_records(3, false, arena);
+		test_records(3, true, arena);
+		test_records(8, false, arena);
+		test_records(WIDE_COUNT, false, arena);
+		test_records(WIDE_COUNT, true, arena);
+	}
+	test_add_to_shared();
+	return check_result();
+}
@@ -0,0 +1,174 @@
+#include "check.h"
+#include <stdarg.h>
+
+// Streaming parses of documents much longer than the tokenizer's window of 64 tokens give the same
+// trees and errors as parses of the whole token list, wherever a token lands relative to a refill
+
+typedef struct {
+	char* text;
+	size_t length;
+	size_t capacity;
+} Doc;
+
+static void add(Doc* doc, const char* format, ...) {
+	va_list args;
+	va_start(args, format);
+	int written = vsnprintf(NULL, 0, format, args);
+	va_end(args);
+	if (doc->length + (size_t)written + 1 > doc->capacity) {
+		doc->capacity = (doc->length + (size_t)written + 1) * 2;
+		doc->text = realloc(doc->text, doc->capacity);
+	}
+	va_start(args, format);
+	vsnprintf(doc->text + doc->length, (size_t)written + 1, format, args);
+	va_end(args);
+	doc->length += (size_t)written;
+}
+
+// Returns the number of errors
+static size_t check_stream_with(const char* input, USEC_ParseOptions options) {
+	options.pedantic = false;
+	options.streaming = false;
+	USEC_ParseResult whole = usec_parse_result(input, strlen(input), &options);
+	options.streaming = true;
+	USEC_ParseResult streamed = usec_parse_result(input, strlen(input), &options);
+	if (!check_same_result(&whole, &streamed)) {
+		fprintf(stderr, "input (%zu bytes):\n%.300s...\n", strlen(input), input);
+		fprintf(stderr, "errors: %zu whole, %zu streamed\n", whole.error_count, streamed.error_count);
+	}
+	CHECK(check_same_result(&whole, &streamed));
+	size_t error_count = whole.error_count;
+	usec_free_result(&whole);
+	usec_free_result(&streamed);
+	return error_count;
+}
+
+// Checks with the default options and with every error collected, returns the errors of the default ones
+static size_t check_stream(const char* input) {
+	USEC_ParseOptions options = usec_get_default_parse_options();
+	size_t error_count = check_stream_with(input, options);
+	options.maxErrors = 0;
+	options.keepVariables = true;
+	check_stream_with(input, options);
+	return error_count;
+}
+
+// A string whose escapes are decoded into the tokenizer's scratch text, long enough to span many refills
+static void add_long_string(Doc* doc, int seed, int length) {
+	add(doc, "\"");
+	for (int i = 0; i < length; ++i) {
+		if (i % 16 == 0) add(doc, "\\t%d\\\"", seed);
+		else add(doc, "%c", 'a' + (seed + i) % 26);
+	}
+	add(doc, "\"");
+}
+
+// Thousands of statements of every kind, with references to variables declared far behind
+static char* make_long(int statements) {
+	Doc doc = {0};
+	for (int i = 0; i < statements; ++i) {
+		switch (i % 9) {
+		case 0: add(&doc, ":v%d = \"value %d\"\n", i, i); break;
+		case 1: add(&doc, "n%d = %d\nd%d = -%d.25\n", i, i, i, i); break;
+		case 2: add(&doc, "s%d = ", i); add_long_string(&doc, i, i % 200); add(&doc, "\n"); break;
+		case 3: add(&doc, "o%d = {x = [1, 2, {y = \"z\", c = 'c'}], w = true, e = null} # comment %d\n", i, i); break;
+		case 4: add(&doc, "r%d = v%d\n", i, i - 4 - (i > 500 ? 495 : 0)); break;
+		case 5: add(&doc, "i%d = \"$(v%d)-$(v%d) \\n\"\n", i, i - 5, i > 100 ? i - 95 : 0); break;
+		case 6: add(&doc, "m%d = `\nline %d\nwith $(v%d)\n`\n", i, i, i - 6); break;
+		case 7: add(&doc, "%%%%\nmultiline comment %d\n%%%%\nscope%d = {:v%d = \"inner\", in = v%d}\n", i, i, i - 7, i - 7); break;
+		case 8: add(&doc, "\"quoted key %d\" = [[], {}, [[%d]]]\n", i, i); break;
+		}
+	}
+	return doc.text;
+}
+
+static void test_long_documents(void) {
+	int sizes[] = {1, 9, 10, 64, 65, 300, 3000};
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+		char* input = make_long(sizes[i]);
+		CHECK(check_stream(input) == 0);
+		free(input);
+	}
+}
+
+// One statement far longer than the window: arrays and objects of n items, with decoded strings all along
+static void test_long_statements(void) {
+	for (int n = 0; n <= 200; n += (n < 140 ? 1 : 20)) {
+		Doc doc = {0};
+		add(&doc, ":v = \"x\"\na = [");
+		for (int i = 0; i < n; ++i) add(&doc, "%s\"item\\t%d\", v", i ? ", " : "", i);
+		add(&doc, "]\nb = {");
+		for (int i = 0; i < n; ++i) add(&doc, "%sk%d = [%d, \"$(v)\\n\"]", i ? ", " : "", i, i);
+		add(&doc, "}\nc = 1\n");
+		CHECK(check_stream(doc.text) == 0);
+		free(doc.text);
+	}
+}
+
+// Shifts long strings, interpolations, multiline strings and comments through every position of a refill
+static void test_boundaries(void) {
+	for (int offset = 0; offset < 150; ++offset) {
+		Doc doc = {0};
+		add(&doc, ":v = \"x\"\npad = [");
+		for (int i = 0; i < offset; ++i) add(&doc, "%s%d", i ? ", " : "", i);
+		add(&doc, "]\n");
+		for (int repeat = 0; repeat < 3; ++repeat) {
+			add(&doc, "s%d = ", repeat);
+			add_long_string(&doc, offset, 500);
+			add(&doc, "\ni%d = \"before $(v) middle $(v) after\"\nm%d = `\nline\n$(v)\n`\n", repeat, repeat);
+			add(&doc, "# comment\n%%%%\nmultiline\n%%%%\nn%d = [", repeat);
+			for (int i = 0; i < offset; ++i) add(&doc, "%s\"%d\\n\"", i ? ", " : "", i);
+			add(&doc, "]\n");
+		}
+		CHECK(check_stream(doc.text) == 0);
+		free(doc.text);
+	}
+}
+
+// Errors late in long documents, from the parser and from the tokenizer, and more of them than maxErrors
+static void test_errors(void) {
+	int sizes[] = {10, 300, 3000};
+	const char* endings[] = {
+		"late = undefined\nafter = 1\n",
+		"late = [1, {a = missing}, 3]\nafter = {b = also_missing}\n",
+		"late = \"unclosed\n",
+		"late = [1, 2\n",
+		"late = {a = 1}}\n",
+		"late = \"$(undefined)\"\n",
+		"late = 'ab'\n",
+		"late = 00\n",
+		"late = 1e999\n",
+	};
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+		for (size_t j = 0; j < sizeof(endings) / sizeof(endings[0]); ++j) {
+			char* body = make_long(sizes[i]);
+			Doc doc = {0};
+			add(&doc, "%s%s", body, endings[j]);
+			CHECK(check_stream(doc.text) > 0);
+			free(doc.text);
+			free(body);
+		}
+	}
+
+	// An error every statement, past maxErrors, and one at every position of a refill
+	Doc doc = {0};
+	for (int i = 0; i < 100; ++i) add(&doc, "ok%d = [%d, %d]\nbad%d = missing%d\n", i, i, i, i, i);
+	CHECK(check_stream(doc.text) == 20);
+	free(doc.text);
+	for (int offset = 0; offset < 140; offset += 3) {
+		Doc doc = {0};
+		add(&doc, "a = [");
+		for (int i = 0; i < offset; ++i) add(&doc, "%d, ", i);
+		add(&doc, "missing, 1]\nb = 2\n");
+		CHECK(check_stream(doc.text) > 0);
+		free(doc.text);
+	}
+}
+
+int main(void) {
+	test_long_documents();
+	test_long_statements();
+	test_boundaries();
+	test_errors();
+	return check_result();
+}
@@ -0,0 +1,174 @@
+#include "check.h"
+
+// The usec_value_* accessors, and replacing the strings and items of a parsed tree
+
+static const char* input =
+	"yes = true\n"
+	"letter = 'c'\n"
+	"negative = -5\n"
+	"big = 18446744073709551615\n"
+	"half = 0.5\n"
+	"text = \"hello world, longer than a few bytes\"\n"
+	"empty = \"\"\n"
+	"nothing = null\n"
+	"items = [1, \"two\", [3], {four = 4}]\n"
+	"numbers = [10, 20, 30]\n"
+	"object = {a = 1, b = \"b\"}\n";
+
+static void test_scalars(const USEC_Value* root) {
+	CHECK(usec_value_type(root) == VALUE_OBJECT);
+	CHECK(usec_value_bool(usec_value_get(root, "yes")));
+	CHECK(usec_value_char(usec_value_get(root, "letter")) == 'c');
+
+	const USEC_Value* negative = usec_value_get(root, "negative");
+	CHECK(usec_value_type(negative) == VALUE_INT);
+	CHECK(usec_value_int(negative) == -5);
+	CHECK(usec_value_double(negative) == -5.0);
+
+	const USEC_Value* big = usec_value_get(root, "big");
+	CHECK(usec_value_type(big) == VALUE_UINT);
+	CHECK(usec_value_uint(big) == UINT64_MAX);
+	CHECK(usec_value_double(big) == 18446744073709551615.0);
+
+	CHECK(usec_value_double(usec_value_get(root, "half")) == 0.5);
+	CHECK(usec_value_int(usec_value_get(root, "half")) == 0);
+
+	size_t length;
+	const char* text = usec_value_string(usec_value_get(root, "text"), &length);
+	CHECK(text && strcmp(text, "hello world, longer than a few bytes") == 0 && length == strlen(text));
+	text = usec_value_string(usec_value_get(root, "empty"), &length);
+	CHECK(text && text[0] == '\0' && length == 0);
+	CHECK(usec_value_string(usec_value_get(root, "half"), &length) == NULL && length == 0);
+	CHECK(usec_value_string(usec_value_get(root, "half"), NULL) == NULL);
+
+	// Other types and missing values read as zero
+	CHECK(usec_value_type(usec_value_get(root, "nothing")) == VALUE_NULL);
+	CHECK(usec_value_type(NULL) == VALUE_NULL);
+	CHECK(!usec_value_bool(usec_value_get(root, "text")));
+	CHECK(usec_value_char(NULL) == 0);
+	CHECK(usec_value_int(usec_value_get(root, "text")) == 0);
+	CHECK(usec_value_uint(NULL) == 0);
+	CHECK(usec_value_double(usec_value_get(root, "yes")) == 0.0);
+}
+
+static void test_containers(const USEC_Value* root) {
+	USEC_Value scratch;
+	const USEC_Value* items = usec_value_get(root, "items");
+	CHECK(usec_value_type(items) == VALUE_ARRAY);
+	CHECK(usec_value_count(items) == 4);
+	CHECK(usec_value_uint(usec_value_at(items, 0, &scratch)) == 1);
+	CHECK(strcmp(usec_value_string(usec_value_at(items, 1, &scratch), NULL), "two") == 0);
+	CHECK(usec_value_count(usec_value_at(items, 2, &scratch)) == 1);
+	CHECK(usec_value_uint(usec_value_get(usec_value_at(items, 3, &scratch), "four")) == 4);
+	CHECK(usec_value_at(items, 4, &scratch) == NULL);
+	CHECK(usec_value_at(root, 0, &scratch) == NULL);
+
+	// Packed or not, arrays read the same
+	const USEC_Value* numbers = usec_value_get(root, "numbers");
+	CHECK(usec_value_type(numbers) == VALUE_ARRAY);
+	CHECK(usec_value_count(numbers) == 3);
+	for (size_t i = 0; i < 3; ++i) CHECK(usec_value_uint(usec_value_at(numbers, i, &scratch)) == (i + 1) * 10);
+	CHECK(usec_value_at(numbers, 3, &scratch) == NULL);
+
+	const USEC_Value* object = usec_value_get(root, "object");
+	CHECK(usec_value_count(object) == 2);
+	const USEC_Value* value;
+	CHECK(strcmp(usec_value_entry(object, 0, &value), "a") == 0 && usec_value_uint(value) == 1);
+	CHECK(strcmp(usec_value_entry(object, 1, NULL), "b") == 0);
+	CHECK(usec_value_entry(object, 2, &value) == NULL && value == NULL);
+	CHECK(usec_value_entry(items, 0, &value) == NULL && value == NULL);
+	CHECK(usec_value_get(object, "missing") == NULL);
+	CHECK(usec_value_get(object, NULL) == NULL);
+	CHECK(usec_value_get(items, "a") == NULL);
+	CHECK(usec_value_count(usec_value_get(root, "text")) == 0);
+	CHECK(usec_value_count(NULL) == 0);
+}
+
+// Formatting nodes around a value are looked through
+static void test_formatting(void) {
+	USEC_Value* object = usec_parse("!{a = [1, 2], b = \"b\"}", NULL);
+	USEC_Value* comment = usec_create_comment("comment");
+	USEC_Value* wrapped = usec_create_format(object, &comment, 1, NULL, 0);
+
+	USEC_Value scratch;
+	CHECK(usec_value_type(wrapped) == VALUE_OBJECT);
+	CHECK(usec_value_count(wrapped) == 2);
+	CHECK(usec_value_uint(usec_value_at(usec_value_get(wrapped, "a"), 1, &scratch)) == 2);
+	CHECK(strcmp(usec_value_entry(wrapped, 1, NULL), "b") == 0);
+
+	USEC_Value* number = usec_parse("!7", NULL);
+	USEC_Value* wrapped_number = usec_create_format(number, NULL, 0, NULL, 0);
+	CHECK(usec_value_uint(wrapped_number) == 7);
+	CHECK(usec_value_double(wrapped_number) == 7.0);
+
+	usec_free(wrapped_number);
+	usec_free(wrapped);
+}
+
+static char* copy_string(const char* text) {
+	char* copy = malloc(strlen(text) + 1);
+	strcpy(copy, text);
+	return copy;
+}
+
+// Parsed strings and items may share their value's allocation, replacing them still leaves usec_free
+// with the new ones to free
+static void test_replace(void) {
+	USEC_Value* root = usec_parse(input, NULL);
+	CHECK(root != NULL);
+	if (!root) return;
+
+	// A member's string, and a string item of an array
+	USEC_Value* text = (USEC_Value*)usec_value_get(root, "text");
+	text->stringValue = copy_string("first replacement");
+	// A string the caller assigned is theirs to free and assign again
+	free(text->stringValue);
+	text->stringValue = copy_string("replaced member");
+	USEC_Value* items = (USEC_Value*)usec_value_get(root, "items");
+	USEC_Value* two = items->arrayValue.items[1];
+	two->stringValue = copy_string("replaced item");
+	CHECK(strcmp(usec_value_string(usec_value_get(root, "text"), NULL), "replaced member") == 0);
+
+	// Items freed with usec_free and replaced by values of their own
+	usec_free(items->arrayValue.items[0]);
+	items->arrayValue.items[0] = usec_parse("!\"first\"", NULL);
+	usec_free(items->arrayValue.items[3]);
+	items->arrayValue.items[3] = usec_parse("![5, 6]", NULL);
+
+	USEC_Value* expected = usec_parse(
+		"yes = true\nletter = 'c'\nnegative = -5\nbig = 18446744073709551615\nhalf = 0.5\n"
+		"text = \"replaced member\"\nempty = \"\"\nnothing = null\n"
+		"items = [\"first\", \"replaced item\", [3], [5, 6]]\nnumbers = [10, 20, 30]\nobject = {a = 1, b = \"b\"}\n", NULL);
+	CHECK_SAME_TREE(expected, root);
+
+	// Clones of the changed tree own their strings and items like any other tree
+	USEC_Value* clone = usec_clone(root);
+	CHECK_SAME_TREE(expected, clone);
+	usec_free(root);
+	CHECK_SAME_TREE(expected, clone);
+
+	// Cloned strings are replaced the same way
+	USEC_Value* clone_text = (USEC_Value*)usec_value_get(clone, "text");
+	clone_text->stringValue = copy_string("again");
+	CHECK(strcmp(usec_value_string(clone_text, NULL), "again") == 0);
+
+	usec_free(clone);
+	usec_free(expected);
+}
+
+int main(void) {
+	for (int mode = 0; mode < 4; ++mode) {
+		USEC_ParseOptions options = usec_get_default_parse_options();
+		options.packArrays = mode & 1;
+		options.useArena = mode & 2;
+		USEC_Value* root = usec_parse(input, &options);
+		CHECK(root != NULL);
+		if (!root) continue;
+		test_scalars(root);
+		test_containers(root);
+		usec_free(root);
+	}
+	test_formatting();
+	test_replace();
+	return check_result();
+}